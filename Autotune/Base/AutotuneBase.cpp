@@ -0,0 +1,484 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include "AutotuneBase.hpp"
+
+#include "../../2-3-Swap/Base/Swap_2_3_Base.hpp"
+#include "../../BinarySwap/234Schedule/BinarySwap234Schedule.hpp"
+#include "../../BinarySwap/Fold/BinarySwapFold.hpp"
+#include "../../BinarySwap/Telescoping/BinarySwapTelescoping.hpp"
+#include "../../DirectSend/Overlap/DirectSendOverlap.hpp"
+#include "../../RadixK/Base/RadixKBase.hpp"
+
+#include <Common/ImageFull.hpp>
+#include <Common/ImageRGBAFloatColorOnly.hpp>
+#include <Common/ImageRGBAUByteColorFloatDepth.hpp>
+#include <Common/ImageRGBAUByteColorOnly.hpp>
+#include <Common/ImageRGBFloatColorDepth.hpp>
+#include <Common/ImageSparse.hpp>
+#include <Common/MainLoop.hpp>
+#include <Common/Timer.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+constexpr auto DEFAULT_CACHE_FILENAME = "autotune-cache.txt";
+constexpr int DEFAULT_CALIBRATION_TRIALS = 3;
+
+// Used to create the communicator on which the calibration results are shared.
+constexpr int AUTOTUNE_GROUP_TAG = 36250;
+
+static std::string kToString(const std::vector<int>& kVector) {
+  std::stringstream buffer;
+  for (auto&& k : kVector) {
+    buffer << k << ",";
+  }
+  std::string s = buffer.str();
+  return s.substr(0, s.length() - 1);
+}
+
+// Images packed from the dirty tiles of an incremental composite change height
+// every frame. Rounding the height in the cache key keeps them from being
+// calibrated again for every frame.
+static int roundUpToPowerOfTwo(int value) {
+  int rounded = 1;
+  while (rounded < value) {
+    rounded *= 2;
+  }
+  return rounded;
+}
+
+// Returns an empty ImageFull of the same type as the given image (or, for
+// compressed images, of the type the image uncompresses to).
+static std::unique_ptr<ImageFull> createFullPrototype(const Image* image) {
+  std::unique_ptr<Image> emptyImage = image->createNew(0, 0);
+  const ImageSparse* sparseImage =
+      dynamic_cast<const ImageSparse*>(emptyImage.get());
+  if (sparseImage != nullptr) {
+    return sparseImage->uncompress();
+  }
+  return std::unique_ptr<ImageFull>(
+      dynamic_cast<ImageFull*>(emptyImage.release()));
+}
+
+static std::string getFormatName(const Image* image,
+                                 const ImageFull* prototype) {
+  std::string formatName;
+  if (dynamic_cast<const ImageRGBAUByteColorFloatDepth*>(prototype) !=
+      nullptr) {
+    formatName = "color-byte-depth-float";
+  } else if (dynamic_cast<const ImageRGBFloatColorDepth*>(prototype) !=
+             nullptr) {
+    formatName = "color-float-depth-float";
+  } else if (dynamic_cast<const ImageRGBAUByteColorOnly*>(prototype) !=
+             nullptr) {
+    formatName = "color-byte-depth-none";
+  } else if (dynamic_cast<const ImageRGBAFloatColorOnly*>(prototype) !=
+             nullptr) {
+    formatName = "color-float-depth-none";
+  } else {
+    formatName = "unknown";
+  }
+
+  if (dynamic_cast<const ImageSparse*>(image) != nullptr) {
+    formatName += "-compressed";
+  }
+
+  return formatName;
+}
+
+AutotuneBase::AutotuneBase()
+    : chosenCandidate(-1),
+      cacheFilename(DEFAULT_CACHE_FILENAME),
+      recalibrate(false),
+      calibrationTrials(DEFAULT_CALIBRATION_TRIALS) {}
+
+void AutotuneBase::buildCandidates(MPI_Comm groupCommunicator) {
+  this->candidates.clear();
+
+  int numProc;
+  MPI_Comm_size(groupCommunicator, &numProc);
+
+  // The candidates record their options, which we do not want in the output.
+  std::stringstream dummyStream;
+  YamlWriter dummyYaml(dummyStream);
+
+  auto addCandidate = [this](const std::string& name, Compositor* compositor) {
+    std::unique_ptr<Compositor> compositorHolder(compositor);
+    for (auto&& candidate : this->candidates) {
+      if (candidate.name == name) {
+        // Parameters resolved to an existing candidate. Skip it.
+        return;
+      }
+    }
+    compositorHolder->setAutoCompressThreshold(
+        this->getAutoCompressThreshold());
+    this->candidates.push_back({name, std::move(compositorHolder)});
+  };
+
+  addCandidate("binary-swap-fold", new BinarySwapFold);
+  BinarySwapFold* splitFold = new BinarySwapFold;
+  splitFold->setSplitFold(true);
+  addCandidate("binary-swap-split-fold", splitFold);
+  addCandidate("binary-swap-telescoping", new BinarySwapTelescoping);
+  addCandidate("binary-swap-234-schedule", new BinarySwap234Schedule);
+  addCandidate("2-3-swap", new Swap_2_3_Base);
+
+  for (int maxSplit : {numProc, 16, 8, 4, 2}) {
+    maxSplit = std::min(maxSplit, numProc);
+    DirectSendOverlap* directSend = new DirectSendOverlap;
+    directSend->setOptions(
+        this->directSendOptions, groupCommunicator, dummyYaml);
+    directSend->setMaxSplit(maxSplit);
+    std::stringstream name;
+    name << "direct-send(max-image-split=" << maxSplit << ")";
+    addCandidate(name.str(), directSend);
+  }
+
+  for (int targetK : {2, 3, 4, 8, 16}) {
+    RadixKBase* radixK = new RadixKBase;
+    radixK->setOptions(this->radixKOptions, groupCommunicator, dummyYaml);
+    radixK->generateK(targetK, numProc);
+    addCandidate("radix-k(k=" + kToString(radixK->getKVector()) + ")", radixK);
+  }
+
+  RadixKBase* modelRadixK = new RadixKBase;
+  modelRadixK->setOptions(this->radixKOptions, groupCommunicator, dummyYaml);
+  modelRadixK->useKModel(groupCommunicator);
+  addCandidate("radix-k(k-model)", modelRadixK);
+}
+
+int AutotuneBase::findCachedCandidate(const std::string& key) const {
+  std::ifstream cacheFile(this->cacheFilename);
+  int foundCandidate = -1;
+  std::string line;
+  // Later lines override earlier ones, so read the whole file.
+  while (std::getline(cacheFile, line)) {
+    std::size_t split = line.find_last_of(' ');
+    if ((split == std::string::npos) || (line.substr(0, split) != key)) {
+      continue;
+    }
+    std::string name = line.substr(split + 1);
+    for (int candidate = 0;
+         candidate < static_cast<int>(this->candidates.size());
+         ++candidate) {
+      if (this->candidates[candidate].name == name) {
+        foundCandidate = candidate;
+      }
+    }
+  }
+  return foundCandidate;
+}
+
+void AutotuneBase::writeCachedCandidate(const std::string& key,
+                                        int candidate) const {
+  std::ofstream cacheFile(this->cacheFilename, std::ios_base::app);
+  cacheFile << key << " " << this->candidates[candidate].name << std::endl;
+  if (cacheFile.fail()) {
+    std::cerr << "Could not write autotune cache file " << this->cacheFilename
+              << std::endl;
+  }
+}
+
+int AutotuneBase::calibrate(const Image* localImage,
+                            MPI_Group group,
+                            MPI_Comm communicator,
+                            MPI_Comm groupCommunicator,
+                            YamlWriter& yaml) {
+  int groupRank;
+  MPI_Comm_rank(groupCommunicator, &groupRank);
+
+  // Build a synthetic image of the same type and size as the local image with
+  // the foreground covering the valid viewport.
+  std::unique_ptr<ImageFull> prototype = createFullPrototype(localImage);
+  std::unique_ptr<Image> newImage =
+      prototype->createNew(localImage->getWidth(),
+                           localImage->getHeight(),
+                           localImage->getRegionBegin(),
+                           localImage->getRegionEnd(),
+                           localImage->getValidViewport());
+  std::unique_ptr<ImageFull> syntheticFullImage(
+      dynamic_cast<ImageFull*>(newImage.release()));
+  syntheticFullImage->clear();
+
+  const Viewport& validViewport = localImage->getValidViewport();
+  int width = syntheticFullImage->getWidth();
+  bool orderDependent = syntheticFullImage->blendIsOrderDependent();
+  Color foregroundColor = orderDependent ? Color(0.25f, 0.25f, 0.25f, 0.5f)
+                                         : Color(1.0f, 1.0f, 1.0f, 1.0f);
+  for (int pixelIndex = syntheticFullImage->getRegionBegin();
+       pixelIndex < syntheticFullImage->getRegionEnd();
+       ++pixelIndex) {
+    int x = pixelIndex % width;
+    int y = pixelIndex / width;
+    if ((x >= validViewport.getMinX()) && (x <= validViewport.getMaxX()) &&
+        (y >= validViewport.getMinY()) && (y <= validViewport.getMaxY())) {
+      int localIndex = pixelIndex - syntheticFullImage->getRegionBegin();
+      syntheticFullImage->setColor(localIndex, foregroundColor);
+      // Vary the depth so that depth comparisons go both ways.
+      float depth = static_cast<float>((pixelIndex + 7 * groupRank) % 97) / 97;
+      syntheticFullImage->setDepth(localIndex, depth);
+    }
+  }
+
+  std::unique_ptr<Image> syntheticImage;
+  if (dynamic_cast<const ImageSparse*>(localImage) != nullptr) {
+    syntheticImage = syntheticFullImage->compress()->shallowCopy();
+  } else {
+    syntheticImage = syntheticFullImage->shallowCopy();
+  }
+
+  // The candidates write their own information to a yaml writer, which we
+  // do not want recorded for the calibration runs.
+  std::stringstream dummyStream;
+  YamlWriter dummyYaml(dummyStream);
+
+  int bestCandidate = 0;
+  double bestSeconds = std::numeric_limits<double>::max();
+
+  yaml.StartBlock("autotune-calibration");
+  for (int candidate = 0;
+       candidate < static_cast<int>(this->candidates.size());
+       ++candidate) {
+    double candidateSeconds = std::numeric_limits<double>::max();
+    for (int trial = 0; trial < this->calibrationTrials; ++trial) {
+      MPI_Barrier(groupCommunicator);
+      std::chrono::high_resolution_clock::time_point startTime =
+          std::chrono::high_resolution_clock::now();
+
+      this->candidates[candidate].compositor->compose(
+          syntheticImage.get(), group, communicator, dummyYaml);
+
+      std::chrono::duration<double> secondsElapsed =
+          std::chrono::high_resolution_clock::now() - startTime;
+      double seconds = secondsElapsed.count();
+      // The composite is not done until every process is done.
+      MPI_Allreduce(
+          MPI_IN_PLACE, &seconds, 1, MPI_DOUBLE, MPI_MAX, groupCommunicator);
+      candidateSeconds = std::min(candidateSeconds, seconds);
+    }
+
+    yaml.StartListItem();
+    yaml.AddDictionaryEntry("candidate", this->candidates[candidate].name);
+    yaml.AddDictionaryEntry("seconds", candidateSeconds);
+
+    if (candidateSeconds < bestSeconds) {
+      bestCandidate = candidate;
+      bestSeconds = candidateSeconds;
+    }
+  }
+  yaml.EndBlock();
+
+  return bestCandidate;
+}
+
+std::unique_ptr<Image> AutotuneBase::compose(Image* localImage,
+                                             MPI_Group group,
+                                             MPI_Comm communicator,
+                                             YamlWriter& yaml) {
+  int numProc;
+  MPI_Group_size(group, &numProc);
+
+  std::unique_ptr<ImageFull> prototype = createFullPrototype(localImage);
+  std::stringstream keyStream;
+  keyStream << numProc << " " << localImage->getWidth() << " "
+            << roundUpToPowerOfTwo(localImage->getHeight()) << " "
+            << getFormatName(localImage, prototype.get())
+            << this->candidateOptionsKey;
+  std::string key = keyStream.str();
+
+  if (key != this->chosenKey) {
+    // New configuration. Either find the best compositor in the cache or
+    // figure it out by trying them all.
+    MPI_Comm groupCommunicator;
+    MPI_Comm_create_group(
+        communicator, group, AUTOTUNE_GROUP_TAG, &groupCommunicator);
+    int groupRank;
+    MPI_Comm_rank(groupCommunicator, &groupRank);
+
+    this->buildCandidates(groupCommunicator);
+
+    int candidate = -1;
+    if (!this->recalibrate) {
+      if (groupRank == 0) {
+        candidate = this->findCachedCandidate(key);
+      }
+      MPI_Bcast(&candidate, 1, MPI_INT, 0, groupCommunicator);
+    }
+
+    if (candidate >= 0) {
+      yaml.AddDictionaryEntry("autotune-source", "cache");
+    } else {
+      yaml.AddDictionaryEntry("autotune-source", "calibration");
+      Timer timeCalibration(yaml, "autotune-calibration-seconds");
+      candidate = this->calibrate(
+          localImage, group, communicator, groupCommunicator, yaml);
+      if (groupRank == 0) {
+        this->writeCachedCandidate(key, candidate);
+      }
+    }
+
+    MPI_Comm_free(&groupCommunicator);
+
+    this->chosenKey = key;
+    this->chosenCandidate = candidate;
+  }
+
+  yaml.AddDictionaryEntry("autotune-choice",
+                          this->candidates[this->chosenCandidate].name);
+
+  return this->candidates[this->chosenCandidate].compositor->compose(
+      localImage, group, communicator, yaml);
+}
+
+enum optionIndex { CACHE_FILE, RECALIBRATE, CALIBRATION_TRIALS };
+
+// The options of the candidate compositors are numbered from these offsets so
+// that they do not collide with each other or the options above.
+constexpr int DIRECT_SEND_OPTIONS_OFFSET = 10;
+constexpr int RADIX_K_OPTIONS_OFFSET = 20;
+
+// Options for the parameters that the autotuner varies between candidates.
+// These are not accepted because they would be overridden anyway.
+static bool isVariedByAutotune(const option::Descriptor& descriptor) {
+  for (const char* name :
+       {"max-image-split", "k", "target-k", "k-model", "split-fold"}) {
+    if (std::string(name) == descriptor.longopt) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static const option::Descriptor* findOption(
+    const std::vector<option::Descriptor>& usage, const char* longopt) {
+  for (auto&& descriptor : usage) {
+    if (std::string(longopt) == descriptor.longopt) {
+      return &descriptor;
+    }
+  }
+  return nullptr;
+}
+
+// Options shared by several candidate compositors (such as
+// max-inflight-receives) are added once and passed on to all of them.
+static void appendOptions(std::vector<option::Descriptor>& usage,
+                          const std::vector<option::Descriptor>& newOptions,
+                          int offset) {
+  for (auto&& descriptor : newOptions) {
+    if (isVariedByAutotune(descriptor) ||
+        (findOption(usage, descriptor.longopt) != nullptr)) {
+      continue;
+    }
+    usage.push_back({descriptor.index + offset,
+                     descriptor.type,
+                     descriptor.shortopt,
+                     descriptor.longopt,
+                     descriptor.check_arg,
+                     descriptor.help});
+  }
+}
+
+// Pulls the options of one candidate compositor back out to the indices that
+// compositor expects. Options not accepted by appendOptions are left unset.
+static std::vector<option::Option> extractOptions(
+    const std::vector<option::Option>& options,
+    const std::vector<option::Descriptor>& candidateOptions) {
+  std::vector<option::Descriptor> usage = AutotuneBase::getOptionVector();
+  std::vector<option::Option> extracted;
+  for (auto&& descriptor : candidateOptions) {
+    if (extracted.size() <= descriptor.index) {
+      extracted.resize(descriptor.index + 1);
+    }
+    const option::Descriptor* autotuneDescriptor =
+        findOption(usage, descriptor.longopt);
+    if (!isVariedByAutotune(descriptor) && (autotuneDescriptor != nullptr)) {
+      extracted[descriptor.index] = options[autotuneDescriptor->index];
+    }
+  }
+  return extracted;
+}
+
+std::vector<option::Descriptor> AutotuneBase::getOptionVector() {
+  std::vector<option::Descriptor> usage;
+  // clang-format off
+  usage.push_back(
+    {CACHE_FILE, 0, "", "autotune-cache", NonemptyStringArg,
+     "  --autotune-cache=<file> Set the file in which the compositor chosen\n"
+     "                         for each configuration (number of processes,\n"
+     "                         image size, image format, and compositor\n"
+     "                         options) is recorded.\n"
+     "                         (Default autotune-cache.txt)"});
+  usage.push_back(
+    {RECALIBRATE, 0, "", "autotune-recalibrate", option::Arg::None,
+     "  --autotune-recalibrate Ignore any choices in the cache file and run\n"
+     "                         the calibration again."});
+  usage.push_back(
+    {CALIBRATION_TRIALS, 0, "", "autotune-trials", PositiveIntArg,
+     "  --autotune-trials=<num> Set the number of times each candidate is run\n"
+     "                         during calibration. The fastest time of each\n"
+     "                         candidate is used. (Default 3)\n"});
+  // clang-format on
+
+  appendOptions(usage,
+                DirectSendOverlap::getOptionVector(),
+                DIRECT_SEND_OPTIONS_OFFSET);
+  appendOptions(
+      usage, RadixKBase::getOptionVector(), RADIX_K_OPTIONS_OFFSET);
+
+  return usage;
+}
+
+bool AutotuneBase::setOptions(const std::vector<option::Option>& options,
+                              MPI_Comm,
+                              YamlWriter& yaml) {
+  if (options[CACHE_FILE]) {
+    this->cacheFilename = options[CACHE_FILE].arg;
+  }
+  yaml.AddDictionaryEntry("autotune-cache", this->cacheFilename);
+
+  this->recalibrate = options[RECALIBRATE];
+  yaml.AddDictionaryEntry("autotune-recalibrate",
+                          this->recalibrate ? "yes" : "no");
+
+  if (options[CALIBRATION_TRIALS]) {
+    this->calibrationTrials = atoi(options[CALIBRATION_TRIALS].arg);
+  }
+  yaml.AddDictionaryEntry("autotune-trials", this->calibrationTrials);
+
+  this->directSendOptions =
+      extractOptions(options, DirectSendOverlap::getOptionVector());
+  this->radixKOptions = extractOptions(options, RadixKBase::getOptionVector());
+
+  // The options given to the candidates change how fast they are, so a choice
+  // made with some options does not hold for others.
+  std::stringstream optionsKey;
+  for (auto&& descriptor : getOptionVector()) {
+    const option::Option& option = options[descriptor.index];
+    if ((descriptor.index < DIRECT_SEND_OPTIONS_OFFSET) || !option) {
+      continue;
+    }
+    optionsKey << " --" << descriptor.longopt;
+    if (option.arg != nullptr) {
+      optionsKey << "=" << option.arg;
+    }
+  }
+  this->candidateOptionsKey = optionsKey.str();
+
+  return true;
+}
+
+void AutotuneBase::setAutoCompressThreshold(float threshold) {
+  this->Compositor::setAutoCompressThreshold(threshold);
+  for (auto&& candidate : this->candidates) {
+    candidate.compositor->setAutoCompressThreshold(threshold);
+  }
+}
@@ -0,0 +1,74 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef AUTOTUNEBASE_HPP
+#define AUTOTUNEBASE_HPP
+
+#include <Common/Compositor.hpp>
+
+#include <string>
+
+/// \brief A compositor that picks the fastest of several other compositors.
+///
+/// The first time an image of a particular configuration (number of
+/// processes, width, height rounded up to a power of two, format, and the
+/// options passed on to the candidates) is composited, a set of candidate
+/// compositing algorithms and parameters are each run a few times on a
+/// synthetic image with the same type, size, and valid viewport as the real
+/// image. The fastest is chosen and used for this and all subsequent composites
+/// of that configuration. The choice is saved in a cache file so that later
+/// runs of the same configuration can skip the calibration.
+///
+/// The command line options of the candidate compositors are accepted and
+/// passed on to every candidate of that type, except for the options of
+/// parameters that the autotuner varies itself (such as the k values of
+/// radix-k).
+///
+class AutotuneBase : public Compositor {
+  struct Candidate {
+    std::string name;
+    std::unique_ptr<Compositor> compositor;
+  };
+
+  std::vector<Candidate> candidates;
+  int chosenCandidate;
+  std::string chosenKey;
+
+  std::string cacheFilename;
+  bool recalibrate;
+  int calibrationTrials;
+
+  std::vector<option::Option> directSendOptions;
+  std::vector<option::Option> radixKOptions;
+  std::string candidateOptionsKey;
+
+  void buildCandidates(MPI_Comm groupCommunicator);
+  int findCachedCandidate(const std::string &key) const;
+  void writeCachedCandidate(const std::string &key, int candidate) const;
+  int calibrate(const Image *localImage,
+                MPI_Group group,
+                MPI_Comm communicator,
+                MPI_Comm groupCommunicator,
+                YamlWriter &yaml);
+
+ public:
+  AutotuneBase();
+
+  std::unique_ptr<Image> compose(Image *localImage,
+                                 MPI_Group group,
+                                 MPI_Comm communicator,
+                                 YamlWriter &yaml) final;
+
+  bool setOptions(const std::vector<option::Option> &options,
+                  MPI_Comm communicator,
+                  YamlWriter &yaml) override;
+  void setAutoCompressThreshold(float threshold) override;
+  static std::vector<option::Descriptor> getOptionVector();
+};
+
+#endif  // AUTOTUNEBASE_HPP
@@ -9,6 +9,9 @@
 #include "BinarySwap234Schedule.hpp"
 #include "../Base/BinarySwapBase.hpp"
 
+#include <Common/ImagePackedMessage.hpp>
+#include <Common/ImageView.hpp>
+
 static int getLargestPowerOfTwoNoBiggerThan(int x) {
   int power2 = 1;
   while (power2 <= x) {
@@ -28,22 +31,46 @@ static int getRealRank(MPI_Group group, int rank, MPI_Comm communicator) {
   return realRank;
 }
 
-// Performs a typical binary-swap step
-static std::unique_ptr<Image> swapHalves(Image *localImage,
-                                         MPI_Group group,
-                                         MPI_Comm communicator,
-                                         int subgroupStart) {
+static std::vector<Image *> toPointers(
+    const std::vector<std::unique_ptr<Image>> &images) {
+  std::vector<Image *> pointers;
+  for (auto &&image : images) {
+    pointers.push_back(image.get());
+  }
+  return pointers;
+}
+
+// Returns "empty" images in place of the given ones.
+static std::vector<std::unique_ptr<Image>> emptyImages(
+    const std::vector<Image *> &localImages) {
+  std::vector<std::unique_ptr<Image>> resultImages;
+  for (auto &&localImage : localImages) {
+    resultImages.push_back(localImage->copySubrange(0, 0));
+  }
+  return resultImages;
+}
+
+// Performs a typical binary-swap step. The halves of all the images are
+// exchanged in one message each way.
+static std::vector<std::unique_ptr<Image>> swapHalves(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    int subgroupStart) {
   int rank;
   MPI_Group_rank(group, &rank);
 
-  // Divide the image into halves.
-  std::unique_ptr<const Image> firstHalf =
-      localImage->window(0, localImage->getNumberOfPixels() / 2);
-  std::unique_ptr<const Image> secondHalf = localImage->window(
-      localImage->getNumberOfPixels() / 2, localImage->getNumberOfPixels());
+  // Divide the images into halves.
+  std::vector<ImageView> firstHalves;
+  std::vector<ImageView> secondHalves;
+  for (auto &&localImage : localImages) {
+    int numPixels = localImage->getNumberOfPixels();
+    firstHalves.emplace_back(*localImage, 0, numPixels / 2);
+    secondHalves.emplace_back(*localImage, numPixels / 2, numPixels);
+  }
 
-  std::unique_ptr<const Image> toKeep;
-  std::unique_ptr<const Image> toSend;
+  std::vector<ImageView> *toKeep;
+  std::vector<ImageView> *toSend;
 
   int partnerRank;
 
@@ -52,13 +79,13 @@ static std::unique_ptr<Image> swapHalves(Image *localImage,
   PairRole role;
   if (rank == subgroupStart) {
     role = PairRole::FIRST;
-    toKeep.swap(firstHalf);
-    toSend.swap(secondHalf);
+    toKeep = &firstHalves;
+    toSend = &secondHalves;
     partnerRank = rank + 1;
   } else if (rank == subgroupStart + 1) {
     role = PairRole::SECOND;
-    toKeep.swap(secondHalf);
-    toSend.swap(firstHalf);
+    toKeep = &secondHalves;
+    toSend = &firstHalves;
     partnerRank = rank - 1;
   } else {
     std::cerr << "Binary Swap - 234 Schedule - swapHalves "
@@ -66,84 +93,133 @@ static std::unique_ptr<Image> swapHalves(Image *localImage,
     exit(1);
   }
 
-  // Receive our half of the image and send out our partner's half.
-  std::unique_ptr<Image> recvImage = toKeep->createNew();
-  std::vector<MPI_Request> recvRequests = recvImage->IReceive(
-      getRealRank(group, partnerRank, communicator), communicator);
-  std::vector<MPI_Request> sendRequests = toSend->ISend(
+  // Receive our halves of the images and send out our partner's halves.
+  std::vector<std::unique_ptr<Image>> recvImages;
+  ImagePackedReceiver packedReceive;
+  ImagePackedSender packedSend;
+  for (std::size_t imageIndex = 0; imageIndex < localImages.size();
+       ++imageIndex) {
+    const ImageView &keepView = (*toKeep)[imageIndex];
+    recvImages.push_back(localImages[imageIndex]->createNew(
+        keepView.getRegionBegin(), keepView.getRegionEnd()));
+    packedReceive.add(*recvImages.back());
+    packedSend.add(std::move((*toSend)[imageIndex]));
+  }
+  MPI_Request recvRequest = packedReceive.IReceive(
       getRealRank(group, partnerRank, communicator), communicator);
-
-  // Wait for my image to come in.
-  MPI_Waitall(recvRequests.size(), recvRequests.data(), MPI_STATUSES_IGNORE);
-
-  // Blend the incoming image.
-  std::unique_ptr<Image> blendedImage;
-  switch (role) {
-    case PairRole::FIRST:
-      blendedImage = toKeep->blend(*recvImage);
-      break;
-    case PairRole::SECOND:
-      blendedImage = recvImage->blend(*toKeep);
-      break;
+  std::vector<MPI_Request> sendRequests;
+  packedSend.ISend(getRealRank(group, partnerRank, communicator),
+                   communicator,
+                   sendRequests);
+
+  // Wait for my images to come in.
+  packedReceive.wait(recvRequest);
+
+  // Blend the incoming images.
+  std::vector<std::unique_ptr<Image>> blendedImages;
+  for (std::size_t imageIndex = 0; imageIndex < localImages.size();
+       ++imageIndex) {
+    ImageView recvView(*recvImages[imageIndex]);
+    switch (role) {
+      case PairRole::FIRST:
+        blendedImages.push_back((*toKeep)[imageIndex].blend(recvView));
+        break;
+      case PairRole::SECOND:
+        blendedImages.push_back(recvView.blend((*toKeep)[imageIndex]));
+        break;
+    }
   }
 
   // Wait for my images to finish sending.
   MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
 
   // Return result
-  return blendedImage;
+  return blendedImages;
+}
+
+// Receives the images sent to this process in one message from sourceRank
+// into buffers the size of the given images. Call wait on the returned
+// receiver with the request to finish the receive.
+static std::vector<std::unique_ptr<Image>> receiveImages(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    int sourceRank,
+    ImagePackedReceiver &packedReceiveOut,
+    MPI_Request &requestOut) {
+  std::vector<std::unique_ptr<Image>> recvImages;
+  for (auto &&localImage : localImages) {
+    recvImages.push_back(localImage->createNew());
+    packedReceiveOut.add(*recvImages.back());
+  }
+  requestOut = packedReceiveOut.IReceive(
+      getRealRank(group, sourceRank, communicator), communicator);
+  return recvImages;
 }
 
 // Takes a group of 3 processes, divides their images in half, and composites
 // them such that the first two processes have the first and second pieces,
 // respectively, and the 3 is empty.
-static std::unique_ptr<Image> Eliminate32(Image *localImage,
-                                          MPI_Group group,
-                                          MPI_Comm communicator,
-                                          int subgroupStart) {
+static std::vector<std::unique_ptr<Image>> Eliminate32(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    int subgroupStart) {
   int rank;
   MPI_Group_rank(group, &rank);
 
   if ((rank == subgroupStart) || (rank == subgroupStart + 1)) {
     // This rank will hold one of the two image halves.
-    // First, get the receive ready for the half sent by the third process.
-    std::unique_ptr<Image> recvImage = localImage->createNew();
-    std::vector<MPI_Request> recvRequests = recvImage->IReceive(
-        getRealRank(group, subgroupStart + 2, communicator), communicator);
+    // First, get the receive ready for the halves sent by the third process.
+    ImagePackedReceiver packedReceive;
+    MPI_Request recvRequest;
+    std::vector<std::unique_ptr<Image>> recvImages =
+        receiveImages(localImages,
+                      group,
+                      communicator,
+                      subgroupStart + 2,
+                      packedReceive,
+                      recvRequest);
 
     // Next, do a normal binary swap between the first two processes.
-    std::unique_ptr<Image> blendedImage =
-        swapHalves(localImage, group, communicator, subgroupStart);
+    std::vector<std::unique_ptr<Image>> blendedImages =
+        swapHalves(localImages, group, communicator, subgroupStart);
 
-    // Wait for the incoming image to finish.
-    MPI_Waitall(recvRequests.size(), recvRequests.data(), MPI_STATUSES_IGNORE);
+    // Wait for the incoming images to finish.
+    packedReceive.wait(recvRequest);
 
-    // Finally, blend the third process' image.
-    return blendedImage->blend(*recvImage);
+    // Finally, blend the third process' images.
+    for (std::size_t imageIndex = 0; imageIndex < localImages.size();
+         ++imageIndex) {
+      blendedImages[imageIndex] =
+          blendedImages[imageIndex]->blend(*recvImages[imageIndex]);
+    }
+    return blendedImages;
   } else if (rank == subgroupStart + 2) {
     // This rank gives away its two halves.
 
-    // Divide the image into halves.
-    std::unique_ptr<const Image> firstHalf =
-        localImage->window(0, localImage->getNumberOfPixels() / 2);
-    std::unique_ptr<const Image> secondHalf = localImage->window(
-        localImage->getNumberOfPixels() / 2, localImage->getNumberOfPixels());
+    // Divide the images into halves.
+    ImagePackedSender firstSend;
+    ImagePackedSender secondSend;
+    for (auto &&localImage : localImages) {
+      int numPixels = localImage->getNumberOfPixels();
+      firstSend.add(ImageView(*localImage, 0, numPixels / 2));
+      secondSend.add(ImageView(*localImage, numPixels / 2, numPixels));
+    }
     // Send the images out.
-    std::vector<MPI_Request> firstSendRequests = firstHalf->ISend(
-        getRealRank(group, subgroupStart, communicator), communicator);
-    std::vector<MPI_Request> secondSendRequests = secondHalf->ISend(
-        getRealRank(group, subgroupStart + 1, communicator), communicator);
+    std::vector<MPI_Request> sendRequests;
+    firstSend.ISend(getRealRank(group, subgroupStart, communicator),
+                    communicator,
+                    sendRequests);
+    secondSend.ISend(getRealRank(group, subgroupStart + 1, communicator),
+                     communicator,
+                     sendRequests);
 
     // Wait for the messages to finish.
-    MPI_Waitall(firstSendRequests.size(),
-                firstSendRequests.data(),
-                MPI_STATUSES_IGNORE);
-    MPI_Waitall(secondSendRequests.size(),
-                secondSendRequests.data(),
-                MPI_STATUSES_IGNORE);
-
-    // Return empty image
-    return localImage->copySubrange(0, 0);
+    MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+
+    // Return empty images
+    return emptyImages(localImages);
   } else {
     std::cerr << "Binary Swap - 234 Schedule - Eliminate32 "
               << "called with invalid subgroupStart" << std::endl;
@@ -153,41 +229,54 @@ static std::unique_ptr<Image> Eliminate32(Image *localImage,
 
 // Takes a group of 4 processes, does a standard swap on two pairs, and then
 // blends the data from the second group to the first.
-static std::unique_ptr<Image> Eliminate42(Image *localImage,
-                                          MPI_Group group,
-                                          MPI_Comm communicator,
-                                          int subgroupStart) {
+static std::vector<std::unique_ptr<Image>> Eliminate42(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    int subgroupStart) {
   int rank;
   MPI_Group_rank(group, &rank);
 
   if ((rank == subgroupStart) || (rank == subgroupStart + 1)) {
     // This rank is part of the first group.
-    // First, get the receive ready for the half sent by the second group.
-    std::unique_ptr<Image> recvImage = localImage->createNew();
-    std::vector<MPI_Request> recvRequests = recvImage->IReceive(
-        getRealRank(group, rank + 2, communicator), communicator);
+    // First, get the receive ready for the halves sent by the second group.
+    ImagePackedReceiver packedReceive;
+    MPI_Request recvRequest;
+    std::vector<std::unique_ptr<Image>> recvImages = receiveImages(
+        localImages, group, communicator, rank + 2, packedReceive, recvRequest);
 
     // Next, do a normal binary swap.
-    std::unique_ptr<Image> blendedImage =
-        swapHalves(localImage, group, communicator, subgroupStart);
+    std::vector<std::unique_ptr<Image>> blendedImages =
+        swapHalves(localImages, group, communicator, subgroupStart);
 
-    // Wait for the incoming image to finish.
-    MPI_Waitall(recvRequests.size(), recvRequests.data(), MPI_STATUSES_IGNORE);
+    // Wait for the incoming images to finish.
+    packedReceive.wait(recvRequest);
 
-    // Finally, blend the other group's image.
-    return blendedImage->blend(*recvImage);
+    // Finally, blend the other group's images.
+    for (std::size_t imageIndex = 0; imageIndex < localImages.size();
+         ++imageIndex) {
+      blendedImages[imageIndex] =
+          blendedImages[imageIndex]->blend(*recvImages[imageIndex]);
+    }
+    return blendedImages;
   } else if ((rank == subgroupStart + 2) || (rank == subgroupStart + 3)) {
     // This rank is part of the second group.
     // First, do a normal binary swap.
-    std::unique_ptr<Image> blendedImage =
-        swapHalves(localImage, group, communicator, subgroupStart + 2);
+    std::vector<std::unique_ptr<Image>> blendedImages =
+        swapHalves(localImages, group, communicator, subgroupStart + 2);
 
-    // Next, send the image to the first group.
-    blendedImage->Send(getRealRank(group, rank - 2, communicator),
-                       communicator);
+    // Next, send the images to the first group.
+    ImagePackedSender packedSend;
+    for (auto &&blendedImage : blendedImages) {
+      packedSend.add(*blendedImage);
+    }
+    std::vector<MPI_Request> sendRequests;
+    packedSend.ISend(
+        getRealRank(group, rank - 2, communicator), communicator, sendRequests);
+    MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
 
-    // Return empty image
-    return localImage->copySubrange(0, 0);
+    // Return empty images
+    return emptyImages(localImages);
   } else {
     std::cerr << "Binary Swap - 234 Schedule - Eliminate42 "
               << "called with invalid subgroupStart" << std::endl;
@@ -199,10 +288,21 @@ std::unique_ptr<Image> BinarySwap234Schedule::compose(Image *localImage,
                                                       MPI_Group group,
                                                       MPI_Comm communicator,
                                                       YamlWriter &yaml) {
+  std::vector<Image *> localImages(1, localImage);
+  return std::move(
+      this->composeMany(localImages, group, communicator, yaml).front());
+}
+
+std::vector<std::unique_ptr<Image>> BinarySwap234Schedule::composeMany(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    YamlWriter &yaml) {
   // The 234composite algorithm (or binary swap with 234 scheduling) spends its
   // first iteration reducing the number of processes to a power of two. It
   // does this with a combination of 3-2 and 4-2 elimination where 3 or 4
-  // processes are reduced to 2.
+  // processes are reduced to 2. All images go through the same schedule, and
+  // the images going to the same process are packed into one message.
 
   int rank;
   MPI_Group_rank(group, &rank);
@@ -214,7 +314,8 @@ std::unique_ptr<Image> BinarySwap234Schedule::compose(Image *localImage,
 
   if (numProc == targetP2) {
     // Case 0, started with a power of 2 number of processes.
-    return BinarySwapBase().compose(localImage, group, communicator, yaml);
+    return BinarySwapBase(this->getAutoCompressThreshold())
+        .composeMany(localImages, group, communicator, yaml);
   } else if (numProc < targetP2 + (targetP2 / 2)) {
     // Case 1, use 3-2 elimination with standard swaps
     // Each 3-2 elimination takes one process out of the composite. Thus, we
@@ -225,12 +326,12 @@ std::unique_ptr<Image> BinarySwap234Schedule::compose(Image *localImage,
     // Do the prescribed swap or elemination.
     enum struct PairRole { FIRST, SECOND };
     PairRole role;
-    std::unique_ptr<Image> workingImage;
+    std::vector<std::unique_ptr<Image>> workingImages;
     if (rank < firstSwapGroup) {
       // Case 1.a: This rank in a 3-2 elimination
       int subgroupStart = (rank / 3) * 3;
-      workingImage =
-          Eliminate32(localImage, group, communicator, subgroupStart);
+      workingImages =
+          Eliminate32(localImages, group, communicator, subgroupStart);
       assert(rank >= subgroupStart);
       assert((rank - subgroupStart) < 3);
       switch (rank - subgroupStart) {
@@ -241,12 +342,13 @@ std::unique_ptr<Image> BinarySwap234Schedule::compose(Image *localImage,
           role = PairRole::SECOND;
           break;
         default:
-          return workingImage;
+          return workingImages;
       }
     } else {
       // Case 1.b: This rank in a standard swap
       int subgroupStart = (((rank - firstSwapGroup) / 2) * 2) + firstSwapGroup;
-      workingImage = swapHalves(localImage, group, communicator, subgroupStart);
+      workingImages =
+          swapHalves(localImages, group, communicator, subgroupStart);
       assert(rank >= subgroupStart);
       assert((rank - subgroupStart) < 2);
       switch (rank - subgroupStart) {
@@ -280,8 +382,10 @@ std::unique_ptr<Image> BinarySwap234Schedule::compose(Image *localImage,
     MPI_Group subgroup;
     MPI_Group_range_incl(group, 2, rankRange, &subgroup);
 
-    std::unique_ptr<Image> result = BinarySwapBase().compose(
-        workingImage.get(), subgroup, communicator, yaml);
+    std::vector<std::unique_ptr<Image>> result =
+        BinarySwapBase(this->getAutoCompressThreshold())
+            .composeMany(
+                toPointers(workingImages), subgroup, communicator, yaml);
 
     MPI_Group_free(&subgroup);
     return result;
@@ -296,12 +400,12 @@ std::unique_ptr<Image> BinarySwap234Schedule::compose(Image *localImage,
     // Do the prescribed swap or elemination.
     enum struct PairRole { FIRST, SECOND };
     PairRole role;
-    std::unique_ptr<Image> workingImage;
+    std::vector<std::unique_ptr<Image>> workingImages;
     if (rank < first32Group) {
       // Case 2.a: This rank in a 4-2 elimination
       int subgroupStart = (rank / 4) * 4;
-      workingImage =
-          Eliminate42(localImage, group, communicator, subgroupStart);
+      workingImages =
+          Eliminate42(localImages, group, communicator, subgroupStart);
       assert(rank >= subgroupStart);
       assert((rank - subgroupStart) < 4);
       switch (rank - subgroupStart) {
@@ -312,13 +416,13 @@ std::unique_ptr<Image> BinarySwap234Schedule::compose(Image *localImage,
           role = PairRole::SECOND;
           break;
         default:
-          return workingImage;
+          return workingImages;
       }
     } else {
       // Case 2.b: This rank in a 3-2 elimination
       int subgroupStart = (((rank - first32Group) / 3) * 3) + first32Group;
-      workingImage =
-          Eliminate32(localImage, group, communicator, subgroupStart);
+      workingImages =
+          Eliminate32(localImages, group, communicator, subgroupStart);
       assert(rank >= subgroupStart);
       assert((rank - subgroupStart) < 3);
       switch (rank - subgroupStart) {
@@ -329,7 +433,7 @@ std::unique_ptr<Image> BinarySwap234Schedule::compose(Image *localImage,
           role = PairRole::SECOND;
           break;
         default:
-          return workingImage;
+          return workingImages;
       }
     }
 
@@ -359,8 +463,10 @@ std::unique_ptr<Image> BinarySwap234Schedule::compose(Image *localImage,
       MPI_Group_range_incl(group, 1, &rankRange[1], &subgroup);
     }
 
-    std::unique_ptr<Image> result = BinarySwapBase().compose(
-        workingImage.get(), subgroup, communicator, yaml);
+    std::vector<std::unique_ptr<Image>> result =
+        BinarySwapBase(this->getAutoCompressThreshold())
+            .composeMany(
+                toPointers(workingImages), subgroup, communicator, yaml);
 
     MPI_Group_free(&subgroup);
     return result;
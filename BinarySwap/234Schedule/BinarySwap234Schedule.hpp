@@ -17,6 +17,12 @@ class BinarySwap234Schedule : public Compositor {
                                  MPI_Group group,
                                  MPI_Comm communicator,
                                  YamlWriter &yaml) final;
+
+  std::vector<std::unique_ptr<Image>> composeMany(
+      const std::vector<Image *> &localImages,
+      MPI_Group group,
+      MPI_Comm communicator,
+      YamlWriter &yaml) final;
 };
 
 #endif  // BINARYSWAP234SCHEDULE_HPP
@@ -8,6 +8,12 @@
 
 #include "BinarySwapBase.hpp"
 
+#include <Common/AutoCompress.hpp>
+#include <Common/ImageFull.hpp>
+#include <Common/ImagePackedMessage.hpp>
+#include <Common/ImageSparse.hpp>
+#include <Common/ImageView.hpp>
+
 enum PairRole { PAIR_ROLE_EVEN, PAIR_ROLE_ODD };
 
 static bool isPowerOfTwo(int x) {
@@ -34,7 +40,28 @@ static int getRealRank(MPI_Group group, int rank, MPI_Comm communicator) {
 std::unique_ptr<Image> BinarySwapBase::compose(Image *localImage,
                                                MPI_Group group,
                                                MPI_Comm communicator,
-                                               YamlWriter &) {
+                                               YamlWriter &yaml) {
+  std::vector<Image *> localImages(1, localImage);
+  return std::move(
+      this->composeMany(localImages, group, communicator, yaml).front());
+}
+
+std::vector<std::unique_ptr<Image>> BinarySwapBase::composeMany(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    YamlWriter &yaml) {
+  RoundHook noHook;
+  return this->composeManyWithHook(
+      localImages, group, communicator, yaml, noHook);
+}
+
+std::vector<std::unique_ptr<Image>> BinarySwapBase::composeManyWithHook(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    YamlWriter &yaml,
+    RoundHook &roundHook) {
   // Binary-swap is a recursive algorithm. We start with a process group with
   // all the processes, then divide and conquer the group until we only have
   // groups of size 1.
@@ -48,7 +75,14 @@ std::unique_ptr<Image> BinarySwapBase::compose(Image *localImage,
   int numProc;
   MPI_Group_size(workingGroup, &numProc);
 
-  std::unique_ptr<Image> workingImage = localImage->shallowCopy();
+  // All images go through the same schedule. Every round exchanges the
+  // pieces of all the images with the same partner at the same time.
+  int numImages = static_cast<int>(localImages.size());
+  std::vector<std::unique_ptr<Image>> workingImages;
+  workingImages.reserve(numImages);
+  for (auto &&localImage : localImages) {
+    workingImages.push_back(localImage->shallowCopy());
+  }
 
   // This version of binary swap only works if the communicator size is a power
   // of two.
@@ -58,17 +92,17 @@ std::unique_ptr<Image> BinarySwapBase::compose(Image *localImage,
     exit(1);
   }
 
-  while (numProc > 1) {
-    // At each iteration of the binary-swap algorithm, divide the image in half.
-    std::unique_ptr<const Image> firstHalf =
-        workingImage->window(0, workingImage->getNumberOfPixels() / 2);
-    std::unique_ptr<const Image> secondHalf =
-        workingImage->window(workingImage->getNumberOfPixels() / 2,
-                             workingImage->getNumberOfPixels());
+  float autoCompressThreshold = this->getAutoCompressThreshold();
+  if (autoCompressThreshold >= 0) {
+    yaml.StartBlock("auto-compress-rounds");
+  }
 
-    std::unique_ptr<const Image> toKeep;
-    std::unique_ptr<const Image> toSend;
+  if (numProc == 1) {
+    // No rounds. The local images are already final.
+    roundHook.imagesFinished(workingImages);
+  }
 
+  while (numProc > 1) {
     int partnerRank;
 
     // At each iteration of the binary-swap algorithm, each process pairs with
@@ -82,36 +116,125 @@ std::unique_ptr<Image> BinarySwapBase::compose(Image *localImage,
       // The "even" role has the smaller rank. It has the image that goes on
       // top, and we will collect the first half of the image.
       role = PAIR_ROLE_EVEN;
-      toKeep.swap(firstHalf);
-      toSend.swap(secondHalf);
       partnerRank = rank + 1;
     } else {
       // The "odd" role has the larger rank. It has the image that goes on
       // the bottom, and we will collect the second half of the image.
       role = PAIR_ROLE_ODD;
-      toKeep.swap(secondHalf);
-      toSend.swap(firstHalf);
       partnerRank = rank - 1;
     }
+    int realPartnerRank = getRealRank(workingGroup, partnerRank, communicator);
 
-    // Receive our half of the image and send out our partner's half.
-    std::unique_ptr<Image> recvImage = toKeep->createNew();
-    std::vector<MPI_Request> recvRequests = recvImage->IReceive(
-        getRealRank(workingGroup, partnerRank, communicator), communicator);
-    std::vector<MPI_Request> sendRequests = toSend->ISend(
-        getRealRank(workingGroup, partnerRank, communicator), communicator);
-
-    // Wait for my image to come in.
-    MPI_Waitall(recvRequests.size(), recvRequests.data(), MPI_STATUSES_IGNORE);
-
-    // Blend the incoming image and set the workingImage to the result.
-    switch (role) {
-      case PAIR_ROLE_EVEN:
-        workingImage = toKeep->blend(*recvImage);
-        break;
-      case PAIR_ROLE_ODD:
-        workingImage = recvImage->blend(*toKeep);
-        break;
+    bool compressRound = false;
+    if (autoCompressThreshold >= 0) {
+      // Both partners see the same pixel counts, so they pick the same form.
+      float activeRatio;
+      compressRound = chooseAutoCompress(workingImages,
+                                         autoCompressThreshold,
+                                         {realPartnerRank},
+                                         communicator,
+                                         activeRatio);
+      yaml.StartListItem();
+      yaml.AddDictionaryEntry("active-ratio", activeRatio);
+      yaml.AddDictionaryEntry("compressed", compressRound ? "yes" : "no");
+
+      if (!compressRound) {
+        for (auto &&workingImage : workingImages) {
+          const ImageSparse *sparseImage =
+              dynamic_cast<const ImageSparse *>(workingImage.get());
+          if (sparseImage != nullptr) {
+            workingImage = sparseImage->uncompress();
+          }
+        }
+      }
+    }
+
+    std::vector<std::unique_ptr<const Image>> toKeep(numImages);
+    std::vector<std::unique_ptr<const Image>> toSend(numImages);
+    std::vector<std::unique_ptr<Image>> recvImages(numImages);
+    // The halves of all the images going to or coming from the partner are
+    // packed into one message each way.
+    ImagePackedReceiver packedReceive;
+    ImagePackedSender packedSend;
+
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      Image *workingImage = workingImages[imageIndex].get();
+
+      // At each iteration of the binary-swap algorithm, divide the image in
+      // half.
+      int numPixels = workingImage->getNumberOfPixels();
+      int halfPixels = numPixels / 2;
+      int keepBegin = 0;
+      int keepEnd = 0;
+      int sendBegin = 0;
+      int sendEnd = 0;
+      switch (role) {
+        case PAIR_ROLE_EVEN:
+          keepBegin = 0;
+          keepEnd = halfPixels;
+          sendBegin = halfPixels;
+          sendEnd = numPixels;
+          break;
+        case PAIR_ROLE_ODD:
+          keepBegin = halfPixels;
+          keepEnd = numPixels;
+          sendBegin = 0;
+          sendEnd = halfPixels;
+          break;
+      }
+
+      const ImageFull *fullImage =
+          dynamic_cast<const ImageFull *>(workingImage);
+      if (compressRound && (fullImage != nullptr)) {
+        // Compress straight into the two halves rather than compressing the
+        // whole image and then windowing it.
+        std::vector<std::unique_ptr<ImageSparse>> halves =
+            fullImage->compressInto(2, {halfPixels});
+        bool keepFirst = (keepBegin == 0);
+        toKeep[imageIndex] = std::move(halves[keepFirst ? 0 : 1]);
+        toSend[imageIndex] = std::move(halves[keepFirst ? 1 : 0]);
+        packedSend.add(*toSend[imageIndex]);
+      } else {
+        // Only the half that is kept and blended needs a window. The half
+        // sent to our partner is sent straight from the working image.
+        toKeep[imageIndex] = workingImage->window(keepBegin, keepEnd);
+        packedSend.add(ImageView(*workingImage, sendBegin, sendEnd));
+      }
+
+      // Receive our half of the image and send out our partner's half.
+      recvImages[imageIndex] = toKeep[imageIndex]->createNew();
+      packedReceive.add(*recvImages[imageIndex]);
+    }
+    MPI_Request recvRequest =
+        packedReceive.IReceive(realPartnerRank, communicator);
+    std::vector<MPI_Request> sendRequests;
+    packedSend.ISend(realPartnerRank, communicator, sendRequests);
+
+    roundHook.roundStarted(toKeep);
+
+    // Wait for my images to come in.
+    packedReceive.wait(recvRequest);
+
+    // Blend the incoming images and set the workingImages to the result. The
+    // halves being sent may be views of the working images, so hold on to
+    // those until the sends finish.
+    std::vector<std::unique_ptr<Image>> sendingImages(numImages);
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      sendingImages[imageIndex].swap(workingImages[imageIndex]);
+      switch (role) {
+        case PAIR_ROLE_EVEN:
+          workingImages[imageIndex] =
+              toKeep[imageIndex]->blend(*recvImages[imageIndex]);
+          break;
+        case PAIR_ROLE_ODD:
+          workingImages[imageIndex] =
+              recvImages[imageIndex]->blend(*toKeep[imageIndex]);
+          break;
+      }
+    }
+
+    if (numProc == 2) {
+      roundHook.imagesFinished(workingImages);
     }
 
     // Wait for my images to finish sending.
@@ -134,8 +257,12 @@ std::unique_ptr<Image> BinarySwapBase::compose(Image *localImage,
     MPI_Group_size(workingGroup, &numProc);
   }
 
-  // Clean up internal objects and return image.
+  if (autoCompressThreshold >= 0) {
+    yaml.EndBlock();
+  }
+
+  // Clean up internal objects and return images.
   MPI_Group_free(&workingGroup);
 
-  return workingImage;
+  return workingImages;
 }
@@ -13,10 +13,58 @@
 
 class BinarySwapBase : public Compositor {
  public:
+  /// \brief Lets a caller of \c composeManyWithHook do work during the rounds.
+  ///
+  /// Compositors that run a binary-swap as part of a larger algorithm use
+  /// this to overlap their own work with the exchanges of the binary-swap.
+  ///
+  class RoundHook {
+   public:
+    /// Called in each round after the exchange with the partner has started
+    /// and before waiting for it. \a toKeep holds the halves of the images
+    /// this process keeps, which are blended with the partner's halves when
+    /// they arrive. The hook may replace them (for example, with the result
+    /// of blending another image into them).
+    virtual void roundStarted(
+        std::vector<std::unique_ptr<const Image>> & /*toKeep*/) {}
+
+    /// Called as soon as the final images are blended (before waiting for
+    /// the last sends to finish).
+    virtual void imagesFinished(
+        const std::vector<std::unique_ptr<Image>> & /*images*/) {}
+
+    virtual ~RoundHook() = default;
+  };
+
+  BinarySwapBase() = default;
+
+  /// Creates a binary-swap compositor with the given automatic compression
+  /// threshold (see \c Compositor::setAutoCompressThreshold). Compositors
+  /// that finish with a binary-swap pass their own threshold here.
+  ///
+  explicit BinarySwapBase(float autoCompressThreshold) {
+    this->setAutoCompressThreshold(autoCompressThreshold);
+  }
+
   std::unique_ptr<Image> compose(Image *localImage,
                                  MPI_Group group,
                                  MPI_Comm communicator,
                                  YamlWriter &yaml) final;
+
+  std::vector<std::unique_ptr<Image>> composeMany(
+      const std::vector<Image *> &localImages,
+      MPI_Group group,
+      MPI_Comm communicator,
+      YamlWriter &yaml) final;
+
+  /// Same as \c composeMany, but calls the given hook during the rounds.
+  ///
+  std::vector<std::unique_ptr<Image>> composeManyWithHook(
+      const std::vector<Image *> &localImages,
+      MPI_Group group,
+      MPI_Comm communicator,
+      YamlWriter &yaml,
+      RoundHook &roundHook);
 };
 
 #endif  // BINARYSWABASEP_HPP
@@ -9,6 +9,11 @@
 #include "BinarySwapFold.hpp"
 #include "../Base/BinarySwapBase.hpp"
 
+#include <Common/ImagePackedMessage.hpp>
+#include <Common/ImageView.hpp>
+
+#include <deque>
+
 static int getLargestPowerOfTwoNoBiggerThan(int x) {
   int power2 = 1;
   while (power2 <= x) {
@@ -28,15 +33,28 @@ static int getRealRank(MPI_Group group, int rank, MPI_Comm communicator) {
   return realRank;
 }
 
+BinarySwapFold::BinarySwapFold() : splitFold(false) {}
+
 std::unique_ptr<Image> BinarySwapFold::compose(Image *localImage,
                                                MPI_Group group,
                                                MPI_Comm communicator,
                                                YamlWriter &yaml) {
+  std::vector<Image *> localImages(1, localImage);
+  return std::move(
+      this->composeMany(localImages, group, communicator, yaml).front());
+}
+
+std::vector<std::unique_ptr<Image>> BinarySwapFold::composeMany(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    YamlWriter &yaml) {
   // The base binary-swap algorithm only operates on process groups with a size
   // of a power-of-two. This compositing algorithm first shrinks the given
   // process group to one that is a power-of-two. It does this by taking an
   // excess processes, folding their image into another process, and then going
-  // idle the rest of the time.
+  // idle the rest of the time. All images go through the same schedule, and
+  // the images going to the same process are packed into one message.
 
   int myGroupRank;
   MPI_Group_rank(group, &myGroupRank);
@@ -54,12 +72,20 @@ std::unique_ptr<Image> BinarySwapFold::compose(Image *localImage,
   // Special case: we already have a power of two. Just call the base
   // binary-swap and return.
   if (numProcsToRemove == 0) {
-    return BinarySwapBase().compose(localImage, group, communicator, yaml);
+    return BinarySwapBase(this->getAutoCompressThreshold())
+        .composeMany(localImages, group, communicator, yaml);
+  }
+
+  if (this->splitFold) {
+    return this->composeSplitFold(localImages, group, communicator, yaml);
   }
 
   std::vector<int> procsToRemove(numProcsToRemove);
 
-  std::unique_ptr<Image> workingImage = localImage->shallowCopy();
+  std::vector<std::unique_ptr<Image>> workingImages;
+  for (auto &&localImage : localImages) {
+    workingImages.push_back(localImage->shallowCopy());
+  }
 
   // We have to transfer the images from numProcsToRemove processes to another
   // process and blend them there. We have to match up adjacent processes so
@@ -70,17 +96,38 @@ std::unique_ptr<Image> BinarySwapFold::compose(Image *localImage,
     int rankToSend = 2 * i + 1;
     procsToRemove[i] = rankToSend;
     if (myGroupRank == rankToRecv) {
-      // This process absorbs an image from another process.
-      std::unique_ptr<Image> incomingImage = workingImage->createNew();
-      incomingImage->Receive(getRealRank(group, rankToSend, communicator),
-                             communicator);
-      workingImage = workingImage->blend(*incomingImage);
+      // This process absorbs the images from another process.
+      std::vector<std::unique_ptr<Image>> incomingImages;
+      ImagePackedReceiver packedReceive;
+      for (auto &&workingImage : workingImages) {
+        incomingImages.push_back(workingImage->createNew());
+        packedReceive.add(*incomingImages.back());
+      }
+      MPI_Request recvRequest = packedReceive.IReceive(
+          getRealRank(group, rankToSend, communicator), communicator);
+      packedReceive.wait(recvRequest);
+      for (std::size_t imageIndex = 0; imageIndex < workingImages.size();
+           ++imageIndex) {
+        workingImages[imageIndex] =
+            workingImages[imageIndex]->blend(*incomingImages[imageIndex]);
+      }
     } else if (myGroupRank == rankToSend) {
-      // This process sends its image out and drops out of the composition by
-      // returning an empty image.
-      workingImage->Send(getRealRank(group, rankToRecv, communicator),
-                         communicator);
-      return workingImage->copySubrange(0, 0);
+      // This process sends its images out and drops out of the composition by
+      // returning "empty" images.
+      ImagePackedSender packedSend;
+      for (auto &&workingImage : workingImages) {
+        packedSend.add(*workingImage);
+      }
+      std::vector<MPI_Request> sendRequests;
+      packedSend.ISend(getRealRank(group, rankToRecv, communicator),
+                       communicator,
+                       sendRequests);
+      MPI_Waitall(
+          sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+      for (auto &&workingImage : workingImages) {
+        workingImage = workingImage->copySubrange(0, 0);
+      }
+      return workingImages;
     }
   }
 
@@ -89,11 +136,222 @@ std::unique_ptr<Image> BinarySwapFold::compose(Image *localImage,
   MPI_Group_excl(group, numProcsToRemove, procsToRemove.data(), &subGroup);
 
   // Now call the base binary-swap algorithm.
-  std::unique_ptr<Image> resultImage = BinarySwapBase().compose(
-      workingImage.get(), subGroup, communicator, yaml);
+  std::vector<Image *> workingImagePointers;
+  for (auto &&workingImage : workingImages) {
+    workingImagePointers.push_back(workingImage.get());
+  }
+  std::vector<std::unique_ptr<Image>> resultImages =
+      BinarySwapBase(this->getAutoCompressThreshold())
+          .composeMany(workingImagePointers, subGroup, communicator, yaml);
 
   // Cleanup
   MPI_Group_free(&subGroup);
 
-  return resultImage;
+  return resultImages;
+}
+
+std::vector<std::unique_ptr<Image>> BinarySwapFold::composeSplitFold(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    YamlWriter &yaml) {
+  // In split fold, the first round of binary swap is done by targetGroupSize/2
+  // subgroups of contiguous processes. Each subgroup has a pair of processes
+  // (the first and the last) that do a normal swap of their image halves. The
+  // excess processes are spread over the subgroups (at most two per subgroup)
+  // and sit between the pair. They split their image and send one half to each
+  // process of the pair and then drop out. After this round, the first
+  // processes of all subgroups hold the first image half and the last
+  // processes hold the second image half, so each of these can continue with
+  // the base binary-swap algorithm.
+
+  int myGroupRank;
+  MPI_Group_rank(group, &myGroupRank);
+
+  int originalGroupSize;
+  MPI_Group_size(group, &originalGroupSize);
+
+  int targetGroupSize = getLargestPowerOfTwoNoBiggerThan(originalGroupSize);
+  int numProcsToRemove = originalGroupSize - targetGroupSize;
+  int numSubgroups = targetGroupSize / 2;
+
+  // Find the subgroups. While we are at it, record the first and last process
+  // of each, which are the processes that continue to the binary swap.
+  std::vector<int> firstProcs(numSubgroups);
+  std::vector<int> lastProcs(numSubgroups);
+  int subgroupStart = 0;
+  int mySubgroupStart = -1;
+  int mySubgroupSize = -1;
+  for (int subgroupIndex = 0; subgroupIndex < numSubgroups; ++subgroupIndex) {
+    int subgroupSize = 2 + numProcsToRemove / numSubgroups;
+    if (subgroupIndex < (numProcsToRemove % numSubgroups)) {
+      ++subgroupSize;
+    }
+    assert(subgroupSize <= 4);
+    if ((myGroupRank >= subgroupStart) &&
+        (myGroupRank < subgroupStart + subgroupSize)) {
+      mySubgroupStart = subgroupStart;
+      mySubgroupSize = subgroupSize;
+    }
+    firstProcs[subgroupIndex] = subgroupStart;
+    lastProcs[subgroupIndex] = subgroupStart + subgroupSize - 1;
+    subgroupStart += subgroupSize;
+  }
+  assert(subgroupStart == originalGroupSize);
+  assert(mySubgroupStart >= 0);
+
+  int firstRank = mySubgroupStart;
+  int lastRank = mySubgroupStart + mySubgroupSize - 1;
+
+  int numImages = static_cast<int>(localImages.size());
+  std::vector<ImageView> firstHalves;
+  std::vector<ImageView> secondHalves;
+  for (auto &&localImage : localImages) {
+    int numPixels = localImage->getNumberOfPixels();
+    firstHalves.emplace_back(*localImage, 0, numPixels / 2);
+    secondHalves.emplace_back(*localImage, numPixels / 2, numPixels);
+  }
+
+  if ((myGroupRank != firstRank) && (myGroupRank != lastRank)) {
+    // This process is excess. It sends its halves to the pair and drops out of
+    // the composition by returning "empty" images.
+    ImagePackedSender firstSend;
+    ImagePackedSender secondSend;
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      firstSend.add(std::move(firstHalves[imageIndex]));
+      secondSend.add(std::move(secondHalves[imageIndex]));
+    }
+    std::vector<MPI_Request> sendRequests;
+    firstSend.ISend(getRealRank(group, firstRank, communicator),
+                    communicator,
+                    sendRequests);
+    secondSend.ISend(getRealRank(group, lastRank, communicator),
+                     communicator,
+                     sendRequests);
+    MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+    std::vector<std::unique_ptr<Image>> emptyImages;
+    for (auto &&localImage : localImages) {
+      emptyImages.push_back(localImage->copySubrange(0, 0));
+    }
+    return emptyImages;
+  }
+
+  std::vector<ImageView> *toKeep;
+  std::vector<ImageView> *toSend;
+  int partnerRank;
+  if (myGroupRank == firstRank) {
+    toKeep = &firstHalves;
+    toSend = &secondHalves;
+    partnerRank = lastRank;
+  } else {
+    toKeep = &secondHalves;
+    toSend = &firstHalves;
+    partnerRank = firstRank;
+  }
+
+  // Receive the halves I keep from every other process in my subgroup, the
+  // halves of all the images from one process in one message.
+  std::vector<std::vector<std::unique_ptr<Image>>> incomingImages;
+  std::deque<ImagePackedReceiver> packedReceives;
+  std::vector<MPI_Request> recvRequests;
+  for (int rank = firstRank; rank <= lastRank; ++rank) {
+    if (rank == myGroupRank) {
+      continue;
+    }
+    incomingImages.emplace_back();
+    packedReceives.emplace_back();
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      const ImageView &keepView = (*toKeep)[imageIndex];
+      incomingImages.back().push_back(localImages[imageIndex]->createNew(
+          keepView.getRegionBegin(), keepView.getRegionEnd()));
+      packedReceives.back().add(*incomingImages.back().back());
+    }
+    recvRequests.push_back(packedReceives.back().IReceive(
+        getRealRank(group, rank, communicator), communicator));
+  }
+
+  ImagePackedSender packedSend;
+  for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+    packedSend.add(std::move((*toSend)[imageIndex]));
+  }
+  std::vector<MPI_Request> sendRequests;
+  packedSend.ISend(getRealRank(group, partnerRank, communicator),
+                   communicator,
+                   sendRequests);
+
+  // Blend the halves in rank order. My own half goes on top if I am the first
+  // process and on the bottom if I am the last.
+  std::vector<std::unique_ptr<Image>> workingImages(numImages);
+  for (std::size_t index = 0; index < incomingImages.size(); ++index) {
+    packedReceives[index].wait(recvRequests[index]);
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      std::unique_ptr<Image> &workingImage = workingImages[imageIndex];
+      std::unique_ptr<Image> &incomingImage =
+          incomingImages[index][imageIndex];
+      if (workingImage) {
+        workingImage = workingImage->blend(*incomingImage);
+      } else if (myGroupRank == firstRank) {
+        workingImage =
+            (*toKeep)[imageIndex].blend(ImageView(*incomingImage));
+      } else {
+        workingImage.swap(incomingImage);
+      }
+    }
+  }
+  if (myGroupRank == lastRank) {
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      workingImages[imageIndex] = ImageView(*workingImages[imageIndex])
+                                      .blend((*toKeep)[imageIndex]);
+    }
+  }
+
+  MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+
+  // Continue the binary swap with the processes holding the same half.
+  MPI_Group subGroup;
+  if (myGroupRank == firstRank) {
+    MPI_Group_incl(group, numSubgroups, firstProcs.data(), &subGroup);
+  } else {
+    MPI_Group_incl(group, numSubgroups, lastProcs.data(), &subGroup);
+  }
+
+  std::vector<Image *> workingImagePointers;
+  for (auto &&workingImage : workingImages) {
+    workingImagePointers.push_back(workingImage.get());
+  }
+  std::vector<std::unique_ptr<Image>> resultImages =
+      BinarySwapBase(this->getAutoCompressThreshold())
+          .composeMany(workingImagePointers, subGroup, communicator, yaml);
+
+  MPI_Group_free(&subGroup);
+
+  return resultImages;
+}
+
+enum optionIndex { SPLIT_FOLD };
+
+std::vector<option::Descriptor> BinarySwapFold::getOptionVector() {
+  std::vector<option::Descriptor> usage;
+  // clang-format off
+  usage.push_back(
+    {SPLIT_FOLD, 0, "", "split-fold", option::Arg::None,
+     "  --split-fold            Instead of sending its whole image to one\n"
+     "                          process, each excess process sends half of its\n"
+     "                          image to each process of a first-round swap\n"
+     "                          pair. This spreads the cost of the excess\n"
+     "                          processes over more processes.\n"});
+  // clang-format on
+
+  return usage;
+}
+
+bool BinarySwapFold::setOptions(const std::vector<option::Option> &options,
+                                MPI_Comm,
+                                YamlWriter &yaml) {
+  if (options[SPLIT_FOLD]) {
+    this->splitFold = true;
+  }
+  yaml.AddDictionaryEntry("split-fold", this->splitFold ? "yes" : "no");
+
+  return true;
 }
@@ -12,11 +12,42 @@
 #include <Common/Compositor.hpp>
 
 class BinarySwapFold : public Compositor {
+  bool splitFold;
+
+  std::vector<std::unique_ptr<Image>> composeSplitFold(
+      const std::vector<Image *> &localImages,
+      MPI_Group group,
+      MPI_Comm communicator,
+      YamlWriter &yaml);
+
  public:
+  BinarySwapFold();
+
+  /// \brief Sets whether excess processes split their images in two.
+  ///
+  /// Normally, each excess process sends its whole image to one other
+  /// process, which has to blend it before starting the binary swap. When
+  /// split fold is on, each excess process instead sends half of its image to
+  /// each of the two processes of a first-round swap pair, so the extra
+  /// blending is spread over more processes.
+  ///
+  void setSplitFold(bool _splitFold) { this->splitFold = _splitFold; }
+
   std::unique_ptr<Image> compose(Image *localImage,
                                  MPI_Group group,
                                  MPI_Comm communicator,
                                  YamlWriter &yaml) final;
+
+  std::vector<std::unique_ptr<Image>> composeMany(
+      const std::vector<Image *> &localImages,
+      MPI_Group group,
+      MPI_Comm communicator,
+      YamlWriter &yaml) final;
+
+  bool setOptions(const std::vector<option::Option> &options,
+                  MPI_Comm communicator,
+                  YamlWriter &yaml) override;
+  static std::vector<option::Descriptor> getOptionVector();
 };
 
 #endif  // BINARYSWAPFOLD_HPP
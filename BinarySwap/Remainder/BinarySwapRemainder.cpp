@@ -8,6 +8,9 @@
 
 #include "BinarySwapRemainder.hpp"
 
+#include <Common/ImagePackedMessage.hpp>
+#include <Common/ImageView.hpp>
+
 enum PairRole { PAIR_ROLE_EVEN, PAIR_ROLE_ODD };
 
 static int getRealRank(MPI_Group group, int rank, MPI_Comm communicator) {
@@ -24,7 +27,17 @@ static int getRealRank(MPI_Group group, int rank, MPI_Comm communicator) {
 std::unique_ptr<Image> BinarySwapRemainder::compose(Image *localImage,
                                                     MPI_Group group,
                                                     MPI_Comm communicator,
-                                                    YamlWriter &) {
+                                                    YamlWriter &yaml) {
+  std::vector<Image *> localImages(1, localImage);
+  return std::move(
+      this->composeMany(localImages, group, communicator, yaml).front());
+}
+
+std::vector<std::unique_ptr<Image>> BinarySwapRemainder::composeMany(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    YamlWriter &) {
   // Binary-swap-remainder is a recursive algorithm that operates very similar
   // to the base algorithm. (You should understand the base algorithm before
   // reading this one.) The only difference is that at an iteration if the
@@ -40,39 +53,53 @@ std::unique_ptr<Image> BinarySwapRemainder::compose(Image *localImage,
   int numProc;
   MPI_Group_size(workingGroup, &numProc);
 
-  std::unique_ptr<Image> workingImage = localImage->shallowCopy();
+  // All images go through the same schedule. The pieces of all the images
+  // going to the same process are packed into one message.
+  int numImages = static_cast<int>(localImages.size());
+  std::vector<std::unique_ptr<Image>> workingImages;
+  workingImages.reserve(numImages);
+  for (auto &&localImage : localImages) {
+    workingImages.push_back(localImage->shallowCopy());
+  }
 
   while (numProc > 1) {
-    // At each iteration of the binary-swap algorithm, divide the image in half.
-    std::unique_ptr<const Image> firstHalf =
-        workingImage->window(0, workingImage->getNumberOfPixels() / 2);
-    std::unique_ptr<const Image> secondHalf =
-        workingImage->window(workingImage->getNumberOfPixels() / 2,
-                             workingImage->getNumberOfPixels());
+    // At each iteration of the binary-swap algorithm, divide the images in
+    // half.
+    std::vector<ImageView> firstHalves;
+    std::vector<ImageView> secondHalves;
+    for (auto &&workingImage : workingImages) {
+      int numPixels = workingImage->getNumberOfPixels();
+      firstHalves.emplace_back(*workingImage, 0, numPixels / 2);
+      secondHalves.emplace_back(*workingImage, numPixels / 2, numPixels);
+    }
 
     bool haveRemainder = ((numProc % 2) == 1);
     if (haveRemainder && (rank == (numProc - 1))) {
       // My process is in the remainder. Offload my images to processes in
       // another group and drop out of the composition.
-      std::vector<MPI_Request> firstSendRequests = firstHalf->ISend(
-          getRealRank(workingGroup, numProc - 3, communicator), communicator);
-      std::vector<MPI_Request> secondSendRequests = secondHalf->ISend(
-          getRealRank(workingGroup, numProc - 2, communicator), communicator);
-
-      MPI_Waitall(firstSendRequests.size(),
-                  firstSendRequests.data(),
-                  MPI_STATUSES_IGNORE);
-      MPI_Waitall(secondSendRequests.size(),
-                  secondSendRequests.data(),
-                  MPI_STATUSES_IGNORE);
-
-      workingImage = workingImage->copySubrange(0, 0);
+      ImagePackedSender firstSend;
+      ImagePackedSender secondSend;
+      for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+        firstSend.add(std::move(firstHalves[imageIndex]));
+        secondSend.add(std::move(secondHalves[imageIndex]));
+      }
+      std::vector<MPI_Request> sendRequests;
+      firstSend.ISend(getRealRank(workingGroup, numProc - 3, communicator),
+                      communicator,
+                      sendRequests);
+      secondSend.ISend(getRealRank(workingGroup, numProc - 2, communicator),
+                       communicator,
+                       sendRequests);
+
+      MPI_Waitall(
+          sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+
+      for (auto &&workingImage : workingImages) {
+        workingImage = workingImage->copySubrange(0, 0);
+      }
       break;
     }
 
-    std::unique_ptr<const Image> toKeep;
-    std::unique_ptr<const Image> toSend;
-
     int partnerRank;
 
     // At each iteration of the binary-swap algorithm, each process pairs with
@@ -82,51 +109,84 @@ std::unique_ptr<Image> BinarySwapRemainder::compose(Image *localImage,
     // ours. We use whether the rank is even or odd to determine which member
     // of the pair we are.
     PairRole role;
+    std::vector<ImageView> *toKeep;
+    std::vector<ImageView> *toSend;
     if (rank % 2 == 0) {
       // The "even" role has the smaller rank. It has the image that goes on
       // top, and we will collect the first half of the image.
       role = PAIR_ROLE_EVEN;
-      toKeep.swap(firstHalf);
-      toSend.swap(secondHalf);
+      toKeep = &firstHalves;
+      toSend = &secondHalves;
       partnerRank = rank + 1;
     } else {
       // The "odd" role has the larger rank. It has the image that goes on
       // the bottom, and we will collect the second half of the image.
       role = PAIR_ROLE_ODD;
-      toKeep.swap(secondHalf);
-      toSend.swap(firstHalf);
+      toKeep = &secondHalves;
+      toSend = &firstHalves;
       partnerRank = rank - 1;
     }
 
-    // Receive our half of the image and send out our partner's half.
-    std::unique_ptr<Image> recvImage = toKeep->createNew();
-    std::vector<MPI_Request> recvRequests = recvImage->IReceive(
-        getRealRank(workingGroup, partnerRank, communicator), communicator);
-    std::vector<MPI_Request> sendRequests = toSend->ISend(
+    // Receive our halves of the images and send out our partner's halves.
+    // If the remainder sends to us, get its receive ready too.
+    bool receiveRemainder = haveRemainder && (rank >= numProc - 3);
+    std::vector<std::unique_ptr<Image>> recvImages;
+    std::vector<std::unique_ptr<Image>> remainderImages;
+    ImagePackedReceiver packedReceive;
+    ImagePackedReceiver remainderReceive;
+    ImagePackedSender packedSend;
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      const ImageView &keepView = (*toKeep)[imageIndex];
+      recvImages.push_back(workingImages[imageIndex]->createNew(
+          keepView.getRegionBegin(), keepView.getRegionEnd()));
+      packedReceive.add(*recvImages.back());
+      if (receiveRemainder) {
+        remainderImages.push_back(recvImages.back()->createNew());
+        remainderReceive.add(*remainderImages.back());
+      }
+      packedSend.add(std::move((*toSend)[imageIndex]));
+    }
+    MPI_Request recvRequest = packedReceive.IReceive(
         getRealRank(workingGroup, partnerRank, communicator), communicator);
-
-    // Wait for my image to come in.
-    MPI_Waitall(recvRequests.size(), recvRequests.data(), MPI_STATUSES_IGNORE);
-
-    // Blend the incoming image and set the workingImage to the result.
-    switch (role) {
-      case PAIR_ROLE_EVEN:
-        workingImage = toKeep->blend(*recvImage);
-        break;
-      case PAIR_ROLE_ODD:
-        workingImage = recvImage->blend(*toKeep);
-        break;
+    MPI_Request remainderRequest = MPI_REQUEST_NULL;
+    if (receiveRemainder) {
+      remainderRequest = remainderReceive.IReceive(
+          getRealRank(workingGroup, numProc - 1, communicator), communicator);
+    }
+    std::vector<MPI_Request> sendRequests;
+    packedSend.ISend(getRealRank(workingGroup, partnerRank, communicator),
+                     communicator,
+                     sendRequests);
+
+    // Wait for my images to come in.
+    packedReceive.wait(recvRequest);
+
+    // Blend the incoming images and set the workingImages to the result.
+    std::vector<std::unique_ptr<Image>> blendedImages;
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      ImageView recvView(*recvImages[imageIndex]);
+      switch (role) {
+        case PAIR_ROLE_EVEN:
+          blendedImages.push_back((*toKeep)[imageIndex].blend(recvView));
+          break;
+        case PAIR_ROLE_ODD:
+          blendedImages.push_back(recvView.blend((*toKeep)[imageIndex]));
+          break;
+      }
     }
 
-    // Receive any images from the remainder if necessary
-    if (haveRemainder && (rank >= numProc - 3)) {
-      recvImage->Receive(getRealRank(workingGroup, numProc - 1, communicator),
-                         communicator);
-      workingImage = workingImage->blend(*recvImage);
+    // Blend any images from the remainder if necessary
+    if (receiveRemainder) {
+      remainderReceive.wait(remainderRequest);
+      for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+        blendedImages[imageIndex] =
+            blendedImages[imageIndex]->blend(*remainderImages[imageIndex]);
+      }
     }
 
     // Wait for my images to finish sending.
     MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+    workingImages.swap(blendedImages);
 
     // Create a sub-communicator containing all the processes with same portion
     // of the image as me.
@@ -145,8 +205,8 @@ std::unique_ptr<Image> BinarySwapRemainder::compose(Image *localImage,
     MPI_Group_size(workingGroup, &numProc);
   }
 
-  // Clean up internal objects and return image.
+  // Clean up internal objects and return images.
   MPI_Group_free(&workingGroup);
 
-  return workingImage;
+  return workingImages;
 }
@@ -17,6 +17,12 @@ class BinarySwapRemainder : public Compositor {
                                  MPI_Group group,
                                  MPI_Comm communicator,
                                  YamlWriter &yaml) final;
+
+  std::vector<std::unique_ptr<Image>> composeMany(
+      const std::vector<Image *> &localImages,
+      MPI_Group group,
+      MPI_Comm communicator,
+      YamlWriter &yaml) final;
 };
 
 #endif  // BINARYSWAPREMANDER_HPP
@@ -7,7 +7,9 @@
 // certain rights in this software.
 
 #include "BinarySwapTelescoping.hpp"
-#include "../Base/BinarySwapBase.hpp"
+
+#include <Common/ImageFull.hpp>
+#include <Common/ImageSparse.hpp>
 
 #include <array>
 
@@ -42,11 +44,13 @@ static int imagePieceToRank(int piece, int numProc) {
   return rankToImagePiece(piece, numProc);
 }
 
-static std::unique_ptr<const Image> getSubregion(const Image &image,
-                                                 int pieceIndex,
-                                                 int numPieces) {
+static void getSubregionRange(int numPixels,
+                              int pieceIndex,
+                              int numPieces,
+                              int &subRegionBeginOut,
+                              int &subRegionEndOut) {
   int subRegionBegin = 0;
-  int subRegionEnd = image.getNumberOfPixels();
+  int subRegionEnd = numPixels;
 
   // We have to be careful about how we break up the subregions of the image.
   // We need to make sure we match how binary-swap does it.
@@ -61,6 +65,20 @@ static std::unique_ptr<const Image> getSubregion(const Image &image,
     }
   }
 
+  subRegionBeginOut = subRegionBegin;
+  subRegionEndOut = subRegionEnd;
+}
+
+static std::unique_ptr<const Image> getSubregion(const Image &image,
+                                                 int pieceIndex,
+                                                 int numPieces) {
+  int subRegionBegin;
+  int subRegionEnd;
+  getSubregionRange(image.getNumberOfPixels(),
+                    pieceIndex,
+                    numPieces,
+                    subRegionBegin,
+                    subRegionEnd);
   return image.window(subRegionBegin, subRegionEnd);
 }
 
@@ -75,12 +93,154 @@ static int getRealRank(MPI_Group group, int rank, MPI_Comm communicator) {
   return realRank;
 }
 
-std::unique_ptr<Image> BinarySwapTelescoping::composeBigGroup(
-    Image *localImage,
+// Returns the image in compressed or full form.
+static std::unique_ptr<const Image> toForm(const Image &image,
+                                           bool compressed) {
+  const ImageSparse *sparseImage = dynamic_cast<const ImageSparse *>(&image);
+  if (compressed && (sparseImage == nullptr)) {
+    return dynamic_cast<const ImageFull &>(image).compress();
+  } else if (!compressed && (sparseImage != nullptr)) {
+    return sparseImage->uncompress();
+  } else {
+    return image.shallowCopy();
+  }
+}
+
+namespace {
+
+// Receives the pieces of the little group's images in the big group and blends
+// them in. The little group's images go underneath everything in the big
+// group. If blending is order dependent, they can only be blended at the end.
+// Otherwise, they are blended in the round of the binary-swap that keeps
+// halves of the same region as the pieces (the last round) if they have
+// arrived by then, while the partner's halves are still in flight.
+class BlendLittleGroupPieces : public BinarySwapBase::RoundHook {
+  bool canBlendEarly;
+  bool blended;
+  std::vector<std::unique_ptr<Image>> littleImages;
+  std::vector<MPI_Request> littleRequests;
+
+ public:
+  explicit BlendLittleGroupPieces(bool _canBlendEarly)
+      : canBlendEarly(_canBlendEarly), blended(false) {}
+
+  void receive(std::unique_ptr<Image> &&littleImage,
+               int realSourceRank,
+               MPI_Comm communicator) {
+    std::vector<MPI_Request> newRequests =
+        littleImage->IReceive(realSourceRank, communicator);
+    this->littleRequests.insert(
+        this->littleRequests.end(), newRequests.begin(), newRequests.end());
+    this->littleImages.push_back(std::move(littleImage));
+  }
+
+  void roundStarted(std::vector<std::unique_ptr<const Image>> &toKeep) final {
+    if (this->blended) {
+      return;
+    }
+
+    // Testing also lets the transfer make progress during the binary-swap.
+    int arrived;
+    MPI_Testall(this->littleRequests.size(),
+                this->littleRequests.data(),
+                &arrived,
+                MPI_STATUSES_IGNORE);
+    if (!arrived || !this->canBlendEarly ||
+        (toKeep.front()->getRegionBegin() !=
+         this->littleImages.front()->getRegionBegin()) ||
+        (toKeep.front()->getRegionEnd() !=
+         this->littleImages.front()->getRegionEnd())) {
+      return;
+    }
+
+    for (std::size_t imageIndex = 0; imageIndex < toKeep.size(); ++imageIndex) {
+      toKeep[imageIndex] =
+          toKeep[imageIndex]->blend(*this->littleImages[imageIndex]);
+    }
+    this->blended = true;
+  }
+
+  // Blends in the pieces that could not be blended during the binary-swap.
+  void finish(std::vector<std::unique_ptr<Image>> &images) {
+    if (this->blended) {
+      return;
+    }
+    MPI_Waitall(this->littleRequests.size(),
+                this->littleRequests.data(),
+                MPI_STATUSES_IGNORE);
+    for (std::size_t imageIndex = 0; imageIndex < images.size(); ++imageIndex) {
+      images[imageIndex] =
+          images[imageIndex]->blend(*this->littleImages[imageIndex]);
+    }
+    this->blended = true;
+  }
+};
+
+// Sends the pieces of the little group's composite to the processes of the big
+// group holding the corresponding pieces as soon as the composite is done.
+class SendPiecesToBigGroup : public BinarySwapBase::RoundHook {
+  MPI_Group bigGroup;
+  MPI_Comm communicator;
+  int bigGroupSize;
+  int firstCorrespondingPieceIndex;
+  int numPieces;
+  bool sendCompressed;
+  std::vector<std::unique_ptr<const Image>> images;
+  std::vector<std::unique_ptr<const Image>> subImages;
+  std::vector<MPI_Request> sendRequests;
+
+ public:
+  SendPiecesToBigGroup(MPI_Group _bigGroup,
+                       MPI_Comm _communicator,
+                       int _bigGroupSize,
+                       int _firstCorrespondingPieceIndex,
+                       int _numPieces,
+                       bool _sendCompressed)
+      : bigGroup(_bigGroup),
+        communicator(_communicator),
+        bigGroupSize(_bigGroupSize),
+        firstCorrespondingPieceIndex(_firstCorrespondingPieceIndex),
+        numPieces(_numPieces),
+        sendCompressed(_sendCompressed) {}
+
+  void imagesFinished(
+      const std::vector<std::unique_ptr<Image>> &finishedImages) final {
+    for (auto &&finishedImage : finishedImages) {
+      // The big group receives pieces in the form of the local images, but
+      // automatic compression can leave the composite in the other form.
+      this->images.push_back(toForm(*finishedImage, this->sendCompressed));
+      for (int subPieceIndex = 0; subPieceIndex < this->numPieces;
+           ++subPieceIndex) {
+        this->subImages.push_back(
+            getSubregion(*this->images.back(), subPieceIndex, this->numPieces));
+        int destRank = imagePieceToRank(
+            this->firstCorrespondingPieceIndex + subPieceIndex,
+            this->bigGroupSize);
+        std::vector<MPI_Request> newRequests = this->subImages.back()->ISend(
+            getRealRank(this->bigGroup, destRank, this->communicator),
+            this->communicator);
+        this->sendRequests.insert(
+            this->sendRequests.end(), newRequests.begin(), newRequests.end());
+      }
+    }
+  }
+
+  void wait() {
+    MPI_Waitall(this->sendRequests.size(),
+                this->sendRequests.data(),
+                MPI_STATUSES_IGNORE);
+  }
+};
+
+}  // anonymous namespace
+
+std::vector<std::unique_ptr<Image>> BinarySwapTelescoping::composeBigGroup(
+    const std::vector<Image *> &localImages,
     MPI_Group bigGroup,
     MPI_Group littleGroup,
     MPI_Comm communicator,
-    YamlWriter &yaml) {
+    YamlWriter &yaml,
+    BinarySwapBase::RoundHook &roundHook) {
   int myGroupRank;
   MPI_Group_rank(bigGroup, &myGroupRank);
   assert(myGroupRank != MPI_UNDEFINED);
@@ -93,15 +253,11 @@ std::unique_ptr<Image> BinarySwapTelescoping::composeBigGroup(
   // All data will be in the biggest power-of-two partition.
   otherGroupSize = getLargestPowerOfTwoNoBiggerThan(otherGroupSize);
 
-  // Start by doing a normal binary swap.
-  std::unique_ptr<Image> composedImage =
-      BinarySwapBase().compose(localImage, bigGroup, communicator, yaml);
-
   // Figure out how many image pieces each process in the little group holds.
   int numImagePiecesInEachLittleProc = myGroupSize / otherGroupSize;
 
   // The ordering that binary-swap leaves image pieces is weird. Figure out
-  // which piece I have.
+  // which piece I will have.
   int myPieceIndex = rankToImagePiece(myGroupRank, myGroupSize);
 
   // The little group has different piece indexing since it has fewer large
@@ -111,21 +267,47 @@ std::unique_ptr<Image> BinarySwapTelescoping::composeBigGroup(
   // Figure out which rank in the little group has my corresponding piece.
   int correspondingRank =
       imagePieceToRank(correspondingPieceIndex, otherGroupSize);
+  int realCorrespondingRank =
+      getRealRank(littleGroup, correspondingRank, communicator);
+
+  // Post the receives for the little group's pieces before starting on the
+  // binary swap so that the transfers can happen while we are swapping.
+  BlendLittleGroupPieces blendLittlePieces(
+      !localImages.front()->blendIsOrderDependent());
+  for (auto &&localImage : localImages) {
+    int pieceBegin;
+    int pieceEnd;
+    getSubregionRange(localImage->getNumberOfPixels(),
+                      myPieceIndex,
+                      myGroupSize,
+                      pieceBegin,
+                      pieceEnd);
+    blendLittlePieces.receive(
+        localImage->createNew(pieceBegin + localImage->getRegionBegin(),
+                              pieceEnd + localImage->getRegionBegin()),
+        realCorrespondingRank,
+        communicator);
+  }
 
-  // Now receive the image and blend it into my own.
-  std::unique_ptr<Image> incomingImage = composedImage->createNew();
-  incomingImage->Receive(
-      getRealRank(littleGroup, correspondingRank, communicator), communicator);
-  composedImage = composedImage->blend(*incomingImage);
+  // Now do a binary swap in the big group, which blends in the little
+  // group's pieces along the way if it can.
+  std::vector<std::unique_ptr<Image>> resultImages =
+      BinarySwapBase(this->getAutoCompressThreshold())
+          .composeManyWithHook(
+              localImages, bigGroup, communicator, yaml, blendLittlePieces);
+  blendLittlePieces.finish(resultImages);
 
-  return composedImage;
+  roundHook.imagesFinished(resultImages);
+
+  return resultImages;
 }
 
-void BinarySwapTelescoping::composeLittleGroup(Image *localImage,
-                                               MPI_Group bigGroup,
-                                               MPI_Group littleGroup,
-                                               MPI_Comm communicator,
-                                               YamlWriter &yaml) {
+void BinarySwapTelescoping::composeLittleGroup(
+    const std::vector<Image *> &localImages,
+    MPI_Group bigGroup,
+    MPI_Group littleGroup,
+    MPI_Comm communicator,
+    YamlWriter &yaml) {
   int myGroupRank;
   MPI_Group_rank(littleGroup, &myGroupRank);
   assert(myGroupRank != MPI_UNDEFINED);
@@ -136,60 +318,72 @@ void BinarySwapTelescoping::composeLittleGroup(Image *localImage,
   int otherGroupSize;
   MPI_Group_size(bigGroup, &otherGroupSize);
 
-  // Recursively call myself to composite my group.
-  std::unique_ptr<Image> composedImage =
-      this->compose(localImage, littleGroup, communicator, yaml);
-
-  // The compose method will only return an image in the top power-of-two
-  // processes. The rest are empty. The rest of this function only deals with
-  // this part of the group.
-  myGroupSize = getLargestPowerOfTwoNoBiggerThan(myGroupSize);
-  if (myGroupSize <= myGroupRank) {
-    assert(composedImage->getNumberOfPixels() == 0);
-    return;
-  }
+  // The composite of my group will only be in the top power-of-two
+  // processes. The rest of this function only matters to this part of the
+  // group.
+  int topGroupSize = getLargestPowerOfTwoNoBiggerThan(myGroupSize);
 
   // Figure out how many pieces I have to break up my image into.
-  int numImagePiecesInEachLittleProc = otherGroupSize / myGroupSize;
+  int numImagePiecesInEachLittleProc = otherGroupSize / topGroupSize;
 
   // The ordering that binary-swap leaves image pieces is weird. Figure out
   // which piece I have.
-  int myPieceIndex = rankToImagePiece(myGroupRank, myGroupSize);
+  int myPieceIndex = rankToImagePiece(myGroupRank, topGroupSize);
 
   // The big group has different piece indexing since it has more small
   // pieces. Figure out the index of the first piece that I have.
   int firstCorrespondingPieceIndex =
       myPieceIndex * numImagePiecesInEachLittleProc;
 
-  std::vector<std::unique_ptr<const Image>> subImages;
-  std::vector<MPI_Request> sendRequests;
-  for (int subPieceIndex = 0; subPieceIndex < numImagePiecesInEachLittleProc;
-       ++subPieceIndex) {
-    subImages.push_back(getSubregion(
-        *composedImage, subPieceIndex, numImagePiecesInEachLittleProc));
-    int destRank = imagePieceToRank(
-        firstCorrespondingPieceIndex + subPieceIndex, otherGroupSize);
-    std::vector<MPI_Request> newRequests = subImages.back()->ISend(
-        getRealRank(bigGroup, destRank, communicator), communicator);
-    sendRequests.insert(
-        sendRequests.end(), newRequests.begin(), newRequests.end());
-  }
+  // Recursively call myself to composite my group. The pieces are sent to
+  // the big group as soon as the composite is done.
+  bool sendCompressed =
+      (dynamic_cast<const ImageSparse *>(localImages.front()) != nullptr);
+  SendPiecesToBigGroup sendPieces(bigGroup,
+                                  communicator,
+                                  otherGroupSize,
+                                  firstCorrespondingPieceIndex,
+                                  numImagePiecesInEachLittleProc,
+                                  sendCompressed);
+  this->composeWithHook(
+      localImages, littleGroup, communicator, yaml, sendPieces);
 
   // Wait for everything to finish sending.
-  MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+  sendPieces.wait();
 }
 
 std::unique_ptr<Image> BinarySwapTelescoping::compose(Image *localImage,
                                                       MPI_Group group,
                                                       MPI_Comm communicator,
                                                       YamlWriter &yaml) {
+  std::vector<Image *> localImages(1, localImage);
+  return std::move(
+      this->composeMany(localImages, group, communicator, yaml).front());
+}
+
+std::vector<std::unique_ptr<Image>> BinarySwapTelescoping::composeMany(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    YamlWriter &yaml) {
+  BinarySwapBase::RoundHook noHook;
+  return this->composeWithHook(
+      localImages, group, communicator, yaml, noHook);
+}
+
+std::vector<std::unique_ptr<Image>> BinarySwapTelescoping::composeWithHook(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    YamlWriter &yaml,
+    BinarySwapBase::RoundHook &roundHook) {
   // The base binary-swap algorithm only operates on process groups with a size
   // of a power-of-two. This compositing algorithm first identifies a large
   // subgroup that is a power-of-two and runs the base binary-swap on that
   // partition. Concurrently, it recursively calls the telescoping method on
   // the remaining partition. After both complete, image pieces from the
   // smaller group are transferred to corresponding processes in the larger
-  // group.
+  // group. The given hook is told when the images are finished.
 
   int originalGroupSize;
   MPI_Group_size(group, &originalGroupSize);
@@ -199,7 +393,8 @@ std::unique_ptr<Image> BinarySwapTelescoping::compose(Image *localImage,
   // Special case: we already have a power of two. Just call the base
   // binary-swap and return.
   if (targetGroupSize == originalGroupSize) {
-    return BinarySwapBase().compose(localImage, group, communicator, yaml);
+    return BinarySwapBase(this->getAutoCompressThreshold())
+        .composeManyWithHook(localImages, group, communicator, yaml, roundHook);
   }
 
   // Split up the group into two partitions.
@@ -216,20 +411,22 @@ std::unique_ptr<Image> BinarySwapTelescoping::compose(Image *localImage,
   int bigGroupRank;
   MPI_Group_rank(bigGroup, &bigGroupRank);
 
-  std::unique_ptr<Image> resultImage;
+  std::vector<std::unique_ptr<Image>> resultImages;
 
   if (bigGroupRank != MPI_UNDEFINED) {
-    resultImage = this->composeBigGroup(
-        localImage, bigGroup, littleGroup, communicator, yaml);
+    resultImages = this->composeBigGroup(
+        localImages, bigGroup, littleGroup, communicator, yaml, roundHook);
   } else {
     this->composeLittleGroup(
-        localImage, bigGroup, littleGroup, communicator, yaml);
-    resultImage = localImage->copySubrange(0, 0);
+        localImages, bigGroup, littleGroup, communicator, yaml);
+    for (auto &&localImage : localImages) {
+      resultImages.push_back(localImage->copySubrange(0, 0));
+    }
   }
 
   // Cleanup
   MPI_Group_free(&bigGroup);
   MPI_Group_free(&littleGroup);
 
-  return resultImage;
+  return resultImages;
 }
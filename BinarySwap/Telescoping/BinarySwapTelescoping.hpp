@@ -11,14 +11,24 @@
 
 #include <Common/Compositor.hpp>
 
+#include "../Base/BinarySwapBase.hpp"
+
 class BinarySwapTelescoping : public Compositor {
  private:
-  std::unique_ptr<Image> composeBigGroup(Image *localImage,
-                                         MPI_Group bigGroup,
-                                         MPI_Group littleGroup,
-                                         MPI_Comm communicator,
-                                         YamlWriter &yaml);
-  void composeLittleGroup(Image *localImage,
+  std::vector<std::unique_ptr<Image>> composeWithHook(
+      const std::vector<Image *> &localImages,
+      MPI_Group group,
+      MPI_Comm communicator,
+      YamlWriter &yaml,
+      BinarySwapBase::RoundHook &roundHook);
+  std::vector<std::unique_ptr<Image>> composeBigGroup(
+      const std::vector<Image *> &localImages,
+      MPI_Group bigGroup,
+      MPI_Group littleGroup,
+      MPI_Comm communicator,
+      YamlWriter &yaml,
+      BinarySwapBase::RoundHook &roundHook);
+  void composeLittleGroup(const std::vector<Image *> &localImages,
                           MPI_Group bigGroup,
                           MPI_Group littleGroup,
                           MPI_Comm communicator,
@@ -29,6 +39,12 @@ class BinarySwapTelescoping : public Compositor {
                                  MPI_Group group,
                                  MPI_Comm communicator,
                                  YamlWriter &yaml) final;
+
+  std::vector<std::unique_ptr<Image>> composeMany(
+      const std::vector<Image *> &localImages,
+      MPI_Group group,
+      MPI_Comm communicator,
+      YamlWriter &yaml) final;
 };
 
 #endif  // BINARYSWAPTELESCOPING_HPP
@@ -29,6 +29,7 @@ get_filename_component(miniGraphics_SOURCE_DIR
   )
 
 find_package(MPI REQUIRED)
+find_package(Threads REQUIRED)
 
 # Create the config header file
 function(miniGraphics_create_config_header miniapp_name)
@@ -53,6 +54,7 @@ function(miniGraphics_target_features target_name)
   set(libs
     ${MPI_CXX_LINK_FLAGS}
     ${MPI_CXX_LIBRARIES}
+    ${CMAKE_THREAD_LIBS_INIT}
     )
 
   set(cxx_flags
@@ -0,0 +1,293 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include "AutoCompress.hpp"
+
+#include <Common/ImageSparse.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <limits>
+
+constexpr int AUTO_COMPRESS_TAG = 47305;
+
+constexpr int CALIBRATION_RATIO_STEPS = 10;
+constexpr int CALIBRATION_TRIALS = 3;
+
+// Active pixels of the synthetic images come in runs that repeat with this
+// period, much like the spans of a rendered object.
+constexpr int CALIBRATION_RUN_PERIOD = 64;
+
+// The cost of blending and sending grows linearly with the number of pixels,
+// so a piece of the image is enough to compare the two forms.
+constexpr int CALIBRATION_MAX_PIXELS = 65536;
+
+// Full images have to be scanned to find their active pixels. Checking every
+// few pixels is enough to estimate the fraction, and an odd stride keeps the
+// samples from lining up with the columns of the image.
+constexpr int ACTIVE_PIXEL_SAMPLE_STRIDE = 7;
+
+template <typename Operation>
+static double timeOperation(Operation operation) {
+  double bestSeconds = std::numeric_limits<double>::max();
+  for (int trial = 0; trial < CALIBRATION_TRIALS; ++trial) {
+    std::chrono::high_resolution_clock::time_point startTime =
+        std::chrono::high_resolution_clock::now();
+
+    operation();
+
+    std::chrono::duration<double> secondsElapsed =
+        std::chrono::high_resolution_clock::now() - startTime;
+    bestSeconds = std::min(bestSeconds, secondsElapsed.count());
+  }
+  return bestSeconds;
+}
+
+static std::unique_ptr<ImageFull> createCalibrationImage(
+    const ImageFull& sampleImage,
+    float activeRatio,
+    int runOffset,
+    float depth) {
+  std::unique_ptr<Image> imageHolder = sampleImage.createNew(
+      0, std::min(sampleImage.getNumberOfPixels(), CALIBRATION_MAX_PIXELS));
+  ImageFull* image = dynamic_cast<ImageFull*>(imageHolder.get());
+  assert((image != NULL) && "Internal error: createNew bad type.");
+  image->clear();
+
+  int runLength =
+      static_cast<int>(activeRatio * CALIBRATION_RUN_PERIOD + 0.5f);
+  // Partially transparent, so that images without depth really blend.
+  Color color(0.5f, 0.25f, 0.125f, 0.5f);
+  int numPixels = image->getNumberOfPixels();
+  for (int pixelIndex = 0; pixelIndex < numPixels; ++pixelIndex) {
+    if (((pixelIndex + runOffset) % CALIBRATION_RUN_PERIOD) < runLength) {
+      image->setColor(pixelIndex, color);
+      image->setDepth(pixelIndex, depth);
+    }
+  }
+
+  imageHolder.release();
+  return std::unique_ptr<ImageFull>(image);
+}
+
+// Returns the time to exchange the given image with a neighboring process
+// divided by the size of the image.
+static double measureSecondsPerByte(const ImageFull& image,
+                                    MPI_Comm communicator) {
+  int rank;
+  MPI_Comm_rank(communicator, &rank);
+  int numProc;
+  MPI_Comm_size(communicator, &numProc);
+
+  int partnerRank = rank ^ 1;
+  if (partnerRank >= numProc) {
+    // The last process of an odd count has no neighbor and waits for the
+    // others in the reduction.
+    return 0.0;
+  }
+
+  std::unique_ptr<Image> recvImage = image.createNew();
+  double seconds = timeOperation([&]() {
+    std::vector<MPI_Request> requests =
+        recvImage->IReceive(partnerRank, communicator);
+    std::vector<MPI_Request> sendRequests =
+        image.ISend(partnerRank, communicator);
+    requests.insert(requests.end(), sendRequests.begin(), sendRequests.end());
+    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+  });
+
+  return seconds / std::max<std::size_t>(image.getDataSize(), 1);
+}
+
+float calibrateAutoCompress(const ImageFull& sampleImage,
+                            MPI_Comm communicator,
+                            YamlWriter& yaml) {
+  std::vector<double> measurements(2 * CALIBRATION_RATIO_STEPS + 1);
+  std::vector<std::size_t> fullBytes(CALIBRATION_RATIO_STEPS);
+  std::vector<std::size_t> compressedBytes(CALIBRATION_RATIO_STEPS);
+
+  for (int step = 0; step < CALIBRATION_RATIO_STEPS; ++step) {
+    float activeRatio = static_cast<float>(step + 1) / CALIBRATION_RATIO_STEPS;
+    std::unique_ptr<ImageFull> topImage =
+        createCalibrationImage(sampleImage, activeRatio, 0, 0.25f);
+    std::unique_ptr<ImageFull> bottomImage = createCalibrationImage(
+        sampleImage, activeRatio, CALIBRATION_RUN_PERIOD / 2, 0.5f);
+    std::unique_ptr<ImageSparse> compressedTop = topImage->compress();
+    std::unique_ptr<ImageSparse> compressedBottom = bottomImage->compress();
+    fullBytes[step] = topImage->getDataSize();
+    compressedBytes[step] = compressedTop->getDataSize();
+
+    measurements[2 * step] =
+        timeOperation([&]() { topImage->blend(*bottomImage); });
+    measurements[2 * step + 1] =
+        timeOperation([&]() { compressedTop->blend(*compressedBottom); });
+  }
+
+  std::unique_ptr<ImageFull> sendImage =
+      createCalibrationImage(sampleImage, 1.0f, 0, 0.25f);
+  measurements.back() = measureSecondsPerByte(*sendImage, communicator);
+
+  // Every process has to come to the same decision, and a round takes as
+  // long as the slowest process.
+  MPI_Allreduce(MPI_IN_PLACE,
+                measurements.data(),
+                static_cast<int>(measurements.size()),
+                MPI_DOUBLE,
+                MPI_MAX,
+                communicator);
+  double secondsPerByte = measurements.back();
+
+  // Compressed images are cheaper at low fractions of active pixels. The
+  // threshold is the largest fraction before they stop being cheaper.
+  float threshold = 0.0f;
+  bool compressedCheaper = true;
+
+  yaml.StartBlock("auto-compress-calibration");
+  for (int step = 0; step < CALIBRATION_RATIO_STEPS; ++step) {
+    float activeRatio = static_cast<float>(step + 1) / CALIBRATION_RATIO_STEPS;
+    double fullSeconds =
+        measurements[2 * step] + fullBytes[step] * secondsPerByte;
+    double compressedSeconds =
+        measurements[2 * step + 1] + compressedBytes[step] * secondsPerByte;
+
+    yaml.StartListItem();
+    yaml.AddDictionaryEntry("active-ratio", activeRatio);
+    yaml.AddDictionaryEntry("full-seconds", fullSeconds);
+    yaml.AddDictionaryEntry("compressed-seconds", compressedSeconds);
+
+    if (compressedCheaper && (compressedSeconds <= fullSeconds)) {
+      threshold = activeRatio;
+    } else {
+      compressedCheaper = false;
+    }
+  }
+  yaml.EndBlock();
+
+  yaml.AddDictionaryEntry("auto-compress-threshold", threshold);
+  return threshold;
+}
+
+bool chooseAutoCompress(const std::vector<std::unique_ptr<Image>>& images,
+                        float threshold,
+                        const std::vector<int>& realPeerRanks,
+                        MPI_Comm communicator,
+                        float& activeRatioOut) {
+  std::vector<Image*> imagePointers;
+  imagePointers.reserve(images.size());
+  for (auto&& image : images) {
+    imagePointers.push_back(image.get());
+  }
+  return chooseAutoCompress(
+      imagePointers, threshold, realPeerRanks, communicator, activeRatioOut);
+}
+
+// Counts the active pixels of the images (in localCounts[0]) and all their
+// pixels (in localCounts[1]).
+static void countActivePixels(const std::vector<Image*>& images,
+                              long long localCounts[2]) {
+  localCounts[0] = 0;
+  localCounts[1] = 0;
+  for (auto&& image : images) {
+    const ImageSparse* sparseImage = dynamic_cast<const ImageSparse*>(image);
+    const ImageFull* fullImage = dynamic_cast<const ImageFull*>(image);
+    if (sparseImage != nullptr) {
+      localCounts[0] += sparseImage->getNumberOfActivePixels();
+    } else if (fullImage != nullptr) {
+      // Count the foreground of full images too, so that images left
+      // uncompressed by an earlier round can go back to compressed once the
+      // pieces kept are mostly background.
+      localCounts[0] +=
+          fullImage->countActivePixels(ACTIVE_PIXEL_SAMPLE_STRIDE);
+    } else {
+      localCounts[0] += image->getNumberOfPixels();
+    }
+    localCounts[1] += image->getNumberOfPixels();
+  }
+}
+
+static bool chooseFromCounts(const long long counts[2],
+                             float threshold,
+                             float& activeRatioOut) {
+  activeRatioOut = (counts[1] > 0)
+                       ? static_cast<float>(counts[0]) / counts[1]
+                       : 0.0f;
+  return (activeRatioOut <= threshold);
+}
+
+bool chooseAutoCompress(const std::vector<Image*>& images,
+                        float threshold,
+                        const std::vector<int>& realPeerRanks,
+                        MPI_Comm communicator,
+                        float& activeRatioOut) {
+  long long localCounts[2];
+  countActivePixels(images, localCounts);
+
+  std::vector<long long> peerCounts(2 * realPeerRanks.size());
+  std::vector<MPI_Request> requests(2 * realPeerRanks.size());
+  for (std::size_t peer = 0; peer < realPeerRanks.size(); ++peer) {
+    MPI_Irecv(&peerCounts[2 * peer],
+              2,
+              MPI_LONG_LONG,
+              realPeerRanks[peer],
+              AUTO_COMPRESS_TAG,
+              communicator,
+              &requests[2 * peer]);
+    MPI_Isend(localCounts,
+              2,
+              MPI_LONG_LONG,
+              realPeerRanks[peer],
+              AUTO_COMPRESS_TAG,
+              communicator,
+              &requests[2 * peer + 1]);
+  }
+  MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+
+  long long counts[2] = {localCounts[0], localCounts[1]};
+  for (std::size_t peer = 0; peer < realPeerRanks.size(); ++peer) {
+    counts[0] += peerCounts[2 * peer];
+    counts[1] += peerCounts[2 * peer + 1];
+  }
+  return chooseFromCounts(counts, threshold, activeRatioOut);
+}
+
+bool chooseAutoCompress(const std::vector<Image*>& images,
+                        float threshold,
+                        MPI_Comm groupCommunicator,
+                        float& activeRatioOut) {
+  long long counts[2];
+  countActivePixels(images, counts);
+  MPI_Allreduce(
+      MPI_IN_PLACE, counts, 2, MPI_LONG_LONG, MPI_SUM, groupCommunicator);
+  return chooseFromCounts(counts, threshold, activeRatioOut);
+}
+
+bool autoCompressImages(std::vector<std::unique_ptr<Image>>& images,
+                        float threshold,
+                        const std::vector<int>& realPeerRanks,
+                        MPI_Comm communicator,
+                        float& activeRatioOut) {
+  bool compress = chooseAutoCompress(
+      images, threshold, realPeerRanks, communicator, activeRatioOut);
+  for (auto&& image : images) {
+    if (compress) {
+      const ImageFull* fullImage = dynamic_cast<const ImageFull*>(image.get());
+      if (fullImage != nullptr) {
+        image = fullImage->compress();
+      }
+    } else {
+      const ImageSparse* sparseImage =
+          dynamic_cast<const ImageSparse*>(image.get());
+      if (sparseImage != nullptr) {
+        image = sparseImage->uncompress();
+      }
+    }
+  }
+
+  return compress;
+}
@@ -0,0 +1,92 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef AUTOCOMPRESS_HPP
+#define AUTOCOMPRESS_HPP
+
+#include <Common/ImageFull.hpp>
+#include <Common/ImageSparse.hpp>
+#include <Common/YamlWriter.hpp>
+
+#include <memory>
+#include <vector>
+
+#include <mpi.h>
+
+/// \brief Finds the fraction of active pixels above which compressed images
+/// cost more to composite than full images.
+///
+/// Blending compressed images skips the inactive pixels, but the run length
+/// bookkeeping makes each active pixel more expensive. Compressed images also
+/// send less data. This function times the blending of full and compressed
+/// images of the same type as \a sampleImage at several fractions of active
+/// pixels, as well as sending an image to a neighboring process, and returns
+/// the largest fraction at which compressed images are still cheaper. All
+/// processes of \a communicator must call this, and they all get the same
+/// value. The measurements are written to \a yaml.
+///
+float calibrateAutoCompress(const ImageFull& sampleImage,
+                            MPI_Comm communicator,
+                            YamlWriter& yaml);
+
+/// \brief Decides whether images should be compressed for a round.
+///
+/// This makes the same decision as \c autoCompressImages (and must be called
+/// by the same processes) but leaves the images alone, for compositors that
+/// convert the images themselves, for example with \c
+/// ImageFull::compressInto. Returns true if the images should be compressed.
+///
+bool chooseAutoCompress(const std::vector<std::unique_ptr<Image>>& images,
+                        float threshold,
+                        const std::vector<int>& realPeerRanks,
+                        MPI_Comm communicator,
+                        float& activeRatioOut);
+
+/// Like the \c chooseAutoCompress above, but for images held elsewhere.
+bool chooseAutoCompress(const std::vector<Image*>& images,
+                        float threshold,
+                        const std::vector<int>& realPeerRanks,
+                        MPI_Comm communicator,
+                        float& activeRatioOut);
+
+/// \brief Decides whether images should be compressed, over a whole group.
+///
+/// Like the \c chooseAutoCompress above, but the pixel counts are summed
+/// over all processes of \a groupCommunicator with a single \c
+/// MPI_Allreduce, which all of them must call. Use this when every process
+/// of a group exchanges images with every other one (as in a direct send)
+/// rather than exchanging counts with each peer.
+bool chooseAutoCompress(const std::vector<Image*>& images,
+                        float threshold,
+                        MPI_Comm groupCommunicator,
+                        float& activeRatioOut);
+
+/// \brief Converts images to the cheaper representation for a round.
+///
+/// Compositors call this at the start of each round when images are
+/// compressed automatically (see \c Compositor::getAutoCompressThreshold).
+/// The processes exchanging images in a round must agree on the
+/// representation, so the number of active pixels is shared with the
+/// processes in \a realPeerRanks (ranks in \a communicator), which must in
+/// turn list this process. Each peer gets its own message, so this suits a
+/// few partners (such as the pair of a binary-swap round). The active pixels
+/// of full images (those that are not background) are estimated from a
+/// sample of their pixels. If the fraction of active pixels over all these
+/// processes is above \a threshold, compressed images are uncompressed.
+/// Otherwise, full images are compressed.
+///
+/// Returns true if the images are compressed for the round. The fraction of
+/// active pixels is returned in \a activeRatioOut.
+///
+bool autoCompressImages(std::vector<std::unique_ptr<Image>>& images,
+                        float threshold,
+                        const std::vector<int>& realPeerRanks,
+                        MPI_Comm communicator,
+                        float& activeRatioOut);
+
+#endif  // AUTOCOMPRESS_HPP
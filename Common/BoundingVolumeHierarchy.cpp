@@ -0,0 +1,427 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include "BoundingVolumeHierarchy.hpp"
+
+#include <Common/Mesh.hpp>
+
+#include <glm/common.hpp>
+#include <glm/vec2.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+// Planes are tested with this relative tolerance so that rounding never culls
+// a box that touches the frustum.
+constexpr float PLANE_TOLERANCE = 1e-5f;
+
+// Centroids are sorted into this many bins along each axis to choose where
+// to split a node.
+constexpr int NUM_SPLIT_BINS = 16;
+
+// Nodes this deep or deeper are split at the median, which halves them. This
+// bounds the depth of the tree (below MAX_TRAVERSAL_DEPTH) however unevenly
+// the surface area heuristic splits the nodes above them.
+constexpr int MAX_HEURISTIC_DEPTH = 24;
+
+// Returns how many times a node of numTriangles can be halved before it is
+// small enough to be a leaf.
+static constexpr int numMedianSplits(long long numTriangles) {
+  return (numTriangles <= BoundingVolumeHierarchy::MAX_LEAF_TRIANGLES)
+             ? 0
+             : 1 + numMedianSplits((numTriangles + 1) / 2);
+}
+
+// The deepest a leaf can be. Triangles are counted in an int, so no node
+// split at the median has more than that many.
+constexpr int MAX_TREE_DEPTH =
+    MAX_HEURISTIC_DEPTH + numMedianSplits(std::numeric_limits<int>::max());
+
+// A depth-first traversal holds at most one pending sibling for each level
+// above the node it visits plus the two children it pushes.
+static_assert(MAX_TREE_DEPTH + 1 <=
+                  BoundingVolumeHierarchy::MAX_TRAVERSAL_DEPTH,
+              "Traversal stack too small for the depth of the hierarchy.");
+
+namespace {
+
+enum class BoxInFrustum { OUTSIDE, INTERSECTING, INSIDE };
+
+// The six planes bounding the view frustum, in world coordinates. A point p is
+// inside a plane when dot(plane, (p, 1)) >= 0.
+struct FrustumPlanes {
+  std::array<glm::vec4, 6> planes;
+
+  explicit FrustumPlanes(const glm::mat4 &transform) {
+    // Rows of the transform (glm matrices are column major).
+    glm::vec4 rows[4];
+    for (int row = 0; row < 4; ++row) {
+      rows[row] = glm::vec4(transform[0][row],
+                            transform[1][row],
+                            transform[2][row],
+                            transform[3][row]);
+    }
+    // In clip space, the frustum is -w <= x,y,z <= w.
+    for (int axis = 0; axis < 3; ++axis) {
+      this->planes[2 * axis] = rows[3] + rows[axis];
+      this->planes[2 * axis + 1] = rows[3] - rows[axis];
+    }
+  }
+
+  BoxInFrustum classify(const glm::vec3 &boundsMin,
+                        const glm::vec3 &boundsMax) const {
+    bool inside = true;
+    for (const glm::vec4 &plane : this->planes) {
+      // Corners of the box farthest along and against the plane normal.
+      glm::vec3 farCorner(plane.x > 0 ? boundsMax.x : boundsMin.x,
+                          plane.y > 0 ? boundsMax.y : boundsMin.y,
+                          plane.z > 0 ? boundsMax.z : boundsMin.z);
+      glm::vec3 nearCorner(plane.x > 0 ? boundsMin.x : boundsMax.x,
+                           plane.y > 0 ? boundsMin.y : boundsMax.y,
+                           plane.z > 0 ? boundsMin.z : boundsMax.z);
+      glm::vec3 farTerms = glm::vec3(plane) * farCorner;
+      float farDistance = farTerms.x + farTerms.y + farTerms.z + plane.w;
+      float tolerance =
+          PLANE_TOLERANCE * (std::abs(farTerms.x) + std::abs(farTerms.y) +
+                             std::abs(farTerms.z) + std::abs(plane.w));
+      if (farDistance < -tolerance) {
+        return BoxInFrustum::OUTSIDE;
+      }
+      glm::vec3 nearTerms = glm::vec3(plane) * nearCorner;
+      float nearDistance = nearTerms.x + nearTerms.y + nearTerms.z + plane.w;
+      if (nearDistance < tolerance) {
+        inside = false;
+      }
+    }
+    return inside ? BoxInFrustum::INSIDE : BoxInFrustum::INTERSECTING;
+  }
+};
+
+// A bin of centroids along one axis.
+struct SplitBin {
+  glm::vec3 boundsMin;
+  glm::vec3 boundsMax;
+  int numTriangles;
+};
+
+}  // anonymous namespace
+
+static void growBounds(const Mesh &mesh,
+                       int triangleIndex,
+                       glm::vec3 &boundsMin,
+                       glm::vec3 &boundsMax) {
+  const int *connections = mesh.getTriangleConnectionsBuffer(triangleIndex);
+  for (int vertex = 0; vertex < 3; ++vertex) {
+    const float *point = mesh.getPointCoordinatesBuffer(connections[vertex]);
+    glm::vec3 p(point[0], point[1], point[2]);
+    boundsMin = glm::min(boundsMin, p);
+    boundsMax = glm::max(boundsMax, p);
+  }
+}
+
+// Half the surface area of a box, which is proportional to the chance that a
+// random ray through its parent hits it.
+static float halfSurfaceArea(const glm::vec3 &boundsMin,
+                             const glm::vec3 &boundsMax) {
+  glm::vec3 extent = boundsMax - boundsMin;
+  return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+}
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(const Mesh &mesh)
+    : numMeshTriangles(mesh.getNumberOfTriangles()) {
+  this->triangleIndices.resize(this->numMeshTriangles);
+  std::iota(this->triangleIndices.begin(), this->triangleIndices.end(), 0);
+
+  std::vector<glm::vec3> centroids(this->numMeshTriangles);
+  for (int triangleIndex = 0; triangleIndex < this->numMeshTriangles;
+       ++triangleIndex) {
+    const int *connections = mesh.getTriangleConnectionsBuffer(triangleIndex);
+    glm::vec3 sum(0.0f);
+    for (int vertex = 0; vertex < 3; ++vertex) {
+      const float *point = mesh.getPointCoordinatesBuffer(connections[vertex]);
+      sum += glm::vec3(point[0], point[1], point[2]);
+    }
+    centroids[triangleIndex] = sum / 3.0f;
+  }
+
+  if (this->numMeshTriangles > 0) {
+    this->nodes.reserve(
+        2 * (this->numMeshTriangles / MAX_LEAF_TRIANGLES + 1));
+    this->buildNode(mesh, centroids, 0, this->numMeshTriangles, 0);
+  }
+}
+
+int BoundingVolumeHierarchy::buildNode(const Mesh &mesh,
+                                       const std::vector<glm::vec3> &centroids,
+                                       int beginIndex,
+                                       int endIndex,
+                                       int depth) {
+  int nodeIndex = static_cast<int>(this->nodes.size());
+  this->nodes.push_back(Node());
+
+  glm::vec3 boundsMin(std::numeric_limits<float>::max());
+  glm::vec3 boundsMax(-std::numeric_limits<float>::max());
+  glm::vec3 centroidMin(std::numeric_limits<float>::max());
+  glm::vec3 centroidMax(-std::numeric_limits<float>::max());
+  for (int index = beginIndex; index < endIndex; ++index) {
+    int triangleIndex = this->triangleIndices[index];
+    growBounds(mesh, triangleIndex, boundsMin, boundsMax);
+    centroidMin = glm::min(centroidMin, centroids[triangleIndex]);
+    centroidMax = glm::max(centroidMax, centroids[triangleIndex]);
+  }
+
+  Node &node = this->nodes[nodeIndex];
+  node.boundsMin = boundsMin;
+  node.boundsMax = boundsMax;
+  node.firstTriangle = beginIndex;
+  node.numTriangles = endIndex - beginIndex;
+  node.secondChild = -1;
+
+  if ((endIndex - beginIndex) <= MAX_LEAF_TRIANGLES) {
+    return nodeIndex;
+  }
+
+  glm::vec3 extent = centroidMax - centroidMin;
+  int midIndex = -1;
+  if (depth < MAX_HEURISTIC_DEPTH) {
+    midIndex = this->partitionBySurfaceArea(
+        mesh, centroids, beginIndex, endIndex, centroidMin, extent);
+  }
+  if (midIndex < 0) {
+    // Split at the median centroid along the longest axis.
+    int axis = 0;
+    if (extent.y > extent[axis]) {
+      axis = 1;
+    }
+    if (extent.z > extent[axis]) {
+      axis = 2;
+    }
+    midIndex = beginIndex + (endIndex - beginIndex) / 2;
+    std::nth_element(this->triangleIndices.begin() + beginIndex,
+                     this->triangleIndices.begin() + midIndex,
+                     this->triangleIndices.begin() + endIndex,
+                     [&](int triangle1, int triangle2) {
+                       return centroids[triangle1][axis] <
+                              centroids[triangle2][axis];
+                     });
+  }
+
+  this->buildNode(mesh, centroids, beginIndex, midIndex, depth + 1);
+  int secondChild =
+      this->buildNode(mesh, centroids, midIndex, endIndex, depth + 1);
+  // The node vector may have grown, so look the node up again.
+  this->nodes[nodeIndex].secondChild = secondChild;
+  return nodeIndex;
+}
+
+int BoundingVolumeHierarchy::partitionBySurfaceArea(
+    const Mesh &mesh,
+    const std::vector<glm::vec3> &centroids,
+    int beginIndex,
+    int endIndex,
+    const glm::vec3 &centroidMin,
+    const glm::vec3 &centroidExtent) {
+  // The surface area heuristic estimates the cost of a split as the surface
+  // area of each side times its number of triangles. Only the splits between
+  // bins of centroids along each axis are tried.
+  float bestCost = std::numeric_limits<float>::max();
+  int bestAxis = -1;
+  int bestBin = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (!(centroidExtent[axis] > 0.0f)) {
+      continue;
+    }
+    float binScale = NUM_SPLIT_BINS / centroidExtent[axis];
+    SplitBin bins[NUM_SPLIT_BINS];
+    for (SplitBin &bin : bins) {
+      bin.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+      bin.boundsMax = glm::vec3(-std::numeric_limits<float>::max());
+      bin.numTriangles = 0;
+    }
+    for (int index = beginIndex; index < endIndex; ++index) {
+      int triangleIndex = this->triangleIndices[index];
+      float offset = centroids[triangleIndex][axis] - centroidMin[axis];
+      int binIndex = std::min(static_cast<int>(offset * binScale),
+                              NUM_SPLIT_BINS - 1);
+      SplitBin &bin = bins[binIndex];
+      growBounds(mesh, triangleIndex, bin.boundsMin, bin.boundsMax);
+      ++bin.numTriangles;
+    }
+
+    // Cost of everything above each bin, swept from the top.
+    float upperCost[NUM_SPLIT_BINS];
+    glm::vec3 upperMin(std::numeric_limits<float>::max());
+    glm::vec3 upperMax(-std::numeric_limits<float>::max());
+    int upperCount = 0;
+    for (int binIndex = NUM_SPLIT_BINS - 1; binIndex > 0; --binIndex) {
+      upperMin = glm::min(upperMin, bins[binIndex].boundsMin);
+      upperMax = glm::max(upperMax, bins[binIndex].boundsMax);
+      upperCount += bins[binIndex].numTriangles;
+      upperCost[binIndex] =
+          (upperCount > 0) ? upperCount * halfSurfaceArea(upperMin, upperMax)
+                           : 0.0f;
+    }
+
+    glm::vec3 lowerMin(std::numeric_limits<float>::max());
+    glm::vec3 lowerMax(-std::numeric_limits<float>::max());
+    int lowerCount = 0;
+    for (int binIndex = 0; binIndex < NUM_SPLIT_BINS - 1; ++binIndex) {
+      lowerMin = glm::min(lowerMin, bins[binIndex].boundsMin);
+      lowerMax = glm::max(lowerMax, bins[binIndex].boundsMax);
+      lowerCount += bins[binIndex].numTriangles;
+      if ((lowerCount == 0) || (lowerCount == endIndex - beginIndex)) {
+        continue;
+      }
+      float cost = lowerCount * halfSurfaceArea(lowerMin, lowerMax) +
+                   upperCost[binIndex + 1];
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestBin = binIndex;
+      }
+    }
+  }
+  if (bestAxis < 0) {
+    // All the centroids are in one place.
+    return -1;
+  }
+
+  float binScale = NUM_SPLIT_BINS / centroidExtent[bestAxis];
+  auto middle =
+      std::partition(this->triangleIndices.begin() + beginIndex,
+                     this->triangleIndices.begin() + endIndex,
+                     [&](int triangleIndex) {
+                       float offset = centroids[triangleIndex][bestAxis] -
+                                      centroidMin[bestAxis];
+                       return static_cast<int>(offset * binScale) <= bestBin;
+                     });
+  return static_cast<int>(middle - this->triangleIndices.begin());
+}
+
+void BoundingVolumeHierarchy::markTrianglesInFrustum(
+    const glm::mat4 &modelview,
+    const glm::mat4 &projection,
+    std::vector<char> &visibleOut) const {
+  visibleOut.assign(this->numMeshTriangles, 0);
+  if (this->nodes.empty()) {
+    return;
+  }
+
+  FrustumPlanes frustum(projection * modelview);
+
+  int stack[MAX_TRAVERSAL_DEPTH];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    int nodeIndex = stack[--stackSize];
+    const Node &node = this->nodes[nodeIndex];
+    BoxInFrustum inFrustum = frustum.classify(node.boundsMin, node.boundsMax);
+    if (inFrustum == BoxInFrustum::OUTSIDE) {
+      continue;
+    }
+    if ((inFrustum == BoxInFrustum::INSIDE) || node.isLeaf()) {
+      for (int index = node.firstTriangle;
+           index < node.firstTriangle + node.numTriangles;
+           ++index) {
+        visibleOut[this->triangleIndices[index]] = 1;
+      }
+      continue;
+    }
+    assert(stackSize + 2 <= MAX_TRAVERSAL_DEPTH);
+    stack[stackSize++] = node.secondChild;
+    stack[stackSize++] = nodeIndex + 1;
+  }
+}
+
+Viewport BoundingVolumeHierarchy::getProjectedViewport(
+    const glm::mat4 &modelview,
+    const glm::mat4 &projection,
+    int width,
+    int height) const {
+  Viewport wholeImage(0, 0, width - 1, height - 1);
+
+  glm::mat4 transform = projection * modelview;
+  FrustumPlanes frustum(transform);
+
+  glm::vec2 unionMin(std::numeric_limits<float>::max());
+  glm::vec2 unionMax(-std::numeric_limits<float>::max());
+
+  int stack[MAX_TRAVERSAL_DEPTH];
+  int stackSize = 0;
+  if (!this->nodes.empty()) {
+    stack[stackSize++] = 0;
+  }
+  while (stackSize > 0) {
+    int nodeIndex = stack[--stackSize];
+    const Node &node = this->nodes[nodeIndex];
+    if (frustum.classify(node.boundsMin, node.boundsMax) ==
+        BoxInFrustum::OUTSIDE) {
+      continue;
+    }
+
+    bool behindCamera = false;
+    glm::vec2 nodeMin(std::numeric_limits<float>::max());
+    glm::vec2 nodeMax(-std::numeric_limits<float>::max());
+    for (int corner = 0; corner < 8; ++corner) {
+      glm::vec4 point((corner & 1) ? node.boundsMax.x : node.boundsMin.x,
+                      (corner & 2) ? node.boundsMax.y : node.boundsMin.y,
+                      (corner & 4) ? node.boundsMax.z : node.boundsMin.z,
+                      1.0f);
+      glm::vec4 clip = transform * point;
+      if (!(clip.w > 0.0f)) {
+        behindCamera = true;
+        break;
+      }
+      glm::vec2 window((0.5f * clip.x / clip.w + 0.5f) * width,
+                       (0.5f * clip.y / clip.w + 0.5f) * height);
+      nodeMin = glm::min(nodeMin, window);
+      nodeMax = glm::max(nodeMax, window);
+    }
+
+    if (behindCamera) {
+      if (node.isLeaf()) {
+        // Triangles crossing the camera plane can cover anything.
+        return wholeImage;
+      }
+    } else {
+      if ((nodeMin.x >= unionMin.x) && (nodeMin.y >= unionMin.y) &&
+          (nodeMax.x <= unionMax.x) && (nodeMax.y <= unionMax.y)) {
+        // Nothing below this node can grow the viewport.
+        continue;
+      }
+      if (node.isLeaf()) {
+        unionMin = glm::min(unionMin, nodeMin);
+        unionMax = glm::max(unionMax, nodeMax);
+        continue;
+      }
+    }
+    assert(stackSize + 2 <= MAX_TRAVERSAL_DEPTH);
+    stack[stackSize++] = node.secondChild;
+    stack[stackSize++] = nodeIndex + 1;
+  }
+
+  if (unionMin.x > unionMax.x) {
+    return Viewport(width, height, -1, -1);
+  }
+
+  // Projecting here can round differently than painting, so pad by a pixel.
+  // Clamp before converting so that far away boxes do not overflow.
+  glm::vec2 clampMin(-1.0f);
+  glm::vec2 clampMax(static_cast<float>(width), static_cast<float>(height));
+  unionMin = glm::clamp(unionMin, clampMin, clampMax);
+  unionMax = glm::clamp(unionMax, clampMin, clampMax);
+  return Viewport(static_cast<int>(std::floor(unionMin.x)) - 1,
+                  static_cast<int>(std::floor(unionMin.y)) - 1,
+                  static_cast<int>(std::ceil(unionMax.x)) + 1,
+                  static_cast<int>(std::ceil(unionMax.y)) + 1)
+      .intersectWith(wholeImage);
+}
@@ -0,0 +1,115 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef BOUNDINGVOLUMEHIERARCHY_HPP
+#define BOUNDINGVOLUMEHIERARCHY_HPP
+
+#include <miniGraphicsConfig.h>
+
+#include <Common/Viewport.hpp>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <vector>
+
+class Mesh;
+
+/// \brief A hierarchy of axis-aligned boxes around the triangles of a mesh.
+///
+/// The hierarchy is a binary tree. Each leaf holds a few triangles, and each
+/// node has a box around all the triangles below it. It lets painters skip
+/// whole groups of triangles that fall outside the view frustum and gives a
+/// tight bound on the part of the image the mesh can cover.
+///
+/// Each node is split where the surface area heuristic (SAH) estimates that
+/// rays through it test the fewest triangles, so the hierarchy also suits
+/// ray casting (see PainterRayCast). Nodes deep in the tree are split at the
+/// median so that the depth of the tree stays bounded.
+///
+/// The hierarchy refers to triangles by their index in the mesh it was built
+/// from. It does not reorder the mesh.
+///
+class BoundingVolumeHierarchy {
+ public:
+  static constexpr int MAX_LEAF_TRIANGLES = 8;
+
+  /// \brief Size of a stack that can hold the nodes left to visit in a
+  /// depth-first traversal (pushing both children of each node visited).
+  ///
+  /// The build bounds the depth of the tree, and BoundingVolumeHierarchy.cpp
+  /// checks at compile time that this is enough for the deepest tree.
+  static constexpr int MAX_TRAVERSAL_DEPTH = 64;
+
+  struct Node {
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    // Range of the triangles below this node in the triangle index list.
+    int firstTriangle;
+    int numTriangles;
+    // Index of the second child, or -1 for a leaf. (The first child always
+    // follows its parent.)
+    int secondChild;
+
+    bool isLeaf() const { return this->secondChild < 0; }
+  };
+
+ private:
+  std::vector<Node> nodes;
+  std::vector<int> triangleIndices;
+  int numMeshTriangles;
+
+  int buildNode(const Mesh& mesh,
+                const std::vector<glm::vec3>& centroids,
+                int beginIndex,
+                int endIndex,
+                int depth);
+  // Returns the index where the second child starts, or -1 if the centroids
+  // cannot be split.
+  int partitionBySurfaceArea(const Mesh& mesh,
+                             const std::vector<glm::vec3>& centroids,
+                             int beginIndex,
+                             int endIndex,
+                             const glm::vec3& centroidMin,
+                             const glm::vec3& centroidExtent);
+
+ public:
+  /// \brief Builds a hierarchy for the triangles of the given mesh.
+  explicit BoundingVolumeHierarchy(const Mesh& mesh);
+
+  const std::vector<Node>& getNodes() const { return this->nodes; }
+
+  /// \brief Indices of the mesh triangles, grouped by leaf.
+  const std::vector<int>& getTriangleIndices() const {
+    return this->triangleIndices;
+  }
+
+  /// \brief Marks the triangles that may be in the view frustum.
+  ///
+  /// On return, \a visibleOut has an entry for each triangle of the mesh that
+  /// is nonzero if the triangle is in a leaf whose box is at least partly in
+  /// the frustum of the given modelview and projection. Unmarked triangles
+  /// are entirely outside the frustum, so painting them has no effect.
+  void markTrianglesInFrustum(const glm::mat4& modelview,
+                              const glm::mat4& projection,
+                              std::vector<char>& visibleOut) const;
+
+  /// \brief Returns the pixels that the triangles can cover in an image.
+  ///
+  /// The returned viewport is the union of the projected boxes of the leaves
+  /// that are in the view frustum. It is empty (min greater than max) if no
+  /// leaf is. If any of those boxes reach behind the camera, the whole image
+  /// is returned.
+  Viewport getProjectedViewport(const glm::mat4& modelview,
+                                const glm::mat4& projection,
+                                int width,
+                                int height) const;
+};
+
+#endif  // BOUNDINGVOLUMEHIERARCHY_HPP
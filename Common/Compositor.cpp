@@ -8,8 +8,107 @@
 
 #include "Compositor.hpp"
 
+#include <chrono>
+#include <thread>
+
 bool Compositor::setOptions(const std::vector<option::Option>&,
                             MPI_Comm,
                             YamlWriter&) {
   return true;
 }
+
+void Compositor::setAutoCompressThreshold(float threshold) {
+  this->autoCompressThreshold = threshold;
+}
+
+std::vector<std::unique_ptr<Image>> Compositor::composeMany(
+    const std::vector<Image *> &localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    YamlWriter &yaml) {
+  std::vector<std::unique_ptr<Image>> results;
+  results.reserve(localImages.size());
+  for (auto &&localImage : localImages) {
+    results.push_back(this->compose(localImage, group, communicator, yaml));
+  }
+  return results;
+}
+
+namespace {
+
+constexpr int COMPOSE_ASYNC_GROUP_TAG = 28100;
+
+class ThreadComposeHandle : public ComposeHandle {
+  MPI_Comm frameCommunicator;
+  MPI_Group frameGroup;
+  std::unique_ptr<Image> result;
+  std::shared_future<void> finished;
+  std::thread composeThread;
+
+ public:
+  ThreadComposeHandle(Compositor *compositor,
+                      Image *localImage,
+                      MPI_Group group,
+                      MPI_Comm communicator,
+                      YamlWriter &yaml,
+                      std::shared_future<void> previousCompose) {
+    // The new communicator's ranks follow the order of the group, so the
+    // group of the new communicator has the same ordering.
+    MPI_Comm_create_group(
+        communicator, group, COMPOSE_ASYNC_GROUP_TAG, &this->frameCommunicator);
+    MPI_Comm_group(this->frameCommunicator, &this->frameGroup);
+
+    std::promise<void> finishedPromise;
+    this->finished = finishedPromise.get_future().share();
+
+    // The promise is moved into the thread by way of a shared_ptr because
+    // C++11 lambdas cannot capture by move.
+    auto promiseHolder =
+        std::make_shared<std::promise<void>>(std::move(finishedPromise));
+    this->composeThread = std::thread([=, &yaml]() {
+      if (previousCompose.valid()) {
+        previousCompose.wait();
+      }
+      this->result = compositor->compose(
+          localImage, this->frameGroup, this->frameCommunicator, yaml);
+      promiseHolder->set_value();
+    });
+  }
+
+  ~ThreadComposeHandle() {
+    if (this->composeThread.joinable()) {
+      this->wait();
+    }
+  }
+
+  std::shared_future<void> getFinished() const { return this->finished; }
+
+  bool test() override {
+    return this->finished.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  }
+
+  std::unique_ptr<Image> wait() override {
+    this->composeThread.join();
+    MPI_Group_free(&this->frameGroup);
+    MPI_Comm_free(&this->frameCommunicator);
+    return std::move(this->result);
+  }
+};
+
+}  // anonymous namespace
+
+std::unique_ptr<ComposeHandle> Compositor::composeAsync(Image *localImage,
+                                                        MPI_Group group,
+                                                        MPI_Comm communicator,
+                                                        YamlWriter &yaml) {
+  std::unique_ptr<ThreadComposeHandle> handle(
+      new ThreadComposeHandle(this,
+                              localImage,
+                              group,
+                              communicator,
+                              yaml,
+                              this->lastAsyncCompose));
+  this->lastAsyncCompose = handle->getFinished();
+  return handle;
+}
@@ -18,8 +18,36 @@
 
 #include <mpi.h>
 
+#include <future>
+#include <memory>
+#include <vector>
+
+/// \brief A handle to a composite started with Compositor::composeAsync.
+///
+class ComposeHandle {
+ public:
+  /// Returns true if the composite has finished, in which case \c wait will
+  /// return without blocking.
+  ///
+  virtual bool test() = 0;
+
+  /// Blocks until the composite is finished and returns the image that \c
+  /// compose would have returned. This must be called exactly once on each
+  /// process of the group, and handles must be waited on in the order the
+  /// composites were started.
+  ///
+  virtual std::unique_ptr<Image> wait() = 0;
+
+  virtual ~ComposeHandle() = default;
+};
+
 class Compositor {
+  std::shared_future<void> lastAsyncCompose;
+  float autoCompressThreshold;
+
  public:
+  Compositor() : autoCompressThreshold(-1.0f) {}
+
   /// Subclasses need to implement this function. It takes images of the local
   /// partition of the data and combines them into a single image. The
   /// composite algorithm should use the given MPI group, which is defined on
@@ -39,6 +67,43 @@ class Compositor {
                                          MPI_Comm communicator,
                                          YamlWriter &yaml) = 0;
 
+  /// Composites several images of the same size (for example, the views of a
+  /// stereo pair or separate layers) at once. The arguments are otherwise the
+  /// same as for \c compose. The returned vector contains the composited
+  /// piece of each image in the same order as \c localImages, and each
+  /// piece covers the same region of its image.
+  ///
+  /// The default implementation simply calls \c compose for each image.
+  /// Subclasses can override this to run all the images through a single
+  /// schedule, sending all pieces destined for a peer together to amortize
+  /// the latency of each message round.
+  ///
+  virtual std::vector<std::unique_ptr<Image>> composeMany(
+      const std::vector<Image *> &localImages,
+      MPI_Group group,
+      MPI_Comm communicator,
+      YamlWriter &yaml);
+
+  /// Starts compositing the given image and returns immediately with a
+  /// handle to the composite in progress. The arguments are the same as for
+  /// \c compose, but the local image and the YamlWriter must remain valid
+  /// and untouched until the handle's \c wait returns. (The YamlWriter is
+  /// written from another thread, so it should be one dedicated to this
+  /// frame.) This allows a caller to do other work, such as painting the
+  /// next frame, while the composite is running.
+  ///
+  /// The default implementation runs \c compose in a separate thread on a
+  /// private communicator created for this composite, so messages of
+  /// different frames cannot be confused even though compositors use fixed
+  /// tags. Composites started on the same compositor run one after another in
+  /// the order they were started, so \c compose need not be thread safe. This
+  /// requires MPI to be initialized with \c MPI_THREAD_MULTIPLE.
+  ///
+  virtual std::unique_ptr<ComposeHandle> composeAsync(Image *localImage,
+                                                      MPI_Group group,
+                                                      MPI_Comm communicator,
+                                                      YamlWriter &yaml);
+
   /// If a compositor can be controled by some custom command line arguments,
   /// it should override this method to get the options and set up the state.
   /// It should also use the given YamlWriter to record the options used (even
@@ -58,6 +123,20 @@ class Compositor {
                           MPI_Comm communicator,
                           YamlWriter &yaml);
 
+  /// Turns on automatic compression of images during compositing. A
+  /// compositor that supports it calls \c autoCompressImages (see
+  /// AutoCompress.hpp) with this threshold at the start of each round to
+  /// decide whether the round works on compressed or full images. Compositors
+  /// that do not support it keep the images in the form they are given. A
+  /// negative threshold (the default) turns automatic compression off.
+  ///
+  /// Compositors that delegate to other compositors should override this to
+  /// pass the threshold on.
+  ///
+  virtual void setAutoCompressThreshold(float threshold);
+
+  float getAutoCompressThreshold() const { return this->autoCompressThreshold; }
+
   virtual ~Compositor() = default;
 };
 
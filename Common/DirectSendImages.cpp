@@ -0,0 +1,114 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include "DirectSendImages.hpp"
+
+#include <Common/AutoCompress.hpp>
+#include <Common/ImageFull.hpp>
+
+#include <cassert>
+
+// MPI_Comm_create_group is only collective over the group, so the tag keeps
+// the groups of different direct sends apart.
+constexpr int DIRECT_SEND_GROUP_TAG = 47306;
+
+DirectSendImages::DirectSendImages(const std::vector<Image*>& localImages,
+                                   MPI_Group sendGroup,
+                                   MPI_Group recvGroup,
+                                   MPI_Comm communicator,
+                                   float autoCompressThreshold,
+                                   YamlWriter& yaml)
+    : images(localImages), pieces(localImages.size()) {
+  MPI_Group_size(recvGroup, &this->numPieces);
+  if (autoCompressThreshold < 0) {
+    return;
+  }
+
+  // Every process of the direct send exchanges pieces with every other one,
+  // so they all sum their pixel counts to pick the same form.
+  MPI_Group allGroup;
+  MPI_Group_union(sendGroup, recvGroup, &allGroup);
+  MPI_Group commGroup;
+  MPI_Comm_group(communicator, &commGroup);
+  int comparison;
+  MPI_Group_compare(allGroup, commGroup, &comparison);
+  MPI_Group_free(&commGroup);
+  MPI_Comm groupCommunicator = communicator;
+  if (comparison != MPI_IDENT) {
+    MPI_Comm_create_group(
+        communicator, allGroup, DIRECT_SEND_GROUP_TAG, &groupCommunicator);
+  }
+  MPI_Group_free(&allGroup);
+
+  float activeRatio;
+  bool compress = chooseAutoCompress(
+      localImages, autoCompressThreshold, groupCommunicator, activeRatio);
+  if (groupCommunicator != communicator) {
+    MPI_Comm_free(&groupCommunicator);
+  }
+  yaml.StartListItem();
+  yaml.AddDictionaryEntry("active-ratio", activeRatio);
+  yaml.AddDictionaryEntry("compressed", compress ? "yes" : "no");
+
+  std::vector<int> splitPoints;
+  for (int pieceIndex = 1; pieceIndex < this->numPieces; ++pieceIndex) {
+    int rangeBegin;
+    int rangeEnd;
+    getPieceRange(this->getNumberOfPixels(),
+                  pieceIndex,
+                  this->numPieces,
+                  rangeBegin,
+                  rangeEnd);
+    splitPoints.push_back(rangeBegin);
+  }
+
+  for (int imageIndex = 0; imageIndex < this->getNumberOfImages();
+       ++imageIndex) {
+    const Image* image = localImages[imageIndex];
+    const ImageFull* fullImage = dynamic_cast<const ImageFull*>(image);
+    const ImageSparse* sparseImage = dynamic_cast<const ImageSparse*>(image);
+    if (compress && (fullImage != nullptr)) {
+      this->pieces[imageIndex] =
+          fullImage->compressInto(this->numPieces, splitPoints);
+    } else if (!compress && (sparseImage != nullptr)) {
+      this->convertedImages.push_back(sparseImage->uncompress());
+      this->images[imageIndex] = this->convertedImages.back().get();
+    }
+  }
+}
+
+void DirectSendImages::getPieceRange(int imageSize,
+                                     int pieceIndex,
+                                     int numPieces,
+                                     int& rangeBeginOut,
+                                     int& rangeEndOut) {
+  assert(pieceIndex >= 0);
+  assert(pieceIndex < numPieces);
+
+  int pieceSize = imageSize / numPieces;
+  rangeBeginOut = pieceSize * pieceIndex;
+  if (pieceIndex < numPieces - 1) {
+    rangeEndOut = rangeBeginOut + pieceSize;
+  } else {
+    rangeEndOut = imageSize;
+  }
+}
+
+ImageView DirectSendImages::getPiece(int imageIndex, int pieceIndex) const {
+  if (!this->pieces[imageIndex].empty()) {
+    return ImageView(*this->pieces[imageIndex][pieceIndex]);
+  }
+  int rangeBegin;
+  int rangeEnd;
+  getPieceRange(this->getNumberOfPixels(),
+                pieceIndex,
+                this->numPieces,
+                rangeBegin,
+                rangeEnd);
+  return ImageView(*this->images[imageIndex], rangeBegin, rangeEnd);
+}
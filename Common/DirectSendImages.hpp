@@ -0,0 +1,86 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef DIRECTSENDIMAGES_HPP
+#define DIRECTSENDIMAGES_HPP
+
+#include <Common/Image.hpp>
+#include <Common/ImageSparse.hpp>
+#include <Common/ImageView.hpp>
+#include <Common/YamlWriter.hpp>
+
+#include <memory>
+#include <vector>
+
+#include <mpi.h>
+
+/// \brief The local images of a direct send in the form chosen for it.
+///
+/// A direct send splits each image into one piece for each process of the
+/// receiving group (see \c getPieceRange). When images are compressed
+/// automatically (see \c Compositor::setAutoCompressThreshold), the processes
+/// of the direct send first agree on a form with \c chooseAutoCompress, and
+/// images in the other form are converted. A full image to be compressed is
+/// compressed straight into its pieces with \c ImageFull::compressInto, and
+/// those pieces are used whole in place of views of the image.
+///
+class DirectSendImages {
+  std::vector<Image*> images;
+  std::vector<std::unique_ptr<Image>> convertedImages;
+  std::vector<std::vector<std::unique_ptr<ImageSparse>>> pieces;
+  int numPieces;
+
+ public:
+  /// Prepares \a localImages for a direct send from the processes of \a
+  /// sendGroup to those of \a recvGroup. If \a autoCompressThreshold is
+  /// negative, the images are used as they are. Otherwise, every process of
+  /// either group must make one of these, and a list item with the choice is
+  /// added to \a yaml.
+  DirectSendImages(const std::vector<Image*>& localImages,
+                   MPI_Group sendGroup,
+                   MPI_Group recvGroup,
+                   MPI_Comm communicator,
+                   float autoCompressThreshold,
+                   YamlWriter& yaml);
+
+  /// \brief Gets the range of pixels of the given piece of an image.
+  static void getPieceRange(int imageSize,
+                            int pieceIndex,
+                            int numPieces,
+                            int& rangeBeginOut,
+                            int& rangeEndOut);
+
+  int getNumberOfImages() const {
+    return static_cast<int>(this->images.size());
+  }
+
+  /// All the images have the same size.
+  int getNumberOfPixels() const {
+    return this->images.front()->getNumberOfPixels();
+  }
+
+  /// Returns the given image, converted if needed.
+  const Image& getImage(int imageIndex) const {
+    return *this->images[imageIndex];
+  }
+
+  /// Returns an image of the form that is sent, from which receive buffers
+  /// are created.
+  const Image& getPrototype(int imageIndex) const {
+    if (this->pieces[imageIndex].empty()) {
+      return *this->images[imageIndex];
+    } else {
+      return *this->pieces[imageIndex].front();
+    }
+  }
+
+  /// Returns a view of the given piece of an image.
+  ImageView getPiece(int imageIndex, int pieceIndex) const;
+};
+
+#endif  // DIRECTSENDIMAGES_HPP
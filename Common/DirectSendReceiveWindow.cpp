@@ -0,0 +1,109 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include "DirectSendReceiveWindow.hpp"
+
+static int getRealRank(MPI_Group group, int rank, MPI_Comm communicator) {
+  MPI_Group commGroup;
+  MPI_Comm_group(communicator, &commGroup);
+
+  int realRank;
+  MPI_Group_translate_ranks(group, 1, &rank, commGroup, &realRank);
+
+  MPI_Group_free(&commGroup);
+  return realRank;
+}
+
+DirectSendReceiveWindow::DirectSendReceiveWindow(
+    const DirectSendImages& _localImages,
+    MPI_Group _sendGroup,
+    MPI_Group recvGroup,
+    MPI_Comm _communicator,
+    int _maxInFlight)
+    : localImages(&_localImages),
+      sendGroup(_sendGroup),
+      communicator(_communicator),
+      rangeBegin(0),
+      rangeEnd(0),
+      numPieces(0),
+      maxInFlight(_maxInFlight),
+      nextSenderToPost(0),
+      numInFlight(0),
+      spareBuffers(_localImages.getNumberOfImages()) {
+  MPI_Group_rank(this->sendGroup, &this->sendGroupRank);
+
+  int recvGroupRank;
+  MPI_Group_rank(recvGroup, &recvGroupRank);
+  if (recvGroupRank == MPI_UNDEFINED) {
+    // I am not receiving anything.
+    return;
+  }
+  int recvGroupSize;
+  MPI_Group_size(recvGroup, &recvGroupSize);
+
+  int sendGroupSize;
+  MPI_Group_size(this->sendGroup, &sendGroupSize);
+  this->numPieces = sendGroupSize * this->localImages->getNumberOfImages();
+
+  // All the images have the same size, so they all have the same range.
+  DirectSendImages::getPieceRange(this->localImages->getNumberOfPixels(),
+                                  recvGroupRank,
+                                  recvGroupSize,
+                                  this->rangeBegin,
+                                  this->rangeEnd);
+}
+
+bool DirectSendReceiveWindow::postNextReceive(
+    int& sendGroupIndexOut,
+    std::vector<std::unique_ptr<Image>>& imageBuffersOut,
+    ImagePackedReceiver& receiverOut,
+    MPI_Request& requestOut) {
+  int numImages = this->localImages->getNumberOfImages();
+  while (((this->numInFlight == 0) ||
+          (this->numInFlight + numImages <= this->maxInFlight)) &&
+         (this->nextSenderToPost * numImages < this->numPieces)) {
+    sendGroupIndexOut = this->nextSenderToPost;
+    ++this->nextSenderToPost;
+    if (sendGroupIndexOut == this->sendGroupRank) {
+      // "Sending" to self. Nothing to receive.
+      continue;
+    }
+
+    imageBuffersOut.resize(numImages);
+    receiverOut = ImagePackedReceiver();
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      std::vector<std::unique_ptr<Image>>& spares =
+          this->spareBuffers[imageIndex];
+      if (!spares.empty()) {
+        imageBuffersOut[imageIndex] = std::move(spares.back());
+        spares.pop_back();
+      } else {
+        imageBuffersOut[imageIndex] =
+            this->localImages->getPrototype(imageIndex)
+                .createNew(this->rangeBegin, this->rangeEnd);
+      }
+      receiverOut.add(*imageBuffersOut[imageIndex]);
+    }
+    requestOut = receiverOut.IReceive(
+        getRealRank(this->sendGroup, sendGroupIndexOut, this->communicator),
+        this->communicator);
+    this->numInFlight += numImages;
+    return true;
+  }
+  return false;
+}
+
+std::size_t DirectSendReceiveWindow::getRecycledBytes() const {
+  std::size_t numBytes = 0;
+  for (auto&& spares : this->spareBuffers) {
+    for (auto&& imageBuffer : spares) {
+      numBytes += imageBuffer->getDataSize();
+    }
+  }
+  return numBytes;
+}
@@ -0,0 +1,100 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef DIRECTSENDRECEIVEWINDOW_HPP
+#define DIRECTSENDRECEIVEWINDOW_HPP
+
+#include <Common/DirectSendImages.hpp>
+#include <Common/Image.hpp>
+#include <Common/ImagePackedMessage.hpp>
+
+#include <memory>
+#include <vector>
+
+#include <mpi.h>
+
+/// \brief Bounds the number of receives in flight during a direct send.
+///
+/// Keeps track of the receives of the image pieces coming from the processes
+/// of the sending group. The pieces of every image coming from one process
+/// are received together in one packed message (see \c ImagePackedReceiver),
+/// and these receives are posted in the order of the sending group. At most
+/// maxInFlight pieces count against the window at any time, except that the
+/// pieces of one receive are always let in. Once the piece in a receive
+/// buffer has been blended, the buffer is given back with \c recycleBuffer
+/// and is reused for a later receive.
+///
+class DirectSendReceiveWindow {
+  const DirectSendImages* localImages;
+  MPI_Group sendGroup;
+  MPI_Comm communicator;
+  int sendGroupRank;
+  int rangeBegin;
+  int rangeEnd;
+  int numPieces;
+  int maxInFlight;
+
+  int nextSenderToPost;
+  int numInFlight;
+  std::vector<std::vector<std::unique_ptr<Image>>> spareBuffers;
+
+ public:
+  /// Sets up the receives of the pieces of \a localImages that this process
+  /// gets from the processes of \a sendGroup. If this process is not in \a
+  /// recvGroup, there is nothing to receive.
+  DirectSendReceiveWindow(const DirectSendImages& localImages,
+                          MPI_Group sendGroup,
+                          MPI_Group recvGroup,
+                          MPI_Comm communicator,
+                          int maxInFlight);
+
+  /// The number of pieces coming in, including the one "sent" to self.
+  int getNumberOfPieces() const { return this->numPieces; }
+
+  /// The pixels of the images (with respect to their regions) covered by the
+  /// pieces coming in.
+  int getRangeBegin() const { return this->rangeBegin; }
+  int getRangeEnd() const { return this->rangeEnd; }
+
+  /// The rank of this process in the sending group, which may be
+  /// MPI_UNDEFINED.
+  int getSendGroupRank() const { return this->sendGroupRank; }
+
+  /// \brief Posts the receive of the pieces from the next sending process if
+  /// the window has room.
+  ///
+  /// Returns false if the window is full or every piece has been posted.
+  /// Otherwise, returns the sending process (as an index in the sending
+  /// group), the buffers the piece of each image is received in, and the
+  /// packed receive of the pieces along with its request. The pieces are
+  /// received once \c ImagePackedReceiver::finishReceive says so. The pieces
+  /// "sent" to self are skipped. Each piece counts against the window until
+  /// \c releaseReceive is called for it.
+  ///
+  bool postNextReceive(int& sendGroupIndexOut,
+                       std::vector<std::unique_ptr<Image>>& imageBuffersOut,
+                       ImagePackedReceiver& receiverOut,
+                       MPI_Request& requestOut);
+
+  /// Stops counting a received piece against the window, which makes room to
+  /// post more receives.
+  void releaseReceive() { --this->numInFlight; }
+
+  /// Gives back a receive buffer of the given image that is no longer needed
+  /// so that a later receive can use it.
+  void recycleBuffer(int imageIndex, std::unique_ptr<Image> imageBuffer) {
+    this->spareBuffers[imageIndex].push_back(std::move(imageBuffer));
+  }
+
+  /// The total size of the buffers given back with \c recycleBuffer. (For
+  /// compressed images, this is the size of the data last received in each
+  /// buffer.)
+  std::size_t getRecycledBytes() const;
+};
+
+#endif  // DIRECTSENDRECEIVEWINDOW_HPP
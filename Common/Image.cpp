@@ -42,6 +42,13 @@ std::unique_ptr<Image> Image::createNew() const {
                          this->getValidViewport());
 }
 
+std::vector<MPI_Request> Image::ISend(int destRank,
+                                     MPI_Comm communicator) const {
+  ImageSenderMPI sender(destRank, communicator);
+  this->sendMessages(sender);
+  return std::move(sender.getRequests());
+}
+
 void Image::Send(int destRank, MPI_Comm communicator) const {
   std::vector<MPI_Request> requests = this->ISend(destRank, communicator);
 
@@ -49,6 +56,13 @@ void Image::Send(int destRank, MPI_Comm communicator) const {
       static_cast<int>(requests.size()), requests.data(), MPI_STATUSES_IGNORE);
 }
 
+std::vector<MPI_Request> Image::IReceive(int sourceRank,
+                                        MPI_Comm communicator) {
+  ImageReceiverMPI receiver(sourceRank, communicator);
+  this->receiveMessages(receiver);
+  return std::move(receiver.getRequests());
+}
+
 void Image::Receive(int sourceRank, MPI_Comm communicator) {
   std::vector<MPI_Request> requests = this->IReceive(sourceRank, communicator);
 
@@ -58,32 +72,71 @@ void Image::Receive(int sourceRank, MPI_Comm communicator) {
 
 static const int IMAGE_INTERNALS_TAG = 59463;
 
-std::vector<MPI_Request> Image::ISendMetaData(int destRank,
-                                              MPI_Comm communicator) const {
-  std::vector<MPI_Request> requests(1);
+void Image::sendMetaData(ImageSender& sender) const {
+  sender.send(&this->internals, sizeof(Image::Internals), IMAGE_INTERNALS_TAG);
+}
+
+void Image::receiveMetaData(ImageReceiver& receiver) {
+  receiver.receive(
+      &this->internals, sizeof(Image::Internals), IMAGE_INTERNALS_TAG);
+}
+
+void Image::sendSubrangeMetaData(int subregionBegin,
+                                 int subregionEnd,
+                                 ImageSender& sender,
+                                 Internals& metaDataOut) const {
+  assert(subregionBegin <= subregionEnd);
+  assert(subregionBegin >= 0);
+  assert(subregionEnd <= this->getNumberOfPixels());
+
+  metaDataOut = this->internals;
+  metaDataOut.regionBegin = this->getRegionBegin() + subregionBegin;
+  metaDataOut.regionEnd = this->getRegionBegin() + subregionEnd;
 
-  MPI_Isend(&this->internals,
-            sizeof(Image::Internals) / sizeof(int),
-            MPI_INT,
-            destRank,
-            IMAGE_INTERNALS_TAG,
-            communicator,
-            &requests[0]);
+  sender.send(&metaDataOut, sizeof(Image::Internals), IMAGE_INTERNALS_TAG);
+}
 
-  return requests;
+// Returns the image itself if the subrange covers all of it. Otherwise,
+// creates a window in windowHolder and returns that.
+static const Image* wholeImageOrWindow(
+    const Image& image,
+    int subregionBegin,
+    int subregionEnd,
+    std::unique_ptr<const Image>& windowHolder) {
+  if ((subregionBegin == 0) && (subregionEnd == image.getNumberOfPixels())) {
+    return &image;
+  }
+  windowHolder = image.window(subregionBegin, subregionEnd);
+  return windowHolder.get();
 }
 
-std::vector<MPI_Request> Image::IReceiveMetaData(int sourceRank,
-                                                 MPI_Comm communicator) {
-  std::vector<MPI_Request> requests(1);
+void Image::sendSubrangeMessages(int subregionBegin,
+                                 int subregionEnd,
+                                 ImageSender& sender,
+                                 Internals&,
+                                 SubrangeSendBuffers& buffersOut) const {
+  wholeImageOrWindow(*this, subregionBegin, subregionEnd, buffersOut.window)
+      ->sendMessages(sender);
+}
 
-  MPI_Irecv(&this->internals,
-            sizeof(Image::Internals) / sizeof(int),
-            MPI_INT,
-            sourceRank,
-            IMAGE_INTERNALS_TAG,
-            communicator,
-            &requests[0]);
+std::unique_ptr<Image> Image::blendSubranges(int subregionBegin,
+                                             int subregionEnd,
+                                             const Image& otherImage,
+                                             int otherSubregionBegin,
+                                             int otherSubregionEnd) const {
+  std::unique_ptr<const Image> windowHolder;
+  const Image* topImage =
+      wholeImageOrWindow(*this, subregionBegin, subregionEnd, windowHolder);
+  std::unique_ptr<const Image> otherWindowHolder;
+  const Image* bottomImage = wholeImageOrWindow(
+      otherImage, otherSubregionBegin, otherSubregionEnd, otherWindowHolder);
+  return topImage->blend(*bottomImage);
+}
 
-  return requests;
+void Image::blendSubrangeInto(int subregionBegin,
+                              int subregionEnd,
+                              ImageFull& accumulator) const {
+  std::unique_ptr<const Image> windowHolder;
+  wholeImageOrWindow(*this, subregionBegin, subregionEnd, windowHolder)
+      ->blendInto(accumulator);
 }
@@ -17,12 +17,16 @@
 #include <vector>
 
 #include <Common/Color.hpp>
+#include <Common/ImageMessenger.hpp>
 #include <Common/Viewport.hpp>
 
 #include <mpi.h>
 
+class ImageFull;
+class ImageView;
+
 class Image {
- private:
+ protected:
   struct Internals {
     int width;
     int height;
@@ -49,8 +53,12 @@ class Image {
       assert(this->regionBegin <= this->regionEnd);
     }
   };
+
+ private:
   Internals internals;
 
+  friend class ImageView;
+
  protected:
   void resizeRegion(int _regionBegin, int _regionEnd) {
     this->internals.regionBegin = _regionBegin;
@@ -124,7 +132,9 @@ class Image {
   /// \brief Blend this image with another image
   ///
   /// This operation will almost certainly result in an error if the two images
-  /// are not of the same type.
+  /// are not of the same type. The exception is that a compressed image can be
+  /// blended with an image of the type it uncompresses to (in either order).
+  /// In that case, the result is uncompressed.
   ///
   /// When blending, this image is blended "on top" of the other image. Some
   /// blend operations (like z-buffer) do not depend on the blendOrder, so in
@@ -148,6 +158,30 @@ class Image {
   ///
   virtual bool blendIsOrderDependent() const = 0;
 
+  /// \brief Blend this image into a full image in place.
+  ///
+  /// The \a accumulator must be of the uncompressed type of this image (that
+  /// is, the same type or, if this is a compressed image, the type it
+  /// uncompresses to), and its region must contain the region of this image.
+  /// The pixels already in the accumulator are treated as being "on top" of
+  /// this image. Unlike \c blend, no new image is created, so the pieces of
+  /// many images can be accumulated without extra allocations.
+  ///
+  /// Compressed images skip over background pixels where they cannot change
+  /// the accumulator. For z-buffer images, this assumes that the accumulator
+  /// holds nothing behind the background depth (which is the case for any
+  /// rendered or composited image).
+  ///
+  virtual void blendInto(ImageFull& accumulator) const = 0;
+
+  /// \brief Returns the number of bytes of pixel data held in this image.
+  ///
+  /// This is (not counting metadata) the amount of data transferred when the
+  /// image is sent with \c ISend. For compressed images, it reflects the size
+  /// after compression.
+  ///
+  virtual std::size_t getDataSize() const = 0;
+
   /// \brief Creates a new image object of the same type as this one.
   std::unique_ptr<Image> createNew(int _width,
                                    int _height,
@@ -218,8 +252,7 @@ class Image {
   ///
   /// The returned vector of MPI request objects can be used to wait for the
   /// send to be complete.
-  virtual std::vector<MPI_Request> ISend(int destRank,
-                                         MPI_Comm communicator) const = 0;
+  std::vector<MPI_Request> ISend(int destRank, MPI_Comm communicator) const;
 
   /// \brief Sends this image to another process.
   ///
@@ -237,8 +270,7 @@ class Image {
   ///
   /// The returned vector of MPI request objects can be used to wait for the
   /// send to be complete.
-  virtual std::vector<MPI_Request> IReceive(int sourceRank,
-                                            MPI_Comm communicator) = 0;
+  std::vector<MPI_Request> IReceive(int sourceRank, MPI_Comm communicator);
 
   /// \brief Receives an image from another process.
   ///
@@ -248,18 +280,98 @@ class Image {
   /// all the data that is coming in.
   void Receive(int sourceRank, MPI_Comm communicator);
 
+  /// \brief Gives the messages this image is sent as to \a sender.
+  ///
+  /// This is what \c ISend does with a sender that sends each message right
+  /// away. Other senders can pack the messages of many images together. As
+  /// with \c ISend, the image must not change until the messages are sent.
+  virtual void sendMessages(ImageSender& sender) const = 0;
+
+  /// \brief Gives the buffers of the messages this image is received from to
+  /// \a receiver.
+  ///
+  /// The messages match those given by \c sendMessages. As with \c IReceive,
+  /// this image must be large enough to hold all the data coming in.
+  virtual void receiveMessages(ImageReceiver& receiver) = 0;
+
  protected:
   /// \brief Sends the metadata information for this image.
   ///
-  /// This should be used internally by implementations of ISend.
-  std::vector<MPI_Request> ISendMetaData(int destRank,
-                                         MPI_Comm communicator) const;
+  /// This should be used internally by implementations of sendMessages.
+  void sendMetaData(ImageSender& sender) const;
 
   /// \brief Receives the metadata information for this image.
   ///
-  /// This should be used internally by implementations of IReceive.
-  std::vector<MPI_Request> IReceiveMetaData(int sourceRank,
-                                            MPI_Comm communicator);
+  /// This should be used internally by implementations of receiveMessages.
+  void receiveMetaData(ImageReceiver& receiver);
+
+  /// \brief Sends the metadata information for a subrange of this image.
+  ///
+  /// The metadata sent are those of a window of the subrange. They are
+  /// written to \a metaDataOut, which must remain valid until the send
+  /// finishes. This should be used internally by implementations of
+  /// sendSubrangeMessages.
+  void sendSubrangeMetaData(int subregionBegin,
+                            int subregionEnd,
+                            ImageSender& sender,
+                            Internals& metaDataOut) const;
+
+  /// \brief Data that a send of a subrange reads until the send finishes.
+  ///
+  /// Besides the metadata of the subrange (see \c sendSubrangeMetaData),
+  /// a send of a subrange might need to send data that is not in the image
+  /// as it is. These buffers hold that data. \c ImageView keeps them for the
+  /// views it sends.
+  struct SubrangeSendBuffers {
+    /// Compressed images send their active pixels as an image of their own,
+    /// whose metadata are held here.
+    Internals pixelMetaData;
+
+    /// Compressed images send the run lengths of the subrange from where
+    /// they are except for the first and last, which are cut to the
+    /// subrange and held here as background/foreground pairs.
+    int edgeRunLengths[4];
+
+    /// Images that cannot send a subrange in place send a window held here.
+    std::unique_ptr<const Image> window;
+
+    explicit SubrangeSendBuffers(const Internals& _pixelMetaData)
+        : pixelMetaData(_pixelMetaData) {}
+  };
+
+  /// \brief Sends a subrange of this image.
+  ///
+  /// This is used by \c ImageView to send a subrange without creating a
+  /// window. The receiving process gets the same image as if the window was
+  /// sent. The metadata of the subrange are held in \a metaDataOut and any
+  /// other data sent that is not in this image is held in \a buffersOut.
+  /// Both must remain valid until the send finishes. The default
+  /// implementation sends a window.
+  virtual void sendSubrangeMessages(int subregionBegin,
+                                    int subregionEnd,
+                                    ImageSender& sender,
+                                    Internals& metaDataOut,
+                                    SubrangeSendBuffers& buffersOut) const;
+
+  /// \brief Blends a subrange of this image on top of a subrange of another.
+  ///
+  /// This is used by \c ImageView to blend subranges without creating
+  /// windows. The result is the same as that of \c blend on windows of the
+  /// subranges, which is what the default implementation does.
+  virtual std::unique_ptr<Image> blendSubranges(int subregionBegin,
+                                                int subregionEnd,
+                                                const Image& otherImage,
+                                                int otherSubregionBegin,
+                                                int otherSubregionEnd) const;
+
+  /// \brief Blends a subrange of this image into a full image in place.
+  ///
+  /// This is used by \c ImageView to accumulate subranges without creating
+  /// windows. The result is the same as that of \c blendInto on a window of
+  /// the subrange, which is what the default implementation does.
+  virtual void blendSubrangeInto(int subregionBegin,
+                                 int subregionEnd,
+                                 ImageFull& accumulator) const;
 
   virtual void clearImpl(const Color& color, float depth) = 0;
 
@@ -10,12 +10,17 @@
 #define IMAGECOLORDEPTH_HPP
 
 #include "ImageFull.hpp"
+#include "ImageSparse.hpp"
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
 struct ImageColorDepthBase {};
 
+template <typename Features>
+class ImageSparseColorDepth;
+
 /// \brief Implementation of color/depth images
 ///
 /// ImageColorDepth is a base class of images that have both color and depth
@@ -51,9 +56,46 @@ class ImageColorDepth : public ImageFull, ImageColorDepthBase {
   std::shared_ptr<std::vector<ColorType>> colorBuffer;
   std::shared_ptr<std::vector<DepthType>> depthBuffer;
 
+  // Compressed images send the active pixels of a subrange of themselves
+  // with sendSubrangeMessages.
+  friend class ImageSparseColorDepth<Features>;
+
   static constexpr int COLOR_BUFFER_TAG = 12900;
   static constexpr int DEPTH_BUFFER_TAG = 12901;
 
+  // A subrange of an image of this type. It has the accessors that blending
+  // uses, so the same code blends whole images and subranges of them.
+  class Span {
+    const ThisType* image;
+    int subregionBegin;
+    int subregionEnd;
+
+   public:
+    Span(const ThisType& _image, int _subregionBegin, int _subregionEnd)
+        : image(&_image),
+          subregionBegin(_subregionBegin),
+          subregionEnd(_subregionEnd) {}
+    explicit Span(const ThisType& _image)
+        : Span(_image, 0, _image.getNumberOfPixels()) {}
+
+    const ThisType& getImage() const { return *this->image; }
+    int getRegionBegin() const {
+      return this->image->getRegionBegin() + this->subregionBegin;
+    }
+    int getRegionEnd() const {
+      return this->image->getRegionBegin() + this->subregionEnd;
+    }
+    int getNumberOfPixels() const {
+      return this->subregionEnd - this->subregionBegin;
+    }
+    const ColorType* getColorBuffer(int pixelIndex = 0) const {
+      return this->image->getColorBuffer(this->subregionBegin + pixelIndex);
+    }
+    const DepthType* getDepthBuffer(int pixelIndex = 0) const {
+      return this->image->getDepthBuffer(this->subregionBegin + pixelIndex);
+    }
+  };
+
  protected:
   ImageColorDepth(int _width, int _height)
       : ImageFull(_width, _height),
@@ -94,6 +136,75 @@ class ImageColorDepth : public ImageFull, ImageColorDepthBase {
     this->depthBuffer->resize(this->getNumberOfPixels());
   }
 
+  /// \brief Typed access to a contiguous range of pixels of this image.
+  ///
+  /// A PixelSpan points straight into the buffers of the image, so a loop
+  /// over it written for a concrete image type (see ImageTypeDispatch.hpp)
+  /// makes no virtual calls. ImageColorOnly has a span with the same
+  /// interface, which makes it easy to write one loop for both. Pixel indices
+  /// are with respect to the start of the span.
+  class PixelSpan {
+    ColorType* colorBuffer;
+    DepthType* depthBuffer;
+    int numPixels;
+
+   public:
+    PixelSpan(ColorType* _colorBuffer, DepthType* _depthBuffer, int _numPixels)
+        : colorBuffer(_colorBuffer),
+          depthBuffer(_depthBuffer),
+          numPixels(_numPixels) {}
+
+    int getNumberOfPixels() const { return this->numPixels; }
+
+    ColorType* getColorBuffer(int pixelIndex = 0) const {
+      return this->colorBuffer + (pixelIndex * ColorVecSize);
+    }
+    DepthType* getDepthBuffer(int pixelIndex = 0) const {
+      return this->depthBuffer + pixelIndex;
+    }
+
+    Color getColor(int pixelIndex) const {
+      return Features::decodeColor(this->getColorBuffer(pixelIndex));
+    }
+    void setColor(int pixelIndex, const Color& color) const {
+      Features::encodeColor(color, this->getColorBuffer(pixelIndex));
+    }
+    /// Sets a color already encoded with \c encodeColor.
+    void setEncodedColor(int pixelIndex,
+                         const ColorType encodedColor[ColorVecSize]) const {
+      std::copy(encodedColor,
+                encodedColor + ColorVecSize,
+                this->getColorBuffer(pixelIndex));
+    }
+
+    float getDepth(int pixelIndex) const {
+      return Features::decodeDepth(this->getDepthBuffer(pixelIndex));
+    }
+    void setDepth(int pixelIndex, float depth) const {
+      Features::encodeDepth(depth, this->getDepthBuffer(pixelIndex));
+    }
+  };
+
+  static void encodeColor(const Color& color,
+                          ColorType encodedColor[ColorVecSize]) {
+    Features::encodeColor(color, encodedColor);
+  }
+
+  PixelSpan getPixelSpan(int subregionBegin, int subregionEnd) {
+    assert(subregionBegin <= subregionEnd);
+    assert(subregionBegin >= 0);
+    assert(subregionEnd <= this->getNumberOfPixels());
+    return PixelSpan(this->getColorBuffer(subregionBegin),
+                     this->getDepthBuffer(subregionBegin),
+                     subregionEnd - subregionBegin);
+  }
+
+  /// Returns the pixels of row \a y, which must be in the region.
+  PixelSpan getRowSpan(int y) {
+    int rowBegin = this->pixelIndex(0, y);
+    return this->getPixelSpan(rowBegin, rowBegin + this->getWidth());
+  }
+
   Color getColor(int x, int y) const {
     return this->getColor(this->pixelIndex(x, y));
   }
@@ -140,111 +251,28 @@ class ImageColorDepth : public ImageFull, ImageColorDepthBase {
 
   std::unique_ptr<Image> blend(const Image& _otherImage) const final {
     const ThisType* otherImage = dynamic_cast<const ThisType*>(&_otherImage);
-    assert((otherImage != NULL) && "Attempting to blend invalid images.");
-
-    const ThisType* topImage = this;
-    const ThisType* bottomImage = otherImage;
-
-    assert(topImage->getRegionBegin() <= bottomImage->getRegionEnd());
-    assert(bottomImage->getRegionBegin() <= topImage->getRegionEnd());
-
-    int totalRegionBegin =
-        std::min(topImage->getRegionBegin(), bottomImage->getRegionBegin());
-    int totalRegionEnd =
-        std::max(topImage->getRegionEnd(), bottomImage->getRegionEnd());
-
-    std::unique_ptr<Image> outImageHolder = topImage->createNew(
-        this->getWidth(),
-        this->getHeight(),
-        totalRegionBegin,
-        totalRegionEnd,
-        this->getValidViewport().unionWith(otherImage->getValidViewport()));
-    ThisType* outImage = dynamic_cast<ThisType*>(outImageHolder.get());
-    assert((outImage != NULL) && "Internal error: createNew bad type.");
-
-    int topPixelIndex = 0;
-    int bottomPixelIndex = 0;
-    int outPixelIndex = 0;
-
-    // Manage where part of one image has a region that starts before the other
-    if (topImage->getRegionBegin() < bottomImage->getRegionBegin()) {
-      int numToCopy =
-          bottomImage->getRegionBegin() - topImage->getRegionBegin();
-      std::copy(topImage->getColorBuffer(0),
-                topImage->getColorBuffer(numToCopy),
-                outImage->getColorBuffer(0));
-      std::copy(topImage->getDepthBuffer(0),
-                topImage->getDepthBuffer(numToCopy),
-                outImage->getDepthBuffer(0));
-      topPixelIndex += numToCopy;
-      outPixelIndex += numToCopy;
-    } else if (bottomImage->getRegionBegin() < topImage->getRegionBegin()) {
-      int numToCopy =
-          topImage->getRegionBegin() - bottomImage->getRegionBegin();
-      std::copy(bottomImage->getColorBuffer(0),
-                bottomImage->getColorBuffer(numToCopy),
-                outImage->getColorBuffer(0));
-      std::copy(bottomImage->getDepthBuffer(0),
-                bottomImage->getDepthBuffer(numToCopy),
-                outImage->getDepthBuffer(0));
-      bottomPixelIndex += numToCopy;
-      outPixelIndex += numToCopy;
-    }
-
-    // Blend where the two images intersect
-    while ((topPixelIndex < topImage->getNumberOfPixels()) &&
-           (bottomPixelIndex < bottomImage->getNumberOfPixels())) {
-      if (Features::closer(*bottomImage->getDepthBuffer(bottomPixelIndex),
-                           *topImage->getDepthBuffer(topPixelIndex))) {
-        std::copy(bottomImage->getColorBuffer(bottomPixelIndex),
-                  bottomImage->getColorBuffer(bottomPixelIndex + 1),
-                  outImage->getColorBuffer(outPixelIndex));
-        *outImage->getDepthBuffer(outPixelIndex) =
-            *bottomImage->getDepthBuffer(bottomPixelIndex);
-      } else {
-        std::copy(topImage->getColorBuffer(topPixelIndex),
-                  topImage->getColorBuffer(topPixelIndex + 1),
-                  outImage->getColorBuffer(outPixelIndex));
-        *outImage->getDepthBuffer(outPixelIndex) =
-            *topImage->getDepthBuffer(topPixelIndex);
-      }
-      ++topPixelIndex;
-      ++bottomPixelIndex;
-      ++outPixelIndex;
+    if (otherImage == NULL) {
+      // The compressed image can skip over its background.
+      const ImageSparse* sparseImage =
+          dynamic_cast<const ImageSparse*>(&_otherImage);
+      assert((sparseImage != NULL) && "Attempting to blend invalid images.");
+      return sparseImage->blendUnder(*this);
     }
 
-    // Manage where part of one image has a region past the end of the other
-    if (topPixelIndex < topImage->getNumberOfPixels()) {
-      int numToCopy = topImage->getNumberOfPixels() - topPixelIndex;
-      std::copy(topImage->getColorBuffer(topPixelIndex),
-                topImage->getColorBuffer(topPixelIndex + numToCopy),
-                outImage->getColorBuffer(outPixelIndex));
-      std::copy(topImage->getDepthBuffer(topPixelIndex),
-                topImage->getDepthBuffer(topPixelIndex + numToCopy),
-                outImage->getDepthBuffer(outPixelIndex));
-      topPixelIndex += numToCopy;
-      outPixelIndex += numToCopy;
-    }
-
-    if (bottomPixelIndex < bottomImage->getNumberOfPixels()) {
-      int numToCopy = bottomImage->getNumberOfPixels() - bottomPixelIndex;
-      std::copy(bottomImage->getColorBuffer(bottomPixelIndex),
-                bottomImage->getColorBuffer(bottomPixelIndex + numToCopy),
-                outImage->getColorBuffer(outPixelIndex));
-      std::copy(bottomImage->getDepthBuffer(bottomPixelIndex),
-                bottomImage->getDepthBuffer(bottomPixelIndex + numToCopy),
-                outImage->getDepthBuffer(outPixelIndex));
-      bottomPixelIndex += numToCopy;
-      outPixelIndex += numToCopy;
-    }
-
-    assert(outPixelIndex == outImage->getNumberOfPixels());
+    return blendSpans(Span(*this), Span(*otherImage));
+  }
 
-    return outImageHolder;
+  void blendInto(ImageFull& accumulator) const final {
+    this->blendSubrangeInto(0, this->getNumberOfPixels(), accumulator);
   }
 
   bool blendIsOrderDependent() const final { return false; }
 
+  std::size_t getDataSize() const final {
+    return this->getNumberOfPixels() *
+           (sizeof(ColorType) * ColorVecSize + sizeof(DepthType));
+  }
+
   std::unique_ptr<Image> copySubrange(int subregionBegin,
                                       int subregionEnd) const final {
     assert(subregionBegin <= subregionEnd);
@@ -265,6 +293,40 @@ class ImageColorDepth : public ImageFull, ImageColorDepthBase {
     return outImageHolder;
   }
 
+  void copyPixels(int pixelIndex,
+                  const ImageFull& _sourceImage,
+                  int sourcePixelIndex,
+                  int numPixels) final {
+    const ThisType* sourceImage = dynamic_cast<const ThisType*>(&_sourceImage);
+    assert((sourceImage != NULL) && "Attempting to copy invalid image.");
+    assert(pixelIndex + numPixels <= this->getNumberOfPixels());
+    assert(sourcePixelIndex + numPixels <= sourceImage->getNumberOfPixels());
+
+    std::copy(sourceImage->getColorBuffer(sourcePixelIndex),
+              sourceImage->getColorBuffer(sourcePixelIndex + numPixels),
+              this->getColorBuffer(pixelIndex));
+    std::copy(sourceImage->getDepthBuffer(sourcePixelIndex),
+              sourceImage->getDepthBuffer(sourcePixelIndex + numPixels),
+              this->getDepthBuffer(pixelIndex));
+  }
+
+  bool pixelsEqual(int pixelIndex,
+                   const ImageFull& _otherImage,
+                   int otherPixelIndex,
+                   int numPixels) const final {
+    const ThisType* otherImage = dynamic_cast<const ThisType*>(&_otherImage);
+    assert((otherImage != NULL) && "Attempting to compare invalid image.");
+    assert(pixelIndex + numPixels <= this->getNumberOfPixels());
+    assert(otherPixelIndex + numPixels <= otherImage->getNumberOfPixels());
+
+    return std::equal(this->getColorBuffer(pixelIndex),
+                      this->getColorBuffer(pixelIndex + numPixels),
+                      otherImage->getColorBuffer(otherPixelIndex)) &&
+           std::equal(this->getDepthBuffer(pixelIndex),
+                      this->getDepthBuffer(pixelIndex + numPixels),
+                      otherImage->getDepthBuffer(otherPixelIndex));
+  }
+
   std::unique_ptr<ImageFull> Gather(int recvRank,
                                     MPI_Comm communicator) const final {
     int rank;
@@ -317,63 +379,102 @@ class ImageColorDepth : public ImageFull, ImageColorDepthBase {
     return std::unique_ptr<ImageFull>(recvImage);
   }
 
-  std::vector<MPI_Request> ISend(int destRank,
-                                 MPI_Comm communicator) const final {
-    std::vector<MPI_Request> requests =
-        this->ISendMetaData(destRank, communicator);
-
-    MPI_Request colorRequest;
-    MPI_Isend(this->getColorBuffer(),
-              this->getNumberOfPixels() * sizeof(ColorType) * ColorVecSize,
-              MPI_BYTE,
-              destRank,
-              COLOR_BUFFER_TAG,
-              communicator,
-              &colorRequest);
-    requests.push_back(colorRequest);
-
-    MPI_Request depthRequest;
-    MPI_Isend(this->getDepthBuffer(),
-              this->getNumberOfPixels() * sizeof(DepthType),
-              MPI_BYTE,
-              destRank,
-              DEPTH_BUFFER_TAG,
-              communicator,
-              &depthRequest);
-    requests.push_back(depthRequest);
-
-    return requests;
-  }
-
-  std::vector<MPI_Request> IReceive(int sourceRank,
-                                    MPI_Comm communicator) final {
-    std::vector<MPI_Request> requests =
-        this->IReceiveMetaData(sourceRank, communicator);
-
-    MPI_Request colorRequest;
-    MPI_Irecv(this->getColorBuffer(),
-              this->getNumberOfPixels() * sizeof(ColorType) * ColorVecSize,
-              MPI_BYTE,
-              sourceRank,
-              COLOR_BUFFER_TAG,
-              communicator,
-              &colorRequest);
-    requests.push_back(colorRequest);
-
-    MPI_Request depthRequest;
-    MPI_Irecv(this->getDepthBuffer(),
-              this->getNumberOfPixels() * sizeof(DepthType),
-              MPI_BYTE,
-              sourceRank,
-              DEPTH_BUFFER_TAG,
-              communicator,
-              &depthRequest);
-    requests.push_back(depthRequest);
-
-    return requests;
+  void sendMessages(ImageSender& sender) const final {
+    this->sendMetaData(sender);
+    this->sendPixels(0, this->getNumberOfPixels(), sender);
+  }
+
+  void receiveMessages(ImageReceiver& receiver) final {
+    this->receiveMetaData(receiver);
+    receiver.receive(this->getColorBuffer(),
+                     this->getNumberOfPixels() * sizeof(ColorType) *
+                         ColorVecSize,
+                     COLOR_BUFFER_TAG);
+    receiver.receive(this->getDepthBuffer(),
+                     this->getNumberOfPixels() * sizeof(DepthType),
+                     DEPTH_BUFFER_TAG);
   }
 
  protected:
+  void sendSubrangeMessages(int subregionBegin,
+                            int subregionEnd,
+                            ImageSender& sender,
+                            Internals& metaDataOut,
+                            SubrangeSendBuffers&) const final {
+    this->sendSubrangeMetaData(
+        subregionBegin, subregionEnd, sender, metaDataOut);
+    this->sendPixels(subregionBegin, subregionEnd, sender);
+  }
+
+  std::unique_ptr<Image> blendSubranges(int subregionBegin,
+                                        int subregionEnd,
+                                        const Image& _otherImage,
+                                        int otherSubregionBegin,
+                                        int otherSubregionEnd) const final {
+    const ThisType* otherImage = dynamic_cast<const ThisType*>(&_otherImage);
+    if (otherImage == NULL) {
+      return this->Image::blendSubranges(subregionBegin,
+                                         subregionEnd,
+                                         _otherImage,
+                                         otherSubregionBegin,
+                                         otherSubregionEnd);
+    }
+    return blendSpans(
+        Span(*this, subregionBegin, subregionEnd),
+        Span(*otherImage, otherSubregionBegin, otherSubregionEnd));
+  }
+
+  void blendSubrangeInto(int subregionBegin,
+                         int subregionEnd,
+                         ImageFull& _accumulator) const final {
+    ThisType* accumulator = dynamic_cast<ThisType*>(&_accumulator);
+    assert((accumulator != NULL) && "Attempting to blend invalid images.");
+    Span span(*this, subregionBegin, subregionEnd);
+    assert(accumulator->getRegionBegin() <= span.getRegionBegin());
+    assert(span.getRegionEnd() <= accumulator->getRegionEnd());
+
+    int numPixels = span.getNumberOfPixels();
+    int accumulatorPixelIndex =
+        span.getRegionBegin() - accumulator->getRegionBegin();
+    const ColorType* colorBuffer = span.getColorBuffer();
+    const DepthType* depthBuffer = span.getDepthBuffer();
+    ColorType* accumulatorColorBuffer =
+        accumulator->getColorBuffer(accumulatorPixelIndex);
+    DepthType* accumulatorDepthBuffer =
+        accumulator->getDepthBuffer(accumulatorPixelIndex);
+
+    for (int pixelIndex = 0; pixelIndex < numPixels; ++pixelIndex) {
+      if (Features::closer(depthBuffer[pixelIndex],
+                           accumulatorDepthBuffer[pixelIndex])) {
+        std::copy(colorBuffer + pixelIndex * ColorVecSize,
+                  colorBuffer + (pixelIndex + 1) * ColorVecSize,
+                  accumulatorColorBuffer + pixelIndex * ColorVecSize);
+        accumulatorDepthBuffer[pixelIndex] = depthBuffer[pixelIndex];
+      }
+    }
+
+    accumulator->setValidViewport(
+        accumulator->getValidViewport().unionWith(this->getValidViewport()));
+  }
+
+  int countActiveSamples(int checkBegin,
+                         int checkEnd,
+                         int sampleStride) const final {
+    // Background is at the far depth, as when compressing.
+    DepthType backgroundDepth;
+    Features::encodeDepth(1.0f, &backgroundDepth);
+
+    const DepthType* depthBuffer = this->getDepthBuffer();
+    int numActiveSamples = 0;
+    for (int pixelIndex = checkBegin; pixelIndex < checkEnd;
+         pixelIndex += sampleStride) {
+      if (Features::closer(depthBuffer[pixelIndex], backgroundDepth)) {
+        ++numActiveSamples;
+      }
+    }
+    return numActiveSamples;
+  }
+
   void clearImpl(const Color& color, float depth) final {
     int numPixels = this->getNumberOfPixels();
     if (numPixels < 1) {
@@ -397,6 +498,121 @@ class ImageColorDepth : public ImageFull, ImageColorDepthBase {
       dBuffer[pixelIndex] = depthValue;
     }
   }
+
+ private:
+  void sendPixels(int subregionBegin,
+                  int subregionEnd,
+                  ImageSender& sender) const {
+    sender.send(this->getColorBuffer(subregionBegin),
+                (subregionEnd - subregionBegin) * sizeof(ColorType) *
+                    ColorVecSize,
+                COLOR_BUFFER_TAG);
+    sender.send(this->getDepthBuffer(subregionBegin),
+                (subregionEnd - subregionBegin) * sizeof(DepthType),
+                DEPTH_BUFFER_TAG);
+  }
+
+  static std::unique_ptr<Image> blendSpans(const Span& topImage,
+                                           const Span& bottomImage) {
+    assert(topImage.getRegionBegin() <= bottomImage.getRegionEnd());
+    assert(bottomImage.getRegionBegin() <= topImage.getRegionEnd());
+
+    int totalRegionBegin =
+        std::min(topImage.getRegionBegin(), bottomImage.getRegionBegin());
+    int totalRegionEnd =
+        std::max(topImage.getRegionEnd(), bottomImage.getRegionEnd());
+
+    const ThisType& image = topImage.getImage();
+    std::unique_ptr<Image> outImageHolder = image.createNew(
+        image.getWidth(),
+        image.getHeight(),
+        totalRegionBegin,
+        totalRegionEnd,
+        image.getValidViewport().unionWith(
+            bottomImage.getImage().getValidViewport()));
+    ThisType* outImage = dynamic_cast<ThisType*>(outImageHolder.get());
+    assert((outImage != NULL) && "Internal error: createNew bad type.");
+
+    int topPixelIndex = 0;
+    int bottomPixelIndex = 0;
+    int outPixelIndex = 0;
+
+    // Manage where part of one image has a region that starts before the other
+    if (topImage.getRegionBegin() < bottomImage.getRegionBegin()) {
+      int numToCopy =
+          bottomImage.getRegionBegin() - topImage.getRegionBegin();
+      std::copy(topImage.getColorBuffer(0),
+                topImage.getColorBuffer(numToCopy),
+                outImage->getColorBuffer(0));
+      std::copy(topImage.getDepthBuffer(0),
+                topImage.getDepthBuffer(numToCopy),
+                outImage->getDepthBuffer(0));
+      topPixelIndex += numToCopy;
+      outPixelIndex += numToCopy;
+    } else if (bottomImage.getRegionBegin() < topImage.getRegionBegin()) {
+      int numToCopy =
+          topImage.getRegionBegin() - bottomImage.getRegionBegin();
+      std::copy(bottomImage.getColorBuffer(0),
+                bottomImage.getColorBuffer(numToCopy),
+                outImage->getColorBuffer(0));
+      std::copy(bottomImage.getDepthBuffer(0),
+                bottomImage.getDepthBuffer(numToCopy),
+                outImage->getDepthBuffer(0));
+      bottomPixelIndex += numToCopy;
+      outPixelIndex += numToCopy;
+    }
+
+    // Blend where the two images intersect
+    while ((topPixelIndex < topImage.getNumberOfPixels()) &&
+           (bottomPixelIndex < bottomImage.getNumberOfPixels())) {
+      if (Features::closer(*bottomImage.getDepthBuffer(bottomPixelIndex),
+                           *topImage.getDepthBuffer(topPixelIndex))) {
+        std::copy(bottomImage.getColorBuffer(bottomPixelIndex),
+                  bottomImage.getColorBuffer(bottomPixelIndex + 1),
+                  outImage->getColorBuffer(outPixelIndex));
+        *outImage->getDepthBuffer(outPixelIndex) =
+            *bottomImage.getDepthBuffer(bottomPixelIndex);
+      } else {
+        std::copy(topImage.getColorBuffer(topPixelIndex),
+                  topImage.getColorBuffer(topPixelIndex + 1),
+                  outImage->getColorBuffer(outPixelIndex));
+        *outImage->getDepthBuffer(outPixelIndex) =
+            *topImage.getDepthBuffer(topPixelIndex);
+      }
+      ++topPixelIndex;
+      ++bottomPixelIndex;
+      ++outPixelIndex;
+    }
+
+    // Manage where part of one image has a region past the end of the other
+    if (topPixelIndex < topImage.getNumberOfPixels()) {
+      int numToCopy = topImage.getNumberOfPixels() - topPixelIndex;
+      std::copy(topImage.getColorBuffer(topPixelIndex),
+                topImage.getColorBuffer(topPixelIndex + numToCopy),
+                outImage->getColorBuffer(outPixelIndex));
+      std::copy(topImage.getDepthBuffer(topPixelIndex),
+                topImage.getDepthBuffer(topPixelIndex + numToCopy),
+                outImage->getDepthBuffer(outPixelIndex));
+      topPixelIndex += numToCopy;
+      outPixelIndex += numToCopy;
+    }
+
+    if (bottomPixelIndex < bottomImage.getNumberOfPixels()) {
+      int numToCopy = bottomImage.getNumberOfPixels() - bottomPixelIndex;
+      std::copy(bottomImage.getColorBuffer(bottomPixelIndex),
+                bottomImage.getColorBuffer(bottomPixelIndex + numToCopy),
+                outImage->getColorBuffer(outPixelIndex));
+      std::copy(bottomImage.getDepthBuffer(bottomPixelIndex),
+                bottomImage.getDepthBuffer(bottomPixelIndex + numToCopy),
+                outImage->getDepthBuffer(outPixelIndex));
+      bottomPixelIndex += numToCopy;
+      outPixelIndex += numToCopy;
+    }
+
+    assert(outPixelIndex == outImage->getNumberOfPixels());
+
+    return outImageHolder;
+  }
 };
 
 #endif  // IMAGECOLORDEPTH_HPP
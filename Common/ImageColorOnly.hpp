@@ -10,6 +10,7 @@
 #define IMAGECOLORONLY_HPP
 
 #include "ImageFull.hpp"
+#include "ImageSparse.hpp"
 
 #include <algorithm>
 #include <memory>
@@ -17,6 +18,9 @@
 
 struct ImageColorOnlyBase {};
 
+template <typename Features>
+class ImageSparseColorOnly;
+
 /// \brief Implementation of color-only images
 ///
 /// ImageColorOnly is a base class of images that have a color buffer and use
@@ -44,8 +48,42 @@ class ImageColorOnly : public ImageFull, ImageColorOnlyBase {
 
   std::shared_ptr<std::vector<ColorType>> colorBuffer;
 
+  // Compressed images send the active pixels of a subrange of themselves
+  // with sendSubrangeMessages.
+  friend class ImageSparseColorOnly<Features>;
+
   static constexpr int COLOR_BUFFER_TAG = 12900;
 
+  // A subrange of an image of this type. It has the accessors that blending
+  // uses, so the same code blends whole images and subranges of them.
+  class Span {
+    const ThisType* image;
+    int subregionBegin;
+    int subregionEnd;
+
+   public:
+    Span(const ThisType& _image, int _subregionBegin, int _subregionEnd)
+        : image(&_image),
+          subregionBegin(_subregionBegin),
+          subregionEnd(_subregionEnd) {}
+    explicit Span(const ThisType& _image)
+        : Span(_image, 0, _image.getNumberOfPixels()) {}
+
+    const ThisType& getImage() const { return *this->image; }
+    int getRegionBegin() const {
+      return this->image->getRegionBegin() + this->subregionBegin;
+    }
+    int getRegionEnd() const {
+      return this->image->getRegionBegin() + this->subregionEnd;
+    }
+    int getNumberOfPixels() const {
+      return this->subregionEnd - this->subregionBegin;
+    }
+    const ColorType* getColorBuffer(int pixelIndex = 0) const {
+      return this->image->getColorBuffer(this->subregionBegin + pixelIndex);
+    }
+  };
+
  protected:
   ImageColorOnly(int _width, int _height)
       : ImageFull(_width, _height), colorBuffer(new std::vector<ColorType>) {
@@ -75,6 +113,66 @@ class ImageColorOnly : public ImageFull, ImageColorOnlyBase {
     this->colorBuffer->resize(this->getNumberOfPixels() * ColorVecSize);
   }
 
+  /// \brief Typed access to a contiguous range of pixels of this image.
+  ///
+  /// This has the same interface as ImageColorDepth::PixelSpan (see there).
+  /// As with the image, the depth is always 1 and setting it does nothing.
+  class PixelSpan {
+    ColorType* colorBuffer;
+    int numPixels;
+
+   public:
+    PixelSpan(ColorType* _colorBuffer, int _numPixels)
+        : colorBuffer(_colorBuffer), numPixels(_numPixels) {}
+
+    int getNumberOfPixels() const { return this->numPixels; }
+
+    ColorType* getColorBuffer(int pixelIndex = 0) const {
+      return this->colorBuffer + (pixelIndex * ColorVecSize);
+    }
+
+    Color getColor(int pixelIndex) const {
+      return Features::decodeColor(this->getColorBuffer(pixelIndex));
+    }
+    void setColor(int pixelIndex, const Color& color) const {
+      Features::encodeColor(color, this->getColorBuffer(pixelIndex));
+    }
+    /// Sets a color already encoded with \c encodeColor.
+    void setEncodedColor(int pixelIndex,
+                         const ColorType encodedColor[ColorVecSize]) const {
+      std::copy(encodedColor,
+                encodedColor + ColorVecSize,
+                this->getColorBuffer(pixelIndex));
+    }
+
+    float getDepth(int) const {
+      // No depth
+      return 1.0f;
+    }
+    void setDepth(int, float) const {
+      // No depth
+    }
+  };
+
+  static void encodeColor(const Color& color,
+                          ColorType encodedColor[ColorVecSize]) {
+    Features::encodeColor(color, encodedColor);
+  }
+
+  PixelSpan getPixelSpan(int subregionBegin, int subregionEnd) {
+    assert(subregionBegin <= subregionEnd);
+    assert(subregionBegin >= 0);
+    assert(subregionEnd <= this->getNumberOfPixels());
+    return PixelSpan(this->getColorBuffer(subregionBegin),
+                     subregionEnd - subregionBegin);
+  }
+
+  /// Returns the pixels of row \a y, which must be in the region.
+  PixelSpan getRowSpan(int y) {
+    int rowBegin = this->pixelIndex(0, y);
+    return this->getPixelSpan(rowBegin, rowBegin + this->getWidth());
+  }
+
   Color getColor(int x, int y) const {
     return this->getColor(this->pixelIndex(x, y));
   }
@@ -117,88 +215,50 @@ class ImageColorOnly : public ImageFull, ImageColorOnlyBase {
 
   std::unique_ptr<Image> blend(const Image& _otherImage) const final {
     const ThisType* otherImage = dynamic_cast<const ThisType*>(&_otherImage);
-    assert((otherImage != NULL) && "Attempting to blend invalid images.");
-
-    const ThisType* topImage = this;
-    const ThisType* bottomImage = otherImage;
-
-    assert(topImage->getRegionBegin() <= bottomImage->getRegionEnd());
-    assert(bottomImage->getRegionBegin() <= topImage->getRegionEnd());
-
-    int totalRegionBegin =
-        std::min(topImage->getRegionBegin(), bottomImage->getRegionBegin());
-    int totalRegionEnd =
-        std::max(topImage->getRegionEnd(), bottomImage->getRegionEnd());
-
-    std::unique_ptr<Image> outImageHolder = topImage->createNew(
-        this->getWidth(),
-        this->getHeight(),
-        totalRegionBegin,
-        totalRegionEnd,
-        this->getValidViewport().intersectWith(otherImage->getValidViewport()));
-    ThisType* outImage = dynamic_cast<ThisType*>(outImageHolder.get());
-    assert((outImage != NULL) && "Internal error: createNew bad type.");
-
-    int topPixelIndex = 0;
-    int bottomPixelIndex = 0;
-    int outPixelIndex = 0;
-
-    // Manage where part of one image has a region that starts before the other
-    if (topImage->getRegionBegin() < bottomImage->getRegionBegin()) {
-      int numToCopy =
-          bottomImage->getRegionBegin() - topImage->getRegionBegin();
-      std::copy(topImage->getColorBuffer(0),
-                topImage->getColorBuffer(numToCopy),
-                outImage->getColorBuffer(0));
-      topPixelIndex += numToCopy;
-      outPixelIndex += numToCopy;
-    } else if (bottomImage->getRegionBegin() < topImage->getRegionBegin()) {
-      int numToCopy =
-          topImage->getRegionBegin() - bottomImage->getRegionBegin();
-      std::copy(bottomImage->getColorBuffer(0),
-                bottomImage->getColorBuffer(numToCopy),
-                outImage->getColorBuffer(0));
-      bottomPixelIndex += numToCopy;
-      outPixelIndex += numToCopy;
+    if (otherImage == NULL) {
+      // The compressed image can skip over its background.
+      const ImageSparse* sparseImage =
+          dynamic_cast<const ImageSparse*>(&_otherImage);
+      assert((sparseImage != NULL) && "Attempting to blend invalid images.");
+      return sparseImage->blendUnder(*this);
     }
 
-    // Blend where the two images intersect
-    while ((topPixelIndex < topImage->getNumberOfPixels()) &&
-           (bottomPixelIndex < bottomImage->getNumberOfPixels())) {
-      Features::blend(topImage->getColorBuffer(topPixelIndex),
-                      bottomImage->getColorBuffer(bottomPixelIndex),
-                      outImage->getColorBuffer(outPixelIndex));
-      ++topPixelIndex;
-      ++bottomPixelIndex;
-      ++outPixelIndex;
-    }
+    return blendSpans(Span(*this), Span(*otherImage));
+  }
 
-    // Manage where part of one image has a region past the end of the other
-    if (topPixelIndex < topImage->getNumberOfPixels()) {
-      int numToCopy = topImage->getNumberOfPixels() - topPixelIndex;
-      std::copy(topImage->getColorBuffer(topPixelIndex),
-                topImage->getColorBuffer(topPixelIndex + numToCopy),
-                outImage->getColorBuffer(outPixelIndex));
-      topPixelIndex += numToCopy;
-      outPixelIndex += numToCopy;
-    }
+  void blendInto(ImageFull& _accumulator) const final {
+    ThisType* accumulator = dynamic_cast<ThisType*>(&_accumulator);
+    assert((accumulator != NULL) && "Attempting to blend invalid images.");
+    assert(accumulator->getRegionBegin() <= this->getRegionBegin());
+    assert(this->getRegionEnd() <= accumulator->getRegionEnd());
 
-    if (bottomPixelIndex < bottomImage->getNumberOfPixels()) {
-      int numToCopy = bottomImage->getNumberOfPixels() - bottomPixelIndex;
-      std::copy(bottomImage->getColorBuffer(bottomPixelIndex),
-                bottomImage->getColorBuffer(bottomPixelIndex + numToCopy),
-                outImage->getColorBuffer(outPixelIndex));
-      bottomPixelIndex += numToCopy;
-      outPixelIndex += numToCopy;
-    }
+    int numPixels = this->getNumberOfPixels();
+    int accumulatorPixelIndex =
+        this->getRegionBegin() - accumulator->getRegionBegin();
+    const ColorType* colorBuffer = this->getColorBuffer();
+    ColorType* accumulatorColorBuffer =
+        accumulator->getColorBuffer(accumulatorPixelIndex);
 
-    assert(outPixelIndex == outImage->getNumberOfPixels());
+    ColorType blendedColor[ColorVecSize];
+    for (int pixelIndex = 0; pixelIndex < numPixels; ++pixelIndex) {
+      Features::blend(accumulatorColorBuffer + pixelIndex * ColorVecSize,
+                      colorBuffer + pixelIndex * ColorVecSize,
+                      blendedColor);
+      std::copy(blendedColor,
+                blendedColor + ColorVecSize,
+                accumulatorColorBuffer + pixelIndex * ColorVecSize);
+    }
 
-    return outImageHolder;
+    accumulator->setValidViewport(accumulator->getValidViewport().intersectWith(
+        this->getValidViewport()));
   }
 
   bool blendIsOrderDependent() const final { return true; }
 
+  std::size_t getDataSize() const final {
+    return this->getNumberOfPixels() * sizeof(ColorType) * ColorVecSize;
+  }
+
   std::unique_ptr<Image> copySubrange(int subregionBegin,
                                       int subregionEnd) const final {
     assert(subregionBegin <= subregionEnd);
@@ -216,6 +276,34 @@ class ImageColorOnly : public ImageFull, ImageColorOnlyBase {
     return outImageHolder;
   }
 
+  void copyPixels(int pixelIndex,
+                  const ImageFull& _sourceImage,
+                  int sourcePixelIndex,
+                  int numPixels) final {
+    const ThisType* sourceImage = dynamic_cast<const ThisType*>(&_sourceImage);
+    assert((sourceImage != NULL) && "Attempting to copy invalid image.");
+    assert(pixelIndex + numPixels <= this->getNumberOfPixels());
+    assert(sourcePixelIndex + numPixels <= sourceImage->getNumberOfPixels());
+
+    std::copy(sourceImage->getColorBuffer(sourcePixelIndex),
+              sourceImage->getColorBuffer(sourcePixelIndex + numPixels),
+              this->getColorBuffer(pixelIndex));
+  }
+
+  bool pixelsEqual(int pixelIndex,
+                   const ImageFull& _otherImage,
+                   int otherPixelIndex,
+                   int numPixels) const final {
+    const ThisType* otherImage = dynamic_cast<const ThisType*>(&_otherImage);
+    assert((otherImage != NULL) && "Attempting to compare invalid image.");
+    assert(pixelIndex + numPixels <= this->getNumberOfPixels());
+    assert(otherPixelIndex + numPixels <= otherImage->getNumberOfPixels());
+
+    return std::equal(this->getColorBuffer(pixelIndex),
+                      this->getColorBuffer(pixelIndex + numPixels),
+                      otherImage->getColorBuffer(otherPixelIndex));
+  }
+
   std::unique_ptr<ImageFull> Gather(int recvRank,
                                     MPI_Comm communicator) const final {
     int rank;
@@ -268,43 +356,67 @@ class ImageColorOnly : public ImageFull, ImageColorOnlyBase {
     return std::unique_ptr<ImageFull>(recvImage);
   }
 
-  std::vector<MPI_Request> ISend(int destRank,
-                                 MPI_Comm communicator) const final {
-    std::vector<MPI_Request> requests =
-        this->ISendMetaData(destRank, communicator);
-
-    MPI_Request colorRequest;
-    MPI_Isend(this->getColorBuffer(),
-              this->getNumberOfPixels() * sizeof(ColorType) * ColorVecSize,
-              MPI_BYTE,
-              destRank,
-              COLOR_BUFFER_TAG,
-              communicator,
-              &colorRequest);
-    requests.push_back(colorRequest);
-
-    return requests;
+  void sendMessages(ImageSender& sender) const final {
+    this->sendMetaData(sender);
+    this->sendPixels(0, this->getNumberOfPixels(), sender);
   }
 
-  std::vector<MPI_Request> IReceive(int sourceRank,
-                                    MPI_Comm communicator) final {
-    std::vector<MPI_Request> requests =
-        this->IReceiveMetaData(sourceRank, communicator);
-
-    MPI_Request colorRequest;
-    MPI_Irecv(this->getColorBuffer(),
-              this->getNumberOfPixels() * sizeof(ColorType) * ColorVecSize,
-              MPI_BYTE,
-              sourceRank,
-              COLOR_BUFFER_TAG,
-              communicator,
-              &colorRequest);
-    requests.push_back(colorRequest);
-
-    return requests;
+  void receiveMessages(ImageReceiver& receiver) final {
+    this->receiveMetaData(receiver);
+    receiver.receive(this->getColorBuffer(),
+                     this->getNumberOfPixels() * sizeof(ColorType) *
+                         ColorVecSize,
+                     COLOR_BUFFER_TAG);
   }
 
  protected:
+  void sendSubrangeMessages(int subregionBegin,
+                            int subregionEnd,
+                            ImageSender& sender,
+                            Internals& metaDataOut,
+                            SubrangeSendBuffers&) const final {
+    this->sendSubrangeMetaData(
+        subregionBegin, subregionEnd, sender, metaDataOut);
+    this->sendPixels(subregionBegin, subregionEnd, sender);
+  }
+
+  std::unique_ptr<Image> blendSubranges(int subregionBegin,
+                                        int subregionEnd,
+                                        const Image& _otherImage,
+                                        int otherSubregionBegin,
+                                        int otherSubregionEnd) const final {
+    const ThisType* otherImage = dynamic_cast<const ThisType*>(&_otherImage);
+    if (otherImage == NULL) {
+      return this->Image::blendSubranges(subregionBegin,
+                                         subregionEnd,
+                                         _otherImage,
+                                         otherSubregionBegin,
+                                         otherSubregionEnd);
+    }
+    return blendSpans(
+        Span(*this, subregionBegin, subregionEnd),
+        Span(*otherImage, otherSubregionBegin, otherSubregionEnd));
+  }
+
+  int countActiveSamples(int checkBegin,
+                         int checkEnd,
+                         int sampleStride) const final {
+    // Background is transparent black, as when compressing.
+    ColorType backgroundColor[ColorVecSize];
+    Features::encodeColor(Color(0, 0, 0, 0), backgroundColor);
+
+    int numActiveSamples = 0;
+    for (int pixelIndex = checkBegin; pixelIndex < checkEnd;
+         pixelIndex += sampleStride) {
+      if (!std::equal(backgroundColor,
+                      backgroundColor + ColorVecSize,
+                      this->getColorBuffer(pixelIndex))) {
+        ++numActiveSamples;
+      }
+    }
+    return numActiveSamples;
+  }
+
   void clearImpl(const Color& color, float) final {
     int numPixels = this->getNumberOfPixels();
     if (numPixels < 1) {
@@ -324,6 +436,95 @@ class ImageColorOnly : public ImageFull, ImageColorOnlyBase {
       }
     }
   }
+
+ private:
+  void sendPixels(int subregionBegin,
+                  int subregionEnd,
+                  ImageSender& sender) const {
+    sender.send(this->getColorBuffer(subregionBegin),
+                (subregionEnd - subregionBegin) * sizeof(ColorType) *
+                    ColorVecSize,
+                COLOR_BUFFER_TAG);
+  }
+
+  static std::unique_ptr<Image> blendSpans(const Span& topImage,
+                                           const Span& bottomImage) {
+    assert(topImage.getRegionBegin() <= bottomImage.getRegionEnd());
+    assert(bottomImage.getRegionBegin() <= topImage.getRegionEnd());
+
+    int totalRegionBegin =
+        std::min(topImage.getRegionBegin(), bottomImage.getRegionBegin());
+    int totalRegionEnd =
+        std::max(topImage.getRegionEnd(), bottomImage.getRegionEnd());
+
+    const ThisType& image = topImage.getImage();
+    std::unique_ptr<Image> outImageHolder = image.createNew(
+        image.getWidth(),
+        image.getHeight(),
+        totalRegionBegin,
+        totalRegionEnd,
+        image.getValidViewport().intersectWith(
+            bottomImage.getImage().getValidViewport()));
+    ThisType* outImage = dynamic_cast<ThisType*>(outImageHolder.get());
+    assert((outImage != NULL) && "Internal error: createNew bad type.");
+
+    int topPixelIndex = 0;
+    int bottomPixelIndex = 0;
+    int outPixelIndex = 0;
+
+    // Manage where part of one image has a region that starts before the other
+    if (topImage.getRegionBegin() < bottomImage.getRegionBegin()) {
+      int numToCopy =
+          bottomImage.getRegionBegin() - topImage.getRegionBegin();
+      std::copy(topImage.getColorBuffer(0),
+                topImage.getColorBuffer(numToCopy),
+                outImage->getColorBuffer(0));
+      topPixelIndex += numToCopy;
+      outPixelIndex += numToCopy;
+    } else if (bottomImage.getRegionBegin() < topImage.getRegionBegin()) {
+      int numToCopy =
+          topImage.getRegionBegin() - bottomImage.getRegionBegin();
+      std::copy(bottomImage.getColorBuffer(0),
+                bottomImage.getColorBuffer(numToCopy),
+                outImage->getColorBuffer(0));
+      bottomPixelIndex += numToCopy;
+      outPixelIndex += numToCopy;
+    }
+
+    // Blend where the two images intersect
+    while ((topPixelIndex < topImage.getNumberOfPixels()) &&
+           (bottomPixelIndex < bottomImage.getNumberOfPixels())) {
+      Features::blend(topImage.getColorBuffer(topPixelIndex),
+                      bottomImage.getColorBuffer(bottomPixelIndex),
+                      outImage->getColorBuffer(outPixelIndex));
+      ++topPixelIndex;
+      ++bottomPixelIndex;
+      ++outPixelIndex;
+    }
+
+    // Manage where part of one image has a region past the end of the other
+    if (topPixelIndex < topImage.getNumberOfPixels()) {
+      int numToCopy = topImage.getNumberOfPixels() - topPixelIndex;
+      std::copy(topImage.getColorBuffer(topPixelIndex),
+                topImage.getColorBuffer(topPixelIndex + numToCopy),
+                outImage->getColorBuffer(outPixelIndex));
+      topPixelIndex += numToCopy;
+      outPixelIndex += numToCopy;
+    }
+
+    if (bottomPixelIndex < bottomImage.getNumberOfPixels()) {
+      int numToCopy = bottomImage.getNumberOfPixels() - bottomPixelIndex;
+      std::copy(bottomImage.getColorBuffer(bottomPixelIndex),
+                bottomImage.getColorBuffer(bottomPixelIndex + numToCopy),
+                outImage->getColorBuffer(outPixelIndex));
+      bottomPixelIndex += numToCopy;
+      outPixelIndex += numToCopy;
+    }
+
+    assert(outPixelIndex == outImage->getNumberOfPixels());
+
+    return outImageHolder;
+  }
 };
 
 #endif  // IMAGECOLORONLY_HPP
@@ -11,6 +11,8 @@
 
 #include "Image.hpp"
 
+#include <algorithm>
+
 class ImageSparse;
 
 class ImageFull : public Image {
@@ -80,6 +82,63 @@ class ImageFull : public Image {
 
   virtual std::unique_ptr<ImageSparse> compress() const = 0;
 
+  /// \brief Compresses this image directly into separate pieces.
+  ///
+  /// The image is split into \a numPieces pieces, and \a splitPoints gives
+  /// the first pixel (with respect to the region of this image) of each
+  /// piece after the first, so it has \a numPieces - 1 increasing entries.
+  /// This is the same as compressing the image and then taking a window of
+  /// each piece, but the image is scanned only once and each piece gets its
+  /// own buffers, so the pieces are ready to send without further windowing.
+  virtual std::vector<std::unique_ptr<ImageSparse>> compressInto(
+      int numPieces, const std::vector<int>& splitPoints) const = 0;
+
+  /// \brief Estimates the number of pixels that are not background.
+  ///
+  /// These are the pixels that compressing the image keeps. Only every \a
+  /// sampleStride'th pixel is checked, and the count is scaled up to all the
+  /// pixels, so a stride of 1 gives the exact number.
+  int countActivePixels(int sampleStride = 1) const {
+    assert(sampleStride > 0);
+    int width = this->getWidth();
+    int numPixels = this->getNumberOfPixels();
+    const Viewport& validViewport = this->getValidViewport();
+
+    // As when compressing, rows outside of the valid viewport are all
+    // background, so only the pixels in the rows between are checked.
+    int checkBegin = std::min(
+        std::max(validViewport.getMinY() * width - this->getRegionBegin(), 0),
+        numPixels);
+    int checkEnd = std::min(std::max((validViewport.getMaxY() + 1) * width -
+                                         this->getRegionBegin(),
+                                     checkBegin),
+                            numPixels);
+
+    long long numActiveSamples =
+        this->countActiveSamples(checkBegin, checkEnd, sampleStride);
+    return static_cast<int>(std::min<long long>(
+        numActiveSamples * sampleStride, checkEnd - checkBegin));
+  }
+
+  /// \brief Copies pixels from another image of the same type.
+  ///
+  /// Copies \a numPixels pixels starting at \a sourcePixelIndex in \a
+  /// sourceImage into this image starting at \a pixelIndex.
+  virtual void copyPixels(int pixelIndex,
+                          const ImageFull& sourceImage,
+                          int sourcePixelIndex,
+                          int numPixels) = 0;
+
+  /// \brief Returns true if pixels match exactly those of another image.
+  ///
+  /// Compares \a numPixels pixels starting at \a pixelIndex in this image
+  /// with those starting at \a otherPixelIndex in \a otherImage, which must
+  /// be of the same type.
+  virtual bool pixelsEqual(int pixelIndex,
+                           const ImageFull& otherImage,
+                           int otherPixelIndex,
+                           int numPixels) const = 0;
+
   /// \brief Gathers all images to a single image.
   ///
   /// Given an MPI communicator and a destination rank, collects all images
@@ -87,6 +146,13 @@ class ImageFull : public Image {
   /// distinct subregion.
   virtual std::unique_ptr<ImageFull> Gather(int recvRank,
                                             MPI_Comm communicator) const = 0;
+
+ protected:
+  /// Returns how many of every \a sampleStride'th pixel from \a checkBegin
+  /// up to \a checkEnd are not background (see \c countActivePixels).
+  virtual int countActiveSamples(int checkBegin,
+                                 int checkEnd,
+                                 int sampleStride) const = 0;
 };
 
 #endif  // IMAGEFULL_HPP
@@ -0,0 +1,59 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include "ImageMessenger.hpp"
+
+void ImageSenderMPI::send(int numBlocks,
+                          const int* blockLengths,
+                          const void* const* blockAddresses,
+                          int tag) {
+  MPI_Request request;
+  if (numBlocks == 1) {
+    MPI_Isend(blockAddresses[0],
+              blockLengths[0],
+              MPI_BYTE,
+              this->destRank,
+              tag,
+              this->communicator,
+              &request);
+    this->requests.push_back(request);
+    return;
+  }
+
+  // Send the blocks where they are with a datatype that picks up each one.
+  std::vector<MPI_Aint> addresses(numBlocks);
+  for (int blockIndex = 0; blockIndex < numBlocks; ++blockIndex) {
+    MPI_Get_address(blockAddresses[blockIndex], &addresses[blockIndex]);
+  }
+  MPI_Datatype blocksType;
+  MPI_Type_create_hindexed(
+      numBlocks, blockLengths, addresses.data(), MPI_BYTE, &blocksType);
+  MPI_Type_commit(&blocksType);
+  MPI_Isend(MPI_BOTTOM,
+            1,
+            blocksType,
+            this->destRank,
+            tag,
+            this->communicator,
+            &request);
+  // The type is not actually freed until the send finishes.
+  MPI_Type_free(&blocksType);
+  this->requests.push_back(request);
+}
+
+void ImageReceiverMPI::receive(void* buffer, int maxLength, int tag) {
+  MPI_Request request;
+  MPI_Irecv(buffer,
+            maxLength,
+            MPI_BYTE,
+            this->sourceRank,
+            tag,
+            this->communicator,
+            &request);
+  this->requests.push_back(request);
+}
@@ -0,0 +1,94 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef IMAGEMESSENGER_HPP
+#define IMAGEMESSENGER_HPP
+
+#include <vector>
+
+#include <mpi.h>
+
+/// \brief Carries the messages an image is sent as.
+///
+/// An image is sent as a few messages: its metadata and then each of its
+/// buffers. Images give each message to an ImageSender, which can send it
+/// right away as an MPI message (\c ImageSenderMPI) or collect it with the
+/// messages of other images (\c ImagePackedSender). A receiving image gives
+/// the buffer for each message to an \c ImageReceiver in the same order.
+///
+class ImageSender {
+ public:
+  virtual ~ImageSender() = default;
+
+  /// \brief Sends the given blocks of memory as one message.
+  ///
+  /// The blocks are sent one after another, and the receiver gets them as
+  /// one contiguous buffer. They must stay in place until the send finishes.
+  virtual void send(int numBlocks,
+                    const int* blockLengths,
+                    const void* const* blockAddresses,
+                    int tag) = 0;
+
+  /// \brief Sends \a length bytes at \a buffer as one message.
+  void send(const void* buffer, int length, int tag) {
+    this->send(1, &length, &buffer, tag);
+  }
+};
+
+/// \brief Receives the messages an image is sent as.
+///
+/// See \c ImageSender.
+///
+class ImageReceiver {
+ public:
+  virtual ~ImageReceiver() = default;
+
+  /// \brief Receives a message of at most \a maxLength bytes into \a buffer.
+  ///
+  /// Bytes of the buffer past the end of the message are left as they are.
+  /// The buffer might not be filled until the receive finishes.
+  virtual void receive(void* buffer, int maxLength, int tag) = 0;
+};
+
+/// \brief Sends each message of an image as an MPI message of its own.
+class ImageSenderMPI : public ImageSender {
+  int destRank;
+  MPI_Comm communicator;
+  std::vector<MPI_Request> requests;
+
+ public:
+  ImageSenderMPI(int _destRank, MPI_Comm _communicator)
+      : destRank(_destRank), communicator(_communicator) {}
+
+  using ImageSender::send;
+  void send(int numBlocks,
+            const int* blockLengths,
+            const void* const* blockAddresses,
+            int tag) final;
+
+  /// The requests of the messages sent so far.
+  std::vector<MPI_Request>& getRequests() { return this->requests; }
+};
+
+/// \brief Receives each message of an image as an MPI message of its own.
+class ImageReceiverMPI : public ImageReceiver {
+  int sourceRank;
+  MPI_Comm communicator;
+  std::vector<MPI_Request> requests;
+
+ public:
+  ImageReceiverMPI(int _sourceRank, MPI_Comm _communicator)
+      : sourceRank(_sourceRank), communicator(_communicator) {}
+
+  void receive(void* buffer, int maxLength, int tag) final;
+
+  /// The requests of the messages received so far.
+  std::vector<MPI_Request>& getRequests() { return this->requests; }
+};
+
+#endif  // IMAGEMESSENGER_HPP
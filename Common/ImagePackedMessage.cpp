@@ -0,0 +1,128 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include "ImagePackedMessage.hpp"
+
+#include <cassert>
+
+static const int PACKED_IMAGES_TAG = 59464;
+static const int PACKED_HEADERS_TAG = 59465;
+
+void ImagePackedSender::send(int numBlocks,
+                             const int* _blockLengths,
+                             const void* const* _blockAddresses,
+                             int tag) {
+  int length = 0;
+  for (int blockIndex = 0; blockIndex < numBlocks; ++blockIndex) {
+    length += _blockLengths[blockIndex];
+  }
+  this->headers.push_back(tag);
+  this->headers.push_back(length);
+
+  this->blockLengths.insert(
+      this->blockLengths.end(), _blockLengths, _blockLengths + numBlocks);
+  this->blockAddresses.insert(this->blockAddresses.end(),
+                              _blockAddresses,
+                              _blockAddresses + numBlocks);
+}
+
+void ImagePackedSender::add(ImageView&& view) {
+  this->views.push_back(std::move(view));
+  this->views.back().sendMessages(*this);
+}
+
+void ImagePackedSender::ISend(int destRank,
+                              MPI_Comm communicator,
+                              std::vector<MPI_Request>& requestsOut) const {
+  ImageSenderMPI sender(destRank, communicator);
+  if (this->headers.size() != 2) {
+    sender.send(this->headers.data(),
+                static_cast<int>(this->headers.size() * sizeof(int)),
+                PACKED_HEADERS_TAG);
+  }
+  sender.send(static_cast<int>(this->blockLengths.size()),
+              this->blockLengths.data(),
+              this->blockAddresses.data(),
+              PACKED_IMAGES_TAG);
+  requestsOut.insert(requestsOut.end(),
+                     sender.getRequests().begin(),
+                     sender.getRequests().end());
+}
+
+void ImagePackedReceiver::receive(void* buffer, int maxLength, int tag) {
+  this->destinations.push_back(Destination{buffer, maxLength, tag});
+}
+
+MPI_Request ImagePackedReceiver::IReceive(int _sourceRank,
+                                          MPI_Comm _communicator) {
+  this->sourceRank = _sourceRank;
+  this->communicator = _communicator;
+
+  ImageReceiverMPI receiver(this->sourceRank, this->communicator);
+  if (this->destinations.size() == 1) {
+    // A single message is received in place without any headers.
+    this->receivingHeaders = false;
+    receiver.receive(this->destinations[0].buffer,
+                     this->destinations[0].maxLength,
+                     PACKED_IMAGES_TAG);
+  } else {
+    this->receivingHeaders = true;
+    this->headers.resize(2 * this->destinations.size());
+    receiver.receive(this->headers.data(),
+                     static_cast<int>(this->headers.size() * sizeof(int)),
+                     PACKED_HEADERS_TAG);
+  }
+  return receiver.getRequests().front();
+}
+
+bool ImagePackedReceiver::finishReceive(MPI_Request& request) {
+  if (!this->receivingHeaders) {
+    return true;
+  }
+  this->receivingHeaders = false;
+
+  // Now that the length of each message is known, receive each straight
+  // into its buffer.
+  std::vector<int> lengths;
+  std::vector<MPI_Aint> addresses;
+  for (std::size_t index = 0; index < this->destinations.size(); ++index) {
+    const Destination& destination = this->destinations[index];
+    int length = this->headers[2 * index + 1];
+    assert(this->headers[2 * index] == destination.tag);
+    assert(length <= destination.maxLength);
+    if (length > 0) {
+      MPI_Aint address;
+      MPI_Get_address(destination.buffer, &address);
+      lengths.push_back(length);
+      addresses.push_back(address);
+    }
+  }
+  MPI_Datatype blocksType;
+  MPI_Type_create_hindexed(static_cast<int>(lengths.size()),
+                           lengths.data(),
+                           addresses.data(),
+                           MPI_BYTE,
+                           &blocksType);
+  MPI_Type_commit(&blocksType);
+  MPI_Irecv(MPI_BOTTOM,
+            1,
+            blocksType,
+            this->sourceRank,
+            PACKED_IMAGES_TAG,
+            this->communicator,
+            &request);
+  // The type is not actually freed until the receive finishes.
+  MPI_Type_free(&blocksType);
+  return false;
+}
+
+void ImagePackedReceiver::wait(MPI_Request& request) {
+  do {
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+  } while (!this->finishReceive(request));
+}
@@ -0,0 +1,115 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef IMAGEPACKEDMESSAGE_HPP
+#define IMAGEPACKEDMESSAGE_HPP
+
+#include <Common/Image.hpp>
+#include <Common/ImageMessenger.hpp>
+#include <Common/ImageView.hpp>
+
+#include <deque>
+#include <vector>
+
+#include <mpi.h>
+
+/// \brief Sends many images to one process as a single MPI message.
+///
+/// Each image is sent as a few messages (see \c ImageSender), so sending the
+/// images (or pieces of images) of several frames to the same process one at
+/// a time posts many small messages. An ImagePackedSender collects the
+/// messages of all the images added to it and sends them as one MPI message
+/// whose datatype picks up each block where it is, so nothing is copied to
+/// send. The other process receives them with an \c ImagePackedReceiver
+/// given images of the same types in the same order.
+///
+/// The receiver has to know how long each message is to receive them in
+/// place, so unless there is only one message, the tag and length of each
+/// are sent ahead in a small message of their own.
+///
+class ImagePackedSender : public ImageSender {
+  // The tag and length of each message.
+  std::vector<int> headers;
+  std::vector<int> blockLengths;
+  std::vector<const void*> blockAddresses;
+  std::deque<ImageView> views;
+
+ public:
+  using ImageSender::send;
+  void send(int numBlocks,
+            const int* blockLengths,
+            const void* const* blockAddresses,
+            int tag) final;
+
+  /// \brief Adds the messages of an image.
+  ///
+  /// The image must stay in place until the send finishes.
+  void add(const Image& image) { image.sendMessages(*this); }
+
+  /// \brief Adds the messages of a view.
+  ///
+  /// The view is kept here until the send finishes. The viewed image must
+  /// stay in place until then.
+  void add(ImageView&& view);
+
+  /// \brief Sends the messages of everything added without blocking.
+  ///
+  /// The requests of the send are added to \a requestsOut. This object must
+  /// stay in place until they finish.
+  void ISend(int destRank,
+             MPI_Comm communicator,
+             std::vector<MPI_Request>& requestsOut) const;
+};
+
+/// \brief Receives many images sent by an \c ImagePackedSender.
+///
+/// Add the images (of the same types and in the same order as the ones sent)
+/// that receive the data and post the receive with \c IReceive. Each time
+/// the request finishes, call \c finishReceive, which might post the rest of
+/// the receive to the request. The data are received straight into the
+/// images.
+///
+class ImagePackedReceiver : public ImageReceiver {
+  struct Destination {
+    void* buffer;
+    int maxLength;
+    int tag;
+  };
+  std::vector<Destination> destinations;
+  std::vector<int> headers;
+  int sourceRank;
+  MPI_Comm communicator;
+  bool receivingHeaders;
+
+ public:
+  ImagePackedReceiver()
+      : sourceRank(-1), communicator(MPI_COMM_NULL), receivingHeaders(false) {}
+
+  void receive(void* buffer, int maxLength, int tag) final;
+
+  /// \brief Adds an image to receive into.
+  ///
+  /// The image must stay in place and must not be changed until the receive
+  /// finishes.
+  void add(Image& image) { image.receiveMessages(*this); }
+
+  /// \brief Receives the messages of all the images added without blocking.
+  MPI_Request IReceive(int sourceRank, MPI_Comm communicator);
+
+  /// \brief Continues the receive once \a request finishes.
+  ///
+  /// Returns true if all the images have been received. Otherwise, the
+  /// receive of the image data (whose lengths are now known) is posted to \a
+  /// request, which has to be waited on and given here again.
+  bool finishReceive(MPI_Request& request);
+
+  /// \brief Blocks until all the images are received.
+  void wait(MPI_Request& request);
+};
+
+#endif  // IMAGEPACKEDMESSAGE_HPP
@@ -43,6 +43,12 @@ std::unique_ptr<ImageSparse> ImageRGBAFloatColorOnly::compress() const {
       new ImageSparseColorOnly<ImageRGBAFloatColorOnlyFeatures>(*this));
 }
 
+std::vector<std::unique_ptr<ImageSparse>> ImageRGBAFloatColorOnly::compressInto(
+    int numPieces, const std::vector<int>& splitPoints) const {
+  using SparseType = ImageSparseColorOnly<ImageRGBAFloatColorOnlyFeatures>;
+  return SparseType::compressInto(*this, numPieces, splitPoints);
+}
+
 std::unique_ptr<Image> ImageRGBAFloatColorOnly::createNewImpl(
     int _width, int _height, int _regionBegin, int _regionEnd) const {
   return std::unique_ptr<Image>(
@@ -63,6 +63,14 @@ std::unique_ptr<ImageSparse> ImageRGBAUByteColorFloatDepth::compress() const {
       new ImageSparseColorDepth<ImageRGBAUByteColorFloatDepthFeatures>(*this));
 }
 
+std::vector<std::unique_ptr<ImageSparse>>
+ImageRGBAUByteColorFloatDepth::compressInto(
+    int numPieces, const std::vector<int>& splitPoints) const {
+  using SparseType =
+      ImageSparseColorDepth<ImageRGBAUByteColorFloatDepthFeatures>;
+  return SparseType::compressInto(*this, numPieces, splitPoints);
+}
+
 std::unique_ptr<Image> ImageRGBAUByteColorFloatDepth::createNewImpl(
     int _width, int _height, int _regionBegin, int _regionEnd) const {
   return std::unique_ptr<Image>(new ImageRGBAUByteColorFloatDepth(
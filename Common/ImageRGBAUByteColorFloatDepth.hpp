@@ -40,6 +40,9 @@ class ImageRGBAUByteColorFloatDepth
 
   std::unique_ptr<ImageSparse> compress() const final;
 
+  std::vector<std::unique_ptr<ImageSparse>> compressInto(
+      int numPieces, const std::vector<int>& splitPoints) const final;
+
  protected:
   std::unique_ptr<Image> createNewImpl(int _width,
                                        int _height,
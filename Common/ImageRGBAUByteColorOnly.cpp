@@ -51,6 +51,12 @@ std::unique_ptr<ImageSparse> ImageRGBAUByteColorOnly::compress() const {
       new ImageSparseColorOnly<ImageRGBAUByteColorOnlyFeatures>(*this));
 }
 
+std::vector<std::unique_ptr<ImageSparse>> ImageRGBAUByteColorOnly::compressInto(
+    int numPieces, const std::vector<int>& splitPoints) const {
+  using SparseType = ImageSparseColorOnly<ImageRGBAUByteColorOnlyFeatures>;
+  return SparseType::compressInto(*this, numPieces, splitPoints);
+}
+
 std::unique_ptr<Image> ImageRGBAUByteColorOnly::createNewImpl(
     int _width, int _height, int _regionBegin, int _regionEnd) const {
   return std::unique_ptr<Image>(
@@ -49,6 +49,9 @@ class ImageRGBAUByteColorOnly
 
   std::unique_ptr<ImageSparse> compress() const final;
 
+  std::vector<std::unique_ptr<ImageSparse>> compressInto(
+      int numPieces, const std::vector<int>& splitPoints) const final;
+
  protected:
   std::unique_ptr<Image> createNewImpl(int _width,
                                        int _height,
@@ -48,6 +48,12 @@ std::unique_ptr<ImageSparse> ImageRGBFloatColorDepth::compress() const {
       new ImageSparseColorDepth<ImageRGBFloatColorDepthFeatures>(*this));
 }
 
+std::vector<std::unique_ptr<ImageSparse>> ImageRGBFloatColorDepth::compressInto(
+    int numPieces, const std::vector<int>& splitPoints) const {
+  using SparseType = ImageSparseColorDepth<ImageRGBFloatColorDepthFeatures>;
+  return SparseType::compressInto(*this, numPieces, splitPoints);
+}
+
 std::unique_ptr<Image> ImageRGBFloatColorDepth::createNewImpl(
     int _width, int _height, int _regionBegin, int _regionEnd) const {
   return std::unique_ptr<Image>(
@@ -8,6 +8,8 @@
 
 #include "ImageSparse.hpp"
 
+#include <algorithm>
+
 int ImageSparse::RunLengthIterator::advance(int numPixels) {
   int numActivePixels = 0;
   while (numPixels > 0) {
@@ -62,14 +64,204 @@ void ImageSparse::RunLengthIterator::copyPixels(
       outRunlengths.push_back(this->workingRegion);
       numActivePixels += this->getWorkingForeground();
       numPixels -= this->getWorkingPixels();
-      this->workingRegion = *this->currentRegion;
-      ++this->currentRegion;
+      this->workingRegion = RunLengthRegion();
       this->updateWorkingRegion();
     }
     this->verify();
   }
 }
 
+std::size_t ImageSparse::findRunLength(int pixelIndex,
+                                       int& pixelsBefore,
+                                       int& activePixelsBefore) const {
+  std::size_t regionIndex = 0;
+  pixelsBefore = 0;
+  activePixelsBefore = 0;
+
+  if (this->runLengths->size() > RUN_LENGTH_INDEX_STRIDE) {
+    std::vector<RunLengthIndexEntry>& index = this->runLengths->index;
+    if (index.empty()) {
+      index.reserve(this->runLengths->size() / RUN_LENGTH_INDEX_STRIDE + 1);
+      int pixelOffset = 0;
+      int activePixelOffset = 0;
+      for (std::size_t indexedRegion = 0;
+           indexedRegion < this->runLengths->size();
+           ++indexedRegion) {
+        const RunLengthRegion& runLength = (*this->runLengths)[indexedRegion];
+        if ((runLength.backgroundPixels == 0) &&
+            (runLength.foregroundPixels == 0)) {
+          // Anything past here is unused space (see shrinkArraysImpl).
+          break;
+        }
+        if ((indexedRegion % RUN_LENGTH_INDEX_STRIDE) == 0) {
+          index.emplace_back(pixelOffset, activePixelOffset);
+        }
+        pixelOffset += runLength.backgroundPixels + runLength.foregroundPixels;
+        activePixelOffset += runLength.foregroundPixels;
+      }
+      if (index.empty()) {
+        index.emplace_back(0, 0);
+      }
+    }
+
+    // Find the last indexed run length that starts at or before pixelIndex.
+    auto entry = std::upper_bound(
+        index.begin(),
+        index.end(),
+        pixelIndex,
+        [](int pixel, const RunLengthIndexEntry& indexEntry) {
+          return pixel < indexEntry.pixelOffset;
+        });
+    assert(entry != index.begin());
+    --entry;
+
+    regionIndex = (entry - index.begin()) * RUN_LENGTH_INDEX_STRIDE;
+    pixelsBefore = entry->pixelOffset;
+    activePixelsBefore = entry->activePixelOffset;
+  }
+  // Otherwise there are too few run lengths to be worth building an index.
+
+  for (; regionIndex < this->runLengths->size(); ++regionIndex) {
+    const RunLengthRegion& runLength = (*this->runLengths)[regionIndex];
+    int runLengthPixels =
+        runLength.backgroundPixels + runLength.foregroundPixels;
+    if ((runLengthPixels == 0) ||
+        (pixelIndex < pixelsBefore + runLengthPixels)) {
+      // Either this run length has the pixel or it is past the end.
+      break;
+    }
+    pixelsBefore += runLengthPixels;
+    activePixelsBefore += runLength.foregroundPixels;
+  }
+  return regionIndex;
+}
+
+ImageSparse::RunLengthIterator ImageSparse::seekRunLengths(
+    int pixelIndex,
+    int& activePixelsBefore) const {
+  int pixelsBefore;
+  std::size_t regionIndex =
+      this->findRunLength(pixelIndex, pixelsBefore, activePixelsBefore);
+  RunLengthIterator iterator(*this->runLengths, regionIndex);
+  activePixelsBefore += iterator.advance(pixelIndex - pixelsBefore);
+  return iterator;
+}
+
+ImageSparse::RunLengthIterator ImageSparse::seekRunLengthRegion(
+    int subregionBegin,
+    int subregionEnd,
+    int& activeSubregionBegin,
+    int& activeSubregionEnd) const {
+  assert(subregionBegin <= subregionEnd);
+  assert(subregionBegin >= 0);
+  assert(subregionEnd <= this->getNumberOfPixels());
+
+  this->seekRunLengths(subregionEnd, activeSubregionEnd);
+  RunLengthIterator iterator =
+      this->seekRunLengths(subregionBegin, activeSubregionBegin);
+  iterator.limitPixels(subregionEnd - subregionBegin);
+  return iterator;
+}
+
+// Writes the part of a run length (which starts at runLengthBegin) inside a
+// subrange as a background/foreground pair.
+static void cutRunLength(int backgroundPixels,
+                         int foregroundPixels,
+                         int runLengthBegin,
+                         int subregionBegin,
+                         int subregionEnd,
+                         int* cutRunLengthOut) {
+  int foregroundBegin = runLengthBegin + backgroundPixels;
+  int foregroundEnd = foregroundBegin + foregroundPixels;
+  cutRunLengthOut[0] =
+      std::max(0,
+               std::min(foregroundBegin, subregionEnd) -
+                   std::max(runLengthBegin, subregionBegin));
+  cutRunLengthOut[1] =
+      std::max(0,
+               std::min(foregroundEnd, subregionEnd) -
+                   std::max(foregroundBegin, subregionBegin));
+}
+
+void ImageSparse::sendRunLengthRegion(int subregionBegin,
+                                      int subregionEnd,
+                                      ImageSender& sender,
+                                      int tag,
+                                      SubrangeSendBuffers& buffersOut,
+                                      int& activeSubregionBegin,
+                                      int& activeSubregionEnd) const {
+  assert(subregionBegin <= subregionEnd);
+  assert(subregionBegin >= 0);
+  assert(subregionEnd <= this->getNumberOfPixels());
+
+  if (subregionBegin == subregionEnd) {
+    activeSubregionBegin = activeSubregionEnd = 0;
+    sender.send(NULL, 0, tag);
+    return;
+  }
+
+  int firstPixelsBefore;
+  int firstActivePixelsBefore;
+  std::size_t firstRegion = this->findRunLength(
+      subregionBegin, firstPixelsBefore, firstActivePixelsBefore);
+  int lastPixelsBefore;
+  int lastActivePixelsBefore;
+  std::size_t lastRegion = this->findRunLength(
+      subregionEnd - 1, lastPixelsBefore, lastActivePixelsBefore);
+  const RunLengthRegion& first = (*this->runLengths)[firstRegion];
+  const RunLengthRegion& last = (*this->runLengths)[lastRegion];
+
+  activeSubregionBegin =
+      firstActivePixelsBefore +
+      std::max(0,
+               subregionBegin - (firstPixelsBefore + first.backgroundPixels));
+  activeSubregionEnd =
+      lastActivePixelsBefore +
+      std::max(0, subregionEnd - (lastPixelsBefore + last.backgroundPixels));
+
+  static_assert(sizeof(RunLengthRegion) == 2 * sizeof(int),
+                "Edge run lengths are held as pairs of ints.");
+
+  // The message is the cut first run length, the run lengths between the
+  // first and last, and the cut last run length, sent as one message made
+  // of the blocks where each piece is.
+  int* edgeRunLengths = buffersOut.edgeRunLengths;
+  int blockLengths[3];
+  const void* blockAddresses[3];
+  int numBlocks = 0;
+
+  cutRunLength(first.backgroundPixels,
+               first.foregroundPixels,
+               firstPixelsBefore,
+               subregionBegin,
+               subregionEnd,
+               edgeRunLengths);
+  blockLengths[numBlocks] = sizeof(RunLengthRegion);
+  blockAddresses[numBlocks] = edgeRunLengths;
+  ++numBlocks;
+
+  if (lastRegion > firstRegion) {
+    if (lastRegion > firstRegion + 1) {
+      blockLengths[numBlocks] =
+          sizeof(RunLengthRegion) * (lastRegion - firstRegion - 1);
+      blockAddresses[numBlocks] = &(*this->runLengths)[firstRegion + 1];
+      ++numBlocks;
+    }
+
+    cutRunLength(last.backgroundPixels,
+                 last.foregroundPixels,
+                 lastPixelsBefore,
+                 subregionBegin,
+                 subregionEnd,
+                 edgeRunLengths + 2);
+    blockLengths[numBlocks] = sizeof(RunLengthRegion);
+    blockAddresses[numBlocks] = edgeRunLengths + 2;
+    ++numBlocks;
+  }
+
+  sender.send(numBlocks, blockLengths, blockAddresses, tag);
+}
+
 void ImageSparse::copyRunlengthRegion(
     int subregionBegin,
     int subregionEnd,
@@ -80,10 +272,9 @@ void ImageSparse::copyRunlengthRegion(
   assert(subregionBegin >= 0);
   assert(subregionEnd <= this->getNumberOfPixels());
 
-  RunLengthIterator inRunLength = this->createRunLengthIterator();
-
   // Skip over run lengths before subregionBegin
-  activeSubregionBegin = inRunLength.advance(subregionBegin);
+  RunLengthIterator inRunLength =
+      this->seekRunLengths(subregionBegin, activeSubregionBegin);
 
   // Copy run lengths over the range
   int numActiveToCopy;
@@ -92,3 +283,16 @@ void ImageSparse::copyRunlengthRegion(
 
   activeSubregionEnd = activeSubregionBegin + numActiveToCopy;
 }
+
+int ImageSparse::getNumberOfActivePixels() const {
+  int numActivePixels = 0;
+  for (auto&& runLength : *this->runLengths) {
+    if ((runLength.backgroundPixels == 0) &&
+        (runLength.foregroundPixels == 0)) {
+      // Anything past here is unused space (see shrinkArraysImpl).
+      break;
+    }
+    numActivePixels += runLength.foregroundPixels;
+  }
+  return numActivePixels;
+}
@@ -11,6 +11,9 @@
 
 #include "Image.hpp"
 
+#include <algorithm>
+#include <limits>
+
 class ImageFull;
 
 class ImageSparse : public Image {
@@ -24,38 +27,92 @@ class ImageSparse : public Image {
           foregroundPixels(_foregroundPixels) {}
   };
 
-  std::shared_ptr<std::vector<RunLengthRegion>> runLengths;
+  // Images with many run lengths keep an index of where every
+  // RUN_LENGTH_INDEX_STRIDE-th run length starts so that taking a subregion
+  // (such as with window or copySubrange) can seek to it with a binary search
+  // rather than walking all the run lengths before it.
+  static constexpr int RUN_LENGTH_INDEX_STRIDE = 32;
+
+  struct RunLengthIndexEntry {
+    int pixelOffset;
+    int activePixelOffset;
+
+    RunLengthIndexEntry(int _pixelOffset, int _activePixelOffset)
+        : pixelOffset(_pixelOffset), activePixelOffset(_activePixelOffset) {}
+  };
+
+  // The run lengths along with their index. The index lives with the run
+  // lengths so that every image sharing them (such as windows and shallow
+  // copies) shares the index, too. It is built the first time it is needed
+  // (an empty index is not built yet). Anything that changes the run lengths
+  // of an existing image must call runLengthsModified to drop it.
+  struct IndexedRunLengths : std::vector<RunLengthRegion> {
+    mutable std::vector<RunLengthIndexEntry> index;
+  };
+
+  std::shared_ptr<IndexedRunLengths> runLengths;
+
+  void runLengthsModified() { this->runLengths->index.clear(); }
 
   class RunLengthIterator {
     std::vector<RunLengthRegion>::const_iterator currentRegion;
     std::vector<RunLengthRegion>::const_iterator endRegion;
     RunLengthRegion workingRegion;
+    // Number of pixels after the working region the iterator may visit.
+    int pixelsRemaining;
 
     void updateWorkingRegion() {
       while ((this->workingRegion.backgroundPixels == 0) &&
              (this->workingRegion.foregroundPixels == 0) &&
-             (this->currentRegion != this->endRegion)) {
+             (this->currentRegion != this->endRegion) &&
+             (this->pixelsRemaining > 0)) {
         this->workingRegion = *this->currentRegion;
         ++this->currentRegion;
+        this->clipWorkingRegion();
       }
     }
 
+    // Cuts the working region off where the remaining pixels end.
+    void clipWorkingRegion() {
+      RunLengthRegion& region = this->workingRegion;
+      region.backgroundPixels =
+          std::min(region.backgroundPixels, this->pixelsRemaining);
+      region.foregroundPixels =
+          std::min(region.foregroundPixels,
+                   this->pixelsRemaining - region.backgroundPixels);
+      this->pixelsRemaining -=
+          region.backgroundPixels + region.foregroundPixels;
+    }
+
     inline void verify() const {
       assert((this->currentRegion == this->endRegion) ||
+             (this->pixelsRemaining == 0) ||
              (this->workingRegion.backgroundPixels > 0) ||
              (this->workingRegion.foregroundPixels > 0));
     }
 
    public:
-    RunLengthIterator(const std::vector<RunLengthRegion>& runLengths)
-        : currentRegion(runLengths.begin()), endRegion(runLengths.end()) {
+    RunLengthIterator(const std::vector<RunLengthRegion>& runLengths,
+                      std::size_t firstRegion = 0)
+        : currentRegion(runLengths.begin() + firstRegion),
+          endRegion(runLengths.end()),
+          pixelsRemaining(std::numeric_limits<int>::max()) {
+      assert(firstRegion <= runLengths.size());
       this->updateWorkingRegion();
     }
 
+    // Ends the iteration after the given number of pixels (from the current
+    // position) even if there are more run lengths.
+    void limitPixels(int numPixels) {
+      this->pixelsRemaining = numPixels;
+      this->clipWorkingRegion();
+    }
+
     bool atEnd() const {
       return ((this->workingRegion.backgroundPixels == 0) &&
               (this->workingRegion.foregroundPixels == 0) &&
-              (this->currentRegion == this->endRegion));
+              ((this->currentRegion == this->endRegion) ||
+               (this->pixelsRemaining == 0)));
     }
 
     bool inBackground() const {
@@ -96,14 +153,14 @@ class ImageSparse : public Image {
               int _regionEnd,
               const Viewport& _validViewport)
       : Image(_width, _height, _regionBegin, _regionEnd, _validViewport),
-        runLengths(new std::vector<RunLengthRegion>) {}
+        runLengths(new IndexedRunLengths) {}
 
   ImageSparse(int _width,
               int _height,
               int _regionBegin,
               int _regionEnd,
               const Viewport& _validViewport,
-              std::shared_ptr<std::vector<RunLengthRegion>> _runLengths)
+              std::shared_ptr<IndexedRunLengths> _runLengths)
       : Image(_width, _height, _regionBegin, _regionEnd, _validViewport),
         runLengths(_runLengths) {}
 
@@ -142,6 +199,40 @@ class ImageSparse : public Image {
     this->runLengths->resize(runLengthSize);
   }
 
+  // Returns the index in runLengths of the run length containing the given
+  // pixel (or the number of run lengths used if the pixel is at the end).
+  // The numbers of pixels and active pixels before that run length are
+  // returned in pixelsBefore and activePixelsBefore.
+  std::size_t findRunLength(int pixelIndex,
+                            int& pixelsBefore,
+                            int& activePixelsBefore) const;
+
+  // Returns an iterator at the given pixel. The number of active pixels
+  // before that pixel is returned in activePixelsBefore.
+  RunLengthIterator seekRunLengths(int pixelIndex,
+                                   int& activePixelsBefore) const;
+
+  // Returns an iterator over the run lengths of a subrange, which ends at
+  // the end of the subrange. The active pixels of the subrange are those from
+  // activeSubregionBegin to activeSubregionEnd.
+  RunLengthIterator seekRunLengthRegion(int subregionBegin,
+                                        int subregionEnd,
+                                        int& activeSubregionBegin,
+                                        int& activeSubregionEnd) const;
+
+  // Sends the run lengths of a subrange like sendMessages sends all of them
+  // (with the given tag). The run lengths are sent from where they are
+  // except the first and last, which are cut to the subrange in
+  // buffersOut.edgeRunLengths. The active pixels of the subrange are
+  // returned as in seekRunLengthRegion.
+  void sendRunLengthRegion(int subregionBegin,
+                           int subregionEnd,
+                           ImageSender& sender,
+                           int tag,
+                           SubrangeSendBuffers& buffersOut,
+                           int& activeSubregionBegin,
+                           int& activeSubregionEnd) const;
+
   void copyRunlengthRegion(int subregionBegin,
                            int subregionEnd,
                            std::vector<RunLengthRegion>& targetRunLengths,
@@ -150,6 +241,17 @@ class ImageSparse : public Image {
 
  public:
   virtual std::unique_ptr<ImageFull> uncompress() const = 0;
+
+  /// \brief Returns the number of pixels that are not background.
+  int getNumberOfActivePixels() const;
+
+  /// \brief Blends this image behind an image of its uncompressed type.
+  ///
+  /// This is what \c blend of \a topImage with this image does. The result is
+  /// uncompressed, and the background runs of this image are skipped rather
+  /// than uncompressed.
+  virtual std::unique_ptr<ImageFull> blendUnder(
+      const ImageFull& topImage) const = 0;
 };
 
 #endif  // IMAGESPARSE_HPP
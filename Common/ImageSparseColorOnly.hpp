@@ -38,6 +38,51 @@ class ImageSparseColorOnly : public ImageSparse {
     Features::encodeColor(color, this->background.color);
   }
 
+  // A subrange of an image of this type. It has the accessors that blending
+  // uses, so the same code blends whole images and subranges of them.
+  class Span {
+    const ThisType* image;
+    int subregionBegin;
+    int subregionEnd;
+    int activeSubregionBegin;
+    int activeSubregionEnd;
+    RunLengthIterator runLengthsBegin;
+
+   public:
+    Span(const ThisType& _image, int _subregionBegin, int _subregionEnd)
+        : image(&_image),
+          subregionBegin(_subregionBegin),
+          subregionEnd(_subregionEnd),
+          runLengthsBegin(_image.seekRunLengthRegion(_subregionBegin,
+                                                     _subregionEnd,
+                                                     activeSubregionBegin,
+                                                     activeSubregionEnd)) {}
+    explicit Span(const ThisType& _image)
+        : Span(_image, 0, _image.getNumberOfPixels()) {}
+
+    const ThisType& getImage() const { return *this->image; }
+    int getRegionBegin() const {
+      return this->image->getRegionBegin() + this->subregionBegin;
+    }
+    int getRegionEnd() const {
+      return this->image->getRegionBegin() + this->subregionEnd;
+    }
+    int getNumberOfActivePixels() const {
+      return this->activeSubregionEnd - this->activeSubregionBegin;
+    }
+    const ColorType* getColorBuffer() const {
+      return this->image->pixelStorage->getColorBuffer(
+          this->activeSubregionBegin);
+    }
+    RunLengthIterator createRunLengthIterator() const {
+      return this->runLengthsBegin;
+    }
+    std::unique_ptr<Image> copy() const {
+      return this->image->copySubrange(this->subregionBegin,
+                                       this->subregionEnd);
+    }
+  };
+
   ImageSparseColorOnly(
       int _width,
       int _height,
@@ -45,7 +90,7 @@ class ImageSparseColorOnly : public ImageSparse {
       int _regionEnd,
       const Viewport& _validViewport,
       std::shared_ptr<StorageType> _pixelStorage,
-      std::shared_ptr<std::vector<RunLengthRegion>> _runLengths,
+      std::shared_ptr<IndexedRunLengths> _runLengths,
       const BackgroundInfo& _background)
       : ImageSparse(_width,
                     _height,
@@ -81,6 +126,68 @@ class ImageSparseColorOnly : public ImageSparse {
     this->compress(toCompress);
   }
 
+  /// \brief Compresses an image directly into separate pieces.
+  ///
+  /// This implements \c ImageFull::compressInto for images of the storage
+  /// type. Each pixel of \a toCompress is read once, and the run lengths and
+  /// foreground pixels are written straight into the piece they belong to.
+  static std::vector<std::unique_ptr<ImageSparse>> compressInto(
+      const StorageType& toCompress,
+      int numPieces,
+      const std::vector<int>& splitPoints) {
+    assert(numPieces > 0);
+    assert(static_cast<int>(splitPoints.size()) == numPieces - 1);
+
+    int width = toCompress.getWidth();
+    int height = toCompress.getHeight();
+    int numPixels = toCompress.getNumberOfPixels();
+    const Viewport& validViewport = toCompress.getValidViewport();
+
+    // Rows outside of the valid viewport are all background, so only the
+    // pixels in the rows between are checked.
+    int checkBegin = std::min(
+        std::max(validViewport.getMinY() * width - toCompress.getRegionBegin(),
+                 0),
+        numPixels);
+    int checkEnd = std::min(std::max((validViewport.getMaxY() + 1) * width -
+                                         toCompress.getRegionBegin(),
+                                     checkBegin),
+                            numPixels);
+
+    std::vector<std::unique_ptr<ImageSparse>> pieces;
+    pieces.reserve(numPieces);
+    int pieceBegin = 0;
+    for (int pieceIndex = 0; pieceIndex < numPieces; ++pieceIndex) {
+      int pieceEnd = (pieceIndex < numPieces - 1) ? splitPoints[pieceIndex]
+                                                  : numPixels;
+      assert(pieceBegin <= pieceEnd);
+
+      std::unique_ptr<Image> pixelStorageHolder = toCompress.createNew(
+          width, height, 0, 0, Viewport(0, 0, width - 1, height - 1));
+      std::shared_ptr<StorageType> pixelStorage(
+          dynamic_cast<StorageType*>(pixelStorageHolder.get()));
+      assert(pixelStorage && "Internal error: createNew bad type.");
+      pixelStorageHolder.release();
+      BackgroundInfo background;
+      Features::encodeColor(Color(0, 0, 0, 0), background.color);
+      std::unique_ptr<ThisType> piece(
+          new ThisType(width,
+                       height,
+                       toCompress.getRegionBegin() + pieceBegin,
+                       toCompress.getRegionBegin() + pieceEnd,
+                       validViewport,
+                       pixelStorage,
+                       std::make_shared<IndexedRunLengths>(),
+                       background));
+      piece->compressRange(toCompress, pieceBegin, checkBegin, checkEnd);
+      pieces.push_back(std::move(piece));
+
+      pieceBegin = pieceEnd;
+    }
+
+    return pieces;
+  }
+
  private:
   bool isBackground(const ColorType colorComponents[ColorVecSize]) const {
     // Might want a more sophisticated way to check for background if we run
@@ -96,19 +203,16 @@ class ImageSparseColorOnly : public ImageSparse {
   void compress(const StorageType& toCompress) {
     int numActivePixels = 0;
     int iPixel;
+    this->runLengthsModified();
     this->runLengths->resize(0);
     RunLengthRegion workingRunLength;
     const Viewport& validViewport = toCompress.getValidViewport();
 
-    // There is currently little reason to compress an image with a range
-    // narrower than the full image, and the implementation would add
-    // complication here. For now, I am disallowing that.
     if ((toCompress.getRegionBegin() > 0) ||
         (toCompress.getRegionEnd() <
          (toCompress.getWidth() * toCompress.getHeight()))) {
-      std::cerr << "Compression of subregion images currently not supported"
-                << std::endl;
-      abort();
+      this->compressSubregion(toCompress);
+      return;
     }
 
     // Skip over pixels at the bottom of the image
@@ -174,9 +278,103 @@ class ImageSparseColorOnly : public ImageSparse {
 
     this->runLengths->push_back(workingRunLength);
 
+    this->copyForegroundPixels(toCompress, numActivePixels);
+  }
+
+  // A subregion (such as a piece of an image composited in place) does not
+  // line up with the rows of the valid viewport, so every pixel is checked.
+  void compressSubregion(const StorageType& toCompress) {
+    int numActivePixels = 0;
+    int numPixels = toCompress.getNumberOfPixels();
+    int iPixel = 0;
+    this->runLengthsModified();
+    this->runLengths->resize(0);
+    RunLengthRegion workingRunLength;
+
+    while (iPixel < numPixels) {
+      while ((iPixel < numPixels) &&
+             this->isBackground(toCompress.getColorBuffer(iPixel))) {
+        ++workingRunLength.backgroundPixels;
+        ++iPixel;
+      }
+      while ((iPixel < numPixels) &&
+             !this->isBackground(toCompress.getColorBuffer(iPixel))) {
+        ++workingRunLength.foregroundPixels;
+        ++iPixel;
+        ++numActivePixels;
+      }
+      if (iPixel < numPixels) {
+        this->runLengths->push_back(workingRunLength);
+        workingRunLength = RunLengthRegion();
+      }
+    }
+    this->runLengths->push_back(workingRunLength);
+
+    this->copyForegroundPixels(toCompress, numActivePixels);
+  }
+
+  // Compresses the pixels of toCompress that this image covers, which start
+  // at pixelBegin in toCompress. Only the pixels in [checkBegin, checkEnd)
+  // are checked for foreground. Foreground pixels are copied as each run is
+  // found, so toCompress is read once.
+  void compressRange(const StorageType& toCompress,
+                     int pixelBegin,
+                     int checkBegin,
+                     int checkEnd) {
+    int pixelEnd = pixelBegin + this->getNumberOfPixels();
+    checkBegin = std::min(std::max(checkBegin, pixelBegin), pixelEnd);
+    checkEnd = std::min(std::max(checkEnd, checkBegin), pixelEnd);
+
+    this->runLengthsModified();
+    this->runLengths->resize(0);
+    StorageType& pixelStorage = *this->pixelStorage;
+    int numActivePixels = 0;
+    RunLengthRegion workingRunLength(checkBegin - pixelBegin, 0);
+
+    int iPixel = checkBegin;
+    while (iPixel < checkEnd) {
+      while ((iPixel < checkEnd) &&
+             this->isBackground(toCompress.getColorBuffer(iPixel))) {
+        ++workingRunLength.backgroundPixels;
+        ++iPixel;
+      }
+      int runBegin = iPixel;
+      while ((iPixel < checkEnd) &&
+             !this->isBackground(toCompress.getColorBuffer(iPixel))) {
+        ++iPixel;
+      }
+      int numForeground = iPixel - runBegin;
+      if (numForeground > 0) {
+        if (numActivePixels + numForeground >
+            pixelStorage.getNumberOfPixels()) {
+          // Grow geometrically. The finished image is shrunk to fit.
+          pixelStorage.resizeBuffers(
+              0,
+              std::max(numActivePixels + numForeground,
+                       2 * pixelStorage.getNumberOfPixels()));
+        }
+        std::copy(toCompress.getColorBuffer(runBegin),
+                  toCompress.getColorBuffer(iPixel),
+                  pixelStorage.getColorBuffer(numActivePixels));
+        numActivePixels += numForeground;
+
+        workingRunLength.foregroundPixels = numForeground;
+        this->runLengths->push_back(workingRunLength);
+        workingRunLength = RunLengthRegion();
+      }
+    }
+    workingRunLength.backgroundPixels += pixelEnd - checkEnd;
+    this->runLengths->push_back(workingRunLength);
+
+    this->shrinkArrays();
+  }
+
+  // Copies the foreground pixels identified in the run lengths.
+  void copyForegroundPixels(const StorageType& toCompress,
+                            int numActivePixels) {
     this->pixelStorage->resizeBuffers(0, numActivePixels);
 
-    iPixel = 0;
+    int iPixel = 0;
     int iActivePixel = 0;
     for (auto&& runLength : *this->runLengths) {
       iPixel += runLength.backgroundPixels;
@@ -198,6 +396,7 @@ class ImageSparseColorOnly : public ImageSparse {
 
   // Clears the image using the background information already captured.
   void clearKnownBackground() {
+    this->runLengthsModified();
     this->runLengths->resize(1);
     this->runLengths->at(0).backgroundPixels = this->getNumberOfPixels();
     this->runLengths->at(0).foregroundPixels = 0;
@@ -208,60 +407,166 @@ class ImageSparseColorOnly : public ImageSparse {
   // necessary because lengths were not known a priori.
   void shrinkArrays() const { this->shrinkArraysImpl(*this->pixelStorage); }
 
+  // Blends numPixels colors into the target colors. A colorStride of 0 blends
+  // the same color into every target pixel.
+  static void blendColors(ColorType* targetColors,
+                          const ColorType* colors,
+                          int colorStride,
+                          int numPixels,
+                          bool colorsOnTop) {
+    ColorType blendedColor[ColorVecSize];
+    for (int pixelIndex = 0; pixelIndex < numPixels; ++pixelIndex) {
+      ColorType* targetColor = targetColors + pixelIndex * ColorVecSize;
+      const ColorType* color = colors + pixelIndex * colorStride;
+      if (colorsOnTop) {
+        Features::blend(color, targetColor, blendedColor);
+      } else {
+        Features::blend(targetColor, color, blendedColor);
+      }
+      std::copy(blendedColor, blendedColor + ColorVecSize, targetColor);
+    }
+  }
+
+  // Blends the pixels of this image into the given full image starting at
+  // targetPixelIndex. A transparent background changes nothing when blended,
+  // so those runs are only blended if the image was cleared to something else.
+  void blendRunsInto(StorageType& target,
+                     int targetPixelIndex,
+                     bool thisOnTop) const {
+    this->shrinkArrays();
+
+    const ColorType* colorBuffer = this->pixelStorage->getColorBuffer();
+    bool backgroundIsTransparent =
+        std::all_of(this->background.color,
+                    this->background.color + ColorVecSize,
+                    [](ColorType component) { return component == 0; });
+
+    for (auto&& runLength : *this->runLengths) {
+      if (!backgroundIsTransparent) {
+        blendColors(target.getColorBuffer(targetPixelIndex),
+                    this->background.color,
+                    0,
+                    runLength.backgroundPixels,
+                    thisOnTop);
+      }
+      targetPixelIndex += runLength.backgroundPixels;
+
+      blendColors(target.getColorBuffer(targetPixelIndex),
+                  colorBuffer,
+                  ColorVecSize,
+                  runLength.foregroundPixels,
+                  thisOnTop);
+      colorBuffer += runLength.foregroundPixels * ColorVecSize;
+      targetPixelIndex += runLength.foregroundPixels;
+    }
+
+    assert(targetPixelIndex <= target.getNumberOfPixels());
+  }
+
+  // Blends this image with one of the uncompressed type. The result is
+  // uncompressed, which saves uncompressing this image first when the other
+  // image is already full.
+  std::unique_ptr<ImageFull> blendWithFull(const StorageType& fullImage,
+                                           bool thisOnTop) const {
+    assert(this->getRegionBegin() <= fullImage.getRegionEnd());
+    assert(fullImage.getRegionBegin() <= this->getRegionEnd());
+
+    int totalRegionBegin =
+        std::min(this->getRegionBegin(), fullImage.getRegionBegin());
+    int totalRegionEnd =
+        std::max(this->getRegionEnd(), fullImage.getRegionEnd());
+
+    std::unique_ptr<Image> outImageHolder = fullImage.createNew(
+        this->getWidth(),
+        this->getHeight(),
+        totalRegionBegin,
+        totalRegionEnd,
+        this->getValidViewport().intersectWith(fullImage.getValidViewport()));
+    StorageType* outImage = dynamic_cast<StorageType*>(outImageHolder.get());
+    assert((outImage != NULL) && "Internal error: createNew bad type.");
+
+    // Start with the full image. Any part of the output outside of it is
+    // transparent until this image is blended in.
+    int fullBegin = fullImage.getRegionBegin() - totalRegionBegin;
+    int fullEnd = fullImage.getRegionEnd() - totalRegionBegin;
+    std::fill(outImage->getColorBuffer(0),
+              outImage->getColorBuffer(fullBegin),
+              ColorType(0));
+    outImage->copyPixels(
+        fullBegin, fullImage, 0, fullImage.getNumberOfPixels());
+    std::fill(outImage->getColorBuffer(fullEnd),
+              outImage->getColorBuffer(outImage->getNumberOfPixels()),
+              ColorType(0));
+
+    this->blendRunsInto(
+        *outImage, this->getRegionBegin() - totalRegionBegin, thisOnTop);
+
+    outImageHolder.release();
+    return std::unique_ptr<ImageFull>(outImage);
+  }
+
  public:
   std::unique_ptr<Image> blend(const Image& _otherImage) const final {
     const ThisType* otherImage = dynamic_cast<const ThisType*>(&_otherImage);
-    assert((otherImage != NULL) && "Attempting to blend invalid images.");
-
-    const ThisType* topImage = this;
-    const ThisType* bottomImage = otherImage;
+    if (otherImage == NULL) {
+      const StorageType* fullImage =
+          dynamic_cast<const StorageType*>(&_otherImage);
+      assert((fullImage != NULL) && "Attempting to blend invalid images.");
+      return this->blendWithFull(*fullImage, true);
+    }
 
-    topImage->shrinkArrays();
-    bottomImage->shrinkArrays();
+    this->shrinkArrays();
+    otherImage->shrinkArrays();
+    return blendSpans(Span(*this), Span(*otherImage));
+  }
 
-    if ((topImage->getRegionBegin() == bottomImage->getRegionBegin()) &&
-        (topImage->getRegionEnd() == bottomImage->getRegionEnd())) {
-      if (topImage->pixelStorage->getNumberOfPixels() < 1) {
-        return bottomImage->deepCopy();
+ private:
+  static std::unique_ptr<Image> blendSpans(const Span& topImage,
+                                           const Span& bottomImage) {
+    if ((topImage.getRegionBegin() == bottomImage.getRegionBegin()) &&
+        (topImage.getRegionEnd() == bottomImage.getRegionEnd())) {
+      if (topImage.getNumberOfActivePixels() < 1) {
+        return bottomImage.copy();
       }
-      if (bottomImage->pixelStorage->getNumberOfPixels() < 1) {
-        return topImage->deepCopy();
+      if (bottomImage.getNumberOfActivePixels() < 1) {
+        return topImage.copy();
       }
     }
 
     int totalRegionBegin =
-        std::min(topImage->getRegionBegin(), bottomImage->getRegionBegin());
+        std::min(topImage.getRegionBegin(), bottomImage.getRegionBegin());
     int totalRegionEnd =
-        std::max(topImage->getRegionEnd(), bottomImage->getRegionEnd());
+        std::max(topImage.getRegionEnd(), bottomImage.getRegionEnd());
 
     int maxNumActivePixels =
-        std::min(topImage->pixelStorage->getNumberOfPixels() +
-                     bottomImage->pixelStorage->getNumberOfPixels(),
+        std::min(topImage.getNumberOfActivePixels() +
+                     bottomImage.getNumberOfActivePixels(),
                  totalRegionEnd - totalRegionBegin);
 
-    const ColorType* topColorBuffer = topImage->pixelStorage->getColorBuffer();
-    const ColorType* bottomColorBuffer =
-        bottomImage->pixelStorage->getColorBuffer();
+    const ColorType* topColorBuffer = topImage.getColorBuffer();
+    const ColorType* bottomColorBuffer = bottomImage.getColorBuffer();
 
-    std::unique_ptr<Image> outImageHolder = this->createNew(
-        this->getWidth(),
-        this->getHeight(),
+    const ThisType& topWholeImage = topImage.getImage();
+    std::unique_ptr<Image> outImageHolder = topWholeImage.createNew(
+        topWholeImage.getWidth(),
+        topWholeImage.getHeight(),
         totalRegionBegin,
         totalRegionEnd,
-        this->getValidViewport().unionWith(otherImage->getValidViewport()));
+        topWholeImage.getValidViewport().unionWith(
+            bottomImage.getImage().getValidViewport()));
     ThisType* outImage = dynamic_cast<ThisType*>(outImageHolder.get());
     assert((outImage != NULL) && "Internal error: createNew bad type.");
     outImage->pixelStorage->resizeBuffers(0, maxNumActivePixels);
     outImage->runLengths->resize(0);
     ColorType* outColorBuffer = outImage->pixelStorage->getColorBuffer();
 
-    RunLengthIterator topRunLength = topImage->createRunLengthIterator();
-    RunLengthIterator bottomRunLength = bottomImage->createRunLengthIterator();
+    RunLengthIterator topRunLength = topImage.createRunLengthIterator();
+    RunLengthIterator bottomRunLength = bottomImage.createRunLengthIterator();
 
     // Manage where part of one image has a region that starts before the other
-    if (topImage->getRegionBegin() < bottomImage->getRegionBegin()) {
+    if (topImage.getRegionBegin() < bottomImage.getRegionBegin()) {
       int numToCopy =
-          bottomImage->getRegionBegin() - topImage->getRegionBegin();
+          bottomImage.getRegionBegin() - topImage.getRegionBegin();
       int numActivePixels;
       topRunLength.copyPixels(
           numToCopy, *outImage->runLengths, numActivePixels);
@@ -270,9 +575,9 @@ class ImageSparseColorOnly : public ImageSparse {
                 outColorBuffer);
       topColorBuffer += numActivePixels * ColorVecSize;
       outColorBuffer += numActivePixels * ColorVecSize;
-    } else if (bottomImage->getRegionBegin() < topImage->getRegionBegin()) {
+    } else if (bottomImage.getRegionBegin() < topImage.getRegionBegin()) {
       int numToCopy =
-          topImage->getRegionBegin() - bottomImage->getRegionBegin();
+          topImage.getRegionBegin() - bottomImage.getRegionBegin();
       int numActivePixels;
       bottomRunLength.copyPixels(
           numToCopy, *outImage->runLengths, numActivePixels);
@@ -351,7 +656,7 @@ class ImageSparseColorOnly : public ImageSparse {
       assert(bottomRunLength.atEnd());
       int numActivePixels;
       topRunLength.copyPixels(
-          topImage->getRegionEnd() - bottomImage->getRegionEnd(),
+          topImage.getRegionEnd() - bottomImage.getRegionEnd(),
           *outImage->runLengths,
           numActivePixels);
       std::copy(topColorBuffer,
@@ -364,7 +669,7 @@ class ImageSparseColorOnly : public ImageSparse {
       assert(topRunLength.atEnd());
       int numActivePixels;
       bottomRunLength.copyPixels(
-          bottomImage->getRegionEnd() - topImage->getRegionEnd(),
+          bottomImage.getRegionEnd() - topImage.getRegionEnd(),
           *outImage->runLengths,
           numActivePixels);
       std::copy(bottomColorBuffer,
@@ -379,8 +684,35 @@ class ImageSparseColorOnly : public ImageSparse {
     return outImageHolder;
   }
 
+ public:
+  void blendInto(ImageFull& _accumulator) const final {
+    StorageType* accumulator = dynamic_cast<StorageType*>(&_accumulator);
+    assert((accumulator != NULL) && "Attempting to blend invalid images.");
+    assert(accumulator->getRegionBegin() <= this->getRegionBegin());
+    assert(this->getRegionEnd() <= accumulator->getRegionEnd());
+
+    this->blendRunsInto(*accumulator,
+                        this->getRegionBegin() - accumulator->getRegionBegin(),
+                        false);
+
+    accumulator->setValidViewport(accumulator->getValidViewport().intersectWith(
+        this->getValidViewport()));
+  }
+
+  std::unique_ptr<ImageFull> blendUnder(
+      const ImageFull& _topImage) const final {
+    const StorageType* topImage = dynamic_cast<const StorageType*>(&_topImage);
+    assert((topImage != NULL) && "Attempting to blend invalid images.");
+    return this->blendWithFull(*topImage, false);
+  }
+
   bool blendIsOrderDependent() const final { return true; }
 
+  std::size_t getDataSize() const final {
+    return sizeof(RunLengthRegion) * this->runLengths->size() +
+           this->pixelStorage->getDataSize();
+  }
+
   std::unique_ptr<Image> copySubrange(int subregionBegin,
                                       int subregionEnd) const final {
     std::unique_ptr<Image> outImageHolder =
@@ -477,86 +809,90 @@ class ImageSparseColorOnly : public ImageSparse {
   }
 
 
-  std::vector<MPI_Request> ISend(int destRank,
-                                 MPI_Comm communicator) const final {
-    std::vector<MPI_Request> requests =
-        this->ISendMetaData(destRank, communicator);
-
-    MPI_Request backgroundRequest;
-    MPI_Isend(&this->background,
-              sizeof(ThisType::BackgroundInfo),
-              MPI_BYTE,
-              destRank,
-              BACKGROUND_TAG,
-              communicator,
-              &backgroundRequest);
-    requests.push_back(backgroundRequest);
+  void sendMessages(ImageSender& sender) const final {
+    this->sendMetaData(sender);
+    sender.send(
+        &this->background, sizeof(ThisType::BackgroundInfo), BACKGROUND_TAG);
 
     // Make sure we don't send arrays larger than necessary.
     this->shrinkArrays();
 
-    MPI_Request runLengthsRequest;
-    MPI_Isend(this->runLengths->data(),
-              sizeof(RunLengthRegion) * this->runLengths->size(),
-              MPI_BYTE,
-              destRank,
-              RUN_LENGTHS_TAG,
-              communicator,
-              &runLengthsRequest);
-    requests.push_back(runLengthsRequest);
-
-    std::vector<MPI_Request> pixelStorageRequests =
-        this->pixelStorage->ISend(destRank, communicator);
-    requests.insert(requests.end(),
-                    pixelStorageRequests.begin(),
-                    pixelStorageRequests.end());
-
-    return requests;
+    sender.send(this->runLengths->data(),
+                sizeof(RunLengthRegion) * this->runLengths->size(),
+                RUN_LENGTHS_TAG);
+
+    this->pixelStorage->sendMessages(sender);
   }
 
-  std::vector<MPI_Request> IReceive(int sourceRank,
-                                    MPI_Comm communicator) final {
-    std::vector<MPI_Request> requests =
-        this->IReceiveMetaData(sourceRank, communicator);
-
-    MPI_Request backgroundRequest;
-    MPI_Irecv(&this->background,
-              sizeof(ThisType::BackgroundInfo),
-              MPI_BYTE,
-              sourceRank,
-              BACKGROUND_TAG,
-              communicator,
-              &backgroundRequest);
-    requests.push_back(backgroundRequest);
+  void receiveMessages(ImageReceiver& receiver) final {
+    this->receiveMetaData(receiver);
+    receiver.receive(
+        &this->background, sizeof(ThisType::BackgroundInfo), BACKGROUND_TAG);
 
+    this->runLengthsModified();
     // Make sure run length buffer large enough for maximum size image.
     this->runLengths->resize(this->getNumberOfPixels() / 2 + 1);
     // Also make sure runLengths array is zeroed out so we don't count garbage
     // as pixels.
     std::fill(
         this->runLengths->begin(), this->runLengths->end(), RunLengthRegion());
-    MPI_Request runLengthsRequest;
-    MPI_Irecv(this->runLengths->data(),
-              sizeof(RunLengthRegion) * this->runLengths->size(),
-              MPI_BYTE,
-              sourceRank,
-              RUN_LENGTHS_TAG,
-              communicator,
-              &runLengthsRequest);
-    requests.push_back(runLengthsRequest);
+    receiver.receive(this->runLengths->data(),
+                     sizeof(RunLengthRegion) * this->runLengths->size(),
+                     RUN_LENGTHS_TAG);
 
     // Make sure pixel buffer large enough for maximum size image.
     this->pixelStorage->resizeBuffers(0, this->getNumberOfPixels());
-    std::vector<MPI_Request> pixelStorageRequests =
-        this->pixelStorage->IReceive(sourceRank, communicator);
-    requests.insert(requests.end(),
-                    pixelStorageRequests.begin(),
-                    pixelStorageRequests.end());
-
-    return requests;
+    this->pixelStorage->receiveMessages(receiver);
   }
 
  protected:
+  void sendSubrangeMessages(int subregionBegin,
+                            int subregionEnd,
+                            ImageSender& sender,
+                            Internals& metaDataOut,
+                            SubrangeSendBuffers& buffersOut) const final {
+    this->sendSubrangeMetaData(
+        subregionBegin, subregionEnd, sender, metaDataOut);
+    sender.send(
+        &this->background, sizeof(ThisType::BackgroundInfo), BACKGROUND_TAG);
+
+    int activeSubregionBegin;
+    int activeSubregionEnd;
+    this->sendRunLengthRegion(subregionBegin,
+                              subregionEnd,
+                              sender,
+                              RUN_LENGTHS_TAG,
+                              buffersOut,
+                              activeSubregionBegin,
+                              activeSubregionEnd);
+
+    this->pixelStorage->sendSubrangeMessages(activeSubregionBegin,
+                                             activeSubregionEnd,
+                                             sender,
+                                             buffersOut.pixelMetaData,
+                                             buffersOut);
+  }
+
+  std::unique_ptr<Image> blendSubranges(int subregionBegin,
+                                        int subregionEnd,
+                                        const Image& _otherImage,
+                                        int otherSubregionBegin,
+                                        int otherSubregionEnd) const final {
+    const ThisType* otherImage = dynamic_cast<const ThisType*>(&_otherImage);
+    if (otherImage == NULL) {
+      return this->Image::blendSubranges(subregionBegin,
+                                         subregionEnd,
+                                         _otherImage,
+                                         otherSubregionBegin,
+                                         otherSubregionEnd);
+    }
+    this->shrinkArrays();
+    otherImage->shrinkArrays();
+    return blendSpans(
+        Span(*this, subregionBegin, subregionEnd),
+        Span(*otherImage, otherSubregionBegin, otherSubregionEnd));
+  }
+
   void clearImpl(const Color& color, float) final {
     this->setBackground(color);
     this->clearKnownBackground();
@@ -572,8 +908,7 @@ class ImageSparseColorOnly : public ImageSparse {
         dynamic_cast<StorageType*>(pixelStorageCopy.release());
     assert(pixelStorageCopyCast != nullptr);
     std::shared_ptr<StorageType> pixelStorageCopyShared(pixelStorageCopyCast);
-    std::shared_ptr<std::vector<RunLengthRegion>> newRunLengths(
-        new std::vector<RunLengthRegion>);
+    std::shared_ptr<IndexedRunLengths> newRunLengths(new IndexedRunLengths);
     ThisType* newImage = new ThisType(_width,
                                       _height,
                                       _regionBegin,
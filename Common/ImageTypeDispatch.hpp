@@ -0,0 +1,71 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef IMAGETYPEDISPATCH_HPP
+#define IMAGETYPEDISPATCH_HPP
+
+#include <Common/ImageRGBAFloatColorOnly.hpp>
+#include <Common/ImageRGBAUByteColorFloatDepth.hpp>
+#include <Common/ImageRGBAUByteColorOnly.hpp>
+#include <Common/ImageRGBFloatColorDepth.hpp>
+
+/// \brief Calls a functor with an image cast to its concrete type.
+///
+/// The functor must have a templated operator() that takes a reference to an
+/// image. It is called once with \a image cast to whichever of the concrete
+/// full image types it is. Loops in the functor are compiled for each type,
+/// so per-pixel accessors (such as \c getColor or a \c PixelSpan) are not
+/// virtual calls.
+///
+/// Returns true if the functor was called or false if \a image is not one of
+/// the known types.
+///
+template <typename Functor>
+bool dispatchImageType(ImageFull& image, Functor&& functor) {
+#define TRY_IMAGE_TYPE(ImageType)                             \
+  do {                                                        \
+    ImageType* typedImage = dynamic_cast<ImageType*>(&image); \
+    if (typedImage != nullptr) {                              \
+      functor(*typedImage);                                   \
+      return true;                                            \
+    }                                                         \
+  } while (false)
+  TRY_IMAGE_TYPE(ImageRGBAFloatColorOnly);
+  TRY_IMAGE_TYPE(ImageRGBAUByteColorFloatDepth);
+  TRY_IMAGE_TYPE(ImageRGBAUByteColorOnly);
+  TRY_IMAGE_TYPE(ImageRGBFloatColorDepth);
+#undef TRY_IMAGE_TYPE
+
+  return false;
+}
+
+/// \brief Calls a functor with a const image cast to its concrete type.
+///
+/// This is the same as the non-const version except that the functor gets a
+/// const reference.
+///
+template <typename Functor>
+bool dispatchImageType(const ImageFull& image, Functor&& functor) {
+#define TRY_IMAGE_TYPE(ImageType)                                         \
+  do {                                                                    \
+    const ImageType* typedImage = dynamic_cast<const ImageType*>(&image); \
+    if (typedImage != nullptr) {                                          \
+      functor(*typedImage);                                               \
+      return true;                                                        \
+    }                                                                     \
+  } while (false)
+  TRY_IMAGE_TYPE(ImageRGBAFloatColorOnly);
+  TRY_IMAGE_TYPE(ImageRGBAUByteColorFloatDepth);
+  TRY_IMAGE_TYPE(ImageRGBAUByteColorOnly);
+  TRY_IMAGE_TYPE(ImageRGBFloatColorDepth);
+#undef TRY_IMAGE_TYPE
+
+  return false;
+}
+
+#endif  // IMAGETYPEDISPATCH_HPP
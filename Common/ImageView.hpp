@@ -0,0 +1,138 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef IMAGEVIEW_HPP
+#define IMAGEVIEW_HPP
+
+#include <Common/Image.hpp>
+
+#include <memory>
+#include <vector>
+
+#include <mpi.h>
+
+/// \brief A non-owning view of a subrange of an image.
+///
+/// An ImageView refers to a subrange of the pixels of an image like the image
+/// returned from \c Image::window does. Unlike a window, a view is a small
+/// value meant to live on the stack. It holds a plain pointer to the image, so
+/// taking a view allocates nothing and touches no reference counts. Full
+/// images send and blend the pixels of a view directly from their buffers.
+/// Compressed images seek the run lengths of the view with their run length
+/// index and send them (and blend views of the same type) in place as well.
+/// Blends that mix a compressed and a full image create windows. Views of
+/// z-buffer images are also blended into accumulators in place.
+///
+/// The viewed image must outlive the view. Like an image, a view that is sent
+/// must stay in place until the send finishes, so keep views that are being
+/// sent in a container that does not move its elements (such as std::deque).
+///
+class ImageView {
+  const Image* image;
+  int subregionBegin;
+  int subregionEnd;
+
+  Image::Internals metaData;
+  Image::SubrangeSendBuffers sendBuffers;
+
+ public:
+  /// \brief Creates a view of all the pixels of an image.
+  explicit ImageView(const Image& _image)
+      : ImageView(_image, 0, _image.getNumberOfPixels()) {}
+
+  /// \brief Creates a view of a subrange of an image.
+  ///
+  /// As with \c Image::window, the subrange is given with respect to the
+  /// region of the image.
+  ImageView(const Image& _image, int _subregionBegin, int _subregionEnd)
+      : image(&_image),
+        subregionBegin(_subregionBegin),
+        subregionEnd(_subregionEnd),
+        metaData(_image.internals),
+        sendBuffers(_image.internals) {
+    assert(this->subregionBegin <= this->subregionEnd);
+    assert(this->subregionBegin >= 0);
+    assert(this->subregionEnd <= this->image->getNumberOfPixels());
+  }
+
+  ImageView(ImageView&&) = default;
+  ImageView& operator=(ImageView&&) = default;
+
+  const Image& getImage() const { return *this->image; }
+
+  int getRegionBegin() const {
+    return this->image->getRegionBegin() + this->subregionBegin;
+  }
+  int getRegionEnd() const {
+    return this->image->getRegionBegin() + this->subregionEnd;
+  }
+  int getNumberOfPixels() const {
+    return this->subregionEnd - this->subregionBegin;
+  }
+
+  /// \brief Returns a view of a subrange of this view.
+  ///
+  /// The subrange is given with respect to the region of this view.
+  ImageView window(int _subregionBegin, int _subregionEnd) const {
+    assert(_subregionEnd <= this->getNumberOfPixels());
+    return ImageView(*this->image,
+                     this->subregionBegin + _subregionBegin,
+                     this->subregionBegin + _subregionEnd);
+  }
+
+  /// \brief Blends this view "on top" of another view.
+  ///
+  /// The result is the same as that of \c Image::blend on windows of the
+  /// two views.
+  std::unique_ptr<Image> blend(const ImageView& otherView) const {
+    return this->image->blendSubranges(this->subregionBegin,
+                                       this->subregionEnd,
+                                       *otherView.image,
+                                       otherView.subregionBegin,
+                                       otherView.subregionEnd);
+  }
+
+  /// \brief Blends the viewed pixels into a full image in place.
+  ///
+  /// The result is the same as that of \c Image::blendInto on a window of
+  /// this view.
+  void blendInto(ImageFull& accumulator) const {
+    this->image->blendSubrangeInto(
+        this->subregionBegin, this->subregionEnd, accumulator);
+  }
+
+  /// \brief Creates a new image containing a copy of the viewed pixels.
+  std::unique_ptr<Image> copy() const {
+    return this->image->copySubrange(this->subregionBegin, this->subregionEnd);
+  }
+
+  /// \brief Sends the viewed pixels to another process without blocking.
+  ///
+  /// The receiving process receives the same image as if a window of the
+  /// view was sent. This view must stay in place (and must not be moved)
+  /// until all communication finishes.
+  std::vector<MPI_Request> ISend(int destRank, MPI_Comm communicator) {
+    ImageSenderMPI sender(destRank, communicator);
+    this->sendMessages(sender);
+    return std::move(sender.getRequests());
+  }
+
+  /// \brief Gives the messages the viewed pixels are sent as to \a sender.
+  ///
+  /// See \c Image::sendMessages. As with \c ISend, this view must stay in
+  /// place until the messages are sent.
+  void sendMessages(ImageSender& sender) {
+    this->image->sendSubrangeMessages(this->subregionBegin,
+                                      this->subregionEnd,
+                                      sender,
+                                      this->metaData,
+                                      this->sendBuffers);
+  }
+};
+
+#endif  // IMAGEVIEW_HPP
@@ -0,0 +1,161 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include "IncrementalComposite.hpp"
+
+#include <algorithm>
+
+IncrementalComposite::IncrementalComposite()
+    : width(0), height(0), tilesAcross(0), tilesDown(0) {}
+
+template <typename RowFunctor>
+void IncrementalComposite::forEachTileRow(int tileIndex,
+                                          int packedTileIndex,
+                                          RowFunctor rowFunctor) const {
+  int tileX = (tileIndex % this->tilesAcross) * TILE_SIZE;
+  int tileY = (tileIndex / this->tilesAcross) * TILE_SIZE;
+  int tileWidth = std::min(TILE_SIZE, this->width - tileX);
+  int tileHeight = std::min(TILE_SIZE, this->height - tileY);
+
+  int packedWidth = this->tilesAcross * TILE_SIZE;
+  int packedX = (packedTileIndex % this->tilesAcross) * TILE_SIZE;
+  int packedY = (packedTileIndex / this->tilesAcross) * TILE_SIZE;
+
+  for (int row = 0; row < tileHeight; ++row) {
+    rowFunctor((tileY + row) * this->width + tileX,
+               (packedY + row) * packedWidth + packedX,
+               tileWidth);
+  }
+}
+
+int IncrementalComposite::findDirtyTiles(const ImageFull& localImage,
+                                         bool forceAll,
+                                         MPI_Comm communicator) {
+  assert(localImage.getRegionBegin() == 0);
+  assert(localImage.getNumberOfPixels() ==
+         localImage.getWidth() * localImage.getHeight());
+
+  if ((localImage.getWidth() != this->width) ||
+      (localImage.getHeight() != this->height) || !this->previousImage) {
+    this->width = localImage.getWidth();
+    this->height = localImage.getHeight();
+    this->tilesAcross = (this->width + TILE_SIZE - 1) / TILE_SIZE;
+    this->tilesDown = (this->height + TILE_SIZE - 1) / TILE_SIZE;
+    this->previousImage.reset();
+    this->composite.reset();
+    forceAll = true;
+  }
+
+  int numTiles = this->getNumberOfTiles();
+  std::vector<unsigned char> tileChanged(numTiles, forceAll ? 1 : 0);
+  if (!forceAll) {
+    for (int tileIndex = 0; tileIndex < numTiles; ++tileIndex) {
+      this->forEachTileRow(
+          tileIndex,
+          0,
+          [&](int pixelIndex, int, int numPixels) {
+            if (!tileChanged[tileIndex] &&
+                !localImage.pixelsEqual(
+                    pixelIndex, *this->previousImage, pixelIndex, numPixels)) {
+              tileChanged[tileIndex] = 1;
+            }
+          });
+    }
+  }
+
+  // A tile has to be composited again if it changed on any process.
+  MPI_Allreduce(MPI_IN_PLACE,
+                tileChanged.data(),
+                numTiles,
+                MPI_UNSIGNED_CHAR,
+                MPI_BOR,
+                communicator);
+
+  this->dirtyTiles.resize(0);
+  for (int tileIndex = 0; tileIndex < numTiles; ++tileIndex) {
+    if (tileChanged[tileIndex]) {
+      this->dirtyTiles.push_back(tileIndex);
+    }
+  }
+
+  // Remember this image for the next frame. Only the dirty tiles can differ.
+  if (!this->previousImage) {
+    this->previousImage.reset(
+        dynamic_cast<ImageFull*>(localImage.deepCopy().release()));
+  } else {
+    for (auto&& tileIndex : this->dirtyTiles) {
+      this->forEachTileRow(
+          tileIndex, 0, [&](int pixelIndex, int, int numPixels) {
+            this->previousImage->copyPixels(
+                pixelIndex, localImage, pixelIndex, numPixels);
+          });
+    }
+  }
+
+  return this->getNumberOfDirtyTiles();
+}
+
+std::unique_ptr<ImageFull> IncrementalComposite::packDirtyTiles(
+    const ImageFull& image) const {
+  int numDirty = this->getNumberOfDirtyTiles();
+  int packedWidth = this->tilesAcross * TILE_SIZE;
+  int packedHeight =
+      ((numDirty + this->tilesAcross - 1) / this->tilesAcross) * TILE_SIZE;
+
+  std::unique_ptr<Image> packedImageHolder = image.createNew(
+      packedWidth,
+      packedHeight,
+      0,
+      packedWidth * packedHeight,
+      Viewport(0, 0, packedWidth - 1, packedHeight - 1));
+  ImageFull* packedImage = dynamic_cast<ImageFull*>(packedImageHolder.get());
+  assert((packedImage != NULL) && "Internal error: createNew bad type.");
+  packedImage->clear();
+
+  for (int packedIndex = 0; packedIndex < numDirty; ++packedIndex) {
+    this->forEachTileRow(
+        this->dirtyTiles[packedIndex],
+        packedIndex,
+        [&](int pixelIndex, int packedPixelIndex, int numPixels) {
+          packedImage->copyPixels(
+              packedPixelIndex, image, pixelIndex, numPixels);
+        });
+  }
+
+  packedImageHolder.release();
+  return std::unique_ptr<ImageFull>(packedImage);
+}
+
+const ImageFull& IncrementalComposite::patchComposite(
+    const ImageFull& packedComposite) {
+  if (!this->composite) {
+    // The first frame composites all tiles, so every pixel gets set.
+    assert(this->getNumberOfDirtyTiles() == this->getNumberOfTiles());
+    std::unique_ptr<Image> compositeHolder = packedComposite.createNew(
+        this->width,
+        this->height,
+        0,
+        this->width * this->height,
+        Viewport(0, 0, this->width - 1, this->height - 1));
+    this->composite.reset(
+        dynamic_cast<ImageFull*>(compositeHolder.release()));
+  }
+
+  int numDirty = this->getNumberOfDirtyTiles();
+  for (int packedIndex = 0; packedIndex < numDirty; ++packedIndex) {
+    this->forEachTileRow(
+        this->dirtyTiles[packedIndex],
+        packedIndex,
+        [&](int pixelIndex, int packedPixelIndex, int numPixels) {
+          this->composite->copyPixels(
+              pixelIndex, packedComposite, packedPixelIndex, numPixels);
+        });
+  }
+
+  return *this->composite;
+}
@@ -0,0 +1,96 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef INCREMENTALCOMPOSITE_HPP
+#define INCREMENTALCOMPOSITE_HPP
+
+#include <Common/ImageFull.hpp>
+
+#include <memory>
+#include <vector>
+
+#include <mpi.h>
+
+/// \brief Keeps the state to composite only the parts of a frame that changed.
+///
+/// When the camera moves slowly (or not at all), much of each process's image
+/// is the same as in the previous frame. This class divides images into square
+/// tiles and compares each newly painted image with the previous one to find
+/// which tiles changed. A tile that changed on any process must be composited
+/// again, but all other tiles can be reused from the previous composite.
+///
+/// The intended use for each frame is to call \c findDirtyTiles on all
+/// processes, composite the image returned from \c packDirtyTiles in place of
+/// the full image, and then use \c patchComposite on the process that
+/// collects the composited image to update the previous composite with the
+/// newly composited tiles.
+///
+class IncrementalComposite {
+ public:
+  static constexpr int TILE_SIZE = 32;
+
+  IncrementalComposite();
+
+  /// \brief Finds the tiles that need to be composited for this frame.
+  ///
+  /// Compares \a localImage with the image given in the previous call and
+  /// marks as dirty any tile that has changed on any process of \a
+  /// communicator. All processes of the communicator must call this method.
+  /// If \a forceAll is true (for example, because the visibility order of the
+  /// processes changed) or this is the first frame, all tiles are marked
+  /// dirty. Returns the number of dirty tiles.
+  ///
+  int findDirtyTiles(const ImageFull &localImage,
+                     bool forceAll,
+                     MPI_Comm communicator);
+
+  int getNumberOfTiles() const { return this->tilesAcross * this->tilesDown; }
+  int getNumberOfDirtyTiles() const {
+    return static_cast<int>(this->dirtyTiles.size());
+  }
+
+  /// \brief Copies the dirty tiles of the given image into a smaller image.
+  ///
+  /// The tiles are laid out in the returned image in the order of their
+  /// index. The returned image has the same width for every frame. Any part
+  /// of the packed image not covered by a dirty tile is cleared.
+  ///
+  std::unique_ptr<ImageFull> packDirtyTiles(const ImageFull &image) const;
+
+  /// \brief Updates the previous composite with newly composited tiles.
+  ///
+  /// \a packedComposite is the fully composited version of the images
+  /// returned from \c packDirtyTiles. The dirty tiles are copied into the
+  /// composite kept from previous frames, which is returned.
+  ///
+  const ImageFull &patchComposite(const ImageFull &packedComposite);
+
+  /// \brief Returns the composite as of the last call to \c patchComposite.
+  ///
+  const ImageFull &getComposite() const { return *this->composite; }
+
+ private:
+  int width;
+  int height;
+  int tilesAcross;
+  int tilesDown;
+
+  std::unique_ptr<ImageFull> previousImage;
+  std::unique_ptr<ImageFull> composite;
+  std::vector<int> dirtyTiles;
+
+  // Calls rowFunctor(pixelIndex, packedPixelIndex, numPixels) for each row
+  // segment of a tile, where pixelIndex is the index in the full image and
+  // packedPixelIndex is the index in the packed image.
+  template <typename RowFunctor>
+  void forEachTileRow(int tileIndex,
+                      int packedTileIndex,
+                      RowFunctor rowFunctor) const;
+};
+
+#endif  // INCREMENTALCOMPOSITE_HPP
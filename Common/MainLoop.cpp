@@ -10,18 +10,25 @@
 
 #include "miniGraphicsConfig.h"
 
+#include <Common/AutoCompress.hpp>
+#include <Common/BoundingVolumeHierarchy.hpp>
 #include <Common/ImageRGBAFloatColorOnly.hpp>
 #include <Common/ImageRGBAUByteColorFloatDepth.hpp>
 #include <Common/ImageRGBAUByteColorOnly.hpp>
 #include <Common/ImageRGBFloatColorDepth.hpp>
 #include <Common/ImageSparse.hpp>
+#include <Common/ImageTypeDispatch.hpp>
+#include <Common/IncrementalComposite.hpp>
 #include <Common/MakeBox.hpp>
 #include <Common/MeshHelper.hpp>
+#include <Common/MeshVisibilitySorter.hpp>
 #include <Common/ReadSTL.hpp>
 #include <Common/SavePPM.hpp>
 #include <Common/Timer.hpp>
 #include <Common/YamlWriter.hpp>
 
+#include <Paint/PainterHalfSpace.hpp>
+#include <Paint/PainterRayCast.hpp>
 #include <Paint/PainterSimple.hpp>
 #ifdef MINIGRAPHICS_ENABLE_OPENGL
 #include <Paint/PainterOpenGL.hpp>
@@ -45,6 +52,7 @@
 #include <algorithm>
 #include <array>
 #include <chrono>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <memory>
@@ -59,16 +67,26 @@ enum optionIndex {
   WIDTH,
   HEIGHT,
   NUM_TRIALS,
+  PIPELINE_FRAMES,
+  VIEWS,
   YAML_OUTPUT,
   CHECK_IMAGE,
   WRITE_IMAGE,
   PAINTER,
+  PAINT_THREADS,
+  CULL_BACK_FACES,
+  PAINT_COMPRESSED,
+  PAINT_ORDER_INDEPENDENT,
+  INCREMENTAL_SORT,
   GEOMETRY,
   DISTRIBUTION,
   OVERLAP,
+  BOUNDING_VOLUME_HIERARCHY,
   COLOR_FORMAT,
   DEPTH_FORMAT,
   IMAGE_COMPRESS,
+  AUTO_COMPRESS_THRESHOLD,
+  INCREMENTAL_COMPOSITE,
   CAMERA_THETA,
   CAMERA_PHI,
   CAMERA_ZOOM,
@@ -78,8 +96,8 @@ enum optionIndex {
   CAMERA_RANDOM_ALL,
   RANDOM_SEED
 };
-enum enableIndex { DISABLE, ENABLE };
-enum paintType { SIMPLE_RASTER, OPENGL };
+enum enableIndex { DISABLE, ENABLE, AUTO };
+enum paintType { SIMPLE_RASTER, HALF_SPACE, RAY_CAST, OPENGL };
 enum geometryType { BOX, STL_FILE };
 enum distributionType { DUPLICATE, DIVIDE };
 enum colorType { COLOR_UBYTE, COLOR_FLOAT };
@@ -90,17 +108,28 @@ struct RunOptions {
   int imageWidth;
   int imageHeight;
   int numTrials;
+  int pipelineFrames;
+  int numViews;
   std::string yamlFilename;
   bool checkImage;
   bool writeImage;
   paintType painter;
+  int paintThreads;
+  bool cullBackFaces;
+  bool paintCompressed;
+  bool paintOrderIndependent;
+  bool incrementalSort;
   geometryType geometry;
   std::string geometryFile;
   distributionType distribution;
   float overlap;
+  bool boundingVolumeHierarchy;
   colorType colorFormat;
   depthType depthFormat;
   bool compressImages;
+  bool autoCompressImages;
+  float autoCompressThreshold;
+  bool incrementalComposite;
   float thetaRotation;
   float phiRotation;
   float zoom;
@@ -113,16 +142,27 @@ struct RunOptions {
       : imageWidth(1100),
         imageHeight(900),
         numTrials(10),
+        pipelineFrames(1),
+        numViews(1),
         yamlFilename("timing.yaml"),
         checkImage(true),
         writeImage(false),
         painter(SIMPLE_RASTER),
+        paintThreads(1),
+        cullBackFaces(false),
+        paintCompressed(false),
+        paintOrderIndependent(false),
+        incrementalSort(true),
         geometry(BOX),
         distribution(DUPLICATE),
         overlap(-0.05f),
+        boundingVolumeHierarchy(true),
         colorFormat(COLOR_UBYTE),
         depthFormat(DEPTH_FLOAT),
         compressImages(true),
+        autoCompressImages(false),
+        autoCompressThreshold(-1.0f),
+        incrementalComposite(false),
         thetaRotation(25.0f),
         phiRotation(15.0f),
         zoom(1.0f),
@@ -225,20 +265,39 @@ static std::unique_ptr<ImageFull> createImage(const RunOptions& runOptions,
 
 static std::unique_ptr<Painter> createPainter(const RunOptions& runOptions,
                                               YamlWriter& yaml) {
+  std::unique_ptr<Painter> painter;
   switch (runOptions.painter) {
     case SIMPLE_RASTER:
       yaml.AddDictionaryEntry("painter", "simple");
-      return std::unique_ptr<Painter>(new PainterSimple);
+      yaml.AddDictionaryEntry("paint-threads", runOptions.paintThreads);
+      painter.reset(new PainterSimple(runOptions.paintThreads));
+      break;
+    case HALF_SPACE:
+      yaml.AddDictionaryEntry("painter", "half-space");
+      yaml.AddDictionaryEntry("paint-threads", runOptions.paintThreads);
+      painter.reset(new PainterHalfSpace(runOptions.paintThreads));
+      break;
+    case RAY_CAST:
+      yaml.AddDictionaryEntry("painter", "ray-cast");
+      yaml.AddDictionaryEntry("paint-threads", runOptions.paintThreads);
+      painter.reset(new PainterRayCast(runOptions.paintThreads));
+      break;
 #ifdef MINIGRAPHICS_ENABLE_OPENGL
     case OPENGL:
       yaml.AddDictionaryEntry("painter", "OpenGL");
-      return std::unique_ptr<Painter>(new PainterOpenGL);
+      painter.reset(new PainterOpenGL);
+      break;
 #endif
     default:
       std::cerr << "Internal error: bad painter option" << std::endl;
       exit(1);
       return std::unique_ptr<Painter>();
   }
+
+  yaml.AddDictionaryEntry("cull-back-faces",
+                          runOptions.cullBackFaces ? "on" : "off");
+  painter->setCullBackFaces(runOptions.cullBackFaces);
+  return painter;
 }
 
 static Mesh createMesh(const RunOptions& runOptions,
@@ -289,6 +348,14 @@ static Mesh createMesh(const RunOptions& runOptions,
     }
   }
 
+  yaml.AddDictionaryEntry("bounding-volume-hierarchy",
+                          runOptions.boundingVolumeHierarchy ? "on" : "off");
+  if (runOptions.boundingVolumeHierarchy) {
+    // Painters use this to skip triangles outside of the view.
+    Timer timeBuild(yaml, "bounding-volume-hierarchy-seconds");
+    mesh.buildBoundingVolumeHierarchy();
+  }
+
   return mesh;
 }
 
@@ -409,24 +476,43 @@ static MPI_Group createComposeGroup(bool blendIsOrderDependent,
   }
 }
 
-static void doLocalPaint(ImageFull& localImage,
-                         Painter& painter,
-                         const Mesh& mesh,
-                         const glm::mat4& modelview,
-                         const glm::mat4& projection,
-                         YamlWriter& yaml) {
-  Timer timePaint(yaml, "paint-seconds");
-
-  if (localImage.blendIsOrderDependent()) {
-    painter.paint(meshVisibilitySort(mesh, modelview, projection),
-                  localImage,
-                  modelview,
-                  projection);
+/// Paints the mesh into the image and returns the seconds spent sorting the
+/// mesh (which is also part of the paint time). Images that blend in
+/// visibility order are painted with the triangles sorted back to front
+/// unless the painter does order-independent transparency or would ignore
+/// the order anyway.
+static double doLocalPaint(ImageFull& localImage,
+                           Painter& painter,
+                           MeshVisibilitySorter& visibilitySorter,
+                           const Mesh& mesh,
+                           const glm::mat4& modelview,
+                           const glm::mat4& projection) {
+  double sortSeconds = 0.0;
+  if (localImage.blendIsOrderDependent() &&
+      !painter.getOrderIndependentTransparency() &&
+      painter.paintInOrderUsesOrder()) {
+    auto sortStart = std::chrono::high_resolution_clock::now();
+    const std::vector<int>& triangleOrder =
+        visibilitySorter.sort(mesh, modelview, projection);
+    sortSeconds = std::chrono::duration<double>(
+                      std::chrono::high_resolution_clock::now() - sortStart)
+                      .count();
+    painter.paintInOrder(
+        mesh, triangleOrder, localImage, modelview, projection);
   } else {
     painter.paint(mesh, localImage, modelview, projection);
   }
 
-  // Figure out a reasonable valid viewport
+  // Figure out a reasonable valid viewport. The bounding volume hierarchy
+  // gives a tight one. Otherwise, use the projected bounds of the mesh.
+  const BoundingVolumeHierarchy* boundingVolumeHierarchy =
+      mesh.getBoundingVolumeHierarchy();
+  if (boundingVolumeHierarchy != nullptr) {
+    localImage.setValidViewport(boundingVolumeHierarchy->getProjectedViewport(
+        modelview, projection, localImage.getWidth(), localImage.getHeight()));
+    return sortSeconds;
+  }
+
   const glm::vec3& boundsMin = mesh.getBoundsMin();
   const glm::vec3& boundsMax = mesh.getBoundsMax();
   std::array<glm::vec3, 8> boundingBoxVerts = {
@@ -450,44 +536,62 @@ static void doLocalPaint(ImageFull& localImage,
     validViewport = validViewport.unionWith(vertexViewport);
   }
   localImage.setValidViewport(validViewport);
+  return sortSeconds;
 }
 
-static std::unique_ptr<ImageFull> doComposeImage(const RunOptions& runOptions,
-                                                 ImageFull& localImage,
-                                                 Compositor& compositor,
-                                                 MPI_Group composeGroup,
-                                                 MPI_Comm communicator,
-                                                 YamlWriter& yaml) {
-  Timer timeCompositePlusCollect(yaml, "composite-seconds");
-
-  // The partial composite is the time it takes to compose all the pixels
-  // but leave them on whatever process they ended up in. This is often
-  // the reported composite time in many papers.
-  Timer timePartialComposite(yaml, "partial-composite-seconds");
-
-  std::unique_ptr<Image> imageToCompose;
-
-  if (runOptions.compressImages) {
-    Timer timeCompress(yaml, "compress-seconds");
-    imageToCompose = localImage.compress()->shallowCopy();
+/// Returns the image to hand to the compositor for the given local image: the
+/// image already painted compressed if there is one, otherwise the local image
+/// itself or a compressed copy of it. The time to compress is recorded in
+/// \a timeCompress.
+static std::unique_ptr<Image> prepareImageToCompose(
+    const RunOptions& runOptions,
+    ImageFull& localImage,
+    ImageSparse* paintedCompressedImage,
+    Timer& timeCompress) {
+  if (paintedCompressedImage != nullptr) {
+    return paintedCompressedImage->shallowCopy();
+  } else if (runOptions.compressImages) {
+    if (!timeCompress.isRunning()) {
+      timeCompress.start("compress-seconds");
+    }
+    return localImage.compress()->shallowCopy();
   } else {
-    imageToCompose = localImage.shallowCopy();
+    return localImage.shallowCopy();
   }
+}
 
-  std::unique_ptr<Image> compositeImage;
-  compositeImage = compositor.compose(
-      imageToCompose.get(), composeGroup, communicator, yaml);
-
-  std::unique_ptr<ImageFull> uncompressedCompositeImage;
+/// Finishes a composite once the compositor returns the composited pieces.
+/// The pieces are uncompressed and gathered on process 0, and the given
+/// timers for the partial composite and the whole composite are stopped.
+static std::vector<std::unique_ptr<ImageFull>> finishComposeImages(
+    const RunOptions& runOptions,
+    std::vector<std::unique_ptr<Image>>&& compositeImages,
+    Timer& timePartialComposite,
+    Timer& timeCompositePlusCollect,
+    MPI_Comm communicator,
+    YamlWriter& yaml) {
+  std::vector<std::unique_ptr<ImageFull>> uncompressedCompositeImages;
   if (runOptions.compressImages) {
     Timer timeUncompress(yaml, "uncompress-seconds");
 
-    ImageSparse* compressedCompositeImage =
-        dynamic_cast<ImageSparse*>(compositeImage.get());
-    uncompressedCompositeImage = compressedCompositeImage->uncompress();
+    for (auto&& compositeImage : compositeImages) {
+      // A compositor might have already switched to full images when blending
+      // compressed pieces with uncompressed ones.
+      ImageSparse* compressedCompositeImage =
+          dynamic_cast<ImageSparse*>(compositeImage.get());
+      if (compressedCompositeImage != nullptr) {
+        uncompressedCompositeImages.push_back(
+            compressedCompositeImage->uncompress());
+      } else {
+        uncompressedCompositeImages.emplace_back(
+            dynamic_cast<ImageFull*>(compositeImage.release()));
+      }
+    }
   } else {
-    uncompressedCompositeImage.reset(
-        dynamic_cast<ImageFull*>(compositeImage.release()));
+    for (auto&& compositeImage : compositeImages) {
+      uncompressedCompositeImages.emplace_back(
+          dynamic_cast<ImageFull*>(compositeImage.release()));
+    }
   }
 
   // This barrier makes sure that the times for the partial composite and the
@@ -498,18 +602,187 @@ static std::unique_ptr<ImageFull> doComposeImage(const RunOptions& runOptions,
 
   timePartialComposite.stop();
 
-  std::unique_ptr<ImageFull> gatheredImage;
+  std::vector<std::unique_ptr<ImageFull>> gatheredImages;
   {
     Timer timeGather(yaml, "gather-seconds");
 
-    gatheredImage = uncompressedCompositeImage->Gather(0, communicator);
+    for (auto&& uncompressedCompositeImage : uncompressedCompositeImages) {
+      gatheredImages.push_back(
+          uncompressedCompositeImage->Gather(0, communicator));
+    }
   }
 
   timeCompositePlusCollect.stop();
 
-  return gatheredImage;
+  return gatheredImages;
+}
+
+/// Composites the local images. If \a paintedCompressedImages is not empty, it
+/// holds the local images already painted compressed, which are composited
+/// instead.
+static std::vector<std::unique_ptr<ImageFull>> doComposeImages(
+    const RunOptions& runOptions,
+    const std::vector<std::unique_ptr<ImageFull>>& localImages,
+    const std::vector<std::unique_ptr<ImageSparse>>& paintedCompressedImages,
+    Compositor& compositor,
+    MPI_Group composeGroup,
+    MPI_Comm communicator,
+    YamlWriter& yaml) {
+  Timer timeCompositePlusCollect(yaml, "composite-seconds");
+
+  // The partial composite is the time it takes to compose all the pixels
+  // but leave them on whatever process they ended up in. This is often
+  // the reported composite time in many papers.
+  Timer timePartialComposite(yaml, "partial-composite-seconds");
+
+  std::vector<std::unique_ptr<Image>> imagesToCompose;
+  {
+    Timer timeCompress(yaml);
+    for (std::size_t imageIndex = 0; imageIndex < localImages.size();
+         ++imageIndex) {
+      imagesToCompose.push_back(prepareImageToCompose(
+          runOptions,
+          *localImages[imageIndex],
+          paintedCompressedImages.empty()
+              ? nullptr
+              : paintedCompressedImages[imageIndex].get(),
+          timeCompress));
+    }
+  }
+
+  std::vector<std::unique_ptr<Image>> compositeImages;
+  if (imagesToCompose.size() == 1) {
+    compositeImages.push_back(compositor.compose(
+        imagesToCompose.front().get(), composeGroup, communicator, yaml));
+  } else {
+    std::vector<Image*> imagePointers;
+    for (auto&& imageToCompose : imagesToCompose) {
+      imagePointers.push_back(imageToCompose.get());
+    }
+    compositeImages = compositor.composeMany(
+        imagePointers, composeGroup, communicator, yaml);
+  }
+
+  return finishComposeImages(runOptions,
+                             std::move(compositeImages),
+                             timePartialComposite,
+                             timeCompositePlusCollect,
+                             communicator,
+                             yaml);
+}
+
+/// Composites only the tiles of the image that changed since the previous
+/// trial (on any process) and patches them into the previous composite.
+/// Returns the full composite image on rank 0 and nullptr elsewhere.
+static const ImageFull* doIncrementalComposeImage(
+    const RunOptions& runOptions,
+    const ImageFull& localImage,
+    IncrementalComposite& incremental,
+    Compositor& compositor,
+    MPI_Group composeGroup,
+    MPI_Group previousComposeGroup,
+    MPI_Comm communicator,
+    YamlWriter& yaml) {
+  int rank;
+  MPI_Comm_rank(communicator, &rank);
+
+  // If the visibility order of the processes changed, all tiles have to be
+  // blended again even if no image changed.
+  bool orderChanged = true;
+  if (previousComposeGroup != MPI_GROUP_NULL) {
+    int compareResult;
+    MPI_Group_compare(previousComposeGroup, composeGroup, &compareResult);
+    orderChanged = (compareResult != MPI_IDENT);
+  }
+
+  {
+    Timer timeDiff(yaml, "incremental-diff-seconds");
+    incremental.findDirtyTiles(localImage, orderChanged, communicator);
+  }
+  yaml.AddDictionaryEntry("incremental-tiles", incremental.getNumberOfTiles());
+  yaml.AddDictionaryEntry("incremental-dirty-tiles",
+                          incremental.getNumberOfDirtyTiles());
+
+  if (incremental.getNumberOfDirtyTiles() == 0) {
+    // Nothing changed anywhere. The previous composite is still correct.
+    yaml.AddDictionaryEntry("partial-composite-seconds", 0);
+    yaml.AddDictionaryEntry("composite-seconds", 0);
+    return (rank == 0) ? &incremental.getComposite() : nullptr;
+  }
+
+  std::vector<std::unique_ptr<ImageFull>> packedImages;
+  {
+    Timer timePack(yaml, "incremental-pack-seconds");
+    packedImages.push_back(incremental.packDirtyTiles(localImage));
+  }
+
+  std::vector<std::unique_ptr<ImageFull>> packedComposites =
+      doComposeImages(runOptions,
+                      packedImages,
+                      {},
+                      compositor,
+                      composeGroup,
+                      communicator,
+                      yaml);
+
+  if (rank != 0) {
+    return nullptr;
+  }
+
+  Timer timePatch(yaml, "incremental-patch-seconds");
+  return &incremental.patchComposite(*packedComposites.front());
+}
+
+namespace {
+
+// Returns true if the colors differ by more than the threshold in any of the
+// red, green, or blue components.
+inline bool colorsDiffer(const Color& color1,
+                         const Color& color2,
+                         float colorThreshold) {
+  return (fabsf(color1.Components[0] - color2.Components[0]) >
+          colorThreshold) ||
+         (fabsf(color1.Components[1] - color2.Components[1]) >
+          colorThreshold) ||
+         (fabsf(color1.Components[2] - color2.Components[2]) > colorThreshold);
 }
 
+// Counts the pixels whose colors differ between the composite image and a
+// reference image. The reference is given to the call operator with its
+// concrete type (see ImageTypeDispatch.hpp), and the composite image is read
+// with the same type when it matches.
+struct CountBadPixels {
+  const ImageFull& compositeImage;
+  float colorThreshold;
+  int numBadPixels;
+
+  template <typename CompositeType, typename ReferenceType>
+  void count(const CompositeType& typedCompositeImage,
+             const ReferenceType& referenceImage) {
+    int numPixels = referenceImage.getNumberOfPixels();
+    for (int pixel = 0; pixel < numPixels; ++pixel) {
+      if (colorsDiffer(typedCompositeImage.getColor(pixel),
+                       referenceImage.getColor(pixel),
+                       this->colorThreshold)) {
+        ++this->numBadPixels;
+      }
+    }
+  }
+
+  template <typename ImageType>
+  void operator()(const ImageType& referenceImage) {
+    const ImageType* typedCompositeImage =
+        dynamic_cast<const ImageType*>(&this->compositeImage);
+    if (typedCompositeImage != nullptr) {
+      this->count(*typedCompositeImage, referenceImage);
+    } else {
+      this->count(this->compositeImage, referenceImage);
+    }
+  }
+};
+
+}  // anonymous namespace
+
 static void checkImage(const ImageFull& fullCompositeImage,
                        ImageFull& localImage,
                        Painter& painter,
@@ -519,26 +792,25 @@ static void checkImage(const ImageFull& fullCompositeImage,
   constexpr float COLOR_THRESHOLD = 0.02f;
   constexpr float BAD_PIXEL_THRESHOLD = 0.02f;
 
-  std::stringstream dummyStream;
-  YamlWriter dummyYaml(dummyStream);
-
   std::cout << "Checking image validity..." << std::flush;
-  doLocalPaint(localImage, painter, fullMesh, modelview, projection, dummyYaml);
+  // The full mesh is only painted here, so it gets its own sorter.
+  MeshVisibilitySorter visibilitySorter;
+  doLocalPaint(
+      localImage, painter, visibilitySorter, fullMesh, modelview, projection);
 
   int numPixels = localImage.getNumberOfPixels();
-  int numBadPixels = 0;
-  for (int pixel = 0; pixel < numPixels; ++pixel) {
-    Color compositeColor = fullCompositeImage.getColor(pixel);
-    Color localColor = localImage.getColor(pixel);
-    if ((fabsf(compositeColor.Components[0] - localColor.Components[0]) >
-         COLOR_THRESHOLD) ||
-        (fabsf(compositeColor.Components[1] - localColor.Components[1]) >
-         COLOR_THRESHOLD) ||
-        (fabsf(compositeColor.Components[2] - localColor.Components[2]) >
-         COLOR_THRESHOLD)) {
-      ++numBadPixels;
+  CountBadPixels countBadPixels{fullCompositeImage, COLOR_THRESHOLD, 0};
+  if (!dispatchImageType(localImage, countBadPixels)) {
+    // Unknown image type. Get the colors through the virtual methods.
+    for (int pixel = 0; pixel < numPixels; ++pixel) {
+      if (colorsDiffer(fullCompositeImage.getColor(pixel),
+                       localImage.getColor(pixel),
+                       COLOR_THRESHOLD)) {
+        ++countBadPixels.numBadPixels;
+      }
     }
   }
+  int numBadPixels = countBadPixels.numBadPixels;
   std::cout << (100 * numBadPixels) / numPixels << "% bad pixels." << std::endl;
   if (numBadPixels > BAD_PIXEL_THRESHOLD * numPixels) {
     std::cout << "Composite image appears bad!" << std::endl;
@@ -570,13 +842,254 @@ static void checkImage(const ImageFull& fullCompositeImage,
   }
 }
 
-static void writeImage(const ImageFull& image, int trial) {
+static void writeImage(const ImageFull& image, int trial, int view = 0) {
   std::stringstream filename;
-  filename << "composite" << std::setfill('0') << std::setw(3) << trial
-           << ".ppm";
+  filename << "composite" << std::setfill('0') << std::setw(3) << trial;
+  if (view > 0) {
+    filename << "-view" << view;
+  }
+  filename << ".ppm";
   SavePPM(image, filename.str());
 }
 
+/// Checks and writes the composite image of a trial on process 0, as selected
+/// by the run options. The image is ignored on other processes.
+static void checkAndWriteImage(const RunOptions& runOptions,
+                               const ImageFull& compositeImage,
+                               ImageFull& localImage,
+                               Painter& painter,
+                               const Mesh& fullMesh,
+                               const glm::mat4& modelview,
+                               const glm::mat4& projection,
+                               int trial,
+                               int view = 0) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (rank != 0) {
+    return;
+  }
+
+  if (runOptions.checkImage) {
+    checkImage(
+        compositeImage, localImage, painter, fullMesh, modelview, projection);
+  }
+
+  if (runOptions.writeImage) {
+    writeImage(compositeImage, trial, view);
+  }
+}
+
+/// Returns the modelview matrix for one of several views painted each trial.
+/// The views are rotated around the center of the geometry a few degrees
+/// apart horizontally, like the eyes of a stereo pair.
+static glm::mat4 createViewModelview(const glm::mat4& modelview,
+                                     const GeometryInfo& geometryInfo,
+                                     int view) {
+  constexpr float VIEW_SEPARATION_DEGREES = 4.0f;
+
+  glm::vec3 toCenter(0, 0, 1.5f * geometryInfo.distance);
+  glm::mat4 viewTransform = glm::translate(glm::mat4(1.0f), -toCenter);
+  viewTransform = glm::rotate(viewTransform,
+                              glm::radians(VIEW_SEPARATION_DEGREES * view),
+                              glm::vec3(0, 1, 0));
+  viewTransform = glm::translate(viewTransform, toCenter);
+  return viewTransform * modelview;
+}
+
+namespace {
+
+/// Holds the state of a frame that has been painted and is being composited
+/// (asynchronously) while other frames are painted.
+struct PipelineFrame {
+  int trial;
+  std::stringstream yamlStream;
+  std::unique_ptr<YamlWriter> yaml;
+  std::unique_ptr<ImageFull> localImage;
+  std::unique_ptr<Image> imageToCompose;
+  glm::mat4 modelview;
+  glm::mat4 projection;
+  MPI_Group composeGroup;
+  std::unique_ptr<Timer> timeTotal;
+  std::unique_ptr<Timer> timeCompositePlusCollect;
+  std::unique_ptr<Timer> timePartialComposite;
+  std::unique_ptr<ComposeHandle> composeHandle;
+};
+
+}  // anonymous namespace
+
+static std::unique_ptr<PipelineFrame> startPipelineFrame(
+    RunOptions& runOptions,
+    int trial,
+    std::unique_ptr<ImageFull>&& localImage,
+    Compositor& compositor,
+    Painter& painter,
+    MeshVisibilitySorter& visibilitySorter,
+    const Mesh& mesh,
+    const GeometryInfo& geometryInfo,
+    YamlWriter& yaml) {
+  std::unique_ptr<PipelineFrame> frame(new PipelineFrame);
+  frame->trial = trial;
+  frame->localImage = std::move(localImage);
+
+  yaml.StartListItem();
+  frame->yaml.reset(new YamlWriter(frame->yamlStream, yaml));
+  YamlWriter& frameYaml = *frame->yaml;
+
+  frameYaml.AddDictionaryEntry("trial-num", trial);
+
+  createTransforms(runOptions,
+                   trial,
+                   geometryInfo,
+                   frameYaml,
+                   frame->modelview,
+                   frame->projection);
+
+  frame->timeTotal.reset(new Timer(frameYaml, "total-seconds"));
+
+  frame->composeGroup =
+      createComposeGroup(frame->localImage->blendIsOrderDependent(),
+                         geometryInfo,
+                         frame->modelview,
+                         frame->projection,
+                         MPI_COMM_WORLD);
+
+  std::unique_ptr<ImageSparse> paintedCompressedImage;
+  double sortSeconds = 0.0;
+  visibilitySorter.resetStatistics();
+  {
+    Timer timePaint(frameYaml, "paint-seconds");
+    if (runOptions.paintCompressed) {
+      paintedCompressedImage = painter.paintCompressed(
+          mesh, *frame->localImage, frame->modelview, frame->projection);
+    } else {
+      sortSeconds = doLocalPaint(*frame->localImage,
+                                 painter,
+                                 visibilitySorter,
+                                 mesh,
+                                 frame->modelview,
+                                 frame->projection);
+    }
+  }
+  if (frame->localImage->blendIsOrderDependent()) {
+    frameYaml.AddDictionaryEntry("visibility-sort-seconds", sortSeconds);
+    frameYaml.AddDictionaryEntry("visibility-sort-inversions",
+                                 visibilitySorter.getNumberOfInversionsFixed());
+    frameYaml.AddDictionaryEntry("visibility-full-sorts",
+                                 visibilitySorter.getNumberOfFullSorts());
+  }
+
+  frame->timeCompositePlusCollect.reset(
+      new Timer(frameYaml, "composite-seconds"));
+  frame->timePartialComposite.reset(
+      new Timer(frameYaml, "partial-composite-seconds"));
+
+  {
+    Timer timeCompress(frameYaml);
+    frame->imageToCompose = prepareImageToCompose(runOptions,
+                                                  *frame->localImage,
+                                                  paintedCompressedImage.get(),
+                                                  timeCompress);
+  }
+
+  frame->composeHandle = compositor.composeAsync(frame->imageToCompose.get(),
+                                                 frame->composeGroup,
+                                                 MPI_COMM_WORLD,
+                                                 frameYaml);
+
+  return frame;
+}
+
+static std::unique_ptr<ImageFull> finishPipelineFrame(
+    const RunOptions& runOptions,
+    PipelineFrame& frame,
+    Painter& painter,
+    const Mesh& fullMesh,
+    YamlWriter& yaml) {
+  YamlWriter& frameYaml = *frame.yaml;
+
+  std::vector<std::unique_ptr<Image>> compositeImages;
+  compositeImages.push_back(frame.composeHandle->wait());
+  frame.composeHandle.reset();
+  frame.imageToCompose.reset();
+  MPI_Group_free(&frame.composeGroup);
+  std::unique_ptr<ImageFull> fullCompositeImage =
+      std::move(finishComposeImages(runOptions,
+                                    std::move(compositeImages),
+                                    *frame.timePartialComposite,
+                                    *frame.timeCompositePlusCollect,
+                                    MPI_COMM_WORLD,
+                                    frameYaml)
+                    .front());
+
+  frame.timeTotal->stop();
+
+  checkAndWriteImage(runOptions,
+                     *fullCompositeImage,
+                     *frame.localImage,
+                     painter,
+                     fullMesh,
+                     frame.modelview,
+                     frame.projection,
+                     frame.trial);
+
+  yaml.AddFormattedText(frame.yamlStream.str());
+
+  return std::move(frame.localImage);
+}
+
+/// Runs the trials with up to runOptions.pipelineFrames frames in flight at
+/// once. Each frame is painted into its own image and then composited
+/// asynchronously, so the painting of later frames overlaps the compositing
+/// of earlier ones. Frames are finished and recorded in trial order.
+static void runPipelined(RunOptions& runOptions,
+                         std::unique_ptr<ImageFull>&& firstImage,
+                         Compositor& compositor,
+                         Painter& painter,
+                         MeshVisibilitySorter& visibilitySorter,
+                         const Mesh& mesh,
+                         const Mesh& fullMesh,
+                         const GeometryInfo& geometryInfo,
+                         YamlWriter& yaml) {
+  std::vector<std::unique_ptr<ImageFull>> freeImages;
+  freeImages.push_back(std::move(firstImage));
+
+  std::deque<std::unique_ptr<PipelineFrame>> framesInFlight;
+
+  for (int trial = 0; trial < runOptions.numTrials; ++trial) {
+    if (static_cast<int>(framesInFlight.size()) >= runOptions.pipelineFrames) {
+      freeImages.push_back(finishPipelineFrame(
+          runOptions, *framesInFlight.front(), painter, fullMesh, yaml));
+      framesInFlight.pop_front();
+    }
+
+    std::unique_ptr<ImageFull> localImage;
+    if (!freeImages.empty()) {
+      localImage = std::move(freeImages.back());
+      freeImages.pop_back();
+    } else {
+      // All images are in flight. Make another one like them.
+      localImage.reset(dynamic_cast<ImageFull*>(
+          framesInFlight.front()->localImage->createNew().release()));
+    }
+
+    framesInFlight.push_back(startPipelineFrame(runOptions,
+                                                trial,
+                                                std::move(localImage),
+                                                compositor,
+                                                painter,
+                                                visibilitySorter,
+                                                mesh,
+                                                geometryInfo,
+                                                yaml));
+  }
+
+  while (!framesInFlight.empty()) {
+    finishPipelineFrame(
+        runOptions, *framesInFlight.front(), painter, fullMesh, yaml);
+    framesInFlight.pop_front();
+  }
+}
+
 static void run(RunOptions& runOptions,
                 Compositor* compositor,
                 YamlWriter& yaml) {
@@ -590,11 +1103,58 @@ static void run(RunOptions& runOptions,
   yaml.AddDictionaryEntry("rendering-order-dependent",
                           localImage->blendIsOrderDependent() ? "yes" : "no");
 
-  yaml.AddDictionaryEntry("image-compression",
-                          runOptions.compressImages ? "on" : "off");
+  if (runOptions.autoCompressImages) {
+    yaml.AddDictionaryEntry("image-compression", "auto");
+    if (runOptions.autoCompressThreshold >= 0) {
+      yaml.AddDictionaryEntry("auto-compress-threshold",
+                              runOptions.autoCompressThreshold);
+      compositor->setAutoCompressThreshold(runOptions.autoCompressThreshold);
+    } else {
+      Timer timeCalibration(yaml, "auto-compress-calibration-seconds");
+      compositor->setAutoCompressThreshold(
+          calibrateAutoCompress(*localImage, MPI_COMM_WORLD, yaml));
+    }
+  } else {
+    yaml.AddDictionaryEntry("image-compression",
+                            runOptions.compressImages ? "on" : "off");
+  }
+  yaml.AddDictionaryEntry("incremental-composite",
+                          runOptions.incrementalComposite ? "on" : "off");
 
   std::unique_ptr<Painter> painter = createPainter(runOptions, yaml);
 
+  if (runOptions.paintCompressed && !painter->canPaintCompressed(*localImage)) {
+    if (rank == 0) {
+      std::cerr << "The painter cannot paint this image format compressed. "
+                << "Painting full images instead." << std::endl;
+    }
+    runOptions.paintCompressed = false;
+  }
+  yaml.AddDictionaryEntry("paint-compressed",
+                          runOptions.paintCompressed ? "on" : "off");
+
+  if (runOptions.paintOrderIndependent &&
+      !painter->supportsOrderIndependentTransparency()) {
+    if (rank == 0) {
+      std::cerr << "The painter does not support order-independent "
+                << "transparency. Sorting triangles instead." << std::endl;
+    }
+    runOptions.paintOrderIndependent = false;
+  }
+  painter->setOrderIndependentTransparency(runOptions.paintOrderIndependent);
+  yaml.AddDictionaryEntry("paint-order-independent",
+                          runOptions.paintOrderIndependent ? "on" : "off");
+
+  // One for each view, kept for all trials so its memory is reused and each
+  // view's incremental sort starts from that view's order in the last trial.
+  std::vector<MeshVisibilitySorter> visibilitySorters(
+      runOptions.numViews, MeshVisibilitySorter(runOptions.paintThreads));
+  for (auto&& visibilitySorter : visibilitySorters) {
+    visibilitySorter.setIncremental(runOptions.incrementalSort);
+  }
+  yaml.AddDictionaryEntry("incremental-sort",
+                          runOptions.incrementalSort ? "on" : "off");
+
   Mesh mesh = createMesh(runOptions, MPI_COMM_WORLD, yaml);
 
   Mesh fullMesh;
@@ -608,8 +1168,41 @@ static void run(RunOptions& runOptions,
 
   yaml.AddDictionaryEntry("num-triangles", geometryInfo.numTriangles);
 
+  yaml.AddDictionaryEntry("pipeline-frames", runOptions.pipelineFrames);
+  yaml.AddDictionaryEntry("views", runOptions.numViews);
+
+  // Total time for all trials. When frames are pipelined, this (rather than
+  // the sum of the trial times, which overlap) measures frame throughput.
+  Timer timeAllTrials(yaml, "all-trials-seconds");
+
   yaml.StartBlock("trials");
 
+  if (runOptions.pipelineFrames > 1) {
+    runPipelined(runOptions,
+                 std::move(localImage),
+                 *compositor,
+                 *painter,
+                 visibilitySorters.front(),
+                 mesh,
+                 fullMesh,
+                 geometryInfo,
+                 yaml);
+    yaml.EndBlock();
+    return;
+  }
+
+  // Each view is painted into its own image. All views are composited
+  // together.
+  std::vector<std::unique_ptr<ImageFull>> localImages;
+  for (int view = 1; view < runOptions.numViews; ++view) {
+    localImages.emplace_back(
+        dynamic_cast<ImageFull*>(localImage->createNew().release()));
+  }
+  localImages.insert(localImages.begin(), std::move(localImage));
+
+  IncrementalComposite incremental;
+  MPI_Group previousComposeGroup = MPI_GROUP_NULL;
+
   for (int trial = 0; trial < runOptions.numTrials; ++trial) {
     yaml.StartListItem();
     yaml.AddDictionaryEntry("trial-num", trial);
@@ -619,46 +1212,115 @@ static void run(RunOptions& runOptions,
     createTransforms(
         runOptions, trial, geometryInfo, yaml, modelview, projection);
 
-    std::unique_ptr<ImageFull> fullCompositeImage;
+    std::vector<glm::mat4> viewModelviews;
+    for (int view = 0; view < runOptions.numViews; ++view) {
+      viewModelviews.push_back(
+          createViewModelview(modelview, geometryInfo, view));
+    }
+
+    std::vector<std::unique_ptr<ImageFull>> fullCompositeImages;
+    std::vector<const ImageFull*> compositeImages;
 
     {
       Timer timeTotal(yaml, "total-seconds");
 
+      // All views are composited with the same group, so the visibility
+      // order is determined from the first view.
       MPI_Group composeGroup =
-          createComposeGroup(localImage->blendIsOrderDependent(),
+          createComposeGroup(localImages.front()->blendIsOrderDependent(),
                              geometryInfo,
-                             modelview,
+                             viewModelviews.front(),
                              projection,
                              MPI_COMM_WORLD);
 
-      doLocalPaint(*localImage, *painter, mesh, modelview, projection, yaml);
+      std::vector<std::unique_ptr<ImageSparse>> paintedCompressedImages;
+      double sortSeconds = 0.0;
+      for (auto&& visibilitySorter : visibilitySorters) {
+        visibilitySorter.resetStatistics();
+      }
+      {
+        Timer timePaint(yaml, "paint-seconds");
+        for (int view = 0; view < runOptions.numViews; ++view) {
+          if (runOptions.paintCompressed) {
+            paintedCompressedImages.push_back(
+                painter->paintCompressed(mesh,
+                                         *localImages[view],
+                                         viewModelviews[view],
+                                         projection));
+          } else {
+            sortSeconds += doLocalPaint(*localImages[view],
+                                        *painter,
+                                        visibilitySorters[view],
+                                        mesh,
+                                        viewModelviews[view],
+                                        projection);
+          }
+        }
+      }
+      if (localImages.front()->blendIsOrderDependent()) {
+        long long numInversionsFixed = 0;
+        int numFullSorts = 0;
+        for (auto&& visibilitySorter : visibilitySorters) {
+          numInversionsFixed += visibilitySorter.getNumberOfInversionsFixed();
+          numFullSorts += visibilitySorter.getNumberOfFullSorts();
+        }
+        yaml.AddDictionaryEntry("visibility-sort-seconds", sortSeconds);
+        yaml.AddDictionaryEntry("visibility-sort-inversions",
+                                numInversionsFixed);
+        yaml.AddDictionaryEntry("visibility-full-sorts", numFullSorts);
+      }
 
       // TODO: This barrier should be optional, but is needed for any of the
       // timing of the composition to be useful.
       MPI_Barrier(MPI_COMM_WORLD);
 
-      fullCompositeImage = doComposeImage(runOptions,
-                                          *localImage,
-                                          *compositor,
-                                          composeGroup,
-                                          MPI_COMM_WORLD,
-                                          yaml);
+      if (runOptions.incrementalComposite) {
+        compositeImages.push_back(
+            doIncrementalComposeImage(runOptions,
+                                      *localImages.front(),
+                                      incremental,
+                                      *compositor,
+                                      composeGroup,
+                                      previousComposeGroup,
+                                      MPI_COMM_WORLD,
+                                      yaml));
+
+        // Keep the group to check for visibility order changes next trial.
+        if (previousComposeGroup != MPI_GROUP_NULL) {
+          MPI_Group_free(&previousComposeGroup);
+        }
+        previousComposeGroup = composeGroup;
+      } else {
+        fullCompositeImages = doComposeImages(runOptions,
+                                              localImages,
+                                              paintedCompressedImages,
+                                              *compositor,
+                                              composeGroup,
+                                              MPI_COMM_WORLD,
+                                              yaml);
+        for (auto&& fullCompositeImage : fullCompositeImages) {
+          compositeImages.push_back(fullCompositeImage.get());
+        }
 
-      MPI_Group_free(&composeGroup);
+        MPI_Group_free(&composeGroup);
+      }
     }
 
-    if (runOptions.checkImage && (rank == 0)) {
-      checkImage(*fullCompositeImage,
-                 *localImage,
-                 *painter,
-                 fullMesh,
-                 modelview,
-                 projection);
+    for (int view = 0; view < runOptions.numViews; ++view) {
+      checkAndWriteImage(runOptions,
+                         *compositeImages[view],
+                         *localImages[view],
+                         *painter,
+                         fullMesh,
+                         viewModelviews[view],
+                         projection,
+                         trial,
+                         view);
     }
+  }
 
-    if (runOptions.writeImage && (rank == 0)) {
-      writeImage(*fullCompositeImage, trial);
-    }
+  if (previousComposeGroup != MPI_GROUP_NULL) {
+    MPI_Group_free(&previousComposeGroup);
   }
 
   yaml.EndBlock();
@@ -682,6 +1344,23 @@ int MainLoop(int argc,
   return MainLoop(argc, argv, compositor, compositorOptionsVector, appName);
 }
 
+/// Returns the number of frames given to --pipeline-frames on the command line
+/// (or 1 if it is not given). MainLoop has to know this before MPI is
+/// initialized, which is before the options are parsed.
+static int findPipelineFrames(int argc, char* argv[]) {
+  const std::string optionName = "--pipeline-frames";
+  int pipelineFrames = 1;
+  for (int argIndex = 1; argIndex < argc; ++argIndex) {
+    std::string arg = argv[argIndex];
+    if ((arg == optionName) && (argIndex + 1 < argc)) {
+      pipelineFrames = atoi(argv[argIndex + 1]);
+    } else if (arg.compare(0, optionName.size() + 1, optionName + "=") == 0) {
+      pipelineFrames = atoi(arg.c_str() + optionName.size() + 1);
+    }
+  }
+  return pipelineFrames;
+}
+
 int MainLoop(int argc,
              char* argv[],
              Compositor* compositor,
@@ -710,7 +1389,14 @@ int MainLoop(int argc,
   // clang-format on
   yaml.AddDictionaryEntry("start-time", startTimeString.str());
 
-  MPI_Init(&argc, &argv);
+  // Pipelined frames are composited on separate threads, which needs full
+  // thread support from MPI. Only ask for it when it is needed.
+  if (findPipelineFrames(argc, argv) > 1) {
+    int threadSupport;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &threadSupport);
+  } else {
+    MPI_Init(&argc, &argv);
+  }
 
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
@@ -744,6 +1430,17 @@ int MainLoop(int argc,
     {NUM_TRIALS,   0,             "",  "trials",  PositiveIntArg,
      "  --trials=<num>         Set the number of trials (rendered frames).\n"
      "                         (Default 10)"});
+  usage.push_back(
+    {PIPELINE_FRAMES, 0,          "",  "pipeline-frames", PositiveIntArg,
+     "  --pipeline-frames=<num> Allow up to this many frames to be in flight\n"
+     "                         at once. Painting of a frame overlaps the\n"
+     "                         compositing of the previous ones. (Default 1)"});
+  usage.push_back(
+    {VIEWS,        0,             "",  "views", PositiveIntArg,
+     "  --views=<num>          Paint this many views, a few degrees apart, in\n"
+     "                         each trial and composite them all together.\n"
+     "                         Cannot be combined with --pipeline-frames.\n"
+     "                         (Default 1)"});
   usage.push_back(
     {YAML_OUTPUT,  0,             "", "yaml-output", NonemptyStringArg,
      "  --yaml-output=<file>   Specify the filename of the YAML output file\n"
@@ -776,7 +1473,64 @@ int MainLoop(int argc,
   usage.push_back(
     {PAINTER,      SIMPLE_RASTER, "",  "paint-simple-raster", option::Arg::None,
      "  --paint-simple-raster  Use simple triangle rasterization when painting.\n"
-     "                         (Default)\n"});
+     "                         (Default)"});
+  usage.push_back(
+    {PAINTER,      HALF_SPACE,    "",  "paint-half-space", option::Arg::None,
+     "  --paint-half-space     Use edge functions over blocks of pixels when\n"
+     "                         painting."});
+  usage.push_back(
+    {PAINTER,      RAY_CAST,      "",  "paint-raycast", option::Arg::None,
+     "  --paint-raycast        Cast a ray through each pixel when painting.\n"
+     "                         Suits meshes with many more triangles than\n"
+     "                         pixels. Turns on --enable-paint-oit unless\n"
+     "                         it is disabled."});
+  usage.push_back(
+    {PAINT_THREADS, 0,            "",  "paint-threads", PositiveIntArg,
+     "  --paint-threads=<num>  Use this many threads for simple triangle\n"
+     "                         rasterization or ray casting, and to transform\n"
+     "                         the vertices for half-space rasterization. The\n"
+     "                         painted image is the same for any number of\n"
+     "                         threads. (Default 1)"});
+  usage.push_back(
+    {CULL_BACK_FACES,ENABLE,      "",  "enable-cull-back-faces", option::Arg::None,
+     "  --enable-cull-back-faces Skip painting triangles facing away from the\n"
+     "                         camera. Only correct for closed surfaces."});
+  usage.push_back(
+    {CULL_BACK_FACES,DISABLE,     "",  "disable-cull-back-faces", option::Arg::None,
+     "  --disable-cull-back-faces Paint triangles facing either way. (Default)"});
+  usage.push_back(
+    {PAINT_COMPRESSED,ENABLE,     "",  "enable-paint-compressed", option::Arg::None,
+     "  --enable-paint-compressed Paint straight into compressed images rather\n"
+     "                         than painting full images and compressing them.\n"
+     "                         Requires image compression and a depth buffer,\n"
+     "                         and only the simple painter supports it."});
+  usage.push_back(
+    {PAINT_COMPRESSED,DISABLE,    "",  "disable-paint-compressed", option::Arg::None,
+     "  --disable-paint-compressed Paint full images. (Default)"});
+  usage.push_back(
+    {PAINT_ORDER_INDEPENDENT,ENABLE, "", "enable-paint-oit", option::Arg::None,
+     "  --enable-paint-oit     Paint images without depth with order-\n"
+     "                         independent transparency. Fragments are blended\n"
+     "                         in depth order for each pixel instead of sorting\n"
+     "                         the triangles each frame. The simple and ray-\n"
+     "                         casting painters support it (--paint-raycast\n"
+     "                         turns it on)."});
+  usage.push_back(
+    {PAINT_ORDER_INDEPENDENT,DISABLE, "", "disable-paint-oit", option::Arg::None,
+     "  --disable-paint-oit    Sort the triangles back to front to paint images\n"
+     "                         without depth. (Default) The ray-casting painter\n"
+     "                         blends in depth order anyway, so it skips the\n"
+     "                         sort."});
+  usage.push_back(
+    {INCREMENTAL_SORT,ENABLE,     "",  "enable-incremental-sort", option::Arg::None,
+     "  --enable-incremental-sort Start sorting the triangles of each frame\n"
+     "                         from the order of the last frame, which is\n"
+     "                         faster when the camera moves a little at a\n"
+     "                         time. (Default)"});
+  usage.push_back(
+    {INCREMENTAL_SORT,DISABLE,    "",  "disable-incremental-sort", option::Arg::None,
+     "  --disable-incremental-sort Sort the triangles of each frame from\n"
+     "                         scratch.\n"});
 
   usage.push_back(
     {GEOMETRY,     BOX,           "",  "box", option::Arg::None,
@@ -801,7 +1555,16 @@ int MainLoop(int argc,
      "                         A value of 0 makes the geometry flush. A value\n"
      "                         of 1 completely overlaps all geometry. Negative\n"
      "                         values space the geometry appart. Has no effect\n"
-     "                         with --divide-geometry option. (Default -0.05)\n"});
+     "                         with --divide-geometry option. (Default -0.05)"});
+  usage.push_back(
+    {BOUNDING_VOLUME_HIERARCHY,ENABLE, "", "enable-bounding-volume-hierarchy", option::Arg::None,
+     "  --enable-bounding-volume-hierarchy Build a bounding volume hierarchy\n"
+     "                         over the local triangles, which painters use to\n"
+     "                         skip triangles outside of the view. (Default)"});
+  usage.push_back(
+    {BOUNDING_VOLUME_HIERARCHY,DISABLE, "", "disable-bounding-volume-hierarchy", option::Arg::None,
+     "  --disable-bounding-volume-hierarchy Do not build the hierarchy. The\n"
+     "                         ray-casting painter then builds one each frame.\n"});
 
   usage.push_back(
     {COLOR_FORMAT, COLOR_UBYTE,   "",  "color-ubyte", option::Arg::None,
@@ -824,6 +1587,35 @@ int MainLoop(int argc,
   usage.push_back(
     {IMAGE_COMPRESS,DISABLE,      "",  "disable-image-compress", option::Arg::None,
      "  --disable-image-compress Do not compress images during compositing.\n"});
+  usage.push_back(
+    {IMAGE_COMPRESS,AUTO,         "",  "image-compress", NonemptyStringArg,
+     "  --image-compress=<mode> Set image compression to on, off, or auto. With\n"
+     "                         auto, each round of compositing compresses or\n"
+     "                         uncompresses the images depending on the\n"
+     "                         fraction of active pixels, using thresholds\n"
+     "                         measured at startup. The binary-swap, direct-\n"
+     "                         send and radix-k compositors decide per round;\n"
+     "                         others treat auto as on."});
+  usage.push_back(
+    {AUTO_COMPRESS_THRESHOLD,0,   "",  "auto-compress-threshold", FloatArg,
+     "  --auto-compress-threshold=<num> Compress images in rounds where the\n"
+     "                         fraction of active pixels is at most this\n"
+     "                         value (between 0 and 1) instead of measuring\n"
+     "                         the threshold at startup. Implies\n"
+     "                         --image-compress=auto.\n"});
+
+  usage.push_back(
+    {INCREMENTAL_COMPOSITE,ENABLE,"",  "enable-incremental-composite", option::Arg::None,
+     "  --enable-incremental-composite Only composite the tiles of the image\n"
+     "                         that changed since the previous trial on some\n"
+     "                         process and reuse the rest of the previous\n"
+     "                         composite. Useful for a slowly moving camera.\n"
+     "                         Cannot be combined with --pipeline-frames or\n"
+     "                         --views."});
+  usage.push_back(
+    {INCREMENTAL_COMPOSITE,DISABLE,"", "disable-incremental-composite", option::Arg::None,
+     "  --disable-incremental-composite Composite the full image every trial.\n"
+     "                         (Default)\n"});
 
   usage.push_back(
     {CAMERA_THETA, CAMERA_STILL,  "",  "camera-theta", FloatArg,
@@ -952,6 +1744,31 @@ int MainLoop(int argc,
     runOptions.numTrials = atoi(options[NUM_TRIALS].arg);
   }
 
+  if (options[PIPELINE_FRAMES]) {
+    runOptions.pipelineFrames = atoi(options[PIPELINE_FRAMES].arg);
+    int threadSupport;
+    MPI_Query_thread(&threadSupport);
+    if ((runOptions.pipelineFrames > 1) &&
+        (threadSupport < MPI_THREAD_MULTIPLE)) {
+      if (rank == 0) {
+        std::cerr << "--pipeline-frames requires MPI_THREAD_MULTIPLE, which "
+                  << "this MPI library does not provide." << std::endl;
+      }
+      return 1;
+    }
+  }
+
+  if (options[VIEWS]) {
+    runOptions.numViews = atoi(options[VIEWS].arg);
+    if ((runOptions.numViews > 1) && (runOptions.pipelineFrames > 1)) {
+      if (rank == 0) {
+        std::cerr << "--views cannot be combined with --pipeline-frames."
+                  << std::endl;
+      }
+      return 1;
+    }
+  }
+
   if (options[YAML_OUTPUT]) {
     runOptions.yamlFilename = options[YAML_OUTPUT].arg;
   }
@@ -968,6 +1785,34 @@ int MainLoop(int argc,
     runOptions.painter = static_cast<paintType>(options[PAINTER].type());
   }
 
+  if (options[PAINT_THREADS]) {
+    runOptions.paintThreads = atoi(options[PAINT_THREADS].arg);
+  }
+
+  if (options[CULL_BACK_FACES]) {
+    runOptions.cullBackFaces =
+        (options[CULL_BACK_FACES].last()->type() == ENABLE);
+  }
+
+  if (options[PAINT_COMPRESSED]) {
+    runOptions.paintCompressed =
+        (options[PAINT_COMPRESSED].last()->type() == ENABLE);
+  }
+
+  if (options[PAINT_ORDER_INDEPENDENT]) {
+    runOptions.paintOrderIndependent =
+        (options[PAINT_ORDER_INDEPENDENT].last()->type() == ENABLE);
+  } else if (runOptions.painter == RAY_CAST) {
+    // Rays blend what they hit in depth order anyway, so sorting the
+    // triangles first is wasted.
+    runOptions.paintOrderIndependent = true;
+  }
+
+  if (options[INCREMENTAL_SORT]) {
+    runOptions.incrementalSort =
+        (options[INCREMENTAL_SORT].last()->type() == ENABLE);
+  }
+
   if (options[GEOMETRY]) {
     runOptions.geometry =
         static_cast<geometryType>(options[GEOMETRY].last()->type());
@@ -979,6 +1824,11 @@ int MainLoop(int argc,
         static_cast<distributionType>(options[DISTRIBUTION].last()->type());
   }
 
+  if (options[BOUNDING_VOLUME_HIERARCHY]) {
+    runOptions.boundingVolumeHierarchy =
+        (options[BOUNDING_VOLUME_HIERARCHY].last()->type() == ENABLE);
+  }
+
   if (options[COLOR_FORMAT]) {
     runOptions.colorFormat =
         static_cast<colorType>(options[COLOR_FORMAT].type());
@@ -989,8 +1839,60 @@ int MainLoop(int argc,
   }
 
   if (options[IMAGE_COMPRESS]) {
-    runOptions.compressImages =
-        (options[IMAGE_COMPRESS].last()->type() == ENABLE);
+    const option::Option* compressOption = options[IMAGE_COMPRESS].last();
+    runOptions.compressImages = (compressOption->type() == ENABLE);
+    runOptions.autoCompressImages = false;
+    if (compressOption->type() == AUTO) {
+      std::string mode = compressOption->arg;
+      if ((mode == "on") || (mode == "auto")) {
+        runOptions.compressImages = true;
+        runOptions.autoCompressImages = (mode == "auto");
+      } else if (mode != "off") {
+        if (rank == 0) {
+          std::cerr << "--image-compress must be on, off, or auto."
+                    << std::endl;
+        }
+        return 1;
+      }
+    }
+  }
+
+  if (options[AUTO_COMPRESS_THRESHOLD]) {
+    runOptions.autoCompressThreshold =
+        strtof(options[AUTO_COMPRESS_THRESHOLD].arg, NULL);
+    if ((runOptions.autoCompressThreshold < 0) ||
+        (runOptions.autoCompressThreshold > 1)) {
+      if (rank == 0) {
+        std::cerr << "--auto-compress-threshold must be between 0 and 1."
+                  << std::endl;
+      }
+      return 1;
+    }
+    runOptions.compressImages = true;
+    runOptions.autoCompressImages = true;
+  }
+
+  if (options[INCREMENTAL_COMPOSITE]) {
+    runOptions.incrementalComposite =
+        (options[INCREMENTAL_COMPOSITE].last()->type() == ENABLE);
+    if (runOptions.incrementalComposite &&
+        ((runOptions.pipelineFrames > 1) || (runOptions.numViews > 1))) {
+      if (rank == 0) {
+        std::cerr << "--enable-incremental-composite cannot be combined with "
+                  << "--pipeline-frames or --views." << std::endl;
+      }
+      return 1;
+    }
+  }
+
+  if (runOptions.paintCompressed &&
+      (!runOptions.compressImages || runOptions.incrementalComposite)) {
+    if (rank == 0) {
+      std::cerr << "--enable-paint-compressed requires image compression and "
+                << "cannot be combined with --enable-incremental-composite."
+                << std::endl;
+    }
+    return 1;
   }
 
   if (options[OVERLAP]) {
@@ -8,6 +8,8 @@
 
 #include "Mesh.hpp"
 
+#include <Common/BoundingVolumeHierarchy.hpp>
+
 #include <glm/gtx/normal.hpp>
 
 #include <algorithm>
@@ -74,6 +76,7 @@ void Mesh::setNumberOfVertices(int numVertices) {
   this->numberOfVertices = numVertices;
   this->pointCoordinates.resize(3 * numVertices);
   this->boundsValid = false;
+  this->boundingVolumeHierarchy.reset();
 }
 
 void Mesh::setNumberOfTriangles(int numTriangles) {
@@ -82,6 +85,7 @@ void Mesh::setNumberOfTriangles(int numTriangles) {
   this->triangleNormals.resize(3 * numTriangles);
   this->triangleColors.resize(4 * numTriangles);
   this->boundsValid = false;
+  this->boundingVolumeHierarchy.reset();
 }
 
 inline glm::vec3 Mesh::getPointCoordinates(int vertexIndex) const {
@@ -110,6 +114,7 @@ void Mesh::setVertex(int vertexIndex, const glm::vec3 &pointCoordinate) {
   v[1] = pointCoordinate.y;
   v[2] = pointCoordinate.z;
   this->boundsValid = false;
+  this->boundingVolumeHierarchy.reset();
 }
 
 void Mesh::setTriangle(int triangleIndex,
@@ -121,6 +126,7 @@ void Mesh::setTriangle(int triangleIndex,
   connections[0] = vertexIndices[0];
   connections[1] = vertexIndices[1];
   connections[2] = vertexIndices[2];
+  this->boundingVolumeHierarchy.reset();
 
   this->setColor(triangleIndex, color);
 
@@ -137,6 +143,7 @@ void Mesh::setTriangle(int triangleIndex,
   connections[0] = vertexIndices[0];
   connections[1] = vertexIndices[1];
   connections[2] = vertexIndices[2];
+  this->boundingVolumeHierarchy.reset();
 
   this->setNormal(triangleIndex, normal);
   this->setColor(triangleIndex, color);
@@ -169,9 +176,12 @@ void Mesh::addVertex(const glm::vec3 &pointCoordinate) {
   this->pointCoordinates.push_back(pointCoordinate.z);
   ++this->numberOfVertices;
   this->boundsValid = false;
+  this->boundingVolumeHierarchy.reset();
 }
 
 void Mesh::addTriangle(const int vertexIndices[3], const Color &color) {
+  this->boundingVolumeHierarchy.reset();
+
   this->triangleConnections.push_back(vertexIndices[0]);
   this->triangleConnections.push_back(vertexIndices[1]);
   this->triangleConnections.push_back(vertexIndices[2]);
@@ -190,6 +200,8 @@ void Mesh::addTriangle(const int vertexIndices[3], const Color &color) {
 void Mesh::addTriangle(const int vertexIndices[3],
                        const glm::vec3 &normal,
                        const Color &color) {
+  this->boundingVolumeHierarchy.reset();
+
   this->triangleConnections.push_back(vertexIndices[0]);
   this->triangleConnections.push_back(vertexIndices[1]);
   this->triangleConnections.push_back(vertexIndices[2]);
@@ -326,6 +338,11 @@ const glm::vec3 &Mesh::getBoundsMax() const {
   return this->boundsMax;
 }
 
+void Mesh::buildBoundingVolumeHierarchy() {
+  this->boundingVolumeHierarchy =
+      std::make_shared<const BoundingVolumeHierarchy>(*this);
+}
+
 void Mesh::send(int destRank, MPI_Comm communicator) const {
   MPI_Send(&this->numberOfVertices,
            1,
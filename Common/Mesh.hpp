@@ -11,6 +11,7 @@
 
 #include <miniGraphicsConfig.h>
 
+#include <memory>
 #include <vector>
 
 #include "Triangle.hpp"
@@ -20,6 +21,8 @@
 
 #include <mpi.h>
 
+class BoundingVolumeHierarchy;
+
 class Mesh {
  private:
   std::vector<float> pointCoordinates;   // Three (x,y,z) coordinates per vertex
@@ -34,6 +37,9 @@ class Mesh {
   glm::vec3 boundsMax;
   bool boundsValid;
 
+  // Shared by copies of the mesh and dropped when the geometry changes.
+  std::shared_ptr<const BoundingVolumeHierarchy> boundingVolumeHierarchy;
+
   void updateBounds() const;
   void computeBounds();
 
@@ -133,6 +139,25 @@ class Mesh {
   const glm::vec3& getBoundsMin() const;
   const glm::vec3& getBoundsMax() const;
 
+  /// \brief Builds a bounding volume hierarchy over the triangles.
+  ///
+  /// The hierarchy is kept until a method that sets or adds vertices or
+  /// triangles drops it. Writing through the buffer accessors does not, so
+  /// call this again (or clearBoundingVolumeHierarchy) after changing the
+  /// vertices or connections that way. Building it is only worthwhile for a
+  /// mesh that is painted many times.
+  void buildBoundingVolumeHierarchy();
+
+  /// \brief Drops the bounding volume hierarchy, if any.
+  void clearBoundingVolumeHierarchy() {
+    this->boundingVolumeHierarchy.reset();
+  }
+
+  /// \brief Returns the bounding volume hierarchy or null if none is built.
+  const BoundingVolumeHierarchy* getBoundingVolumeHierarchy() const {
+    return this->boundingVolumeHierarchy.get();
+  }
+
   void send(int destRank, MPI_Comm communicator) const;
 
   void receive(int srcRank, MPI_Comm communicator);
@@ -8,12 +8,13 @@
 
 #include "MeshHelper.hpp"
 
+#include <Common/MeshVisibilitySorter.hpp>
+
 #include <glm/gtc/matrix_inverse.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/mat4x4.hpp>
 
 #include <algorithm>
-#include <array>
 #include <cmath>
 
 // A set of colors automatically assigned to mesh regions on each process.
@@ -130,63 +131,31 @@ Mesh meshGather(const Mesh& mesh, MPI_Comm communicator) {
 Mesh meshVisibilitySort(const Mesh& mesh,
                         const glm::mat4& modelview,
                         const glm::mat4& projection) {
-  // Set up array of transformed centroids.
-  using DistIndex = std::pair<float, int>;
-  std::vector<DistIndex> triList;
-  triList.reserve(mesh.getNumberOfTriangles());
-
-  glm::mat4 fullTransform = projection * modelview;
-
-  for (int triIndex = 0; triIndex < mesh.getNumberOfTriangles(); ++triIndex) {
-    Triangle triangle = mesh.getTriangle(triIndex);
-
-    std::array<float, 3> vertexDists;
-    for (int vertI = 0; vertI < 3; ++vertI) {
-      glm::vec4 transformedVert =
-          fullTransform * glm::vec4(triangle.vertex[vertI], 1.0f);
-      vertexDists[vertI] = transformedVert.z / transformedVert.w;
-      // Make sure closest vert is in index 0
-      if (vertexDists[0] > vertexDists[vertI]) {
-        std::swap(vertexDists[0], vertexDists[vertI]);
-      }
-    }
-
-    // Weight the point to sort by toward the closest vertex. Generally, the
-    // closest vertex tends to be a better indicator of visibility depth than
-    // centroid, but use the other two vertices to break ties in polygons that
-    // share vertices.
-    triList.push_back(DistIndex(
-        0.9f * vertexDists[0] + 0.05f * (vertexDists[1] + vertexDists[2]),
-        triIndex));
-  }
-
-  // Sort the array with a compare function that causes the array to be sorted
-  // by the distance to the viewer with the largest distance first.
-  std::sort(triList.begin(),
-            triList.end(),
-            [](const DistIndex& a, const DistIndex& b) -> bool {
-              return (a.first > b.first);
-            });
+  MeshVisibilitySorter sorter;
+  return meshReorderTriangles(mesh, sorter.sort(mesh, modelview, projection));
+}
 
-  // Construct a new mesh with the sorted order.
-  Mesh sortedMesh(mesh.getNumberOfVertices(), triList.size());
+Mesh meshReorderTriangles(const Mesh& mesh,
+                          const std::vector<int>& triangleOrder) {
+  int numOutputTriangles = static_cast<int>(triangleOrder.size());
+  Mesh reorderedMesh(mesh.getNumberOfVertices(), numOutputTriangles);
   std::copy(mesh.getPointCoordinatesBuffer(0),
             mesh.getPointCoordinatesBuffer(mesh.getNumberOfVertices()),
-            sortedMesh.getPointCoordinatesBuffer(0));
+            reorderedMesh.getPointCoordinatesBuffer(0));
 
-  for (int outputTriIndex = 0; outputTriIndex < triList.size();
+  for (int outputTriIndex = 0; outputTriIndex < numOutputTriangles;
        ++outputTriIndex) {
-    int inputTriIndex = triList[outputTriIndex].second;
+    int inputTriIndex = triangleOrder[outputTriIndex];
     std::copy(mesh.getTriangleConnectionsBuffer(inputTriIndex),
               mesh.getTriangleConnectionsBuffer(inputTriIndex + 1),
-              sortedMesh.getTriangleConnectionsBuffer(outputTriIndex));
+              reorderedMesh.getTriangleConnectionsBuffer(outputTriIndex));
     std::copy(mesh.getTriangleNormalsBuffer(inputTriIndex),
               mesh.getTriangleNormalsBuffer(inputTriIndex + 1),
-              sortedMesh.getTriangleNormalsBuffer(outputTriIndex));
+              reorderedMesh.getTriangleNormalsBuffer(outputTriIndex));
     std::copy(mesh.getTriangleColorsBuffer(inputTriIndex),
               mesh.getTriangleColorsBuffer(inputTriIndex + 1),
-              sortedMesh.getTriangleColorsBuffer(outputTriIndex));
+              reorderedMesh.getTriangleColorsBuffer(outputTriIndex));
   }
 
-  return sortedMesh;
+  return reorderedMesh;
 }
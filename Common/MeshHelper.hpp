@@ -13,6 +13,8 @@
 
 #include <Common/Mesh.hpp>
 
+#include <vector>
+
 /// \brief Broadcasts the mesh from MPI rank 0 to all other meshes.
 ///
 /// All processes of the MPI commuicator must call this method before any can
@@ -53,8 +55,19 @@ Mesh meshGather(const Mesh& mesh, MPI_Comm communicator);
 /// The ordering formed is approximate. Complicated geometries might have
 /// some errors in the ordering.
 ///
+/// This copies the whole mesh. To paint in visibility order each frame, use
+/// a MeshVisibilitySorter and Painter::paintInOrder instead.
+///
 Mesh meshVisibilitySort(const Mesh& mesh,
                         const glm::mat4& modelview,
                         const glm::mat4& projection);
 
+/// \brief Returns a copy of the mesh with its triangles reordered.
+///
+/// Triangle i of the returned mesh is triangle \a triangleOrder[i] of the
+/// given mesh. Triangles not in \a triangleOrder are left out.
+///
+Mesh meshReorderTriangles(const Mesh& mesh,
+                          const std::vector<int>& triangleOrder);
+
 #endif  // MESHHELPER_HPP
@@ -0,0 +1,248 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include "MeshVisibilitySorter.hpp"
+
+#include <Common/RunThreads.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+// The default for MeshVisibilitySorter::setMinTrianglesPerThread.
+constexpr int DEFAULT_MIN_TRIANGLES_PER_THREAD = 32768;
+
+// An incremental sort that has to fix more than this many inversions per
+// triangle gives up and falls back to the radix sort, which would be faster.
+constexpr int MAX_INVERSIONS_PER_TRIANGLE = 8;
+
+// After an incremental sort gives up, that many sorts (doubling each time it
+// gives up again, up to this many) go straight to the radix sort, so a camera
+// that keeps moving fast does not pay for failed attempts every frame.
+constexpr int MAX_INCREMENTAL_BACKOFF = 16;
+
+constexpr int NUM_DIGITS = 1 << MeshVisibilitySorter::RADIX_BITS;
+constexpr int NUM_PASSES = 32 / MeshVisibilitySorter::RADIX_BITS;
+
+// Maps a depth to an integer key that orders the opposite way, so that
+// sorting the keys in increasing order puts the farthest depth first. Setting
+// the sign bit of positive floats and flipping all the bits of negative ones
+// orders them as unsigned integers.
+static inline std::uint32_t farthestFirstKey(float depth) {
+  std::uint32_t bits;
+  std::memcpy(&bits, &depth, sizeof(bits));
+  std::uint32_t ordered = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+  return ~ordered;
+}
+
+MeshVisibilitySorter::MeshVisibilitySorter(int _numThreads)
+    : numThreads(std::max(_numThreads, 1)),
+      minTrianglesPerThread(DEFAULT_MIN_TRIANGLES_PER_THREAD),
+      incremental(true),
+      incrementalBackoff(0),
+      sortsUntilIncremental(0) {
+  this->resetStatistics();
+}
+
+void MeshVisibilitySorter::resetStatistics() {
+  this->numInversionsFixed = 0;
+  this->numIncrementalSorts = 0;
+  this->numFullSorts = 0;
+}
+
+void MeshVisibilitySorter::computeKeys(const Mesh &mesh,
+                                       const glm::mat4 &modelview,
+                                       const glm::mat4 &projection,
+                                       int numThreadsToUse) {
+  int numVertices = mesh.getNumberOfVertices();
+  int numTriangles = mesh.getNumberOfTriangles();
+  this->vertexDepths.resize(numVertices);
+  this->keys.resize(numTriangles);
+
+  // Only the z and w rows of the transform are needed for the depth.
+  glm::mat4 fullTransform = projection * modelview;
+  const float z0 = fullTransform[0][2], z1 = fullTransform[1][2];
+  const float z2 = fullTransform[2][2], z3 = fullTransform[3][2];
+  const float w0 = fullTransform[0][3], w1 = fullTransform[1][3];
+  const float w2 = fullTransform[2][3], w3 = fullTransform[3][3];
+
+  const float *points = mesh.getPointCoordinatesBuffer();
+  float *depths = this->vertexDepths.data();
+  runThreads(numThreadsToUse, [&](int threadIndex) {
+    int begin, end;
+    getThreadRange(numVertices, threadIndex, numThreadsToUse, begin, end);
+    for (int vertexIndex = begin; vertexIndex < end; ++vertexIndex) {
+      float x = points[3 * vertexIndex + 0];
+      float y = points[3 * vertexIndex + 1];
+      float z = points[3 * vertexIndex + 2];
+      depths[vertexIndex] = (z0 * x + z1 * y + z2 * z + z3) /
+                            (w0 * x + w1 * y + w2 * z + w3);
+    }
+  });
+
+  const int *connections = mesh.getTriangleConnectionsBuffer();
+  std::uint32_t *triangleKeys = this->keys.data();
+  runThreads(numThreadsToUse, [&](int threadIndex) {
+    int begin, end;
+    getThreadRange(numTriangles, threadIndex, numThreadsToUse, begin, end);
+    for (int triIndex = begin; triIndex < end; ++triIndex) {
+      float closest = depths[connections[3 * triIndex + 0]];
+      float other1 = depths[connections[3 * triIndex + 1]];
+      float other2 = depths[connections[3 * triIndex + 2]];
+      if (closest > other1) {
+        std::swap(closest, other1);
+      }
+      if (closest > other2) {
+        std::swap(closest, other2);
+      }
+      // Weight the point to sort by toward the closest vertex (as in
+      // meshVisibilitySort).
+      triangleKeys[triIndex] =
+          farthestFirstKey(0.9f * closest + 0.05f * (other1 + other2));
+    }
+  });
+}
+
+void MeshVisibilitySorter::radixSort(int numThreadsToUse) {
+  int numTriangles = static_cast<int>(this->keys.size());
+  this->triangleOrder.resize(numTriangles);
+  std::iota(this->triangleOrder.begin(), this->triangleOrder.end(), 0);
+  this->scratchKeys.resize(numTriangles);
+  this->scratchOrder.resize(numTriangles);
+  this->digitCounts.resize(numThreadsToUse * NUM_DIGITS);
+
+  for (int pass = 0; pass < NUM_PASSES; ++pass) {
+    int shift = pass * RADIX_BITS;
+
+    // Count the digits in the range of each thread.
+    runThreads(numThreadsToUse, [&](int threadIndex) {
+      int *counts = &this->digitCounts[threadIndex * NUM_DIGITS];
+      std::fill(counts, counts + NUM_DIGITS, 0);
+      int begin, end;
+      getThreadRange(numTriangles, threadIndex, numThreadsToUse, begin, end);
+      for (int index = begin; index < end; ++index) {
+        ++counts[(this->keys[index] >> shift) & (NUM_DIGITS - 1)];
+      }
+    });
+
+    // Turn the counts into the place where each thread writes each digit.
+    // Within a digit, the threads write in order, so the sort is stable. If
+    // every key has the same digit, the pass would not move anything.
+    bool allKeysShareDigit = false;
+    int offset = 0;
+    for (int digit = 0; digit < NUM_DIGITS; ++digit) {
+      int digitTotal = 0;
+      for (int threadIndex = 0; threadIndex < numThreadsToUse; ++threadIndex) {
+        int &count = this->digitCounts[threadIndex * NUM_DIGITS + digit];
+        int numInDigit = count;
+        count = offset;
+        offset += numInDigit;
+        digitTotal += numInDigit;
+      }
+      if (digitTotal == numTriangles) {
+        allKeysShareDigit = true;
+        break;
+      }
+    }
+    if (allKeysShareDigit) {
+      continue;
+    }
+
+    runThreads(numThreadsToUse, [&](int threadIndex) {
+      int *offsets = &this->digitCounts[threadIndex * NUM_DIGITS];
+      int begin, end;
+      getThreadRange(numTriangles, threadIndex, numThreadsToUse, begin, end);
+      for (int index = begin; index < end; ++index) {
+        std::uint32_t key = this->keys[index];
+        int destination = offsets[(key >> shift) & (NUM_DIGITS - 1)]++;
+        this->scratchKeys[destination] = key;
+        this->scratchOrder[destination] = this->triangleOrder[index];
+      }
+    });
+    this->keys.swap(this->scratchKeys);
+    this->triangleOrder.swap(this->scratchOrder);
+  }
+}
+
+// Fixes the previous order with an insertion sort. Returns false if fixing it
+// would take too long, in which case the order is left for the radix sort to
+// replace.
+bool MeshVisibilitySorter::incrementalSort() {
+  int numTriangles = static_cast<int>(this->keys.size());
+
+  // With the index in the low bits, ties are broken by index as in the
+  // stable radix sort.
+  this->keysWithIndices.resize(numTriangles);
+  std::uint64_t *sortKeys = this->keysWithIndices.data();
+  for (int position = 0; position < numTriangles; ++position) {
+    int triIndex = this->triangleOrder[position];
+    sortKeys[position] =
+        (static_cast<std::uint64_t>(this->keys[triIndex]) << 32) |
+        static_cast<std::uint32_t>(triIndex);
+  }
+
+  // Each step an entry moves down fixes one inversion.
+  long long maxInversions =
+      static_cast<long long>(MAX_INVERSIONS_PER_TRIANGLE) * numTriangles;
+  long long inversions = 0;
+  for (int position = 1; position < numTriangles; ++position) {
+    std::uint64_t sortKey = sortKeys[position];
+    int destination = position;
+    while ((destination > 0) && (sortKeys[destination - 1] > sortKey)) {
+      sortKeys[destination] = sortKeys[destination - 1];
+      --destination;
+    }
+    sortKeys[destination] = sortKey;
+    inversions += position - destination;
+    if (inversions > maxInversions) {
+      return false;
+    }
+  }
+
+  for (int position = 0; position < numTriangles; ++position) {
+    this->triangleOrder[position] =
+        static_cast<int>(sortKeys[position] & 0xFFFFFFFFu);
+  }
+  this->numInversionsFixed += inversions;
+  return true;
+}
+
+const std::vector<int> &MeshVisibilitySorter::sort(
+    const Mesh &mesh,
+    const glm::mat4 &modelview,
+    const glm::mat4 &projection) {
+  int numThreadsToUse =
+      std::max(std::min(this->numThreads,
+                        mesh.getNumberOfTriangles() /
+                            this->minTrianglesPerThread),
+               1);
+  this->computeKeys(mesh, modelview, projection, numThreadsToUse);
+
+  // The previous order is only used if it is for as many triangles.
+  bool sorted = false;
+  if (this->incremental && !this->keys.empty() &&
+      (this->triangleOrder.size() == this->keys.size())) {
+    if (this->sortsUntilIncremental > 0) {
+      --this->sortsUntilIncremental;
+    } else if (this->incrementalSort()) {
+      ++this->numIncrementalSorts;
+      this->incrementalBackoff = 0;
+      sorted = true;
+    } else {
+      this->incrementalBackoff =
+          std::min(std::max(2 * this->incrementalBackoff, 1),
+                   MAX_INCREMENTAL_BACKOFF);
+      this->sortsUntilIncremental = this->incrementalBackoff;
+    }
+  }
+  if (!sorted) {
+    this->radixSort(numThreadsToUse);
+    ++this->numFullSorts;
+  }
+  return this->triangleOrder;
+}
@@ -0,0 +1,123 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef MESHVISIBILITYSORTER_HPP
+#define MESHVISIBILITYSORTER_HPP
+
+#include <miniGraphicsConfig.h>
+
+#include <Common/Mesh.hpp>
+
+#include <glm/mat4x4.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+/// \brief Sorts the triangles of a mesh from back to front.
+///
+/// The sorter finds the same approximate visibility order as
+/// meshVisibilitySort, but it only produces the order of the triangle
+/// indices. Painters follow that order (see Painter::paintInOrder), so the
+/// mesh is never copied.
+///
+/// Each triangle is sorted by a depth weighted toward its closest vertex.
+/// The depth of each vertex is computed once (not once for each triangle
+/// using it). The depths are turned into integer keys and sorted with a
+/// stable least significant digit radix sort, which can be split among
+/// several threads. Passes over digits that all keys share are skipped.
+///
+/// All memory is held by the sorter and reused, so once it has sorted a mesh
+/// it does not allocate again unless a larger mesh comes along. Keep a sorter
+/// around for painting each frame.
+///
+/// When the camera moves a little between frames, the order barely changes.
+/// So, when incremental sorting is on, the sorter starts from the order it
+/// found last time and fixes it with an insertion sort, which takes time
+/// proportional to the number of triangles plus the number of inversions
+/// (pairs of triangles out of order). If there turn out to be too many
+/// inversions (say, because the camera jumped), the sorter gives up and
+/// falls back to the radix sort for the next few sorts. Ties are broken by
+/// triangle index either way, so both give exactly the same order.
+///
+class MeshVisibilitySorter {
+ public:
+  /// Keys are sorted this many bits at a time.
+  static constexpr int RADIX_BITS = 8;
+
+ private:
+  int numThreads;
+  int minTrianglesPerThread;
+  bool incremental;
+  int incrementalBackoff;
+  int sortsUntilIncremental;
+
+  std::vector<float> vertexDepths;
+  std::vector<std::uint32_t> keys;
+  std::vector<std::uint32_t> scratchKeys;
+  std::vector<int> triangleOrder;
+  std::vector<int> scratchOrder;
+  // A histogram of digits for each thread.
+  std::vector<int> digitCounts;
+  // Keys in the previous order, with the triangle index in the low bits.
+  std::vector<std::uint64_t> keysWithIndices;
+
+  long long numInversionsFixed;
+  int numIncrementalSorts;
+  int numFullSorts;
+
+  void computeKeys(const Mesh& mesh,
+                   const glm::mat4& modelview,
+                   const glm::mat4& projection,
+                   int numThreadsToUse);
+  void radixSort(int numThreadsToUse);
+  bool incrementalSort();
+
+ public:
+  /// \brief Creates a sorter that splits large meshes among \a numThreads
+  /// threads.
+  explicit MeshVisibilitySorter(int _numThreads = 1);
+
+  int getNumberOfThreads() const { return this->numThreads; }
+
+  /// \brief Meshes with fewer triangles than this per thread are sorted in
+  /// fewer threads, since starting a thread costs more than sorting them.
+  void setMinTrianglesPerThread(int _minTrianglesPerThread) {
+    this->minTrianglesPerThread = std::max(_minTrianglesPerThread, 1);
+  }
+  int getMinTrianglesPerThread() const { return this->minTrianglesPerThread; }
+
+  /// \brief Start each sort from the order of the previous one. On by
+  /// default.
+  void setIncremental(bool _incremental) { this->incremental = _incremental; }
+  bool getIncremental() const { return this->incremental; }
+
+  /// \brief Inversions fixed by incremental sorts since the statistics were
+  /// last reset.
+  long long getNumberOfInversionsFixed() const {
+    return this->numInversionsFixed;
+  }
+  /// \brief Sorts finished incrementally since the statistics were last
+  /// reset.
+  int getNumberOfIncrementalSorts() const { return this->numIncrementalSorts; }
+  /// \brief Radix sorts (including fallbacks from incremental sorts) since
+  /// the statistics were last reset.
+  int getNumberOfFullSorts() const { return this->numFullSorts; }
+  void resetStatistics();
+
+  /// \brief Sorts the triangles of the mesh from back to front.
+  ///
+  /// Returns the triangle indices with the farthest triangle first.
+  /// Triangles at the same depth stay in mesh order. The returned array is
+  /// held by the sorter and is overwritten by the next call to sort.
+  const std::vector<int>& sort(const Mesh& mesh,
+                               const glm::mat4& modelview,
+                               const glm::mat4& projection);
+};
+
+#endif  // MESHVISIBILITYSORTER_HPP
@@ -0,0 +1,47 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef RUNTHREADS_HPP
+#define RUNTHREADS_HPP
+
+#include <thread>
+#include <vector>
+
+/// \brief Runs a function in several threads.
+///
+/// Calls \a function with each thread index from 0 to \a numThreads - 1, each
+/// in its own thread, and waits for all of them to finish. The calling thread
+/// runs index 0, so \a numThreads of 1 starts no threads.
+///
+template <typename Function>
+void runThreads(int numThreads, Function function) {
+  std::vector<std::thread> threads;
+  threads.reserve(numThreads - 1);
+  for (int threadIndex = 1; threadIndex < numThreads; ++threadIndex) {
+    threads.emplace_back(function, threadIndex);
+  }
+  function(0);
+  for (auto &&thread : threads) {
+    thread.join();
+  }
+}
+
+/// \brief Gets the range [begin, end) of \a count items handled by a thread.
+///
+/// The items are split into \a numThreads contiguous ranges of nearly equal
+/// size.
+///
+inline void getThreadRange(
+    int count, int threadIndex, int numThreads, int &begin, int &end) {
+  begin = static_cast<int>(static_cast<long long>(count) * threadIndex /
+                           numThreads);
+  end = static_cast<int>(static_cast<long long>(count) * (threadIndex + 1) /
+                         numThreads);
+}
+
+#endif  // RUNTHREADS_HPP
@@ -10,9 +10,30 @@
 
 #include <Common/ImageFull.hpp>
 #include <Common/ImageSparse.hpp>
+#include <Common/ImageTypeDispatch.hpp>
 
 #include <fstream>
 
+namespace {
+
+struct WritePixels {
+  std::ofstream &file;
+
+  template <typename ImageType>
+  void operator()(const ImageType &image) const {
+    for (int y = image.getHeight() - 1; y >= 0; --y) {
+      for (int x = 0; x < image.getWidth(); ++x) {
+        Color color = image.getColor(x, y);
+        this->file << color.GetComponentAsByte(0);
+        this->file << color.GetComponentAsByte(1);
+        this->file << color.GetComponentAsByte(2);
+      }
+    }
+  }
+};
+
+}  // anonymous namespace
+
 static bool doSavePPM(const ImageFull &image, const std::string &filename) {
   std::ofstream file(filename.c_str(),
                      std::ios_base::binary | std::ios_base::out);
@@ -21,13 +42,10 @@ static bool doSavePPM(const ImageFull &image, const std::string &filename) {
   file << image.getWidth() << " " << image.getHeight() << std::endl;
   file << 255 << std::endl;
 
-  for (int y = image.getHeight() - 1; y >= 0; --y) {
-    for (int x = 0; x < image.getWidth(); ++x) {
-      Color color = image.getColor(x, y);
-      file << color.GetComponentAsByte(0);
-      file << color.GetComponentAsByte(1);
-      file << color.GetComponentAsByte(2);
-    }
+  WritePixels writePixels{file};
+  if (!dispatchImageType(image, writePixels)) {
+    // Unknown image type. Get the colors through the virtual methods.
+    writePixels(image);
   }
 
   file.close();
@@ -0,0 +1,241 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include <Common/BoundingVolumeHierarchy.hpp>
+#include <Common/Mesh.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define TEST_ASSERT(condition) \
+  CheckAssert(condition, #condition, __FILE__, __LINE__);
+
+static void CheckAssert(bool condition,
+                        const std::string& conditionStr,
+                        const std::string& filename,
+                        int line) {
+  if (condition) {
+    std::cout << "    OK (" << conditionStr << ")" << std::endl;
+  } else {
+    std::cerr << "    *** FAILED! *** (" << conditionStr << "), " << filename
+              << ":" << line << std::endl;
+    exit(1);
+  }
+}
+
+constexpr int GRID_SIZE = 20;
+
+// A flat grid of 2 * GRID_SIZE * GRID_SIZE triangles in the unit square of
+// the z = 0 plane.
+static Mesh createGrid() {
+  Mesh mesh;
+  for (int j = 0; j <= GRID_SIZE; ++j) {
+    for (int i = 0; i <= GRID_SIZE; ++i) {
+      mesh.addVertex(glm::vec3(static_cast<float>(i) / GRID_SIZE,
+                               static_cast<float>(j) / GRID_SIZE,
+                               0.0f));
+    }
+  }
+  for (int j = 0; j < GRID_SIZE; ++j) {
+    for (int i = 0; i < GRID_SIZE; ++i) {
+      int corner = j * (GRID_SIZE + 1) + i;
+      int lower[3] = {corner, corner + 1, corner + GRID_SIZE + 2};
+      int upper[3] = {corner, corner + GRID_SIZE + 2, corner + GRID_SIZE + 1};
+      mesh.addTriangle(lower);
+      mesh.addTriangle(upper);
+    }
+  }
+  return mesh;
+}
+
+static void TestStructure(const Mesh& mesh,
+                          const BoundingVolumeHierarchy& hierarchy) {
+  std::cout << "  Structure" << std::endl;
+
+  const std::vector<BoundingVolumeHierarchy::Node>& nodes =
+      hierarchy.getNodes();
+  const std::vector<int>& triangleIndices = hierarchy.getTriangleIndices();
+  int numTriangles = mesh.getNumberOfTriangles();
+
+  // Every triangle is in exactly one leaf.
+  std::vector<int> leafCount(numTriangles, 0);
+  bool boundsContainTriangles = true;
+  bool childrenPartitionParent = true;
+  for (int nodeIndex = 0; nodeIndex < static_cast<int>(nodes.size());
+       ++nodeIndex) {
+    const BoundingVolumeHierarchy::Node& node = nodes[nodeIndex];
+    for (int index = node.firstTriangle;
+         index < node.firstTriangle + node.numTriangles;
+         ++index) {
+      Triangle triangle = mesh.getTriangle(triangleIndices[index]);
+      for (int vertex = 0; vertex < 3; ++vertex) {
+        const glm::vec3& point = triangle.vertex[vertex];
+        for (int axis = 0; axis < 3; ++axis) {
+          if ((point[axis] < node.boundsMin[axis]) ||
+              (point[axis] > node.boundsMax[axis])) {
+            boundsContainTriangles = false;
+          }
+        }
+      }
+      if (node.isLeaf()) {
+        ++leafCount[triangleIndices[index]];
+      }
+    }
+    if (!node.isLeaf()) {
+      const BoundingVolumeHierarchy::Node& first = nodes[nodeIndex + 1];
+      const BoundingVolumeHierarchy::Node& second = nodes[node.secondChild];
+      if ((first.firstTriangle != node.firstTriangle) ||
+          (second.firstTriangle != first.firstTriangle + first.numTriangles) ||
+          (first.numTriangles + second.numTriangles != node.numTriangles)) {
+        childrenPartitionParent = false;
+      }
+    } else if (node.numTriangles >
+               BoundingVolumeHierarchy::MAX_LEAF_TRIANGLES) {
+      childrenPartitionParent = false;
+    }
+  }
+  TEST_ASSERT(nodes.size() > 1);
+  TEST_ASSERT(nodes[0].numTriangles == numTriangles);
+  TEST_ASSERT(boundsContainTriangles);
+  TEST_ASSERT(childrenPartitionParent);
+  bool eachTriangleInOneLeaf = true;
+  for (int count : leafCount) {
+    if (count != 1) {
+      eachTriangleInOneLeaf = false;
+    }
+  }
+  TEST_ASSERT(eachTriangleInOneLeaf);
+}
+
+static void TestFrustum(const Mesh& mesh,
+                        const BoundingVolumeHierarchy& hierarchy) {
+  std::cout << "  Frustum" << std::endl;
+
+  constexpr int IMAGE_SIZE = 100;
+  glm::mat4 projection =
+      glm::perspective(glm::radians(30.0f), 1.0f, 0.1f, 10.0f);
+  glm::vec4 viewport(0, 0, IMAGE_SIZE, IMAGE_SIZE);
+  std::vector<char> visible;
+
+  std::cout << "    Whole grid in view" << std::endl;
+  glm::mat4 modelview = glm::lookAt(glm::vec3(0.5f, 0.5f, 3.0f),
+                                    glm::vec3(0.5f, 0.5f, 0.0f),
+                                    glm::vec3(0, 1, 0));
+  hierarchy.markTrianglesInFrustum(modelview, projection, visible);
+  TEST_ASSERT(static_cast<int>(visible.size()) == mesh.getNumberOfTriangles());
+  bool allVisible = true;
+  for (char mark : visible) {
+    if (!mark) {
+      allVisible = false;
+    }
+  }
+  TEST_ASSERT(allVisible);
+
+  // The tight viewport must contain every projected vertex.
+  Viewport tight = hierarchy.getProjectedViewport(
+      modelview, projection, IMAGE_SIZE, IMAGE_SIZE);
+  bool verticesInViewport = true;
+  for (int vertex = 0; vertex < mesh.getNumberOfVertices(); ++vertex) {
+    const float* point = mesh.getPointCoordinatesBuffer(vertex);
+    glm::vec3 window = glm::project(glm::vec3(point[0], point[1], point[2]),
+                                    modelview,
+                                    projection,
+                                    viewport);
+    if ((window.x < tight.getMinX()) || (window.x > tight.getMaxX() + 1) ||
+        (window.y < tight.getMinY()) || (window.y > tight.getMaxY() + 1)) {
+      verticesInViewport = false;
+    }
+  }
+  TEST_ASSERT(verticesInViewport);
+  TEST_ASSERT(tight.getMinX() > 0);
+  TEST_ASSERT(tight.getMaxX() < IMAGE_SIZE - 1);
+
+  std::cout << "    Corner of grid in view" << std::endl;
+  modelview = glm::lookAt(glm::vec3(0.1f, 0.1f, 0.5f),
+                          glm::vec3(0.1f, 0.1f, 0.0f),
+                          glm::vec3(0, 1, 0));
+  hierarchy.markTrianglesInFrustum(modelview, projection, visible);
+  // Every triangle with a vertex in the view must be marked, and some
+  // triangles far from it must not be.
+  bool markedWhenInView = true;
+  int numMarked = 0;
+  for (int triangleIndex = 0; triangleIndex < mesh.getNumberOfTriangles();
+       ++triangleIndex) {
+    if (visible[triangleIndex]) {
+      ++numMarked;
+    }
+    Triangle triangle = mesh.getTriangle(triangleIndex);
+    for (int vertex = 0; vertex < 3; ++vertex) {
+      glm::vec4 clip =
+          projection * modelview * glm::vec4(triangle.vertex[vertex], 1.0f);
+      if ((clip.x >= -clip.w) && (clip.x <= clip.w) && (clip.y >= -clip.w) &&
+          (clip.y <= clip.w) && (clip.z >= -clip.w) && (clip.z <= clip.w) &&
+          !visible[triangleIndex]) {
+        markedWhenInView = false;
+      }
+    }
+  }
+  TEST_ASSERT(markedWhenInView);
+  TEST_ASSERT(numMarked > 0);
+  TEST_ASSERT(numMarked < mesh.getNumberOfTriangles() / 2);
+
+  std::cout << "    Grid behind camera" << std::endl;
+  modelview = glm::lookAt(glm::vec3(0.5f, 0.5f, 3.0f),
+                          glm::vec3(0.5f, 0.5f, 6.0f),
+                          glm::vec3(0, 1, 0));
+  hierarchy.markTrianglesInFrustum(modelview, projection, visible);
+  bool noneVisible = true;
+  for (char mark : visible) {
+    if (mark) {
+      noneVisible = false;
+    }
+  }
+  TEST_ASSERT(noneVisible);
+  Viewport empty = hierarchy.getProjectedViewport(
+      modelview, projection, IMAGE_SIZE, IMAGE_SIZE);
+  TEST_ASSERT(empty.getMinX() > empty.getMaxX());
+}
+
+static void TestMeshOwnership() {
+  std::cout << "  Mesh ownership" << std::endl;
+
+  Mesh mesh = createGrid();
+  TEST_ASSERT(mesh.getBoundingVolumeHierarchy() == nullptr);
+  mesh.buildBoundingVolumeHierarchy();
+  TEST_ASSERT(mesh.getBoundingVolumeHierarchy() != nullptr);
+
+  Mesh copy = mesh;
+  TEST_ASSERT(copy.getBoundingVolumeHierarchy() ==
+              mesh.getBoundingVolumeHierarchy());
+
+  // Reading or writing colors through the buffers keeps the hierarchy.
+  mesh.getTriangleColorsBuffer(0)[3] = 0.5f;
+  mesh.getPointCoordinatesBuffer(0);
+  TEST_ASSERT(mesh.getBoundingVolumeHierarchy() != nullptr);
+
+  mesh.setVertex(0, glm::vec3(-1.0f, -1.0f, 0.0f));
+  TEST_ASSERT(mesh.getBoundingVolumeHierarchy() == nullptr);
+  TEST_ASSERT(copy.getBoundingVolumeHierarchy() != nullptr);
+
+  copy.clearBoundingVolumeHierarchy();
+  TEST_ASSERT(copy.getBoundingVolumeHierarchy() == nullptr);
+}
+
+int BoundingVolumeHierarchyTest(int, char* []) {
+  Mesh mesh = createGrid();
+  BoundingVolumeHierarchy hierarchy(mesh);
+
+  TestStructure(mesh, hierarchy);
+  TestFrustum(mesh, hierarchy);
+  TestMeshOwnership();
+
+  return 0;
+}
@@ -10,6 +10,7 @@
 #include <Common/ImageRGBAUByteColorFloatDepth.hpp>
 #include <Common/ImageRGBAUByteColorOnly.hpp>
 #include <Common/ImageRGBFloatColorDepth.hpp>
+#include <Common/ImageView.hpp>
 #include <Common/SavePPM.hpp>
 
 #include <cmath>
@@ -440,6 +441,33 @@ static void TestBlend() {
                 *topImage->copySubrange(MID2, END));
 }
 
+template <typename ImageType>
+static void TestBlendInto() {
+  constexpr int MID1 = IMAGE_WIDTH * IMAGE_HEIGHT / 3;
+  constexpr int MID2 = IMAGE_WIDTH * IMAGE_HEIGHT / 2;
+  constexpr int END = IMAGE_WIDTH * IMAGE_HEIGHT;
+
+  std::cout << "  Blend into" << std::endl;
+  std::unique_ptr<ImageType> accumulator = createImage1<ImageType>();
+  createImage2<ImageType>()->blendInto(*accumulator);
+  compareImages(*accumulator, *createImageCombined<ImageType>());
+
+  std::cout << "  Blend subrange into" << std::endl;
+  accumulator = createImage1<ImageType>();
+  createImage2<ImageType>(MID1, MID2)->blendInto(*accumulator);
+  compareImages(*accumulator->copySubrange(0, MID1),
+                *createImage1<ImageType>(0, MID1));
+  compareImages(*accumulator->copySubrange(MID1, MID2),
+                *createImageCombined<ImageType>(MID1, MID2));
+  compareImages(*accumulator->copySubrange(MID2, END),
+                *createImage1<ImageType>(MID2, END));
+
+  std::cout << "  Blend window into" << std::endl;
+  accumulator = createImage1<ImageType>(MID1, MID2);
+  createImage2<ImageType>()->window(MID1, MID2)->blendInto(*accumulator);
+  compareImages(*accumulator, *createImageCombined<ImageType>(MID1, MID2));
+}
+
 template <typename ImageType>
 static void TestWindow() {
   std::cout << "  Window image" << std::endl;
@@ -481,6 +509,86 @@ static void TestWindow() {
   compareImages(*blendedImage, *createImageCombined<ImageType>(MID2, MID3));
 }
 
+template <typename ImageType>
+static void TestCopyPixels() {
+  std::cout << "  Copy pixels" << std::endl;
+  constexpr int MID1 = IMAGE_WIDTH * IMAGE_HEIGHT / 3;
+  constexpr int MID2 = IMAGE_WIDTH * IMAGE_HEIGHT / 2;
+  constexpr int END = IMAGE_WIDTH * IMAGE_HEIGHT;
+
+  std::unique_ptr<ImageType> image1 = createImage1<ImageType>();
+  std::unique_ptr<ImageType> image2 = createImage2<ImageType>();
+
+  TEST_ASSERT(image1->pixelsEqual(0, *createImage1<ImageType>(), 0, END));
+  TEST_ASSERT(!image1->pixelsEqual(0, *image2, 0, END));
+
+  image1->copyPixels(MID1, *image2, MID1, MID2 - MID1);
+  TEST_ASSERT(image1->pixelsEqual(MID1, *image2, MID1, MID2 - MID1));
+  compareImages(*image1->copySubrange(0, MID1),
+                *createImage1<ImageType>(0, MID1));
+  compareImages(*image1->copySubrange(MID1, MID2),
+                *createImage2<ImageType>(MID1, MID2));
+  compareImages(*image1->copySubrange(MID2, END),
+                *createImage1<ImageType>(MID2, END));
+
+  std::cout << "  Copy pixels to different location" << std::endl;
+  std::unique_ptr<ImageType> subImage = createImage2<ImageType>(0, MID1);
+  subImage->copyPixels(0, *image2, MID2, MID1);
+  TEST_ASSERT(subImage->pixelsEqual(0, *image2, MID2, MID1));
+}
+
+template <typename ImageType>
+static void TestView() {
+  std::cout << "  View image" << std::endl;
+  constexpr int MID1 = IMAGE_WIDTH * IMAGE_HEIGHT / 3;
+  constexpr int MID2 = IMAGE_WIDTH * IMAGE_HEIGHT / 2;
+  constexpr int MID3 = 2 * IMAGE_WIDTH * IMAGE_HEIGHT / 3;
+  constexpr int END = IMAGE_WIDTH * IMAGE_HEIGHT;
+
+  std::unique_ptr<ImageType> originalImage = createImage1<ImageType>();
+  std::unique_ptr<ImageType> bottomImage = createImage2<ImageType>();
+
+  ImageView view(*originalImage, MID1, MID2);
+  TEST_ASSERT(view.getRegionBegin() == MID1);
+  TEST_ASSERT(view.getNumberOfPixels() == MID2 - MID1);
+  compareImages(*view.copy(), *createImage1<ImageType>(MID1, MID2));
+
+  std::cout << "  View of view" << std::endl;
+  ImageView wideView(*originalImage, MID1, MID3 + 10);
+  ImageView subView = wideView.window(MID2 - MID1, MID3 - MID1);
+  compareImages(*subView.copy(), *createImage1<ImageType>(MID2, MID3));
+
+  std::cout << "  View transfer" << std::endl;
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  std::unique_ptr<Image> destImage = originalImage->createNew(MID2, MID3);
+  std::vector<MPI_Request> recvRequests =
+      destImage->IReceive(rank, MPI_COMM_WORLD);
+
+  std::vector<MPI_Request> sendRequests = subView.ISend(rank, MPI_COMM_WORLD);
+
+  MPI_Waitall(recvRequests.size(), recvRequests.data(), MPI_STATUSES_IGNORE);
+  compareImages(*destImage, *createImage1<ImageType>(MID2, MID3));
+
+  MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+
+  std::cout << "  View blend" << std::endl;
+  std::unique_ptr<Image> blendedImage =
+      subView.blend(ImageView(*bottomImage, MID2, MID3));
+  compareImages(*blendedImage, *createImageCombined<ImageType>(MID2, MID3));
+
+  std::cout << "  View blend unaligned" << std::endl;
+  blendedImage = ImageView(*originalImage, 0, MID2)
+                     .blend(ImageView(*bottomImage, MID1, END));
+  compareImages(*blendedImage->copySubrange(0, MID1),
+                *createImage1<ImageType>(0, MID1));
+  compareImages(*blendedImage->copySubrange(MID1, MID2),
+                *createImageCombined<ImageType>(MID1, MID2));
+  compareImages(*blendedImage->copySubrange(MID2, END),
+                *createImage2<ImageType>(MID2, END));
+}
+
 template <typename ImageType>
 static void DoImageTest(const std::string& imageTypeName) {
   std::cout << imageTypeName << std::endl;
@@ -489,7 +597,10 @@ static void DoImageTest(const std::string& imageTypeName) {
   TestTransfer<ImageType>();
   TestSubrange<ImageType>();
   TestBlend<ImageType>();
+  TestBlendInto<ImageType>();
   TestWindow<ImageType>();
+  TestView<ImageType>();
+  TestCopyPixels<ImageType>();
 }
 
 #define DO_IMAGE_TEST(ImageType) DoImageTest<ImageType>(#ImageType)
@@ -6,10 +6,12 @@
 // the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
 // certain rights in this software.
 
+#include <Common/ImagePackedMessage.hpp>
 #include <Common/ImageRGBAFloatColorOnly.hpp>
 #include <Common/ImageRGBAUByteColorFloatDepth.hpp>
 #include <Common/ImageRGBAUByteColorOnly.hpp>
 #include <Common/ImageRGBFloatColorDepth.hpp>
+#include <Common/ImageView.hpp>
 #include <Common/ImageSparse.hpp>
 #include <Common/SavePPM.hpp>
 
@@ -17,6 +19,7 @@
 #include <iostream>
 #include <string>
 #include <type_traits>
+#include <vector>
 
 #include <mpi.h>
 
@@ -332,6 +335,27 @@ static void TestCompressUncompress() {
 
   compareImages(*fullImage, *sparseImage->uncompress());
 
+  std::cout << "  Compressed data is smaller" << std::endl;
+  TEST_ASSERT(sparseImage->getDataSize() < fullImage->getDataSize());
+
+  std::cout << "  Count active pixels" << std::endl;
+  int numActivePixels = sparseImage->getNumberOfActivePixels();
+  TEST_ASSERT(fullImage->countActivePixels() == numActivePixels);
+  TEST_ASSERT(std::abs(fullImage->countActivePixels(7) - numActivePixels) <=
+              numActivePixels / 10);
+
+  std::cout << "  Compress into pieces" << std::endl;
+  constexpr int MID1 = IMAGE_WIDTH * IMAGE_HEIGHT / 3;
+  constexpr int MID2 = IMAGE_WIDTH * IMAGE_HEIGHT / 2;
+  std::vector<std::unique_ptr<ImageSparse>> pieces =
+      fullImage->compressInto(4, {MID1, MID1, MID2});
+  TEST_ASSERT(pieces.size() == 4);
+  compareImages(*pieces[0], *createImage1<ImageType>(0, MID1));
+  TEST_ASSERT(pieces[1]->getNumberOfPixels() == 0);
+  compareImages(*pieces[2], *createImage1<ImageType>(MID1, MID2));
+  compareImages(*pieces[3],
+                *createImage1<ImageType>(MID2, IMAGE_WIDTH * IMAGE_HEIGHT));
+
   std::cout << "  Compress skips over empty regions" << std::endl;
   Viewport validViewport = fullImage->getValidViewport();
   TEST_ASSERT(validViewport.getMinX() > 0);
@@ -524,6 +548,78 @@ static void TestBlend() {
                 *topImage->copySubrange(MID2, END));
 }
 
+template <typename ImageType>
+static void TestBlendWithFull() {
+  std::unique_ptr<ImageType> topImage = createImage1<ImageType>();
+  std::unique_ptr<ImageType> bottomImage = createImage2<ImageType>();
+
+  std::cout << "  Blend sparse over full" << std::endl;
+  std::unique_ptr<Image> blendImage = topImage->compress()->blend(*bottomImage);
+  TEST_ASSERT(dynamic_cast<ImageFull*>(blendImage.get()) != nullptr);
+  compareImages(*blendImage, *createImageCombined<ImageType>());
+
+  std::cout << "  Blend full over sparse" << std::endl;
+  blendImage = topImage->blend(*bottomImage->compress());
+  TEST_ASSERT(dynamic_cast<ImageFull*>(blendImage.get()) != nullptr);
+  compareImages(*blendImage, *createImageCombined<ImageType>());
+
+  constexpr int MID1 = IMAGE_WIDTH * IMAGE_HEIGHT / 3;
+  constexpr int MID2 = IMAGE_WIDTH * IMAGE_HEIGHT / 2;
+  constexpr int END = IMAGE_WIDTH * IMAGE_HEIGHT;
+
+  std::cout << "  Blend sparse over full unaligned" << std::endl;
+  blendImage = topImage->compress()->copySubrange(0, MID2)->blend(
+      *bottomImage->copySubrange(MID1, END));
+  compareImages(*blendImage->copySubrange(0, MID1),
+                *topImage->copySubrange(0, MID1));
+  compareImages(*blendImage->copySubrange(MID1, MID2),
+                *createImageCombined<ImageType>()->copySubrange(MID1, MID2));
+  compareImages(*blendImage->copySubrange(MID2, END),
+                *bottomImage->copySubrange(MID2, END));
+
+  std::cout << "  Blend full over sparse unaligned" << std::endl;
+  blendImage = topImage->copySubrange(MID1, MID2)->blend(
+      *bottomImage->compress()->window(0, END));
+  compareImages(*blendImage->copySubrange(0, MID1),
+                *bottomImage->copySubrange(0, MID1));
+  compareImages(*blendImage->copySubrange(MID1, MID2),
+                *createImageCombined<ImageType>()->copySubrange(MID1, MID2));
+  compareImages(*blendImage->copySubrange(MID2, END),
+                *bottomImage->copySubrange(MID2, END));
+}
+
+template <typename ImageType>
+static void TestBlendInto() {
+  constexpr int MID1 = IMAGE_WIDTH * IMAGE_HEIGHT / 3;
+  constexpr int MID2 = IMAGE_WIDTH * IMAGE_HEIGHT / 2;
+  constexpr int END = IMAGE_WIDTH * IMAGE_HEIGHT;
+
+  std::cout << "  Blend into" << std::endl;
+  std::unique_ptr<ImageType> accumulator = createImage1<ImageType>();
+  createImage2<ImageType>()->compress()->blendInto(*accumulator);
+  compareImages(*accumulator, *createImageCombined<ImageType>());
+
+  std::cout << "  Blend window into" << std::endl;
+  accumulator = createImage1<ImageType>();
+  createImage2<ImageType>()->compress()->window(MID1, MID2)->blendInto(
+      *accumulator);
+  compareImages(*accumulator->copySubrange(0, MID1),
+                *createImage1<ImageType>(0, MID1));
+  compareImages(*accumulator->copySubrange(MID1, MID2),
+                *createImageCombined<ImageType>(MID1, MID2));
+  compareImages(*accumulator->copySubrange(MID2, END),
+                *createImage1<ImageType>(MID2, END));
+
+  std::cout << "  Compress subrange" << std::endl;
+  std::unique_ptr<ImageType> subImage =
+      createImageCombined<ImageType>(MID1, MID2);
+  std::unique_ptr<ImageSparse> compressedImage = subImage->compress();
+  TEST_ASSERT(compressedImage->getRegionBegin() == MID1);
+  TEST_ASSERT(compressedImage->getRegionEnd() == MID2);
+  TEST_ASSERT(compressedImage->getDataSize() < subImage->getDataSize());
+  compareImages(*compressedImage, *subImage);
+}
+
 template <typename ImageType>
 static void TestWindow() {
   std::cout << "  Window image" << std::endl;
@@ -542,6 +638,36 @@ static void TestWindow() {
   compareImages(*windowImage2, *createImage1<ImageType>(MID2, MID3));
   compareImages(*windowImage, *createImage1<ImageType>(MID1, MID2));
 
+  std::cout << "  Windows across the image" << std::endl;
+  constexpr int STEP = 37;
+  constexpr int LENGTH = 53;
+  for (int begin = 0; begin + LENGTH <= IMAGE_WIDTH * IMAGE_HEIGHT;
+       begin += STEP) {
+    compareImages(*originalImage->window(begin, begin + LENGTH),
+                  *createImage1<ImageType>(begin, begin + LENGTH));
+  }
+
+  std::cout << "  Window of a shallow copy after receiving into the image"
+            << std::endl;
+  {
+    // The copy shares the run lengths, so it must not keep seeking with an
+    // index of the run lengths that were replaced.
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    std::unique_ptr<Image> changedImage = createImage1<ImageType>()->compress();
+    std::unique_ptr<const Image> imageCopy = changedImage->shallowCopy();
+    compareImages(*imageCopy->window(MID2, MID3),
+                  *createImage1<ImageType>(MID2, MID3));
+
+    std::vector<MPI_Request> recvRequests =
+        changedImage->IReceive(rank, MPI_COMM_WORLD);
+    createImage2<ImageType>()->compress()->Send(rank, MPI_COMM_WORLD);
+    MPI_Waitall(
+        recvRequests.size(), recvRequests.data(), MPI_STATUSES_IGNORE);
+    compareImages(*imageCopy->window(MID2, MID3),
+                  *createImage2<ImageType>(MID2, MID3));
+  }
+
   std::cout << "  Window of window" << std::endl;
   windowImage = originalImage->window(MID1, MID3 + 10);
   windowImage = windowImage->window(MID2 - MID1, MID3 - MID1);
@@ -566,6 +692,131 @@ static void TestWindow() {
   compareImages(*blendedImage, *createImageCombined<ImageType>(MID2, MID3));
 }
 
+template <typename ImageType>
+static void TestView() {
+  std::cout << "  View image" << std::endl;
+  constexpr int MID1 = IMAGE_WIDTH * IMAGE_HEIGHT / 3;
+  constexpr int MID2 = IMAGE_WIDTH * IMAGE_HEIGHT / 2;
+  constexpr int MID3 = 2 * IMAGE_WIDTH * IMAGE_HEIGHT / 3;
+  constexpr int END = IMAGE_WIDTH * IMAGE_HEIGHT;
+
+  std::unique_ptr<ImageSparse> originalImage =
+      createImage1<ImageType>()->compress();
+  std::unique_ptr<ImageSparse> bottomImage =
+      createImage2<ImageType>()->compress();
+
+  ImageView view(*originalImage, MID1, MID2);
+  TEST_ASSERT(view.getRegionBegin() == MID1);
+  TEST_ASSERT(view.getNumberOfPixels() == MID2 - MID1);
+  compareImages(*view.copy(), *createImage1<ImageType>(MID1, MID2));
+
+  std::cout << "  View of view" << std::endl;
+  ImageView wideView(*originalImage, MID1, MID3 + 10);
+  ImageView subView = wideView.window(MID2 - MID1, MID3 - MID1);
+  compareImages(*subView.copy(), *createImage1<ImageType>(MID2, MID3));
+
+  std::cout << "  View transfer" << std::endl;
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  std::unique_ptr<Image> destImage = originalImage->createNew(MID2, MID3);
+  std::vector<MPI_Request> recvRequests =
+      destImage->IReceive(rank, MPI_COMM_WORLD);
+
+  std::vector<MPI_Request> sendRequests = subView.ISend(rank, MPI_COMM_WORLD);
+
+  MPI_Waitall(recvRequests.size(), recvRequests.data(), MPI_STATUSES_IGNORE);
+  compareImages(*destImage, *createImage1<ImageType>(MID2, MID3));
+
+  MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+
+  std::cout << "  View transfer edge cases" << std::endl;
+  const int transferRanges[][2] = {{0, END},
+                                   {MID1, MID1},
+                                   {MID1, MID1 + 1},
+                                   {MID1 + 3, MID2 - 5},
+                                   {END - 1, END}};
+  for (auto&& range : transferRanges) {
+    destImage = originalImage->createNew(range[0], range[1]);
+    recvRequests = destImage->IReceive(rank, MPI_COMM_WORLD);
+
+    ImageView rangeView(*originalImage, range[0], range[1]);
+    sendRequests = rangeView.ISend(rank, MPI_COMM_WORLD);
+
+    MPI_Waitall(recvRequests.size(), recvRequests.data(), MPI_STATUSES_IGNORE);
+    compareImages(*destImage, *createImage1<ImageType>(range[0], range[1]));
+
+    MPI_Waitall(
+        sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+  }
+
+  std::cout << "  Packed transfer" << std::endl;
+  // A compressed image, views of it, and a full image in one message. One
+  // view is received in a buffer larger than it, as direct send does.
+  std::unique_ptr<Image> fullImage = createImage2<ImageType>();
+  ImagePackedSender packedSend;
+  packedSend.add(*originalImage);
+  packedSend.add(ImageView(*originalImage, MID1 + 3, MID2 - 5));
+  packedSend.add(ImageView(*originalImage, MID1, MID1));
+  packedSend.add(*fullImage);
+
+  std::unique_ptr<Image> wholeDest = originalImage->createNew();
+  std::unique_ptr<Image> largerDest = originalImage->createNew(MID1, MID2);
+  std::unique_ptr<Image> emptyDest = originalImage->createNew(MID1, MID1);
+  std::unique_ptr<Image> fullDest = fullImage->createNew();
+  ImagePackedReceiver packedReceive;
+  packedReceive.add(*wholeDest);
+  packedReceive.add(*largerDest);
+  packedReceive.add(*emptyDest);
+  packedReceive.add(*fullDest);
+
+  MPI_Request packedRecvRequest =
+      packedReceive.IReceive(rank, MPI_COMM_WORLD);
+  std::vector<MPI_Request> packedSendRequests;
+  packedSend.ISend(rank, MPI_COMM_WORLD, packedSendRequests);
+  packedReceive.wait(packedRecvRequest);
+  compareImages(*wholeDest, *originalImage);
+  compareImages(*largerDest, *createImage1<ImageType>(MID1 + 3, MID2 - 5));
+  compareImages(*emptyDest, *createImage1<ImageType>(MID1, MID1));
+  compareImages(*fullDest, *fullImage);
+  MPI_Waitall(packedSendRequests.size(),
+              packedSendRequests.data(),
+              MPI_STATUSES_IGNORE);
+
+  // A lone message is received in place, here into a larger buffer.
+  std::vector<int> singleData = {1, 2, 3};
+  std::vector<int> singleDest(5, 0);
+  ImagePackedSender singleSend;
+  singleSend.send(singleData.data(), 3 * sizeof(int), 7);
+  ImagePackedReceiver singleReceive;
+  singleReceive.receive(singleDest.data(), 5 * sizeof(int), 7);
+  MPI_Request singleRecvRequest =
+      singleReceive.IReceive(rank, MPI_COMM_WORLD);
+  std::vector<MPI_Request> singleSendRequests;
+  singleSend.ISend(rank, MPI_COMM_WORLD, singleSendRequests);
+  TEST_ASSERT(singleSendRequests.size() == 1);
+  singleReceive.wait(singleRecvRequest);
+  TEST_ASSERT((singleDest == std::vector<int>{1, 2, 3, 0, 0}));
+  MPI_Waitall(singleSendRequests.size(),
+              singleSendRequests.data(),
+              MPI_STATUSES_IGNORE);
+
+  std::cout << "  View blend" << std::endl;
+  std::unique_ptr<Image> blendedImage =
+      subView.blend(ImageView(*bottomImage, MID2, MID3));
+  compareImages(*blendedImage, *createImageCombined<ImageType>(MID2, MID3));
+
+  std::cout << "  View blend unaligned" << std::endl;
+  blendedImage = ImageView(*originalImage, 0, MID2)
+                     .blend(ImageView(*bottomImage, MID1, END));
+  compareImages(*blendedImage->copySubrange(0, MID1),
+                *createImage1<ImageType>(0, MID1));
+  compareImages(*blendedImage->copySubrange(MID1, MID2),
+                *createImageCombined<ImageType>(MID1, MID2));
+  compareImages(*blendedImage->copySubrange(MID2, END),
+                *createImage2<ImageType>(MID2, END));
+}
+
 template <typename ImageType>
 static void DoImageTest(const std::string& imageTypeName) {
   std::cout << imageTypeName << std::endl;
@@ -575,7 +826,10 @@ static void DoImageTest(const std::string& imageTypeName) {
   TestTransfer<ImageType>();
   TestSubrange<ImageType>();
   TestBlend<ImageType>();
+  TestBlendWithFull<ImageType>();
+  TestBlendInto<ImageType>();
   TestWindow<ImageType>();
+  TestView<ImageType>();
 }
 
 #define DO_IMAGE_TEST(ImageType) DoImageTest<ImageType>(#ImageType)
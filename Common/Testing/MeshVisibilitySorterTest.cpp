@@ -0,0 +1,214 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include <Common/Mesh.hpp>
+#include <Common/MeshHelper.hpp>
+#include <Common/MeshVisibilitySorter.hpp>
+#include <Common/Testing/RandomMesh.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define TEST_ASSERT(condition) \
+  CheckAssert(condition, #condition, __FILE__, __LINE__);
+
+static void CheckAssert(bool condition,
+                        const std::string& conditionStr,
+                        const std::string& filename,
+                        int line) {
+  if (condition) {
+    std::cout << "    OK (" << conditionStr << ")" << std::endl;
+  } else {
+    std::cerr << "    *** FAILED! *** (" << conditionStr << "), " << filename
+              << ":" << line << std::endl;
+    exit(1);
+  }
+}
+
+constexpr int NUM_RANDOM_TRIANGLES = 4500;
+// After the random triangles, the mesh repeats every REPEAT_STRIDE-th one, so
+// some triangles have the same depth.
+constexpr int REPEAT_STRIDE = 9;
+constexpr int NUM_TRIANGLES =
+    NUM_RANDOM_TRIANGLES + NUM_RANDOM_TRIANGLES / REPEAT_STRIDE;
+
+// Few enough triangles per thread that the threaded sorter splits them.
+constexpr int MIN_TRIANGLES_PER_THREAD = 1000;
+
+static Mesh createSortMesh() {
+  Mesh mesh = createRandomMesh(1234, NUM_RANDOM_TRIANGLES, 1.0f);
+  for (int repeated = 0; repeated < NUM_RANDOM_TRIANGLES;
+       repeated += REPEAT_STRIDE) {
+    const int* connectionsBuffer = mesh.getTriangleConnectionsBuffer(repeated);
+    int connections[3] = {
+        connectionsBuffer[0], connectionsBuffer[1], connectionsBuffer[2]};
+    mesh.addTriangle(connections);
+  }
+  return mesh;
+}
+
+// Returns the triangle a repeated triangle repeats, or -1 if the triangle is
+// not a repeat.
+static int repeatedTriangle(int triangleIndex) {
+  if (triangleIndex < NUM_RANDOM_TRIANGLES) {
+    return -1;
+  }
+  return (triangleIndex - NUM_RANDOM_TRIANGLES) * REPEAT_STRIDE;
+}
+
+// The depth meshVisibilitySort documents sorting by, computed independently
+// of the sorter.
+static float sortDepth(const Mesh& mesh,
+                       int triangleIndex,
+                       const glm::mat4& fullTransform) {
+  Triangle triangle = mesh.getTriangle(triangleIndex);
+  float depths[3];
+  for (int vertex = 0; vertex < 3; ++vertex) {
+    glm::vec4 transformed =
+        fullTransform * glm::vec4(triangle.vertex[vertex], 1.0f);
+    depths[vertex] = transformed.z / transformed.w;
+  }
+  std::sort(depths, depths + 3);
+  return 0.9f * depths[0] + 0.05f * (depths[1] + depths[2]);
+}
+
+static void TestOrder(const Mesh& mesh,
+                      const glm::mat4& modelview,
+                      const glm::mat4& projection,
+                      bool hasNegativeDepths) {
+  glm::mat4 fullTransform = projection * modelview;
+
+  MeshVisibilitySorter serialSorter(1);
+  std::vector<int> order = serialSorter.sort(mesh, modelview, projection);
+
+  // The order is a permutation of the triangles.
+  std::vector<int> sortedIndices = order;
+  std::sort(sortedIndices.begin(), sortedIndices.end());
+  bool isPermutation = (static_cast<int>(order.size()) == NUM_TRIANGLES);
+  for (int index = 0; isPermutation && (index < NUM_TRIANGLES); ++index) {
+    if (sortedIndices[index] != index) {
+      isPermutation = false;
+    }
+  }
+  TEST_ASSERT(isPermutation);
+
+  // Depths go from farthest to closest (give or take rounding), and
+  // triangles with the same vertices stay in mesh order.
+  constexpr float DEPTH_TOLERANCE = 1e-5f;
+  bool farthestFirst = true;
+  bool stable = true;
+  bool foundNegativeDepth = false;
+  float previousDepth = sortDepth(mesh, order[0], fullTransform);
+  for (int position = 1; position < NUM_TRIANGLES; ++position) {
+    float depth = sortDepth(mesh, order[position], fullTransform);
+    if (depth > previousDepth + DEPTH_TOLERANCE) {
+      farthestFirst = false;
+    }
+    if (depth < 0.0f) {
+      foundNegativeDepth = true;
+    }
+    int repeated = repeatedTriangle(order[position]);
+    if ((repeated >= 0) && (order[position - 1] != repeated)) {
+      stable = false;
+    }
+    previousDepth = depth;
+  }
+  TEST_ASSERT(farthestFirst);
+  TEST_ASSERT(stable);
+  TEST_ASSERT(foundNegativeDepth == hasNegativeDepths);
+
+  // The order does not depend on the number of threads or on what was
+  // sorted before.
+  MeshVisibilitySorter threadedSorter(3);
+  threadedSorter.setMinTrianglesPerThread(MIN_TRIANGLES_PER_THREAD);
+  threadedSorter.sort(mesh, glm::mat4(1.0f), projection);
+  TEST_ASSERT(threadedSorter.sort(mesh, modelview, projection) == order);
+
+  // meshVisibilitySort gives the same order.
+  Mesh sortedMesh = meshVisibilitySort(mesh, modelview, projection);
+  bool sameTriangles = (sortedMesh.getNumberOfTriangles() == NUM_TRIANGLES);
+  for (int position = 0; sameTriangles && (position < NUM_TRIANGLES);
+       ++position) {
+    const int* sortedConnections =
+        sortedMesh.getTriangleConnectionsBuffer(position);
+    const int* connections =
+        mesh.getTriangleConnectionsBuffer(order[position]);
+    if (!std::equal(connections, connections + 3, sortedConnections)) {
+      sameTriangles = false;
+    }
+  }
+  TEST_ASSERT(sameTriangles);
+}
+
+// Sorting after a small camera move fixes the previous order, and sorting
+// after a big one falls back to the radix sort. Either way the order matches
+// sorting from scratch.
+static void TestIncremental(const Mesh& mesh,
+                            const glm::mat4& modelview,
+                            const glm::mat4& projection) {
+  MeshVisibilitySorter sorter(1);
+  TEST_ASSERT(sorter.getIncremental());
+  sorter.sort(mesh, modelview, projection);
+  TEST_ASSERT(sorter.getNumberOfFullSorts() == 1);
+  TEST_ASSERT(sorter.getNumberOfIncrementalSorts() == 0);
+
+  glm::mat4 movedModelview = glm::rotate(
+      modelview, glm::radians(0.001f), glm::vec3(0.0f, 1.0f, 0.0f));
+  MeshVisibilitySorter scratchSorter(1);
+  scratchSorter.setIncremental(false);
+  sorter.resetStatistics();
+  TEST_ASSERT(sorter.sort(mesh, movedModelview, projection) ==
+              scratchSorter.sort(mesh, movedModelview, projection));
+  TEST_ASSERT(sorter.getNumberOfIncrementalSorts() == 1);
+  TEST_ASSERT(sorter.getNumberOfFullSorts() == 0);
+  TEST_ASSERT(sorter.getNumberOfInversionsFixed() > 0);
+
+  glm::mat4 flippedModelview = glm::rotate(
+      modelview, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  sorter.resetStatistics();
+  TEST_ASSERT(sorter.sort(mesh, flippedModelview, projection) ==
+              scratchSorter.sort(mesh, flippedModelview, projection));
+  TEST_ASSERT(sorter.getNumberOfIncrementalSorts() == 0);
+  TEST_ASSERT(sorter.getNumberOfFullSorts() == 1);
+  TEST_ASSERT(scratchSorter.getNumberOfIncrementalSorts() == 0);
+}
+
+int MeshVisibilitySorterTest(int, char* []) {
+  Mesh mesh = createSortMesh();
+  glm::mat4 modelview = glm::lookAt(
+      glm::vec3(0.5f, 1.0f, 3.0f), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+
+  std::cout << "  Perspective" << std::endl;
+  TestOrder(mesh,
+            modelview,
+            glm::perspective(glm::radians(45.0f), 1.0f, 1.0f, 10.0f),
+            false);
+
+  // The depths of the mesh span 0, so the keys of negative and positive
+  // depths are ordered together.
+  std::cout << "  Orthographic" << std::endl;
+  TestOrder(mesh,
+            modelview,
+            glm::ortho(-2.0f, 2.0f, -2.0f, 2.0f, 0.5f, 5.5f),
+            true);
+
+  std::cout << "  Incremental" << std::endl;
+  TestIncremental(mesh,
+                  modelview,
+                  glm::perspective(glm::radians(45.0f), 1.0f, 1.0f, 10.0f));
+
+  std::cout << "  Empty mesh" << std::endl;
+  MeshVisibilitySorter sorter;
+  TEST_ASSERT(sorter.sort(Mesh(), modelview, glm::mat4(1.0f)).empty());
+
+  return 0;
+}
@@ -0,0 +1,49 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef RANDOMMESH_HPP
+#define RANDOMMESH_HPP
+
+// A mesh of random triangles shared by the tests of the libraries.
+
+#include <Common/Color.hpp>
+#include <Common/Mesh.hpp>
+
+#include <glm/vec3.hpp>
+
+#include <random>
+
+/// \brief Creates random triangles in the [-1, 1] cube.
+///
+/// Every triangle has its own three vertices and a random color with the
+/// given alpha (premultiplied into the color). The same seed always gives
+/// the same mesh.
+///
+inline Mesh createRandomMesh(unsigned int seed, int numTriangles, float alpha) {
+  std::mt19937 randomEngine(seed);
+  std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+  std::uniform_real_distribution<float> component(0.0f, 1.0f);
+  Mesh mesh;
+  for (int triangleIndex = 0; triangleIndex < numTriangles; ++triangleIndex) {
+    int vertexIndex = mesh.getNumberOfVertices();
+    for (int vertex = 0; vertex < 3; ++vertex) {
+      mesh.addVertex(glm::vec3(coordinate(randomEngine),
+                               coordinate(randomEngine),
+                               coordinate(randomEngine)));
+    }
+    int connections[3] = {vertexIndex, vertexIndex + 1, vertexIndex + 2};
+    mesh.addTriangle(connections,
+                     Color(alpha * component(randomEngine),
+                           alpha * component(randomEngine),
+                           alpha * component(randomEngine),
+                           alpha));
+  }
+  return mesh;
+}
+
+#endif  // RANDOMMESH_HPP
@@ -15,6 +15,11 @@ YamlWriter::YamlWriter(std::ostream& outputStream)
   this->BlockStack.push(Block(0));
 }
 
+YamlWriter::YamlWriter(std::ostream& outputStream, const YamlWriter& parent)
+    : OutputStream(outputStream), AtBlockStart(parent.AtBlockStart) {
+  this->BlockStack.push(parent.CurrentBlock());
+}
+
 YamlWriter::~YamlWriter() {
   if (this->BlockStack.size() != 1) {
     std::cerr << "YamlWriter destroyed before last block complete."
@@ -89,3 +94,9 @@ void YamlWriter::AddListValue(const std::string& value) {
   this->OutputStream << value << std::endl;
   this->AtBlockStart = false;
 }
+
+void YamlWriter::AddFormattedText(const std::string& text) {
+  this->OutputStream << text;
+  this->CurrentBlock().AtListItemStart = false;
+  this->AtBlockStart = false;
+}
@@ -35,6 +35,13 @@ class YamlWriter {
  public:
   YamlWriter(std::ostream& outputStream = std::cout);
 
+  /// Creates a writer that formats its output as if it were being written to
+  /// \a parent at the parent's current position. This allows a section of
+  /// the output to be built up separately (for example, by another thread)
+  /// and later added to the parent with \c AddFormattedText.
+  ///
+  YamlWriter(std::ostream& outputStream, const YamlWriter& parent);
+
   ~YamlWriter();
 
   /// Starts a block underneath a dictionary item. The key for the block is
@@ -58,6 +65,11 @@ class YamlWriter {
   ///
   void AddListValue(const std::string& value);
 
+  /// Add text that is already formatted for the current position, such as
+  /// the output of a writer created with the parent constructor.
+  ///
+  void AddFormattedText(const std::string& text);
+
   /// Add a key/value pair for a dictionary entry.
   ///
   template <typename T>
@@ -8,11 +8,17 @@
 
 #include "DirectSendBase.hpp"
 
+#include <Common/DirectSendImages.hpp>
+#include <Common/DirectSendReceiveWindow.hpp>
+#include <Common/ImagePackedMessage.hpp>
+#include <Common/ImageView.hpp>
 #include <Common/MainLoop.hpp>
 
 #include <array>
+#include <deque>
 
 constexpr int DEFAULT_MAX_IMAGE_SPLIT = 1000000;
+constexpr int DEFAULT_MAX_INFLIGHT_RECEIVES = 1000000;
 
 static int getRealRank(MPI_Group group, int rank, MPI_Comm communicator) {
   MPI_Group commGroup;
@@ -25,79 +31,56 @@ static int getRealRank(MPI_Group group, int rank, MPI_Comm communicator) {
   return realRank;
 }
 
-static void getPieceRange(int imageSize,
-                          int pieceIndex,
-                          int numPieces,
-                          int& rangeBeginOut,
-                          int& rangeEndOut) {
-  assert(pieceIndex >= 0);
-  assert(pieceIndex < numPieces);
-
-  int pieceSize = imageSize / numPieces;
-  rangeBeginOut = pieceSize * pieceIndex;
-  if (pieceIndex < numPieces - 1) {
-    rangeEndOut = rangeBeginOut + pieceSize;
-  } else {
-    rangeEndOut = imageSize;
-  }
-}
 
-static void PostReceives(
-    Image* localImage,
-    MPI_Group sendGroup,
-    MPI_Group recvGroup,
-    MPI_Comm communicator,
-    std::vector<MPI_Request>& requestsOut,
-    std::vector<std::unique_ptr<const Image>>& incomingImagesOut) {
-  int recvGroupRank;
-  MPI_Group_rank(recvGroup, &recvGroupRank);
-  if (recvGroupRank == MPI_UNDEFINED) {
-    // I am not receiving anything. Just create an "empty" incoming image
-    incomingImagesOut.push_back(localImage->window(0, 0));
-    return;
+// A receive posted through a DirectSendReceiveWindow of the pieces of every
+// image from one process. Pieces are received and blended in the order they
+// are posted.
+struct PostedReceive {
+  std::vector<std::unique_ptr<Image>> imageBuffers;
+  ImagePackedReceiver receiver;
+  MPI_Request request;
+};
+
+static void PostReceives(DirectSendReceiveWindow& window,
+                         std::deque<PostedReceive>& posted) {
+  PostedReceive receive;
+  int sendGroupIndex;
+  while (window.postNextReceive(sendGroupIndex,
+                                receive.imageBuffers,
+                                receive.receiver,
+                                receive.request)) {
+    posted.push_back(std::move(receive));
   }
-  int recvGroupSize;
-  MPI_Group_size(recvGroup, &recvGroupSize);
-
-  int sendGroupRank;
-  MPI_Group_rank(sendGroup, &sendGroupRank);
-  int sendGroupSize;
-  MPI_Group_size(sendGroup, &sendGroupSize);
+}
 
-  int rangeBegin;
-  int rangeEnd;
-  getPieceRange(localImage->getNumberOfPixels(),
-                recvGroupRank,
-                recvGroupSize,
-                rangeBegin,
-                rangeEnd);
+// Waits for the oldest posted receive and returns the buffers of its pieces.
+static std::vector<std::unique_ptr<Image>> WaitForReceive(
+    std::deque<PostedReceive>& posted) {
+  assert(!posted.empty());
+  PostedReceive& receive = posted.front();
+  receive.receiver.wait(receive.request);
+  std::vector<std::unique_ptr<Image>> imageBuffers =
+      std::move(receive.imageBuffers);
+  posted.pop_front();
+  return imageBuffers;
+}
 
-  incomingImagesOut.resize(sendGroupSize);
-  for (int sendGroupIndex = 0; sendGroupIndex < sendGroupSize;
-       ++sendGroupIndex) {
-    if (sendGroupIndex != sendGroupRank) {
-      std::unique_ptr<Image> recvImageBuffer =
-          localImage->createNew(rangeBegin, rangeEnd);
-      std::vector<MPI_Request> newRequests = recvImageBuffer->IReceive(
-          getRealRank(sendGroup, sendGroupIndex, communicator), communicator);
-      requestsOut.insert(
-          requestsOut.end(), newRequests.begin(), newRequests.end());
-      incomingImagesOut[sendGroupIndex].reset(recvImageBuffer.release());
-    } else {
-      // "Sending" to self. Just record a shallow copy of the image.
-      incomingImagesOut[sendGroupIndex] =
-          localImage->window(rangeBegin, rangeEnd);
-    }
-  }
+// Gives back a buffer whose piece has been blended and posts more receives.
+static void RecycleReceiveBuffer(DirectSendReceiveWindow& window,
+                                 std::deque<PostedReceive>& posted,
+                                 int imageIndex,
+                                 std::unique_ptr<Image> imageBuffer) {
+  window.recycleBuffer(imageIndex, std::move(imageBuffer));
+  window.releaseReceive();
+  PostReceives(window, posted);
 }
 
-static void PostSends(
-    Image* localImage,
-    MPI_Group sendGroup,
-    MPI_Group recvGroup,
-    MPI_Comm communicator,
-    std::vector<MPI_Request>& requestsOut,
-    std::vector<std::unique_ptr<const Image>>& outgoingImagesOut) {
+static void PostSends(const DirectSendImages& localImages,
+                      MPI_Group sendGroup,
+                      MPI_Group recvGroup,
+                      MPI_Comm communicator,
+                      std::vector<MPI_Request>& requestsOut,
+                      std::deque<ImagePackedSender>& packedSendsOut) {
   int sendGroupRank;
   MPI_Group_rank(sendGroup, &sendGroupRank);
   if (sendGroupRank == MPI_UNDEFINED) {
@@ -112,91 +95,230 @@ static void PostSends(
   int recvGroupSize;
   MPI_Group_size(recvGroup, &recvGroupSize);
 
-  outgoingImagesOut.resize(recvGroupSize);
   for (int recvGroupIndex = 0; recvGroupIndex < recvGroupSize;
        ++recvGroupIndex) {
     if (recvGroupIndex != recvGroupRank) {
-      int rangeBegin;
-      int rangeEnd;
-      getPieceRange(localImage->getNumberOfPixels(),
-                    recvGroupIndex,
-                    recvGroupSize,
-                    rangeBegin,
-                    rangeEnd);
-      std::unique_ptr<const Image> outImage =
-          localImage->window(rangeBegin, rangeEnd);
-      std::vector<MPI_Request> newRequests = outImage->ISend(
-          getRealRank(recvGroup, recvGroupIndex, communicator), communicator);
-      requestsOut.insert(
-          requestsOut.end(), newRequests.begin(), newRequests.end());
-      outgoingImagesOut[recvGroupIndex].swap(outImage);
+      int realRecvRank = getRealRank(recvGroup, recvGroupIndex, communicator);
+      // Send the pieces of every image going to this peer in one message.
+      // The deque keeps the views in place while they are sent.
+      packedSendsOut.emplace_back();
+      for (int imageIndex = 0; imageIndex < localImages.getNumberOfImages();
+           ++imageIndex) {
+        packedSendsOut.back().add(
+            localImages.getPiece(imageIndex, recvGroupIndex));
+      }
+      packedSendsOut.back().ISend(realRecvRank, communicator, requestsOut);
     } else {
-      // Do not need to send. PostReceives just did a shallow copy of the data.
+      // Do not need to send. My own piece is blended from a view of it.
     }
   }
 }
 
-static std::unique_ptr<Image> ProcessIncomingImages(
-    std::vector<MPI_Request>& requests,
-    std::vector<std::unique_ptr<const Image>>& incomingImages) {
-  if (requests.size() > 0) {
-    MPI_Waitall(requests.size(), requests.data(), MPI_STATUSES_IGNORE);
-  }
+static std::vector<std::unique_ptr<Image>> DoDirectSend(
+    const std::vector<Image*>& inputImages,
+    MPI_Group sendGroup,
+    MPI_Group recvGroup,
+    MPI_Comm communicator,
+    int maxInFlightReceives,
+    float autoCompressThreshold,
+    YamlWriter& yaml,
+    std::size_t& peakReceiveBytesOut) {
+  DirectSendImages localImages(inputImages,
+                               sendGroup,
+                               recvGroup,
+                               communicator,
+                               autoCompressThreshold,
+                               yaml);
+  int numImages = localImages.getNumberOfImages();
+  peakReceiveBytesOut = 0;
 
-  assert(incomingImages.size() > 0);
-  if (incomingImages.size() == 1) {
-    // Unexpected corner case where there is just one image.
-    return incomingImages[0]->deepCopy();
-  }
+  int recvGroupRank;
+  MPI_Group_rank(recvGroup, &recvGroupRank);
+  if (recvGroupRank == MPI_UNDEFINED) {
+    // I am not receiving anything. Just send my pieces and return "empty"
+    // images.
+    std::vector<MPI_Request> sendRequests;
+    std::deque<ImagePackedSender> packedSends;
+    PostSends(localImages,
+              sendGroup,
+              recvGroup,
+              communicator,
+              sendRequests,
+              packedSends);
+
+    std::vector<std::unique_ptr<Image>> resultImages;
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      resultImages.push_back(
+          localImages.getPrototype(imageIndex).copySubrange(0, 0));
+    }
+
+    if (sendRequests.size() > 0) {
+      MPI_Waitall(
+          sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+    }
 
-  std::unique_ptr<Image> workingImage =
-      incomingImages[0]->blend(*incomingImages[1]);
-  for (int imageIndex = 2; imageIndex < incomingImages.size(); ++imageIndex) {
-    workingImage = workingImage->blend(*incomingImages[imageIndex]);
+    return resultImages;
   }
+  int recvGroupSize;
+  MPI_Group_size(recvGroup, &recvGroupSize);
 
-  return workingImage;
-}
+  int sendGroupSize;
+  MPI_Group_size(sendGroup, &sendGroupSize);
 
-std::unique_ptr<Image> DirectSendBase::compose(Image* localImage,
-                                               MPI_Group sendGroup,
-                                               MPI_Group recvGroup,
-                                               MPI_Comm communicator,
-                                               YamlWriter&) {
-  std::vector<MPI_Request> recvRequests;
-  std::vector<std::unique_ptr<const Image>> incomingImages;
-  PostReceives(localImage,
-               sendGroup,
-               recvGroup,
-               communicator,
-               recvRequests,
-               incomingImages);
+  int sendGroupRank;
+  MPI_Group_rank(sendGroup, &sendGroupRank);
+
+  DirectSendReceiveWindow window(
+      localImages, sendGroup, recvGroup, communicator, maxInFlightReceives);
+  std::deque<PostedReceive> posted;
+  PostReceives(window, posted);
 
   std::vector<MPI_Request> sendRequests;
-  std::vector<std::unique_ptr<const Image>> outgoingImages;
-  PostSends(localImage,
+  std::deque<ImagePackedSender> packedSends;
+  PostSends(localImages,
             sendGroup,
             recvGroup,
             communicator,
             sendRequests,
-            outgoingImages);
+            packedSends);
+
+  // "Sending" to self. Just use a view of the image.
+  auto selfPiece = [&](int imageIndex) {
+    return localImages.getPiece(imageIndex, recvGroupRank);
+  };
+
+  // Blend the pieces in order as they come in. The first piece of each image
+  // has to be held until the second one comes in.
+  std::vector<bool> holdingFirstSelfPiece(numImages, false);
+  std::vector<std::unique_ptr<Image>> firstReceivedPieces(numImages);
+  std::vector<std::unique_ptr<Image>> resultImages(numImages);
+  auto blendPiece = [&](int imageIndex, const ImageView& piece) {
+    if (resultImages[imageIndex]) {
+      resultImages[imageIndex] =
+          ImageView(*resultImages[imageIndex]).blend(piece);
+    } else if (holdingFirstSelfPiece[imageIndex]) {
+      resultImages[imageIndex] = selfPiece(imageIndex).blend(piece);
+      holdingFirstSelfPiece[imageIndex] = false;
+    } else {
+      resultImages[imageIndex] =
+          ImageView(*firstReceivedPieces[imageIndex]).blend(piece);
+      window.recycleBuffer(imageIndex,
+                           std::move(firstReceivedPieces[imageIndex]));
+    }
+  };
+  for (int sendGroupIndex = 0; sendGroupIndex < sendGroupSize;
+       ++sendGroupIndex) {
+    bool isFirstPiece = (sendGroupIndex == 0);
+    if (sendGroupIndex == sendGroupRank) {
+      for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+        if (isFirstPiece) {
+          holdingFirstSelfPiece[imageIndex] = true;
+        } else {
+          blendPiece(imageIndex, selfPiece(imageIndex));
+        }
+      }
+      continue;
+    }
+
+    std::vector<std::unique_ptr<Image>> imageBuffers = WaitForReceive(posted);
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      if (isFirstPiece) {
+        // Hold on to this buffer until the next piece comes in. It no longer
+        // counts against the receives in flight.
+        firstReceivedPieces[imageIndex] = std::move(imageBuffers[imageIndex]);
+        window.releaseReceive();
+        PostReceives(window, posted);
+      } else {
+        blendPiece(imageIndex, ImageView(*imageBuffers[imageIndex]));
+        RecycleReceiveBuffer(
+            window, posted, imageIndex, std::move(imageBuffers[imageIndex]));
+      }
+    }
+  }
 
-  std::unique_ptr<Image> resultImage =
-      ProcessIncomingImages(recvRequests, incomingImages);
+  // Receive buffers are kept until the end, so their total size is the peak
+  // memory used for receiving. (For compressed images, this is the size of
+  // the data last received in each buffer.)
+  peakReceiveBytesOut = window.getRecycledBytes();
+  for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+    if (firstReceivedPieces[imageIndex]) {
+      peakReceiveBytesOut += firstReceivedPieces[imageIndex]->getDataSize();
+    }
+  }
+
+  for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+    if (!resultImages[imageIndex]) {
+      // Unexpected corner case where there is just one image.
+      if (holdingFirstSelfPiece[imageIndex]) {
+        resultImages[imageIndex] = selfPiece(imageIndex).copy();
+      } else {
+        resultImages[imageIndex] = std::move(firstReceivedPieces[imageIndex]);
+      }
+    }
+  }
 
   if (sendRequests.size() > 0) {
     MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
   }
 
-  return resultImage;
+  return resultImages;
+}
+
+std::vector<std::unique_ptr<Image>> DirectSendBase::composeMany(
+    const std::vector<Image*>& localImages,
+    MPI_Group sendGroup,
+    MPI_Group recvGroup,
+    MPI_Comm communicator,
+    float autoCompressThreshold,
+    YamlWriter& yaml,
+    std::size_t& peakReceiveBytesOut) {
+  return DoDirectSend(localImages,
+                      sendGroup,
+                      recvGroup,
+                      communicator,
+                      DEFAULT_MAX_INFLIGHT_RECEIVES,
+                      autoCompressThreshold,
+                      yaml,
+                      peakReceiveBytesOut);
+}
+
+std::unique_ptr<Image> DirectSendBase::compose(
+    Image* localImage,
+    MPI_Group sendGroup,
+    MPI_Group recvGroup,
+    MPI_Comm communicator,
+    float autoCompressThreshold,
+    YamlWriter& yaml,
+    std::size_t& peakReceiveBytesOut) {
+  std::vector<Image*> localImages(1, localImage);
+  return std::move(composeMany(localImages,
+                               sendGroup,
+                               recvGroup,
+                               communicator,
+                               autoCompressThreshold,
+                               yaml,
+                               peakReceiveBytesOut)
+                       .front());
 }
 
-DirectSendBase::DirectSendBase() : maxSplit(DEFAULT_MAX_IMAGE_SPLIT) {}
+DirectSendBase::DirectSendBase()
+    : maxSplit(DEFAULT_MAX_IMAGE_SPLIT),
+      maxInFlightReceives(DEFAULT_MAX_INFLIGHT_RECEIVES) {}
 
 std::unique_ptr<Image> DirectSendBase::compose(Image* localImage,
                                                MPI_Group group,
                                                MPI_Comm communicator,
                                                YamlWriter& yaml) {
+  std::vector<Image*> localImages(1, localImage);
+  return std::move(
+      this->composeMany(localImages, group, communicator, yaml).front());
+}
+
+std::vector<std::unique_ptr<Image>> DirectSendBase::composeMany(
+    const std::vector<Image*>& localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    YamlWriter& yaml) {
   int groupSize;
   MPI_Group_size(group, &groupSize);
 
@@ -205,15 +327,31 @@ std::unique_ptr<Image> DirectSendBase::compose(Image* localImage,
       0, std::min(this->maxSplit, groupSize) - 1, 1};
   MPI_Group_range_incl(group, 1, procRange.data(), &recvGroup);
 
-  std::unique_ptr<Image> result =
-      this->compose(localImage, group, recvGroup, communicator, yaml);
+  float autoCompressThreshold = this->getAutoCompressThreshold();
+  if (autoCompressThreshold >= 0) {
+    yaml.StartBlock("auto-compress-rounds");
+  }
+  std::size_t peakReceiveBytes;
+  std::vector<std::unique_ptr<Image>> results =
+      DoDirectSend(localImages,
+                   group,
+                   recvGroup,
+                   communicator,
+                   this->maxInFlightReceives,
+                   autoCompressThreshold,
+                   yaml,
+                   peakReceiveBytes);
+  if (autoCompressThreshold >= 0) {
+    yaml.EndBlock();
+  }
+  yaml.AddDictionaryEntry("peak-receive-bytes", peakReceiveBytes);
 
   MPI_Group_free(&recvGroup);
 
-  return result;
+  return results;
 }
 
-enum optionIndex { MAX_IMAGE_SPLIT };
+enum optionIndex { MAX_IMAGE_SPLIT, MAX_INFLIGHT_RECEIVES };
 
 std::vector<option::Descriptor> DirectSendBase::getOptionVector() {
   std::vector<option::Descriptor> usage;
@@ -224,6 +362,13 @@ std::vector<option::Descriptor> DirectSendBase::getOptionVector() {
      "                          be split during compositing. Setting this\n"
      "                          parameter can reduce the total network traffic,\n"
      "                          but at the expense of load imbalance.\n"});
+  usage.push_back(
+    {MAX_INFLIGHT_RECEIVES, 0, "", "max-inflight-receives", PositiveIntArg,
+     "  --max-inflight-receives=<num> Set the maximum number of image pieces\n"
+     "                          that are received at once. Receive buffers are\n"
+     "                          reused as pieces are blended. Setting this\n"
+     "                          parameter limits the memory used for receiving\n"
+     "                          at the expense of less overlap.\n"});
   // clang-format on
 
   return usage;
@@ -237,5 +382,10 @@ bool DirectSendBase::setOptions(const std::vector<option::Option>& options,
   }
   yaml.AddDictionaryEntry("max-image-split", this->maxSplit);
 
+  if (options[MAX_INFLIGHT_RECEIVES]) {
+    this->maxInFlightReceives = atoi(options[MAX_INFLIGHT_RECEIVES].arg);
+  }
+  yaml.AddDictionaryEntry("max-inflight-receives", this->maxInFlightReceives);
+
   return true;
 }
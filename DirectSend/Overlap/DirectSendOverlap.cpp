@@ -8,9 +8,17 @@
 
 #include "DirectSendOverlap.hpp"
 
+#include <Common/DirectSendImages.hpp>
+#include <Common/DirectSendReceiveWindow.hpp>
+#include <Common/ImageFull.hpp>
+#include <Common/ImagePackedMessage.hpp>
+#include <Common/ImageSparse.hpp>
+#include <Common/ImageView.hpp>
 #include <Common/MainLoop.hpp>
 
+#include <algorithm>
 #include <array>
+#include <deque>
 
 constexpr int DEFAULT_MAX_IMAGE_SPLIT = 1000000;
 
@@ -27,91 +35,185 @@ static int getRealRank(MPI_Group group, int rank, MPI_Comm communicator) {
 
 struct IncomingDirectSendImage {
   std::unique_ptr<Image> imageBuffer;
-  std::vector<MPI_Request> receiveRequests;
-  enum { WAITING, READY, EMPTY } status;
+  enum { NOT_POSTED, WAITING, READY, EMPTY } status;
+  // True if imageBuffer was created for a receive and can be reused for
+  // another receive once it is blended.
+  bool isReceiveBuffer;
+  // True if this image counts against the maximum receives in flight.
+  bool inWindow;
+  // The bytes of imageBuffer counted in ReceiveWindow::currentBytes.
+  std::size_t countedBytes;
+  // The piece "sent" to self is not held in imageBuffer. Instead, it is
+  // viewed in place in these local images until it is blended.
+  const DirectSendImages* selfPieceImages;
+  int selfPieceIndex;
 };
 
-static void getPieceRange(int imageSize,
-                          int pieceIndex,
-                          int numPieces,
-                          int& rangeBeginOut,
-                          int& rangeEndOut) {
-  assert(pieceIndex >= 0);
-  assert(pieceIndex < numPieces);
-
-  int pieceSize = imageSize / numPieces;
-  rangeBeginOut = pieceSize * pieceIndex;
-  if (pieceIndex < numPieces - 1) {
-    rangeEndOut = rangeBeginOut + pieceSize;
-  } else {
-    rangeEndOut = imageSize;
+// Returns a view of the image held in an incoming image.
+static ImageView ViewIncoming(const IncomingDirectSendImage& in,
+                              int imageIndex) {
+  if (in.selfPieceImages != nullptr) {
+    return in.selfPieceImages->getPiece(imageIndex, in.selfPieceIndex);
+  }
+  return ImageView(*in.imageBuffer);
+}
+
+// Keeps track of the receives of the image pieces coming from the processes
+// of sendGroup. At most maxInFlight receive buffers are posted or waiting to
+// be blended at any time. (The first image that has not been blended into
+// another, which is where the others get blended, does not count.)
+//
+// The window also tracks the memory used for receiving: the receive buffers
+// posted or waiting to be blended, the images blended from them, and the
+// accumulators. (For compressed images, a buffer is counted as the size of
+// the data it holds, which is the data last received in it.)
+struct ReceiveWindow {
+  DirectSendReceiveWindow receives;
+  int numWaiting;
+
+  // The request of each posted receive of the pieces from one process, the
+  // process (as an index in sendGroup) it comes from, and the packed receive
+  // to finish each time the request completes. Slots are reused once the
+  // receive finishes.
+  std::vector<MPI_Request> requests;
+  std::vector<int> requestSources;
+  std::vector<ImagePackedReceiver> receivers;
+
+  std::size_t currentBytes;
+  std::size_t peakBytes;
+
+  ReceiveWindow(const DirectSendImages& localImages,
+                MPI_Group sendGroup,
+                MPI_Group recvGroup,
+                MPI_Comm communicator,
+                int maxInFlight)
+      : receives(
+            localImages, sendGroup, recvGroup, communicator, maxInFlight),
+        numWaiting(0),
+        currentBytes(0),
+        peakBytes(0) {}
+
+  void addBytes(std::size_t numBytes) {
+    this->currentBytes += numBytes;
+    this->peakBytes = std::max(this->peakBytes, this->currentBytes);
+  }
+
+  void removeBytes(std::size_t numBytes) {
+    assert(numBytes <= this->currentBytes);
+    this->currentBytes -= numBytes;
+  }
+
+  // Counts the current size of the image held in the given incoming image.
+  void recount(IncomingDirectSendImage& in) {
+    this->removeBytes(in.countedBytes);
+    in.countedBytes = in.imageBuffer->getDataSize();
+    this->addBytes(in.countedBytes);
+  }
+};
+
+
+static void PostMoreReceives(
+    std::vector<std::vector<IncomingDirectSendImage>>& incomingImages,
+    ReceiveWindow& window) {
+  int sendGroupIndex;
+  std::vector<std::unique_ptr<Image>> imageBuffers;
+  ImagePackedReceiver receiver;
+  MPI_Request request;
+  while (window.receives.postNextReceive(
+      sendGroupIndex, imageBuffers, receiver, request)) {
+    for (std::size_t imageIndex = 0; imageIndex < imageBuffers.size();
+         ++imageIndex) {
+      IncomingDirectSendImage& incoming =
+          incomingImages[imageIndex][sendGroupIndex];
+      assert(incoming.status == IncomingDirectSendImage::NOT_POSTED);
+      incoming.imageBuffer = std::move(imageBuffers[imageIndex]);
+      incoming.status = IncomingDirectSendImage::WAITING;
+      incoming.isReceiveBuffer = true;
+      incoming.inWindow = true;
+      window.recount(incoming);
+    }
+    ++window.numWaiting;
+
+    // Record the request, which we will wait for to see which process's
+    // pieces get here first.
+    std::size_t slot = 0;
+    while ((slot < window.requests.size()) &&
+           (window.requests[slot] != MPI_REQUEST_NULL)) {
+      ++slot;
+    }
+    if (slot == window.requests.size()) {
+      window.requests.push_back(MPI_REQUEST_NULL);
+      window.requestSources.emplace_back();
+      window.receivers.emplace_back();
+    }
+    window.requests[slot] = request;
+    window.requestSources[slot] = sendGroupIndex;
+    window.receivers[slot] = std::move(receiver);
   }
 }
 
 static void PostReceives(
-    Image* localImage,
+    const DirectSendImages& localImages,
     MPI_Group sendGroup,
     MPI_Group recvGroup,
-    MPI_Comm communicator,
-    std::vector<IncomingDirectSendImage>& incomingImagesOut) {
+    std::vector<std::vector<IncomingDirectSendImage>>& incomingImagesOut,
+    ReceiveWindow& window) {
+  int numImages = localImages.getNumberOfImages();
+  incomingImagesOut.resize(numImages);
+
   int recvGroupRank;
   MPI_Group_rank(recvGroup, &recvGroupRank);
   if (recvGroupRank == MPI_UNDEFINED) {
     // I am not receiving anything. Just create an "empty" incoming image
-    incomingImagesOut.resize(1);
-    incomingImagesOut[0].imageBuffer = localImage->copySubrange(0, 0);
-    incomingImagesOut[0].status = IncomingDirectSendImage::READY;
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      std::vector<IncomingDirectSendImage>& incomingImages =
+          incomingImagesOut[imageIndex];
+      incomingImages.resize(1);
+      incomingImages[0].imageBuffer =
+          localImages.getPrototype(imageIndex).copySubrange(0, 0);
+      incomingImages[0].status = IncomingDirectSendImage::READY;
+      incomingImages[0].isReceiveBuffer = false;
+      incomingImages[0].inWindow = false;
+      incomingImages[0].countedBytes = 0;
+      incomingImages[0].selfPieceImages = nullptr;
+    }
     return;
   }
-  int recvGroupSize;
-  MPI_Group_size(recvGroup, &recvGroupSize);
-
-  int sendGroupRank;
-  MPI_Group_rank(sendGroup, &sendGroupRank);
   int sendGroupSize;
   MPI_Group_size(sendGroup, &sendGroupSize);
-
-  int rangeBegin;
-  int rangeEnd;
-  getPieceRange(localImage->getNumberOfPixels(),
-                recvGroupRank,
-                recvGroupSize,
-                rangeBegin,
-                rangeEnd);
-
-  incomingImagesOut.resize(sendGroupSize);
-  for (int sendGroupIndex = 0; sendGroupIndex < sendGroupSize;
-       ++sendGroupIndex) {
-    if (sendGroupIndex != sendGroupRank) {
-      incomingImagesOut[sendGroupIndex].imageBuffer =
-          localImage->createNew(rangeBegin, rangeEnd);
-      incomingImagesOut[sendGroupIndex].receiveRequests =
-          incomingImagesOut[sendGroupIndex].imageBuffer->IReceive(
-              getRealRank(sendGroup, sendGroupIndex, communicator),
-              communicator);
-      incomingImagesOut[sendGroupIndex].status =
-          IncomingDirectSendImage::WAITING;
-    } else {
-      // "Sending" to self. Just record a shallow copy of the image.
-      std::unique_ptr<const Image> selfSendImage =
-          localImage->window(rangeBegin, rangeEnd);
-      // I know, this const cast is bad form. But the next thing to happen to
-      // this image is to get blended with something else. The risk is low
-      // and it's just too much trouble to get the const-ness exact.
-      incomingImagesOut[sendGroupIndex].imageBuffer.reset(
-          const_cast<Image*>(selfSendImage.release()));
-      incomingImagesOut[sendGroupIndex].status = IncomingDirectSendImage::READY;
+  int sendGroupRank = window.receives.getSendGroupRank();
+
+  for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+    std::vector<IncomingDirectSendImage>& incomingImages =
+        incomingImagesOut[imageIndex];
+    incomingImages.resize(sendGroupSize);
+    for (auto&& incoming : incomingImages) {
+      incoming.status = IncomingDirectSendImage::NOT_POSTED;
+      incoming.isReceiveBuffer = false;
+      incoming.inWindow = false;
+      incoming.countedBytes = 0;
+      incoming.selfPieceImages = nullptr;
+    }
+    if (sendGroupRank != MPI_UNDEFINED) {
+      // "Sending" to self. Just view the piece in the local image.
+      IncomingDirectSendImage& incoming = incomingImages[sendGroupRank];
+      incoming.selfPieceImages = &localImages;
+      incoming.selfPieceIndex = recvGroupRank;
+      incoming.status = IncomingDirectSendImage::READY;
     }
   }
+
+  // Post the receives for the pieces of every image coming from each peer
+  // together (as far as the window allows).
+  PostMoreReceives(incomingImagesOut, window);
 }
 
-static void PostSends(
-    Image* localImage,
-    MPI_Group sendGroup,
-    MPI_Group recvGroup,
-    MPI_Comm communicator,
-    std::vector<MPI_Request>& requestsOut,
-    std::vector<std::unique_ptr<const Image>>& outgoingImagesOut) {
+static void PostSends(const DirectSendImages& localImages,
+                      MPI_Group sendGroup,
+                      MPI_Group recvGroup,
+                      MPI_Comm communicator,
+                      std::vector<MPI_Request>& requestsOut,
+                      std::deque<ImagePackedSender>& packedSendsOut) {
   int sendGroupRank;
   MPI_Group_rank(sendGroup, &sendGroupRank);
   if (sendGroupRank == MPI_UNDEFINED) {
@@ -126,133 +228,339 @@ static void PostSends(
   int recvGroupSize;
   MPI_Group_size(recvGroup, &recvGroupSize);
 
-  outgoingImagesOut.resize(recvGroupSize);
   for (int recvGroupIndex = 0; recvGroupIndex < recvGroupSize;
        ++recvGroupIndex) {
     if (recvGroupIndex != recvGroupRank) {
-      int rangeBegin;
-      int rangeEnd;
-      getPieceRange(localImage->getNumberOfPixels(),
-                    recvGroupIndex,
-                    recvGroupSize,
-                    rangeBegin,
-                    rangeEnd);
-      std::unique_ptr<const Image> outImage =
-          localImage->window(rangeBegin, rangeEnd);
-      std::vector<MPI_Request> newRequests = outImage->ISend(
-          getRealRank(recvGroup, recvGroupIndex, communicator), communicator);
-      requestsOut.insert(
-          requestsOut.end(), newRequests.begin(), newRequests.end());
-      outgoingImagesOut[recvGroupIndex].swap(outImage);
+      int realRecvRank = getRealRank(recvGroup, recvGroupIndex, communicator);
+      // Send the pieces of every image going to this peer in one message.
+      // The deque keeps the views in place while they are sent.
+      packedSendsOut.emplace_back();
+      for (int imageIndex = 0; imageIndex < localImages.getNumberOfImages();
+           ++imageIndex) {
+        packedSendsOut.back().add(
+            localImages.getPiece(imageIndex, recvGroupIndex));
+      }
+      packedSendsOut.back().ISend(realRecvRank, communicator, requestsOut);
     } else {
       // Do not need to send. PostReceives just did a shallow copy of the data.
     }
   }
 }
 
-static std::unique_ptr<Image> ProcessIncomingImages(
-    std::vector<IncomingDirectSendImage>& incoming) {
-  assert(!incoming.empty());
+// Called when the image in an incoming image is no longer needed.
+static void ReleaseBuffer(IncomingDirectSendImage& in,
+                          int imageIndex,
+                          ReceiveWindow& window) {
+  if (in.inWindow) {
+    in.inWindow = false;
+    window.receives.releaseReceive();
+  }
+  if (in.isReceiveBuffer) {
+    in.isReceiveBuffer = false;
+    window.receives.recycleBuffer(imageIndex, std::move(in.imageBuffer));
+  }
+  in.imageBuffer.reset();
+  in.selfPieceImages = nullptr;
+  window.removeBytes(in.countedBytes);
+  in.countedBytes = 0;
+}
 
-  // Collect the last request for each incoming image. We will wait for these
-  // last requests to see which image gets here first.
-  std::vector<MPI_Request> lastRequests;
-  lastRequests.reserve(incoming.size());
-  int numPending = 0;
+static void BlendReadyImages(std::vector<IncomingDirectSendImage>& incoming,
+                             int imageIndex,
+                             ReceiveWindow& window) {
+  // Check all incoming images and find candidates to blend
+  for (auto targetIn = incoming.begin(); targetIn != incoming.end();
+       ++targetIn) {
+    if (targetIn->status == IncomingDirectSendImage::READY) {
+      // This image is ready to blend. Find any other images that can be
+      // blended with it.
+      for (auto sourceIn = targetIn + 1; sourceIn != incoming.end();
+           ++sourceIn) {
+        if (sourceIn->status == IncomingDirectSendImage::READY) {
+          // Blend these two images together. Store the result in target and
+          // zero out the source. The buffers they had can be reused.
+          std::unique_ptr<Image> blendedImage =
+              ViewIncoming(*targetIn, imageIndex)
+                  .blend(ViewIncoming(*sourceIn, imageIndex));
+          window.addBytes(blendedImage->getDataSize());
+          ReleaseBuffer(*targetIn, imageIndex, window);
+          targetIn->imageBuffer.swap(blendedImage);
+          targetIn->countedBytes = targetIn->imageBuffer->getDataSize();
+          ReleaseBuffer(*sourceIn, imageIndex, window);
+          sourceIn->status = IncomingDirectSendImage::EMPTY;
+        } else if ((sourceIn->status == IncomingDirectSendImage::WAITING) ||
+                   (sourceIn->status == IncomingDirectSendImage::NOT_POSTED)) {
+          if (ViewIncoming(*targetIn, imageIndex)
+                  .getImage()
+                  .blendIsOrderDependent()) {
+            // If blend is order dependent, we cannot blend any other images
+            break;
+          }
+        } else /* sourceIn->status == EMPTY */ {
+          // Just skip over empty images.
+        }
+      }
+    }
+  }
+
+  // The first image left is where everything else gets blended, so it should
+  // not hold up other receives.
   for (auto&& in : incoming) {
-    switch (in.status) {
-      case IncomingDirectSendImage::WAITING:
-        lastRequests.push_back(in.receiveRequests.back());
-        in.receiveRequests.pop_back();
-        ++numPending;
-        break;
-      case IncomingDirectSendImage::READY:
-      case IncomingDirectSendImage::EMPTY:
-        assert(in.receiveRequests.empty());
-        lastRequests.push_back(MPI_REQUEST_NULL);
-        break;
+    if (in.status != IncomingDirectSendImage::EMPTY) {
+      if ((in.status == IncomingDirectSendImage::READY) && in.inWindow) {
+        in.inWindow = false;
+        window.receives.releaseReceive();
+      }
+      break;
     }
   }
+}
 
-  while (numPending > 0) {
+// When blending is order independent (such as with a z-buffer), there is no
+// need to hold on to pieces until their neighbors come in. Instead, each piece
+// is blended straight into a single accumulator as soon as it arrives, and its
+// buffer can be reused right away.
+static void AccumulateImage(IncomingDirectSendImage& in,
+                            int imageIndex,
+                            ImageFull& accumulator,
+                            ReceiveWindow& window) {
+  assert(in.status == IncomingDirectSendImage::READY);
+  ViewIncoming(in, imageIndex).blendInto(accumulator);
+  ReleaseBuffer(in, imageIndex, window);
+  in.status = IncomingDirectSendImage::EMPTY;
+}
+
+// Creates a cleared image of the uncompressed type of prototype over the
+// given region to accumulate pieces in. Nothing in it is valid yet.
+static std::unique_ptr<ImageFull> CreateAccumulator(const Image& prototype,
+                                                    int regionBegin,
+                                                    int regionEnd) {
+  const Image* fullPrototype = &prototype;
+  std::unique_ptr<ImageFull> uncompressedHolder;
+  const ImageSparse* sparsePrototype =
+      dynamic_cast<const ImageSparse*>(&prototype);
+  if (sparsePrototype != nullptr) {
+    // Uncompressing none of the pixels gives an image of the right type.
+    std::unique_ptr<const Image> emptyWindow = sparsePrototype->window(0, 0);
+    uncompressedHolder =
+        dynamic_cast<const ImageSparse&>(*emptyWindow).uncompress();
+    fullPrototype = uncompressedHolder.get();
+  }
+
+  int width = prototype.getWidth();
+  int height = prototype.getHeight();
+  std::unique_ptr<Image> accumulatorHolder = fullPrototype->createNew(
+      width, height, regionBegin, regionEnd, Viewport(width, height, -1, -1));
+  ImageFull* accumulator = dynamic_cast<ImageFull*>(accumulatorHolder.get());
+  assert((accumulator != NULL) && "Internal error: createNew bad type.");
+  accumulator->clear();
+
+  accumulatorHolder.release();
+  return std::unique_ptr<ImageFull>(accumulator);
+}
+
+static std::vector<std::unique_ptr<Image>> ProcessIncomingImages(
+    const DirectSendImages& localImages,
+    std::vector<std::vector<IncomingDirectSendImage>>& incomingImages,
+    ReceiveWindow& window) {
+  assert(!incomingImages.empty());
+  int numImages = static_cast<int>(incomingImages.size());
+
+  // If this process receives pieces of order-independent images, it blends
+  // them into accumulators. (The piece sent to self is ready from the start.)
+  bool accumulate = (window.receives.getNumberOfPieces() > 0) &&
+                    !localImages.getImage(0).blendIsOrderDependent();
+  std::vector<std::unique_ptr<ImageFull>> accumulators(numImages);
+  if (accumulate) {
+    int sendGroupRank = window.receives.getSendGroupRank();
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      // The range of the pieces is within the region of the image.
+      int imageRegionBegin = localImages.getImage(imageIndex).getRegionBegin();
+      accumulators[imageIndex] =
+          CreateAccumulator(localImages.getPrototype(imageIndex),
+                            imageRegionBegin + window.receives.getRangeBegin(),
+                            imageRegionBegin + window.receives.getRangeEnd());
+      window.addBytes(accumulators[imageIndex]->getDataSize());
+      if (sendGroupRank != MPI_UNDEFINED) {
+        AccumulateImage(incomingImages[imageIndex][sendGroupRank],
+                        imageIndex,
+                        *accumulators[imageIndex],
+                        window);
+      }
+    }
+  }
+
+  // We wait for the posted receives to see which process's pieces get here
+  // first. The pieces of all the images from a process come in together, and
+  // each can be blended as soon as they do.
+  while (window.numWaiting > 0) {
     int receiveIndex;
-    MPI_Waitany(lastRequests.size(),
-                lastRequests.data(),
+    MPI_Waitany(window.requests.size(),
+                window.requests.data(),
                 &receiveIndex,
-                MPI_STATUSES_IGNORE);
-    --numPending;
-    // Make sure all the messages have come in
-    MPI_Waitall(incoming[receiveIndex].receiveRequests.size(),
-                incoming[receiveIndex].receiveRequests.data(),
-                MPI_STATUSES_IGNORE);
-    incoming[receiveIndex].status = IncomingDirectSendImage::READY;
-
-    // Check all incoming images and find candidates to blend
-    for (auto targetIn = incoming.begin(); targetIn != incoming.end();
-         ++targetIn) {
-      if (targetIn->status == IncomingDirectSendImage::READY) {
-        // This image is ready to blend. Find any other images that can be
-        // blended with it.
-        for (auto sourceIn = targetIn + 1; sourceIn != incoming.end();
-             ++sourceIn) {
-          if (sourceIn->status == IncomingDirectSendImage::READY) {
-            // Blend these two images together. Store the result in target and
-            // zero out the source.
-            targetIn->imageBuffer =
-                targetIn->imageBuffer->blend(*sourceIn->imageBuffer);
-            sourceIn->status = IncomingDirectSendImage::EMPTY;
-            sourceIn->imageBuffer.reset();
-          } else if (sourceIn->status == IncomingDirectSendImage::WAITING) {
-            if (targetIn->imageBuffer->blendIsOrderDependent()) {
-              // If blend is order dependent, we cannot blend any other images
-              break;
-            }
-          } else /* sourceIn->status == EMPTY */ {
-            // Just skip over empty images.
-          }
-        }
+                MPI_STATUS_IGNORE);
+    assert(receiveIndex != MPI_UNDEFINED);
+    if (!window.receivers[receiveIndex].finishReceive(
+            window.requests[receiveIndex])) {
+      // Only the lengths of the pieces came in. The pieces are still coming.
+      continue;
+    }
+    --window.numWaiting;
+    int sendGroupIndex = window.requestSources[receiveIndex];
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      std::vector<IncomingDirectSendImage>& incoming =
+          incomingImages[imageIndex];
+      IncomingDirectSendImage& in = incoming[sendGroupIndex];
+      in.status = IncomingDirectSendImage::READY;
+      // Compressed images know their size only once they come in.
+      window.recount(in);
+
+      if (accumulate) {
+        AccumulateImage(in, imageIndex, *accumulators[imageIndex], window);
+      } else {
+        BlendReadyImages(incoming, imageIndex, window);
       }
     }
+
+    PostMoreReceives(incomingImages, window);
   }
 
-  // Resulting image should be in first incoming state.
-  assert(incoming.front().status == IncomingDirectSendImage::READY);
+  std::vector<std::unique_ptr<Image>> resultImages;
+  resultImages.reserve(numImages);
+  if (accumulate) {
+    for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+      // Results are expected to be the same type as the input, so compress
+      // the accumulator if the input was compressed.
+      if (dynamic_cast<const ImageSparse*>(
+              &localImages.getPrototype(imageIndex)) != nullptr) {
+        resultImages.push_back(accumulators[imageIndex]->compress());
+      } else {
+        resultImages.push_back(std::move(accumulators[imageIndex]));
+      }
+    }
+    return resultImages;
+  }
 
-  return std::unique_ptr<Image>(incoming.front().imageBuffer.release());
+  for (int imageIndex = 0; imageIndex < numImages; ++imageIndex) {
+    std::vector<IncomingDirectSendImage>& incoming = incomingImages[imageIndex];
+    // Make sure any images that were ready from the start are blended.
+    BlendReadyImages(incoming, imageIndex, window);
+
+    // Resulting image should be in first incoming state.
+    IncomingDirectSendImage& result = incoming.front();
+    assert(result.status == IncomingDirectSendImage::READY);
+
+    if (result.selfPieceImages != nullptr) {
+      // Nothing was blended with the piece sent to self.
+      resultImages.push_back(ViewIncoming(result, imageIndex).copy());
+    } else {
+      resultImages.push_back(std::move(result.imageBuffer));
+    }
+  }
+
+  return resultImages;
 }
 
-std::unique_ptr<Image> DirectSendOverlap::compose(Image* localImage,
-                                                  MPI_Group sendGroup,
-                                                  MPI_Group recvGroup,
-                                                  MPI_Comm communicator,
-                                                  YamlWriter&) {
-  std::vector<IncomingDirectSendImage> incomingImages;
-  PostReceives(localImage, sendGroup, recvGroup, communicator, incomingImages);
+static std::vector<std::unique_ptr<Image>> DoDirectSend(
+    const std::vector<Image*>& inputImages,
+    MPI_Group sendGroup,
+    MPI_Group recvGroup,
+    MPI_Comm communicator,
+    int maxInFlightReceives,
+    float autoCompressThreshold,
+    YamlWriter& yaml,
+    std::size_t& peakReceiveBytesOut) {
+  DirectSendImages localImages(inputImages,
+                               sendGroup,
+                               recvGroup,
+                               communicator,
+                               autoCompressThreshold,
+                               yaml);
+
+  std::vector<std::vector<IncomingDirectSendImage>> incomingImages;
+  ReceiveWindow window(
+      localImages, sendGroup, recvGroup, communicator, maxInFlightReceives);
+  PostReceives(localImages, sendGroup, recvGroup, incomingImages, window);
 
   std::vector<MPI_Request> sendRequests;
-  std::vector<std::unique_ptr<const Image>> outgoingImages;
-  PostSends(localImage,
+  std::deque<ImagePackedSender> packedSends;
+  PostSends(localImages,
             sendGroup,
             recvGroup,
             communicator,
             sendRequests,
-            outgoingImages);
+            packedSends);
 
-  std::unique_ptr<Image> resultImage = ProcessIncomingImages(incomingImages);
+  std::vector<std::unique_ptr<Image>> resultImages =
+      ProcessIncomingImages(localImages, incomingImages, window);
+
+  peakReceiveBytesOut = window.peakBytes;
 
   if (sendRequests.size() > 0) {
     MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
   }
 
-  return resultImage;
+  return resultImages;
 }
 
-DirectSendOverlap::DirectSendOverlap() : maxSplit(DEFAULT_MAX_IMAGE_SPLIT) {}
+std::vector<std::unique_ptr<Image>> DirectSendOverlap::composeMany(
+    const std::vector<Image*>& localImages,
+    MPI_Group sendGroup,
+    MPI_Group recvGroup,
+    MPI_Comm communicator,
+    int maxInFlightReceives,
+    float autoCompressThreshold,
+    YamlWriter& yaml,
+    std::size_t& peakReceiveBytesOut) {
+  return DoDirectSend(localImages,
+                      sendGroup,
+                      recvGroup,
+                      communicator,
+                      maxInFlightReceives,
+                      autoCompressThreshold,
+                      yaml,
+                      peakReceiveBytesOut);
+}
+
+std::unique_ptr<Image> DirectSendOverlap::compose(
+    Image* localImage,
+    MPI_Group sendGroup,
+    MPI_Group recvGroup,
+    MPI_Comm communicator,
+    int maxInFlightReceives,
+    float autoCompressThreshold,
+    YamlWriter& yaml,
+    std::size_t& peakReceiveBytesOut) {
+  std::vector<Image*> localImages(1, localImage);
+  return std::move(composeMany(localImages,
+                               sendGroup,
+                               recvGroup,
+                               communicator,
+                               maxInFlightReceives,
+                               autoCompressThreshold,
+                               yaml,
+                               peakReceiveBytesOut)
+                       .front());
+}
+
+DirectSendOverlap::DirectSendOverlap()
+    : maxSplit(DEFAULT_MAX_IMAGE_SPLIT),
+      maxInFlightReceives(DEFAULT_MAX_INFLIGHT_RECEIVES) {}
 
 std::unique_ptr<Image> DirectSendOverlap::compose(Image* localImage,
                                                   MPI_Group group,
                                                   MPI_Comm communicator,
                                                   YamlWriter& yaml) {
+  std::vector<Image*> localImages(1, localImage);
+  return std::move(
+      this->composeMany(localImages, group, communicator, yaml).front());
+}
+
+std::vector<std::unique_ptr<Image>> DirectSendOverlap::composeMany(
+    const std::vector<Image*>& localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    YamlWriter& yaml) {
   int groupSize;
   MPI_Group_size(group, &groupSize);
 
@@ -261,15 +569,31 @@ std::unique_ptr<Image> DirectSendOverlap::compose(Image* localImage,
       0, std::min(this->maxSplit, groupSize) - 1, 1};
   MPI_Group_range_incl(group, 1, procRange.data(), &recvGroup);
 
-  std::unique_ptr<Image> result =
-      this->compose(localImage, group, recvGroup, communicator, yaml);
+  float autoCompressThreshold = this->getAutoCompressThreshold();
+  if (autoCompressThreshold >= 0) {
+    yaml.StartBlock("auto-compress-rounds");
+  }
+  std::size_t peakReceiveBytes;
+  std::vector<std::unique_ptr<Image>> results =
+      DoDirectSend(localImages,
+                   group,
+                   recvGroup,
+                   communicator,
+                   this->maxInFlightReceives,
+                   autoCompressThreshold,
+                   yaml,
+                   peakReceiveBytes);
+  if (autoCompressThreshold >= 0) {
+    yaml.EndBlock();
+  }
+  yaml.AddDictionaryEntry("peak-receive-bytes", peakReceiveBytes);
 
   MPI_Group_free(&recvGroup);
 
-  return result;
+  return results;
 }
 
-enum optionIndex { MAX_IMAGE_SPLIT };
+enum optionIndex { MAX_IMAGE_SPLIT, MAX_INFLIGHT_RECEIVES };
 
 std::vector<option::Descriptor> DirectSendOverlap::getOptionVector() {
   std::vector<option::Descriptor> usage;
@@ -280,6 +604,13 @@ std::vector<option::Descriptor> DirectSendOverlap::getOptionVector() {
      "                          be split during compositing. Setting this\n"
      "                          parameter can reduce the total network traffic,\n"
      "                          but at the expense of load imbalance.\n"});
+  usage.push_back(
+    {MAX_INFLIGHT_RECEIVES, 0, "", "max-inflight-receives", PositiveIntArg,
+     "  --max-inflight-receives=<num> Set the maximum number of image pieces\n"
+     "                          that are received at once. Receive buffers are\n"
+     "                          reused as pieces are blended. Setting this\n"
+     "                          parameter limits the memory used for receiving\n"
+     "                          at the expense of less overlap.\n"});
   // clang-format on
 
   return usage;
@@ -293,5 +624,10 @@ bool DirectSendOverlap::setOptions(const std::vector<option::Option>& options,
   }
   yaml.AddDictionaryEntry("max-image-split", this->maxSplit);
 
+  if (options[MAX_INFLIGHT_RECEIVES]) {
+    this->maxInFlightReceives = atoi(options[MAX_INFLIGHT_RECEIVES].arg);
+  }
+  yaml.AddDictionaryEntry("max-inflight-receives", this->maxInFlightReceives);
+
   return true;
 }
@@ -13,15 +13,34 @@
 
 class DirectSendOverlap : public Compositor {
   int maxSplit;
+  int maxInFlightReceives;
 
  public:
+  /// The default for the maximum number of image pieces received at once,
+  /// which is big enough to receive all pieces at once.
+  static constexpr int DEFAULT_MAX_INFLIGHT_RECEIVES = 1000000;
+
   DirectSendOverlap();
 
+  int getMaxSplit() const { return this->maxSplit; }
+  void setMaxSplit(int _maxSplit) { this->maxSplit = _maxSplit; }
+
+  int getMaxInFlightReceives() const { return this->maxInFlightReceives; }
+  void setMaxInFlightReceives(int _maxInFlightReceives) {
+    this->maxInFlightReceives = _maxInFlightReceives;
+  }
+
   std::unique_ptr<Image> compose(Image *localImage,
                                  MPI_Group group,
                                  MPI_Comm communicator,
                                  YamlWriter &yaml) final;
 
+  std::vector<std::unique_ptr<Image>> composeMany(
+      const std::vector<Image *> &localImages,
+      MPI_Group group,
+      MPI_Comm communicator,
+      YamlWriter &yaml) final;
+
   /// Performs the direct-send compositing by sending a piece of the image from
   /// every process in sendGroup to each process in recvGroup. The end result
   /// will be a composited piece in each member of recvGroup.
@@ -32,11 +51,40 @@ class DirectSendOverlap : public Compositor {
   /// Any process in sendGroup that is not in recvGroup will return an image
   /// with an empty range.
   ///
+  /// At most \a maxInFlightReceives pieces are received at once (see
+  /// \c setMaxInFlightReceives).
+  ///
+  /// If \a autoCompressThreshold is not negative, the processes first choose
+  /// between compressed and full images as with \c chooseAutoCompress (see
+  /// Compositor::setAutoCompressThreshold) and add a list item with the
+  /// choice to \a yaml. Full images are compressed straight into their
+  /// pieces.
+  ///
+  /// The peak number of bytes held for receiving pieces is returned in \a
+  /// peakReceiveBytesOut.
+  ///
   static std::unique_ptr<Image> compose(Image *localImage,
                                         MPI_Group sendGroup,
                                         MPI_Group recvGroup,
                                         MPI_Comm communicator,
-                                        YamlWriter &yaml);
+                                        int maxInFlightReceives,
+                                        float autoCompressThreshold,
+                                        YamlWriter &yaml,
+                                        std::size_t &peakReceiveBytesOut);
+
+  /// Like the \c compose above, but composites several images of the same
+  /// size at once. The pieces of all the images destined for a peer are sent
+  /// together.
+  ///
+  static std::vector<std::unique_ptr<Image>> composeMany(
+      const std::vector<Image *> &localImages,
+      MPI_Group sendGroup,
+      MPI_Group recvGroup,
+      MPI_Comm communicator,
+      int maxInFlightReceives,
+      float autoCompressThreshold,
+      YamlWriter &yaml,
+      std::size_t &peakReceiveBytesOut);
 
   bool setOptions(const std::vector<option::Option> &options,
                   MPI_Comm communicator,
@@ -12,19 +12,92 @@
 #include <miniGraphicsConfig.h>
 
 #include <Common/ImageFull.hpp>
+#include <Common/ImageSparse.hpp>
 #include <Common/Mesh.hpp>
+#include <Common/MeshHelper.hpp>
 
 #include <glm/mat4x4.hpp>
 
 #include <vector>
 
 class Painter {
+  bool cullBackFaces = false;
+  bool orderIndependentTransparency = false;
+
  public:
+  /// \brief Skip triangles facing away from the camera.
+  ///
+  /// Front faces are those whose vertices appear counter-clockwise in the
+  /// image. Culling is only correct for closed surfaces whose triangles are
+  /// ordered that way (as in the box and in STL files). It also removes the
+  /// back of transparent surfaces, so it changes images without depth.
+  /// Painters that do not support culling ignore this.
+  void setCullBackFaces(bool cull) { this->cullBackFaces = cull; }
+  bool getCullBackFaces() const { return this->cullBackFaces; }
+
+  /// \brief Blend the triangles of images without depth in any order.
+  ///
+  /// Images without depth blend triangles in the order they are painted, so
+  /// the mesh normally has to be sorted back to front first (see
+  /// meshVisibilitySort). With this on, a painter that supports it sorts the
+  /// fragments of each pixel by depth itself, so the mesh can be painted
+  /// unsorted. Painters that do not support it ignore this.
+  void setOrderIndependentTransparency(bool enable) {
+    this->orderIndependentTransparency = enable;
+  }
+  bool getOrderIndependentTransparency() const {
+    return this->orderIndependentTransparency;
+  }
+
+  /// \brief Returns true if the painter honors
+  /// setOrderIndependentTransparency.
+  virtual bool supportsOrderIndependentTransparency() const { return false; }
+
   virtual void paint(const Mesh& mesh,
                      ImageFull& image,
                      const glm::mat4& modelview,
                      const glm::mat4& projection) = 0;
 
+  /// \brief Paints the triangles of the mesh in the given order.
+  ///
+  /// \a triangleOrder lists the indices of the triangles to paint in the
+  /// order to paint them (such as the order from a MeshVisibilitySorter).
+  /// Painters that do not override this paint a reordered copy of the mesh.
+  virtual void paintInOrder(const Mesh& mesh,
+                            const std::vector<int>& triangleOrder,
+                            ImageFull& image,
+                            const glm::mat4& modelview,
+                            const glm::mat4& projection) {
+    this->paint(meshReorderTriangles(mesh, triangleOrder),
+                image,
+                modelview,
+                projection);
+  }
+
+  /// \brief Returns false if paintInOrder gives the same image for any order
+  /// of the triangles, in which case there is no point in sorting them.
+  virtual bool paintInOrderUsesOrder() const { return true; }
+
+  /// \brief Returns true if paintCompressed supports the type of \a image.
+  virtual bool canPaintCompressed(const ImageFull& /*image*/) const {
+    return false;
+  }
+
+  /// \brief Paints straight into a compressed image.
+  ///
+  /// The result is what compressing \a image would give after painting it,
+  /// but the painter never fills (or even clears) a full image. \a image
+  /// only gives the size and type of the result and is not changed. The
+  /// valid viewport of the result covers all the pixels painted. Returns null
+  /// if canPaintCompressed is false for \a image.
+  virtual std::unique_ptr<ImageSparse> paintCompressed(
+      const Mesh& /*mesh*/,
+      const ImageFull& /*image*/,
+      const glm::mat4& /*modelview*/,
+      const glm::mat4& /*projection*/) {
+    return nullptr;
+  }
+
   virtual ~Painter() = default;
 };
 
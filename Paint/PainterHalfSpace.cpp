@@ -0,0 +1,513 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include "PainterHalfSpace.hpp"
+
+#include <Common/BoundingVolumeHierarchy.hpp>
+#include <Common/ImageTypeDispatch.hpp>
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <iostream>
+#include <type_traits>
+
+// Vertex positions are snapped to this many bits below the pixel.
+constexpr int SUBPIXEL_BITS = 4;
+constexpr int SUBPIXEL_SCALE = 1 << SUBPIXEL_BITS;
+
+// Pixels are visited in square blocks with this many pixels on a side.
+constexpr int BLOCK_SIZE = 8;
+
+// The pixels of a block are tracked with one bit each in row-major order.
+constexpr std::uint64_t ALL_BLOCK_PIXELS = ~std::uint64_t(0);
+static_assert(BLOCK_SIZE * BLOCK_SIZE == 64,
+              "The pixels of a block must fit in a 64-bit mask.");
+
+static inline std::uint64_t pixelBit(int rowIndex, int column) {
+  return std::uint64_t(1) << (rowIndex * BLOCK_SIZE + column);
+}
+
+// Triangles with a vertex farther than this (in pixels) from the origin of
+// the image are skipped. This bound keeps the edge functions of the pixels in
+// a partially covered block within 32-bit integers.
+constexpr float GUARD_BAND = 65536.0f;
+
+namespace {
+
+// An edge function E(x, y) = a*x + b*y + c in fixed point. It is positive on
+// the inside of an edge of a counter-clockwise triangle. The fill rule is
+// folded into c so that a pixel is inside when E >= 0.
+struct EdgeFunction {
+  std::int64_t a;
+  std::int64_t b;
+  std::int64_t c;
+
+  EdgeFunction() = default;
+
+  EdgeFunction(std::int64_t x0,
+               std::int64_t y0,
+               std::int64_t x1,
+               std::int64_t y1)
+      : a(y0 - y1), b(x1 - x0), c(x0 * y1 - y0 * x1) {
+    // Top-left rule: pixels exactly on left edges (running down in a
+    // counter-clockwise triangle) or top edges (horizontal and running left)
+    // are inside. The same edge in a neighboring triangle runs the opposite
+    // way, so exactly one of the two triangles gets the pixel.
+    bool topLeft = (this->a > 0) || ((this->a == 0) && (this->b < 0));
+    if (!topLeft) {
+      // E is an integer, so E - 1 >= 0 is the same as E > 0.
+      this->c -= 1;
+    }
+  }
+
+  std::int64_t evaluate(std::int64_t x, std::int64_t y) const {
+    return this->a * x + this->b * y + this->c;
+  }
+};
+
+struct TriangleSetup {
+  EdgeFunction edges[3];
+
+  // Depth plane as depth at the first vertex and its change per pixel.
+  float depth0;
+  float x0;
+  float y0;
+  float depthDx;
+  float depthDy;
+
+  Color color;
+
+  // Range of pixels covered by the bounding box of the triangle.
+  int xBegin;
+  int xEnd;
+  int yBegin;
+  int yEnd;
+};
+
+}  // anonymous namespace
+
+// Sets up the edge functions and depth plane of a triangle. Returns false if
+// the triangle covers no pixels or is culled.
+static bool setupTriangle(const Mesh &mesh,
+                          int triangleIndex,
+                          const ScreenVertices &screenVertices,
+                          const glm::mat3 &normalTransform,
+                          const glm::ivec4 &viewport,
+                          bool cullBackFaces,
+                          TriangleSetup &setup) {
+  const int *connections = mesh.getTriangleConnectionsBuffer(triangleIndex);
+  glm::vec3 vertices[3];
+  std::int64_t fixedX[3];
+  std::int64_t fixedY[3];
+  for (int vertexIndex = 0; vertexIndex < 3; ++vertexIndex) {
+    glm::vec3 &vertex = vertices[vertexIndex];
+    vertex = screenVertices.getVertex(connections[vertexIndex]);
+    // Written to also reject NaN.
+    if (!((std::abs(vertex.x) < GUARD_BAND) &&
+          (std::abs(vertex.y) < GUARD_BAND))) {
+      return false;
+    }
+    fixedX[vertexIndex] =
+        static_cast<std::int64_t>(std::floor(vertex.x * SUBPIXEL_SCALE + 0.5f));
+    fixedY[vertexIndex] =
+        static_cast<std::int64_t>(std::floor(vertex.y * SUBPIXEL_SCALE + 0.5f));
+  }
+
+  // Twice the signed area. Make the triangle counter-clockwise.
+  std::int64_t area = (fixedX[1] - fixedX[0]) * (fixedY[2] - fixedY[0]) -
+                      (fixedX[2] - fixedX[0]) * (fixedY[1] - fixedY[0]);
+  if (area == 0) {
+    return false;
+  }
+  if (area < 0) {
+    if (cullBackFaces) {
+      return false;
+    }
+    std::swap(vertices[1], vertices[2]);
+    std::swap(fixedX[1], fixedX[2]);
+    std::swap(fixedY[1], fixedY[2]);
+    area = -area;
+  }
+
+  std::int64_t minX = std::min(std::min(fixedX[0], fixedX[1]), fixedX[2]);
+  std::int64_t maxX = std::max(std::max(fixedX[0], fixedX[1]), fixedX[2]);
+  std::int64_t minY = std::min(std::min(fixedY[0], fixedY[1]), fixedY[2]);
+  std::int64_t maxY = std::max(std::max(fixedY[0], fixedY[1]), fixedY[2]);
+  if ((maxX < 0) || (maxY < 0)) {
+    return false;
+  }
+  setup.xBegin = static_cast<int>(std::max<std::int64_t>(minX, 0) >>
+                                  SUBPIXEL_BITS);
+  setup.yBegin = static_cast<int>(std::max<std::int64_t>(minY, 0) >>
+                                  SUBPIXEL_BITS);
+  setup.xEnd = static_cast<int>(
+      std::min<std::int64_t>((maxX >> SUBPIXEL_BITS) + 1, viewport[2]));
+  setup.yEnd = static_cast<int>(
+      std::min<std::int64_t>((maxY >> SUBPIXEL_BITS) + 1, viewport[3]));
+  if ((setup.xBegin >= setup.xEnd) || (setup.yBegin >= setup.yEnd)) {
+    return false;
+  }
+
+  setup.edges[0] = EdgeFunction(fixedX[1], fixedY[1], fixedX[2], fixedY[2]);
+  setup.edges[1] = EdgeFunction(fixedX[2], fixedY[2], fixedX[0], fixedY[0]);
+  setup.edges[2] = EdgeFunction(fixedX[0], fixedY[0], fixedX[1], fixedY[1]);
+
+  // Solve for the gradient of depth over the snapped vertex positions.
+  float dx1 = static_cast<float>(fixedX[1] - fixedX[0]) / SUBPIXEL_SCALE;
+  float dy1 = static_cast<float>(fixedY[1] - fixedY[0]) / SUBPIXEL_SCALE;
+  float dx2 = static_cast<float>(fixedX[2] - fixedX[0]) / SUBPIXEL_SCALE;
+  float dy2 = static_cast<float>(fixedY[2] - fixedY[0]) / SUBPIXEL_SCALE;
+  float dDepth1 = vertices[1].z - vertices[0].z;
+  float dDepth2 = vertices[2].z - vertices[0].z;
+  float determinant =
+      static_cast<float>(area) / (SUBPIXEL_SCALE * SUBPIXEL_SCALE);
+  setup.depth0 = vertices[0].z;
+  setup.x0 = static_cast<float>(fixedX[0]) / SUBPIXEL_SCALE;
+  setup.y0 = static_cast<float>(fixedY[0]) / SUBPIXEL_SCALE;
+  setup.depthDx = (dDepth1 * dy2 - dDepth2 * dy1) / determinant;
+  setup.depthDy = (dDepth2 * dx1 - dDepth1 * dx2) / determinant;
+
+  const float *triangleNormal = mesh.getTriangleNormalsBuffer(triangleIndex);
+  glm::vec3 normal = glm::normalize(
+      normalTransform *
+      glm::vec3(triangleNormal[0], triangleNormal[1], triangleNormal[2]));
+  float colorScale = glm::abs(glm::dot(normal, glm::vec3(0, 0, 1)));
+  setup.color =
+      Color(mesh.getTriangleColorsBuffer(triangleIndex)).Scale(colorScale);
+
+  return true;
+}
+
+// Returns true if the pixel was painted.
+template <typename ImageType>
+static inline bool shadePixel(
+    typename ImageType::PixelSpan &row,
+    int x,
+    float depth,
+    const Color &color,
+    const typename ImageType::ColorType encodedColor[]) {
+  if ((depth >= 0.0f) && (depth < row.getDepth(x))) {
+    if (color.Components[3] >= 0.99f) {
+      row.setEncodedColor(x, encodedColor);
+    } else {
+      Color previousColor = row.getColor(x);
+      row.setColor(x, color.BlendOver(previousColor));
+    }
+    row.setDepth(x, depth);
+    return true;
+  }
+  return false;
+}
+
+// Blocks can reject triangles hidden behind what is painted in them only if
+// the image has a depth test. Without one, paint order is blend order, so
+// every triangle has to be painted.
+template <typename ImageType>
+static inline bool canRejectHidden(const ImageType &image) {
+  return std::is_base_of<ImageColorDepthBase, ImageType>::value &&
+         !image.blendIsOrderDependent();
+}
+
+template <typename ImageType>
+static void fillBlock(ImageType &image,
+                      const TriangleSetup &setup,
+                      const typename ImageType::ColorType encodedColor[],
+                      int blockX,
+                      int blockY,
+                      float &blockMaxDepth,
+                      std::uint64_t &blockKnownPixels) {
+  constexpr int BLOCK_SPAN = BLOCK_SIZE - 1;
+
+  float rowDepth = setup.depth0 +
+                   setup.depthDx * (blockX + 0.5f - setup.x0) +
+                   setup.depthDy * (blockY + 0.5f - setup.y0);
+
+  // The depth plane is nearest at one of the corners of the block. It is
+  // stepped across the pixels in float, so allow for rounding that could
+  // make a pixel slightly nearer than the corners.
+  float depthStepX = setup.depthDx * BLOCK_SPAN;
+  float depthStepY = setup.depthDy * BLOCK_SPAN;
+  float minDepth = rowDepth + std::min(depthStepX, 0.0f) +
+                   std::min(depthStepY, 0.0f);
+  float maxDepth = rowDepth + std::max(depthStepX, 0.0f) +
+                   std::max(depthStepY, 0.0f);
+  float depthTolerance =
+      32 * FLT_EPSILON *
+      (std::abs(rowDepth) + std::abs(depthStepX) + std::abs(depthStepY));
+  bool rejectHidden = canRejectHidden(image);
+  if (rejectHidden && (blockKnownPixels == ALL_BLOCK_PIXELS) &&
+      (minDepth - depthTolerance >= blockMaxDepth)) {
+    // Hidden behind everything painted in the block.
+    return;
+  }
+
+  // Edge functions at the center of the first pixel of the block, and their
+  // steps per pixel, for the edges that cross the block. Edges that the
+  // block is entirely inside of are left at 0 so they always pass.
+  std::int32_t rowEdge[3];
+  std::int32_t edgeDx[3];
+  std::int32_t edgeDy[3];
+  bool blockInside = true;
+
+  std::int64_t pixelX = blockX * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2;
+  std::int64_t pixelY = blockY * SUBPIXEL_SCALE + SUBPIXEL_SCALE / 2;
+  for (int edgeIndex = 0; edgeIndex < 3; ++edgeIndex) {
+    const EdgeFunction &edge = setup.edges[edgeIndex];
+    std::int64_t value = edge.evaluate(pixelX, pixelY);
+    std::int64_t stepX = edge.a * SUBPIXEL_SCALE;
+    std::int64_t stepY = edge.b * SUBPIXEL_SCALE;
+
+    // The edge function is linear, so its extremes over the block are at the
+    // corners.
+    std::int64_t maxValue = value +
+                            std::max<std::int64_t>(stepX * BLOCK_SPAN, 0) +
+                            std::max<std::int64_t>(stepY * BLOCK_SPAN, 0);
+    if (maxValue < 0) {
+      // Trivial reject.
+      return;
+    }
+    std::int64_t minValue = value +
+                            std::min<std::int64_t>(stepX * BLOCK_SPAN, 0) +
+                            std::min<std::int64_t>(stepY * BLOCK_SPAN, 0);
+    if (minValue >= 0) {
+      rowEdge[edgeIndex] = 0;
+      edgeDx[edgeIndex] = 0;
+      edgeDy[edgeIndex] = 0;
+    } else {
+      // The edge crosses the block, so its values here are bounded by the
+      // change across the block (see GUARD_BAND).
+      blockInside = false;
+      rowEdge[edgeIndex] = static_cast<std::int32_t>(value);
+      edgeDx[edgeIndex] = static_cast<std::int32_t>(stepX);
+      edgeDy[edgeIndex] = static_cast<std::int32_t>(stepY);
+    }
+  }
+
+  int numColumns = std::min(BLOCK_SIZE, image.getWidth() - blockX);
+  int numRows = std::min(BLOCK_SIZE, image.getHeight() - blockY);
+
+  std::uint64_t paintedPixels = 0;
+  float paintedMaxDepth = 0.0f;
+  float depth[BLOCK_SIZE];
+  bool covered[BLOCK_SIZE];
+  for (int rowIndex = 0; rowIndex < numRows; ++rowIndex) {
+    typename ImageType::PixelSpan row = image.getRowSpan(blockY + rowIndex);
+
+    for (int column = 0; column < BLOCK_SIZE; ++column) {
+      depth[column] = rowDepth + column * setup.depthDx;
+    }
+
+    if (blockInside) {
+      // Trivial accept.
+      for (int column = 0; column < numColumns; ++column) {
+        if (shadePixel<ImageType>(row,
+                                  blockX + column,
+                                  depth[column],
+                                  setup.color,
+                                  encodedColor)) {
+          paintedPixels |= pixelBit(rowIndex, column);
+          paintedMaxDepth = std::max(paintedMaxDepth, depth[column]);
+        }
+      }
+    } else {
+      for (int column = 0; column < BLOCK_SIZE; ++column) {
+        std::int32_t edge0 = rowEdge[0] + column * edgeDx[0];
+        std::int32_t edge1 = rowEdge[1] + column * edgeDx[1];
+        std::int32_t edge2 = rowEdge[2] + column * edgeDx[2];
+        covered[column] = ((edge0 | edge1 | edge2) >= 0);
+      }
+      for (int column = 0; column < numColumns; ++column) {
+        if (covered[column] && shadePixel<ImageType>(row,
+                                                     blockX + column,
+                                                     depth[column],
+                                                     setup.color,
+                                                     encodedColor)) {
+          paintedPixels |= pixelBit(rowIndex, column);
+          paintedMaxDepth = std::max(paintedMaxDepth, depth[column]);
+        }
+      }
+    }
+
+    for (int edgeIndex = 0; edgeIndex < 3; ++edgeIndex) {
+      rowEdge[edgeIndex] += edgeDy[edgeIndex];
+    }
+    rowDepth += setup.depthDy;
+  }
+
+  if (!rejectHidden) {
+    return;
+  }
+  if (blockInside && (minDepth - depthTolerance >= 0.0f)) {
+    // Every pixel of the block now has the depth of the triangle or a nearer
+    // one.
+    maxDepth += depthTolerance;
+    if ((blockKnownPixels != ALL_BLOCK_PIXELS) || (maxDepth < blockMaxDepth)) {
+      blockMaxDepth = maxDepth;
+    }
+    blockKnownPixels = ALL_BLOCK_PIXELS;
+  } else if (paintedPixels != 0) {
+    // Pixels only get nearer once painted, so the farthest depth painted
+    // bounds them.
+    blockMaxDepth = std::max(blockMaxDepth, paintedMaxDepth);
+    blockKnownPixels |= paintedPixels;
+  }
+}
+
+namespace {
+
+struct PaintTriangles {
+  const Mesh &mesh;
+  const ScreenVertices &screenVertices;
+  const glm::mat3 &normalTransform;
+  bool cullBackFaces;
+  // Nonzero for triangles that may be in view, or null to paint all.
+  const char *visibleTriangles;
+  // The triangles to paint in order, or null to paint in mesh order.
+  const std::vector<int> *triangleOrder;
+  std::vector<float> &blockMaxDepth;
+  std::vector<std::uint64_t> &blockKnownPixels;
+
+  template <typename ImageType>
+  void operator()(ImageType &image) const {
+    glm::ivec4 viewport(0, 0, image.getWidth(), image.getHeight());
+    int numTriangles = (this->triangleOrder != nullptr)
+                           ? static_cast<int>(this->triangleOrder->size())
+                           : this->mesh.getNumberOfTriangles();
+
+    // Nothing is painted yet, so no block can reject anything until all its
+    // pixels are painted. Pixels of blocks hanging off the image are never
+    // painted, so they are known from the start.
+    int numBlocksX = (image.getWidth() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int numBlocksY = (image.getHeight() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    this->blockMaxDepth.assign(numBlocksX * numBlocksY, 0.0f);
+    this->blockKnownPixels.resize(numBlocksX * numBlocksY);
+    for (int blockIndexY = 0; blockIndexY < numBlocksY; ++blockIndexY) {
+      int numRows =
+          std::min(BLOCK_SIZE, image.getHeight() - blockIndexY * BLOCK_SIZE);
+      for (int blockIndexX = 0; blockIndexX < numBlocksX; ++blockIndexX) {
+        int numColumns =
+            std::min(BLOCK_SIZE, image.getWidth() - blockIndexX * BLOCK_SIZE);
+        std::uint64_t insidePixels = 0;
+        for (int rowIndex = 0; rowIndex < numRows; ++rowIndex) {
+          for (int column = 0; column < numColumns; ++column) {
+            insidePixels |= pixelBit(rowIndex, column);
+          }
+        }
+        this->blockKnownPixels[blockIndexY * numBlocksX + blockIndexX] =
+            ~insidePixels;
+      }
+    }
+
+    TriangleSetup setup;
+    for (int position = 0; position < numTriangles; ++position) {
+      int triangleIndex = (this->triangleOrder != nullptr)
+                              ? (*this->triangleOrder)[position]
+                              : position;
+      if ((this->visibleTriangles != nullptr) &&
+          !this->visibleTriangles[triangleIndex]) {
+        continue;
+      }
+      if (!setupTriangle(this->mesh,
+                         triangleIndex,
+                         this->screenVertices,
+                         this->normalTransform,
+                         viewport,
+                         this->cullBackFaces,
+                         setup)) {
+        continue;
+      }
+
+      typename ImageType::ColorType encodedColor[ImageType::ColorVecSize];
+      ImageType::encodeColor(setup.color, encodedColor);
+
+      int blockYBegin = setup.yBegin - (setup.yBegin % BLOCK_SIZE);
+      int blockXBegin = setup.xBegin - (setup.xBegin % BLOCK_SIZE);
+      for (int blockY = blockYBegin; blockY < setup.yEnd;
+           blockY += BLOCK_SIZE) {
+        for (int blockX = blockXBegin; blockX < setup.xEnd;
+             blockX += BLOCK_SIZE) {
+          int blockIndex =
+              (blockY / BLOCK_SIZE) * numBlocksX + (blockX / BLOCK_SIZE);
+          fillBlock(image,
+                    setup,
+                    encodedColor,
+                    blockX,
+                    blockY,
+                    this->blockMaxDepth[blockIndex],
+                    this->blockKnownPixels[blockIndex]);
+        }
+      }
+    }
+  }
+};
+
+}  // anonymous namespace
+
+PainterHalfSpace::PainterHalfSpace(int _numThreads)
+    : numThreads(_numThreads) {}
+
+void PainterHalfSpace::paintMesh(const Mesh &mesh,
+                                 const std::vector<int> *triangleOrder,
+                                 ImageFull &image,
+                                 const glm::mat4 &modelview,
+                                 const glm::mat4 &projection) {
+  image.clear();
+
+  // Normals are transformed by the inverse transpose of the rotation/scale
+  // matrix.
+  glm::mat3 normalTransform = glm::inverseTranspose(glm::mat3(modelview));
+
+  const char *visibleTriangles = nullptr;
+  const BoundingVolumeHierarchy *boundingVolumeHierarchy =
+      mesh.getBoundingVolumeHierarchy();
+  if (boundingVolumeHierarchy != nullptr) {
+    boundingVolumeHierarchy->markTrianglesInFrustum(
+        modelview, projection, this->visibleTriangles);
+    visibleTriangles = this->visibleTriangles.data();
+  }
+
+  this->screenVertices.transform(
+      mesh,
+      modelview,
+      projection,
+      glm::ivec4(0, 0, image.getWidth(), image.getHeight()),
+      this->numThreads);
+
+  bool painted = dispatchImageType(image,
+                                   PaintTriangles{mesh,
+                                                  this->screenVertices,
+                                                  normalTransform,
+                                                  this->getCullBackFaces(),
+                                                  visibleTriangles,
+                                                  triangleOrder,
+                                                  this->blockMaxDepth,
+                                                  this->blockKnownPixels});
+  if (!painted) {
+    std::cerr << "Image format not supported by PainterHalfSpace" << std::endl;
+  }
+}
+
+void PainterHalfSpace::paint(const Mesh &mesh,
+                             ImageFull &image,
+                             const glm::mat4 &modelview,
+                             const glm::mat4 &projection) {
+  this->paintMesh(mesh, nullptr, image, modelview, projection);
+}
+
+void PainterHalfSpace::paintInOrder(const Mesh &mesh,
+                                    const std::vector<int> &triangleOrder,
+                                    ImageFull &image,
+                                    const glm::mat4 &modelview,
+                                    const glm::mat4 &projection) {
+  this->paintMesh(mesh, &triangleOrder, image, modelview, projection);
+}
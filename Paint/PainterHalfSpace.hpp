@@ -0,0 +1,86 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef PAINTER_HALF_SPACE_H
+#define PAINTER_HALF_SPACE_H
+
+#include "Painter.hpp"
+#include "ScreenVertices.hpp"
+
+#include <cstdint>
+#include <vector>
+
+/// \brief Paints triangles by testing blocks of pixels against edge functions.
+///
+/// Each triangle is described by the three half-spaces bounded by its edges.
+/// The pixels in the bounding box of the triangle are visited in square
+/// blocks. A block entirely outside an edge is skipped, and a block entirely
+/// inside all edges is filled without testing its pixels. In the remaining
+/// blocks, the edge functions and the depth plane are stepped across each row
+/// of the block in loops the compiler can vectorize.
+///
+/// Vertices are snapped to 1/16 of a pixel, so the edge functions are exact
+/// integers. Pixels exactly on an edge follow a top-left fill rule: a pixel
+/// on an edge shared by two triangles is painted by exactly one of them, so
+/// transparent triangles do not blend twice along their shared edges.
+///
+/// The painter also keeps the farthest depth painted in each block (a
+/// coarse, hierarchical z-buffer). A block where the triangle is entirely
+/// behind that depth is rejected before any pixels are visited, so surfaces
+/// hidden behind ones already painted cost little. The farthest depth is a
+/// running maximum of the depths painted in the block, which only counts once
+/// every pixel of the block is painted. A triangle that covers the whole
+/// block lowers it to the farthest depth of the triangle there. Images
+/// without depth are blended in paint order, so nothing is rejected in them.
+///
+/// Like PainterSimple, this painter transforms each vertex of the mesh once
+/// (split among the given number of threads for large meshes) and skips the
+/// triangles in parts of the mesh's bounding volume hierarchy (if it has one)
+/// outside of the view. It also does not clip triangles. A triangle with a
+/// vertex far outside the image (which only happens when it passes very close
+/// to the camera) is skipped. The triangles are painted in a single thread.
+///
+class PainterHalfSpace : public Painter {
+  int numThreads;
+
+  // Vertices of the mesh in window coordinates.
+  ScreenVertices screenVertices;
+  // Farthest depth in each block of the image (row major) and a bit for each
+  // pixel of the block that is known to be no farther. Kept between calls to
+  // paint so the memory is reused.
+  std::vector<float> blockMaxDepth;
+  std::vector<std::uint64_t> blockKnownPixels;
+  // Triangles that may be in view, when the mesh has a bounding volume
+  // hierarchy.
+  std::vector<char> visibleTriangles;
+
+  // Paints the triangles in the given order, or in mesh order if null.
+  void paintMesh(const Mesh& mesh,
+                 const std::vector<int>* triangleOrder,
+                 ImageFull& image,
+                 const glm::mat4& modelview,
+                 const glm::mat4& projection);
+
+ public:
+  explicit PainterHalfSpace(int _numThreads = 1);
+
+  int getNumberOfThreads() const { return this->numThreads; }
+
+  void paint(const Mesh& mesh,
+             ImageFull& image,
+             const glm::mat4& modelview,
+             const glm::mat4& projection) final;
+
+  void paintInOrder(const Mesh& mesh,
+                    const std::vector<int>& triangleOrder,
+                    ImageFull& image,
+                    const glm::mat4& modelview,
+                    const glm::mat4& projection) final;
+};
+
+#endif  // PAINTER_HALF_SPACE_H
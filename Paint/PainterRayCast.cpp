@@ -0,0 +1,424 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include "PainterRayCast.hpp"
+
+#include <Common/BoundingVolumeHierarchy.hpp>
+#include <Common/ImageTypeDispatch.hpp>
+#include <Common/RunThreads.hpp>
+
+#include <glm/gtc/matrix_inverse.hpp>
+#include <glm/mat3x3.hpp>
+#include <glm/matrix.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <memory>
+
+// Rays are traced in square packets with this many pixels on a side.
+constexpr int PACKET_SIZE = 4;
+constexpr int PACKET_RAYS = PACKET_SIZE * PACKET_SIZE;
+
+// Threads take square tiles of the image with this many pixels on a side.
+constexpr int TILE_SIZE = 32;
+
+namespace {
+
+// Rays start on the near plane at t = 0 and reach the far plane at t = 1.
+// The arrays hold one entry for each ray so that loops over the rays can be
+// vectorized.
+struct RayPacket {
+  float originX[PACKET_RAYS];
+  float originY[PACKET_RAYS];
+  float originZ[PACKET_RAYS];
+  float directionX[PACKET_RAYS];
+  float directionY[PACKET_RAYS];
+  float directionZ[PACKET_RAYS];
+  float inverseDirectionX[PACKET_RAYS];
+  float inverseDirectionY[PACKET_RAYS];
+  float inverseDirectionZ[PACKET_RAYS];
+  // Hits are only looked for up to here. It is the nearest hit found so far,
+  // or negative for rays outside of the image.
+  float tEnd[PACKET_RAYS];
+  // The nearest triangle hit, or -1.
+  int hitTriangle[PACKET_RAYS];
+};
+
+struct Hit {
+  float t;
+  int triangleIndex;
+
+  // Farthest first. Hits at the same place are ordered by triangle so the
+  // image does not depend on the order they were found in.
+  bool operator<(const Hit &other) const {
+    return (this->t > other.t) ||
+           ((this->t == other.t) &&
+            (this->triangleIndex < other.triangleIndex));
+  }
+};
+
+}  // anonymous namespace
+
+// Returns true if any ray of the packet hits the box before its end.
+static bool packetHitsBox(const RayPacket &packet,
+                          const glm::vec3 &boundsMin,
+                          const glm::vec3 &boundsMax) {
+  bool anyHit = false;
+  for (int ray = 0; ray < PACKET_RAYS; ++ray) {
+    float tMinX = (boundsMin.x - packet.originX[ray]) *
+                  packet.inverseDirectionX[ray];
+    float tMaxX = (boundsMax.x - packet.originX[ray]) *
+                  packet.inverseDirectionX[ray];
+    float tMinY = (boundsMin.y - packet.originY[ray]) *
+                  packet.inverseDirectionY[ray];
+    float tMaxY = (boundsMax.y - packet.originY[ray]) *
+                  packet.inverseDirectionY[ray];
+    float tMinZ = (boundsMin.z - packet.originZ[ray]) *
+                  packet.inverseDirectionZ[ray];
+    float tMaxZ = (boundsMax.z - packet.originZ[ray]) *
+                  packet.inverseDirectionZ[ray];
+    float tNear = std::max(std::max(std::min(tMinX, tMaxX),
+                                    std::min(tMinY, tMaxY)),
+                           std::max(std::min(tMinZ, tMaxZ), 0.0f));
+    float tFar = std::min(std::min(std::max(tMinX, tMaxX),
+                                   std::max(tMinY, tMaxY)),
+                          std::min(std::max(tMinZ, tMaxZ), packet.tEnd[ray]));
+    anyHit |= (tNear <= tFar);
+  }
+  return anyHit;
+}
+
+// Finds where each ray of the packet hits a triangle (with the
+// Moller-Trumbore test). Sets hitT to the distance along each ray, or to -1
+// where the ray misses the triangle or hits it at or beyond its end. If
+// frontSign is nonzero, only triangles whose determinant has that sign are
+// hit.
+static void intersectTriangle(const RayPacket &packet,
+                              const glm::vec3 &vertex0,
+                              const glm::vec3 &edge1,
+                              const glm::vec3 &edge2,
+                              float frontSign,
+                              float hitT[]) {
+  for (int ray = 0; ray < PACKET_RAYS; ++ray) {
+    float pX = packet.directionY[ray] * edge2.z -
+               packet.directionZ[ray] * edge2.y;
+    float pY = packet.directionZ[ray] * edge2.x -
+               packet.directionX[ray] * edge2.z;
+    float pZ = packet.directionX[ray] * edge2.y -
+               packet.directionY[ray] * edge2.x;
+    float determinant = edge1.x * pX + edge1.y * pY + edge1.z * pZ;
+    // A zero determinant (a ray parallel to the triangle) gives NaN below,
+    // which fails every test.
+    float inverseDeterminant = 1.0f / determinant;
+
+    float sX = packet.originX[ray] - vertex0.x;
+    float sY = packet.originY[ray] - vertex0.y;
+    float sZ = packet.originZ[ray] - vertex0.z;
+    float u = (sX * pX + sY * pY + sZ * pZ) * inverseDeterminant;
+
+    float qX = sY * edge1.z - sZ * edge1.y;
+    float qY = sZ * edge1.x - sX * edge1.z;
+    float qZ = sX * edge1.y - sY * edge1.x;
+    float v = (packet.directionX[ray] * qX + packet.directionY[ray] * qY +
+               packet.directionZ[ray] * qZ) *
+              inverseDeterminant;
+    float t = (edge2.x * qX + edge2.y * qY + edge2.z * qZ) * inverseDeterminant;
+
+    bool hit = (determinant * frontSign >= 0.0f) && (u >= 0.0f) &&
+               (v >= 0.0f) && (u + v <= 1.0f) && (t >= 0.0f) &&
+               (t < packet.tEnd[ray]);
+    hitT[ray] = hit ? t : -1.0f;
+  }
+}
+
+// Traces the packet through the hierarchy. If hits is null, finds the nearest
+// triangle along each ray. Otherwise, adds every triangle along each ray to
+// hits (an array of a list for each ray) and leaves the ends of the rays
+// alone.
+static void tracePacket(const Mesh &mesh,
+                        const BoundingVolumeHierarchy &hierarchy,
+                        float frontSign,
+                        RayPacket &packet,
+                        std::vector<Hit> *hits) {
+  const std::vector<BoundingVolumeHierarchy::Node> &nodes =
+      hierarchy.getNodes();
+  const std::vector<int> &triangleIndices = hierarchy.getTriangleIndices();
+  if (nodes.empty()) {
+    return;
+  }
+
+  // Children are visited nearest first along the first ray.
+  glm::vec3 packetOrigin(
+      packet.originX[0], packet.originY[0], packet.originZ[0]);
+  glm::vec3 packetDirection(
+      packet.directionX[0], packet.directionY[0], packet.directionZ[0]);
+
+  int stack[BoundingVolumeHierarchy::MAX_TRAVERSAL_DEPTH];
+  int stackSize = 0;
+  stack[stackSize++] = 0;
+  while (stackSize > 0) {
+    int nodeIndex = stack[--stackSize];
+    const BoundingVolumeHierarchy::Node &node = nodes[nodeIndex];
+    // Rays may have hit something nearer since the node was pushed, so the
+    // box is tested when the node is visited.
+    if (!packetHitsBox(packet, node.boundsMin, node.boundsMax)) {
+      continue;
+    }
+
+    if (node.isLeaf()) {
+      for (int index = node.firstTriangle;
+           index < node.firstTriangle + node.numTriangles;
+           ++index) {
+        int triangleIndex = triangleIndices[index];
+        const int *connections =
+            mesh.getTriangleConnectionsBuffer(triangleIndex);
+        const float *point0 = mesh.getPointCoordinatesBuffer(connections[0]);
+        const float *point1 = mesh.getPointCoordinatesBuffer(connections[1]);
+        const float *point2 = mesh.getPointCoordinatesBuffer(connections[2]);
+        glm::vec3 vertex0(point0[0], point0[1], point0[2]);
+        glm::vec3 edge1 =
+            glm::vec3(point1[0], point1[1], point1[2]) - vertex0;
+        glm::vec3 edge2 =
+            glm::vec3(point2[0], point2[1], point2[2]) - vertex0;
+
+        float hitT[PACKET_RAYS];
+        intersectTriangle(packet, vertex0, edge1, edge2, frontSign, hitT);
+        if (hits == nullptr) {
+          for (int ray = 0; ray < PACKET_RAYS; ++ray) {
+            bool hit = (hitT[ray] >= 0.0f);
+            packet.tEnd[ray] = hit ? hitT[ray] : packet.tEnd[ray];
+            packet.hitTriangle[ray] =
+                hit ? triangleIndex : packet.hitTriangle[ray];
+          }
+        } else {
+          for (int ray = 0; ray < PACKET_RAYS; ++ray) {
+            if (hitT[ray] >= 0.0f) {
+              hits[ray].push_back(Hit{hitT[ray], triangleIndex});
+            }
+          }
+        }
+      }
+      continue;
+    }
+
+    int firstChild = nodeIndex + 1;
+    int secondChild = node.secondChild;
+    const BoundingVolumeHierarchy::Node &first = nodes[firstChild];
+    const BoundingVolumeHierarchy::Node &second = nodes[secondChild];
+    float firstDistance = glm::dot(
+        0.5f * (first.boundsMin + first.boundsMax) - packetOrigin,
+        packetDirection);
+    float secondDistance = glm::dot(
+        0.5f * (second.boundsMin + second.boundsMax) - packetOrigin,
+        packetDirection);
+    assert(stackSize + 2 <= BoundingVolumeHierarchy::MAX_TRAVERSAL_DEPTH);
+    if (firstDistance <= secondDistance) {
+      stack[stackSize++] = secondChild;
+      stack[stackSize++] = firstChild;
+    } else {
+      stack[stackSize++] = firstChild;
+      stack[stackSize++] = secondChild;
+    }
+  }
+}
+
+static Color shadeTriangle(const Mesh &mesh,
+                           int triangleIndex,
+                           const glm::mat3 &normalTransform) {
+  const float *triangleNormal = mesh.getTriangleNormalsBuffer(triangleIndex);
+  glm::vec3 normal = glm::normalize(
+      normalTransform *
+      glm::vec3(triangleNormal[0], triangleNormal[1], triangleNormal[2]));
+  float colorScale = glm::abs(glm::dot(normal, glm::vec3(0, 0, 1)));
+  return Color(mesh.getTriangleColorsBuffer(triangleIndex)).Scale(colorScale);
+}
+
+namespace {
+
+struct CastRays {
+  const Mesh &mesh;
+  const BoundingVolumeHierarchy &hierarchy;
+  const glm::mat4 &modelview;
+  const glm::mat4 &projection;
+  const glm::mat3 &normalTransform;
+  bool cullBackFaces;
+  int numThreads;
+
+  template <typename ImageType>
+  void operator()(ImageType &image) const {
+    int width = image.getWidth();
+    int height = image.getHeight();
+    bool allHits = image.blendIsOrderDependent();
+
+    glm::mat4 fullTransform = this->projection * this->modelview;
+    glm::mat4 inverseTransform = glm::inverse(fullTransform);
+    // Rows of the transform that give the depth of a point.
+    glm::vec4 depthRow(fullTransform[0][2],
+                       fullTransform[1][2],
+                       fullTransform[2][2],
+                       fullTransform[3][2]);
+    glm::vec4 wRow(fullTransform[0][3],
+                   fullTransform[1][3],
+                   fullTransform[2][3],
+                   fullTransform[3][3]);
+
+    // Triangles that appear counter-clockwise in the image have a negative
+    // determinant in the ray test, unless the transform mirrors the scene.
+    float frontSign = 0.0f;
+    if (this->cullBackFaces) {
+      frontSign = (glm::determinant(fullTransform) > 0.0f) ? -1.0f : 1.0f;
+    }
+
+    int numTilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    int numTilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    int numTiles = numTilesX * numTilesY;
+
+    // Each thread takes the next tile to paint.
+    std::atomic<int> nextTile(0);
+    runThreads(this->numThreads, [&](int) {
+      RayPacket packet;
+      std::vector<Hit> hits[PACKET_RAYS];
+      for (int tile = nextTile++; tile < numTiles; tile = nextTile++) {
+        int tileX = (tile % numTilesX) * TILE_SIZE;
+        int tileY = (tile / numTilesX) * TILE_SIZE;
+        int tileXEnd = std::min(tileX + TILE_SIZE, width);
+        int tileYEnd = std::min(tileY + TILE_SIZE, height);
+        for (int packetY = tileY; packetY < tileYEnd; packetY += PACKET_SIZE) {
+          for (int packetX = tileX; packetX < tileXEnd;
+               packetX += PACKET_SIZE) {
+            for (int ray = 0; ray < PACKET_RAYS; ++ray) {
+              int x = packetX + ray % PACKET_SIZE;
+              int y = packetY + ray / PACKET_SIZE;
+              bool inImage = (x < width) && (y < height);
+              // Rays outside of the image copy one inside but hit nothing.
+              x = std::min(x, width - 1);
+              y = std::min(y, height - 1);
+              float ndcX = 2.0f * (x + 0.5f) / width - 1.0f;
+              float ndcY = 2.0f * (y + 0.5f) / height - 1.0f;
+              glm::vec4 nearPoint =
+                  inverseTransform * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+              glm::vec4 farPoint =
+                  inverseTransform * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+              glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+              glm::vec3 direction = glm::vec3(farPoint) / farPoint.w - origin;
+              packet.originX[ray] = origin.x;
+              packet.originY[ray] = origin.y;
+              packet.originZ[ray] = origin.z;
+              packet.directionX[ray] = direction.x;
+              packet.directionY[ray] = direction.y;
+              packet.directionZ[ray] = direction.z;
+              packet.inverseDirectionX[ray] = 1.0f / direction.x;
+              packet.inverseDirectionY[ray] = 1.0f / direction.y;
+              packet.inverseDirectionZ[ray] = 1.0f / direction.z;
+              packet.tEnd[ray] = inImage ? 1.0f : -1.0f;
+              packet.hitTriangle[ray] = -1;
+              hits[ray].clear();
+            }
+
+            tracePacket(this->mesh,
+                        this->hierarchy,
+                        frontSign,
+                        packet,
+                        allHits ? hits : nullptr);
+
+            for (int ray = 0; ray < PACKET_RAYS; ++ray) {
+              int x = packetX + ray % PACKET_SIZE;
+              int y = packetY + ray / PACKET_SIZE;
+              if ((x >= tileXEnd) || (y >= tileYEnd)) {
+                continue;
+              }
+              typename ImageType::PixelSpan row = image.getRowSpan(y);
+              if (allHits) {
+                std::sort(hits[ray].begin(), hits[ray].end());
+                Color color = row.getColor(x);
+                for (const Hit &hit : hits[ray]) {
+                  color = shadeTriangle(this->mesh,
+                                        hit.triangleIndex,
+                                        this->normalTransform)
+                              .BlendOver(color);
+                }
+                row.setColor(x, color);
+              } else if (packet.hitTriangle[ray] >= 0) {
+                Color color = shadeTriangle(this->mesh,
+                                            packet.hitTriangle[ray],
+                                            this->normalTransform);
+                if (color.Components[3] < 0.99f) {
+                  color = color.BlendOver(row.getColor(x));
+                }
+                row.setColor(x, color);
+                glm::vec4 point(packet.originX[ray] +
+                                    packet.tEnd[ray] * packet.directionX[ray],
+                                packet.originY[ray] +
+                                    packet.tEnd[ray] * packet.directionY[ray],
+                                packet.originZ[ray] +
+                                    packet.tEnd[ray] * packet.directionZ[ray],
+                                1.0f);
+                row.setDepth(x,
+                             0.5f * glm::dot(depthRow, point) /
+                                     glm::dot(wRow, point) +
+                                 0.5f);
+              }
+            }
+          }
+        }
+      }
+    });
+  }
+};
+
+}  // anonymous namespace
+
+PainterRayCast::PainterRayCast(int _numThreads)
+    : numThreads(std::max(_numThreads, 1)) {}
+
+void PainterRayCast::paint(const Mesh &mesh,
+                           ImageFull &image,
+                           const glm::mat4 &modelview,
+                           const glm::mat4 &projection) {
+  image.clear();
+
+  // Normals are transformed by the inverse transpose of the rotation/scale
+  // matrix.
+  glm::mat3 normalTransform = glm::inverseTranspose(glm::mat3(modelview));
+
+  const BoundingVolumeHierarchy *hierarchy = mesh.getBoundingVolumeHierarchy();
+  std::unique_ptr<BoundingVolumeHierarchy> builtHierarchy;
+  if (hierarchy == nullptr) {
+    builtHierarchy.reset(new BoundingVolumeHierarchy(mesh));
+    hierarchy = builtHierarchy.get();
+  }
+
+  bool painted = dispatchImageType(image,
+                                   CastRays{mesh,
+                                            *hierarchy,
+                                            modelview,
+                                            projection,
+                                            normalTransform,
+                                            this->getCullBackFaces(),
+                                            this->numThreads});
+  if (!painted) {
+    std::cerr << "Image format not supported by PainterRayCast" << std::endl;
+  }
+}
+
+void PainterRayCast::paintInOrder(const Mesh &mesh,
+                                  const std::vector<int> &triangleOrder,
+                                  ImageFull &image,
+                                  const glm::mat4 &modelview,
+                                  const glm::mat4 &projection) {
+  if (static_cast<int>(triangleOrder.size()) != mesh.getNumberOfTriangles()) {
+    this->Painter::paintInOrder(
+        mesh, triangleOrder, image, modelview, projection);
+    return;
+  }
+  this->paint(mesh, image, modelview, projection);
+}
@@ -0,0 +1,74 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef PAINTER_RAY_CAST_H
+#define PAINTER_RAY_CAST_H
+
+#include "Painter.hpp"
+
+#include <vector>
+
+/// \brief Paints triangles by casting a ray through the center of each pixel.
+///
+/// Rasterizing takes time proportional to the number of triangles. Casting
+/// rays through the mesh's bounding volume hierarchy takes time proportional
+/// to the number of pixels times the depth of the hierarchy (about the log of
+/// the number of triangles), so this painter pays off for meshes with many
+/// more triangles than pixels. Nothing is done per triangle or per vertex
+/// each frame.
+///
+/// Rays are traced in square packets of neighboring pixels. The rays of a
+/// packet walk the hierarchy together: a node is visited if any ray of the
+/// packet hits its box, and the nearer child is visited first so that rays
+/// that already hit something skip the boxes behind it. The box and triangle
+/// tests are loops over the rays of the packet, which the compiler can
+/// vectorize.
+///
+/// The image is split into tiles, which threads take in turn. Each pixel is
+/// written by one thread, so no locking is needed and the image is the same
+/// for any number of threads.
+///
+/// Images with depth get the color and depth of the nearest triangle along
+/// each ray. Images without depth get every triangle along each ray blended
+/// from back to front, so the order of the triangles does not matter (and
+/// the painter supports order-independent transparency either way).
+///
+/// The painter uses the bounding volume hierarchy of the mesh. A mesh without
+/// one gets a hierarchy built for the call, which costs far more than casting
+/// the rays.
+///
+class PainterRayCast : public Painter {
+  int numThreads;
+
+ public:
+  explicit PainterRayCast(int _numThreads = 1);
+
+  int getNumberOfThreads() const { return this->numThreads; }
+
+  void paint(const Mesh& mesh,
+             ImageFull& image,
+             const glm::mat4& modelview,
+             const glm::mat4& projection) final;
+
+  /// Each ray finds the triangles along it in depth order, so the order of
+  /// \a triangleOrder is ignored. When it lists every triangle of the mesh
+  /// (as from a MeshVisibilitySorter), this is the same as paint. Otherwise,
+  /// only the listed triangles are painted, from a copy of the mesh that has
+  /// to get its own bounding volume hierarchy.
+  void paintInOrder(const Mesh& mesh,
+                    const std::vector<int>& triangleOrder,
+                    ImageFull& image,
+                    const glm::mat4& modelview,
+                    const glm::mat4& projection) final;
+
+  bool paintInOrderUsesOrder() const final { return false; }
+
+  bool supportsOrderIndependentTransparency() const final { return true; }
+};
+
+#endif  // PAINTER_RAY_CAST_H
@@ -8,11 +8,20 @@
 
 #include "PainterSimple.hpp"
 
+#include <Common/BoundingVolumeHierarchy.hpp>
+#include <Common/ImageSparseColorDepth.hpp>
+#include <Common/ImageTypeDispatch.hpp>
+#include <Common/RunThreads.hpp>
+
 #include <glm/gtc/matrix_inverse.hpp>
-#include <glm/gtc/matrix_transform.hpp>
+#include <glm/vec3.hpp>
 
 #include <math.h>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <type_traits>
 
 static void print(const glm::vec3 &vec) {
   std::cout << vec[0] << "\t" << vec[1] << "\t" << vec[2] << std::endl;
@@ -34,13 +43,277 @@ static inline void clamp(T &variable, T min, T max) {
   variable = std::max(min, std::min(max, variable));
 }
 
-inline void PainterSimple::fillLine(ImageFull &image,
-                                    int y,
-                                    const glm::vec3 &edgeDir1,
-                                    const glm::vec3 &edgeBase1,
-                                    const glm::vec3 &edgeDir2,
-                                    const glm::vec3 &edgeBase2,
-                                    const Color &color) {
+// Rows of the image are split into bands of this many rows for threading.
+constexpr int BAND_ROWS = 16;
+
+namespace {
+
+// One band of the rows of an image that is painted compressed. The rows are
+// held in a small image of the same type, and the band is the only part of
+// the image held uncompressed. Rows are not cleared up front. Instead, each
+// row keeps the span of pixels cleared so far and grows it to cover each
+// line painted in the row. The span is all that needs compressing.
+template <typename ImageType>
+class BandImage {
+ public:
+  using ColorType = typename ImageType::ColorType;
+  static constexpr int ColorVecSize = ImageType::ColorVecSize;
+  using PixelSpan = typename ImageType::PixelSpan;
+
+ private:
+  ImageType &rows;
+  int firstRow;
+  ColorType backgroundColor[ColorVecSize];
+  int spanBegin[BAND_ROWS];
+  int spanEnd[BAND_ROWS];
+
+  void clearPixels(PixelSpan &row, int xBegin, int xEnd) {
+    for (int x = xBegin; x < xEnd; ++x) {
+      row.setEncodedColor(x, this->backgroundColor);
+      row.setDepth(x, 1.0f);
+    }
+  }
+
+ public:
+  // The rows image must be as wide as the painted image and have BAND_ROWS
+  // rows.
+  explicit BandImage(ImageType &_rows) : rows(_rows), firstRow(0) {
+    ImageType::encodeColor(Color(0, 0, 0, 0), this->backgroundColor);
+    this->startBand(0);
+  }
+
+  static void encodeColor(const Color &color, ColorType encodedColor[]) {
+    ImageType::encodeColor(color, encodedColor);
+  }
+
+  const ImageType &getRows() const { return this->rows; }
+  int getWidth() const { return this->rows.getWidth(); }
+
+  // Empties the spans of all rows to paint the band starting at the given row
+  // of the image.
+  void startBand(int _firstRow) {
+    this->firstRow = _firstRow;
+    std::fill(this->spanBegin, this->spanBegin + BAND_ROWS, 0);
+    std::fill(this->spanEnd, this->spanEnd + BAND_ROWS, 0);
+  }
+
+  int getSpanBegin(int rowIndex) const { return this->spanBegin[rowIndex]; }
+  int getSpanEnd(int rowIndex) const { return this->spanEnd[rowIndex]; }
+
+  // y is a row of the image (not of the band).
+  PixelSpan getRowSpan(int y) {
+    return this->rows.getRowSpan(y - this->firstRow);
+  }
+
+  // Makes sure that pixels [xBegin, xEnd) of row y are cleared (or already
+  // painted) before they are painted.
+  void prepareRow(int y, int xBegin, int xEnd) {
+    if (xBegin >= xEnd) {
+      return;
+    }
+    int rowIndex = y - this->firstRow;
+    int &begin = this->spanBegin[rowIndex];
+    int &end = this->spanEnd[rowIndex];
+    PixelSpan row = this->rows.getRowSpan(rowIndex);
+    if (begin >= end) {
+      this->clearPixels(row, xBegin, xEnd);
+      begin = xBegin;
+      end = xEnd;
+      return;
+    }
+    // The span stays contiguous, so anything between it and the new pixels
+    // is cleared too.
+    if (xBegin < begin) {
+      this->clearPixels(row, xBegin, begin);
+      begin = xBegin;
+    }
+    if (xEnd > end) {
+      this->clearPixels(row, end, xEnd);
+      end = xEnd;
+    }
+  }
+};
+
+// The fragments of one band of rows of an image without depth, for painting
+// triangles in any order. Each pixel keeps its nearest fragments sorted by
+// depth. When a pixel has more fragments than it can keep, the farthest two
+// are merged into one. The merge is exact when the fragments come back to
+// front and close otherwise. Fragments behind an opaque one are dropped.
+class FragmentBuffer {
+ public:
+  static constexpr int MAX_FRAGMENTS_PER_PIXEL = 8;
+
+  // Colors are painted with Color, so they are "encoded" as its components.
+  using ColorType = float;
+  static constexpr int ColorVecSize = 4;
+
+  struct Fragment {
+    float depth;
+    Color color;
+  };
+
+  class PixelSpan {
+    FragmentBuffer &buffer;
+    int rowIndex;
+
+   public:
+    PixelSpan(FragmentBuffer &_buffer, int _rowIndex)
+        : buffer(_buffer), rowIndex(_rowIndex) {}
+
+    void addFragment(int x, float depth, const Color &color) const {
+      this->buffer.addFragment(
+          this->rowIndex * this->buffer.width + x, depth, color);
+    }
+  };
+
+ private:
+  int width;
+  int firstRow;
+  std::vector<Fragment> fragments;
+  std::vector<int> numFragments;
+
+  void addFragment(int pixelIndex, float depth, const Color &color) {
+    Fragment *pixel = &this->fragments[pixelIndex * MAX_FRAGMENTS_PER_PIXEL];
+    int &count = this->numFragments[pixelIndex];
+    bool opaque = (color.Components[3] >= 0.99f);
+
+    if ((count > 0) && (depth > pixel[count - 1].depth)) {
+      Fragment &farthest = pixel[count - 1];
+      if (farthest.color.Components[3] >= 0.99f) {
+        return;
+      }
+      if (count == MAX_FRAGMENTS_PER_PIXEL) {
+        farthest.color = farthest.color.BlendOver(color);
+      } else {
+        pixel[count++] = Fragment{depth, color};
+      }
+      return;
+    }
+
+    bool full = (count == MAX_FRAGMENTS_PER_PIXEL);
+    Fragment evicted;
+    if (full) {
+      evicted = pixel[--count];
+    }
+    // A fragment goes in front of those at equal depth, just as painting it
+    // after them in order blends it over them.
+    int index = count;
+    while ((index > 0) && (pixel[index - 1].depth >= depth)) {
+      pixel[index] = pixel[index - 1];
+      --index;
+    }
+    pixel[index] = Fragment{depth, color};
+    ++count;
+
+    if (opaque) {
+      count = index + 1;
+    } else if (full) {
+      pixel[count - 1].color = pixel[count - 1].color.BlendOver(evicted.color);
+    }
+  }
+
+ public:
+  explicit FragmentBuffer(int _width)
+      : width(_width),
+        firstRow(0),
+        fragments(_width * BAND_ROWS * MAX_FRAGMENTS_PER_PIXEL),
+        numFragments(_width * BAND_ROWS, 0) {}
+
+  static void encodeColor(const Color &color, ColorType encodedColor[]) {
+    std::copy(color.Components, color.Components + 4, encodedColor);
+  }
+
+  int getWidth() const { return this->width; }
+
+  // Removes all fragments to paint the band starting at the given row of the
+  // image.
+  void startBand(int _firstRow) {
+    this->firstRow = _firstRow;
+    std::fill(this->numFragments.begin(), this->numFragments.end(), 0);
+  }
+
+  // y is a row of the image (not of the band).
+  PixelSpan getRowSpan(int y) { return PixelSpan(*this, y - this->firstRow); }
+
+  // Blends the fragments of each pixel back to front and writes the result to
+  // rows [firstRow, rowEnd) of the image, which must be cleared.
+  template <typename ImageType>
+  void resolve(ImageType &image, int rowEnd) const {
+    for (int y = this->firstRow; y < rowEnd; ++y) {
+      typename ImageType::PixelSpan row = image.getRowSpan(y);
+      int pixelIndex = (y - this->firstRow) * this->width;
+      for (int x = 0; x < this->width; ++x, ++pixelIndex) {
+        int count = this->numFragments[pixelIndex];
+        if (count < 1) {
+          continue;
+        }
+        const Fragment *pixel =
+            &this->fragments[pixelIndex * MAX_FRAGMENTS_PER_PIXEL];
+        Color color = pixel[count - 1].color;
+        for (int index = count - 2; index >= 0; --index) {
+          color = pixel[index].color.BlendOver(color);
+        }
+        row.setColor(x, color);
+      }
+    }
+  }
+};
+
+}  // anonymous namespace
+
+// Full images are cleared before painting, so their rows need no preparing.
+template <typename ImageType>
+static inline void prepareRow(ImageType &, int, int, int) {}
+
+template <typename ImageType>
+static inline void prepareRow(BandImage<ImageType> &image,
+                              int y,
+                              int xBegin,
+                              int xEnd) {
+  image.prepareRow(y, xBegin, xEnd);
+}
+
+template <typename PixelSpan, typename ColorType>
+static inline void shadePixel(PixelSpan &row,
+                              int x,
+                              float depth,
+                              const Color &color,
+                              const ColorType encodedColor[]) {
+  if ((depth >= 0.0) && (depth < row.getDepth(x))) {
+    if (color.Components[3] >= 0.99f) {
+      row.setEncodedColor(x, encodedColor);
+    } else {
+      Color previousColor = row.getColor(x);
+      row.setColor(x, color.BlendOver(previousColor));
+    }
+    row.setDepth(x, depth);
+  }
+}
+
+// Fragments are kept for blending later rather than blended now.
+static inline void shadePixel(FragmentBuffer::PixelSpan &row,
+                              int x,
+                              float depth,
+                              const Color &color,
+                              const float *) {
+  if ((depth >= 0.0) && (depth < 1.0)) {
+    row.addFragment(x, depth, color);
+  }
+}
+
+// The pixels are accessed through the PixelSpan of the concrete image type,
+// so these are compiled for each image type (see ImageTypeDispatch.hpp) and
+// make no virtual calls per pixel.
+template <typename ImageType>
+static inline void fillLine(
+    ImageType &image,
+    int y,
+    const glm::vec3 &edgeDir1,
+    const glm::vec3 &edgeBase1,
+    const glm::vec3 &edgeDir2,
+    const glm::vec3 &edgeBase2,
+    const Color &color,
+    const typename ImageType::ColorType encodedColor[]) {
   float interp1 = ((float)y - edgeBase1.y) / edgeDir1.y;
   float interp2 = ((float)y - edgeBase2.y) / edgeDir2.y;
 
@@ -66,40 +339,46 @@ inline void PainterSimple::fillLine(ImageFull &image,
 
   int xMax = std::min(static_cast<int>(right.x), image.getWidth());
 
+  prepareRow(image, y, xMin, xMax);
+  typename ImageType::PixelSpan row = image.getRowSpan(y);
   for (int x = xMin; x < xMax; ++x) {
-    if ((depth >= 0.0) && (depth < image.getDepth(x, y))) {
-      if (color.Components[3] >= 0.99f) {
-        image.setColor(x, y, color);
-      } else {
-        Color previousColor = image.getColor(x, y);
-        image.setColor(x, y, color.BlendOver(previousColor));
-      }
-      image.setDepth(x, y, depth);
-      depth += deltaDepth;
-    }
+    shadePixel(row, x, depth, color, encodedColor);
+    depth += deltaDepth;
   }
 }
 
-void PainterSimple::fillTriangle(ImageFull &image,
-                                 const Triangle &triangle,
-                                 const glm::mat4 &modelview,
-                                 const glm::mat4 &projection,
-                                 const glm::mat3 &normalTransform) {
-  glm::vec3 normal = glm::normalize(normalTransform * triangle.normal);
-  float colorScale = glm::abs(glm::dot(normal, glm::vec3(0, 0, 1)));
+// Returns false if the triangle is culled.
+static bool projectTriangle(const Mesh &mesh,
+                            int triangleIndex,
+                            const ScreenVertices &screenVertices,
+                            const glm::mat3 &normalTransform,
+                            const glm::ivec4 &viewport,
+                            bool cullBackFaces,
+                            PainterSimple::ProjectedTriangle &projected) {
+  const int *connections = mesh.getTriangleConnectionsBuffer(triangleIndex);
+  glm::vec3 vMin = screenVertices.getVertex(connections[0]);
+  glm::vec3 vMid = screenVertices.getVertex(connections[1]);
+  glm::vec3 vMax = screenVertices.getVertex(connections[2]);
 
-  const Color &color = triangle.color.Scale(colorScale);
+  if (cullBackFaces) {
+    // Back faces appear clockwise in the image.
+    float area = (vMid.x - vMin.x) * (vMax.y - vMin.y) -
+                 (vMax.x - vMin.x) * (vMid.y - vMin.y);
+    if (area < 0.0f) {
+      return false;
+    }
+  }
 
-  glm::ivec4 viewport(0, 0, image.getWidth(), image.getHeight());
+  const float *triangleNormal = mesh.getTriangleNormalsBuffer(triangleIndex);
+  glm::vec3 normal = glm::normalize(
+      normalTransform *
+      glm::vec3(triangleNormal[0], triangleNormal[1], triangleNormal[2]));
+  float colorScale = glm::abs(glm::dot(normal, glm::vec3(0, 0, 1)));
 
-  // Sort vertices by location along Y axis.
-  glm::vec3 vMin =
-      glm::project(triangle.vertex[0], modelview, projection, viewport);
-  glm::vec3 vMid =
-      glm::project(triangle.vertex[1], modelview, projection, viewport);
-  glm::vec3 vMax =
-      glm::project(triangle.vertex[2], modelview, projection, viewport);
+  projected.color =
+      Color(mesh.getTriangleColorsBuffer(triangleIndex)).Scale(colorScale);
 
+  // Sort vertices by location along Y axis.
   if (vMin.y > vMid.y) {
     std::swap(vMin, vMid);
   }
@@ -110,42 +389,416 @@ void PainterSimple::fillTriangle(ImageFull &image,
     std::swap(vMid, vMax);
   }
 
+  projected.vMin = vMin;
+  projected.vMid = vMid;
+  projected.vMax = vMax;
+
+  projected.yMin = (int)vMin.y;
+  projected.yMid = (int)vMid.y;
+  projected.yMax = (int)vMax.y;
+
+  clamp(projected.yMin, 0, viewport[3]);
+  clamp(projected.yMid, 0, viewport[3]);
+  clamp(projected.yMax, 0, viewport[3]);
+
+  return true;
+}
+
+// Rasterizes the rows of a projected triangle that are in [rowBegin, rowEnd).
+template <typename ImageType>
+static void fillTriangleRows(ImageType &image,
+                             const PainterSimple::ProjectedTriangle &triangle,
+                             int rowBegin,
+                             int rowEnd) {
+  const Color &color = triangle.color;
+  typename ImageType::ColorType encodedColor[ImageType::ColorVecSize];
+  ImageType::encodeColor(color, encodedColor);
+
+  const glm::vec3 &vMin = triangle.vMin;
+  const glm::vec3 &vMid = triangle.vMid;
+  const glm::vec3 &vMax = triangle.vMax;
+
   // Get vectors along edge point from min to max.
   glm::vec3 dirMin2Max = vMax - vMin;
   glm::vec3 dirMin2Mid = vMid - vMin;
   glm::vec3 dirMid2Max = vMax - vMid;
 
-  int yMin = (int)vMin.y;
-  int yMid = (int)vMid.y;
-  int yMax = (int)vMax.y;
-
-  clamp(yMin, 0, image.getHeight());
-  clamp(yMid, 0, image.getHeight());
-  clamp(yMax, 0, image.getHeight());
-
   // Rasterize bottom half
-  for (int y = yMin; y < yMid; ++y) {
-    this->fillLine(image, y, dirMin2Max, vMin, dirMin2Mid, vMin, color);
+  int yEnd = std::min(triangle.yMid, rowEnd);
+  for (int y = std::max(triangle.yMin, rowBegin); y < yEnd; ++y) {
+    fillLine(
+        image, y, dirMin2Max, vMin, dirMin2Mid, vMin, color, encodedColor);
   }
 
   // Rasterize top half
-  for (int y = yMid; y < yMax; ++y) {
-    this->fillLine(image, y, dirMin2Max, vMin, dirMid2Max, vMid, color);
+  yEnd = std::min(triangle.yMax, rowEnd);
+  for (int y = std::max(triangle.yMid, rowBegin); y < yEnd; ++y) {
+    fillLine(
+        image, y, dirMin2Max, vMin, dirMid2Max, vMid, color, encodedColor);
   }
 }
 
-void PainterSimple::paint(const Mesh &mesh,
-                          ImageFull &image,
-                          const glm::mat4 &modelview,
-                          const glm::mat4 &projection) {
+namespace {
+
+struct PaintTriangles {
+  const Mesh &mesh;
+  const ScreenVertices &screenVertices;
+  const glm::mat3 &normalTransform;
+  bool cullBackFaces;
+  bool orderIndependentTransparency;
+  // Nonzero for triangles that may be in view, or null to paint all.
+  const char *visibleTriangles;
+  // The triangles to paint in order, or null to paint in mesh order.
+  const std::vector<int> *triangleOrder;
+  int numThreads;
+  std::vector<PainterSimple::ProjectedTriangle> &projectedTriangles;
+  std::vector<std::vector<std::vector<int>>> &bandBins;
+
+  int getNumberOfTrianglesToPaint() const {
+    return (this->triangleOrder != nullptr)
+               ? static_cast<int>(this->triangleOrder->size())
+               : this->mesh.getNumberOfTriangles();
+  }
+
+  int getTriangleToPaint(int position) const {
+    return (this->triangleOrder != nullptr) ? (*this->triangleOrder)[position]
+                                            : position;
+  }
+
+  // Projects a contiguous chunk of the triangles in each thread and notes
+  // the bands they cover. Returns the number of bands.
+  int binTriangles(const glm::ivec4 &viewport) const {
+    int numTriangles = this->getNumberOfTrianglesToPaint();
+    int numBands = (viewport[3] + BAND_ROWS - 1) / BAND_ROWS;
+    this->projectedTriangles.resize(this->mesh.getNumberOfTriangles());
+    this->bandBins.resize(this->numThreads);
+    for (auto &&threadBins : this->bandBins) {
+      threadBins.resize(numBands);
+      for (auto &&bin : threadBins) {
+        bin.clear();
+      }
+    }
+
+    runThreads(this->numThreads, [&](int threadIndex) {
+      int begin = static_cast<int>(
+          static_cast<long long>(numTriangles) * threadIndex /
+          this->numThreads);
+      int end = static_cast<int>(
+          static_cast<long long>(numTriangles) * (threadIndex + 1) /
+          this->numThreads);
+      std::vector<std::vector<int>> &threadBins = this->bandBins[threadIndex];
+      for (int position = begin; position < end; ++position) {
+        int i = this->getTriangleToPaint(position);
+        if ((this->visibleTriangles != nullptr) &&
+            !this->visibleTriangles[i]) {
+          continue;
+        }
+        PainterSimple::ProjectedTriangle &projected =
+            this->projectedTriangles[i];
+        if (!projectTriangle(this->mesh,
+                             i,
+                             this->screenVertices,
+                             this->normalTransform,
+                             viewport,
+                             this->cullBackFaces,
+                             projected)) {
+          continue;
+        }
+        if (projected.yMin < projected.yMax) {
+          int lastBand = (projected.yMax - 1) / BAND_ROWS;
+          for (int band = projected.yMin / BAND_ROWS; band <= lastBand;
+               ++band) {
+            threadBins[band].push_back(i);
+          }
+        }
+      }
+    });
+
+    return numBands;
+  }
+
+  // Rasterizes the rows of one band. The chunks of triangles are visited in
+  // order, so triangles are drawn in mesh order as they would be by a single
+  // thread.
+  template <typename ImageType>
+  void fillBand(ImageType &image, int band, int rowBegin, int rowEnd) const {
+    for (auto &&threadBins : this->bandBins) {
+      for (int triangleIndex : threadBins[band]) {
+        fillTriangleRows(image,
+                         this->projectedTriangles[triangleIndex],
+                         rowBegin,
+                         rowEnd);
+      }
+    }
+  }
+
+  template <typename ImageType>
+  void operator()(ImageType &image) const {
+    if (this->orderIndependentTransparency && image.blendIsOrderDependent()) {
+      this->paintOrderIndependent(image);
+      return;
+    }
+
+    glm::ivec4 viewport(0, 0, image.getWidth(), image.getHeight());
+    int numTriangles = this->getNumberOfTrianglesToPaint();
+
+    if (this->numThreads <= 1) {
+      PainterSimple::ProjectedTriangle projected;
+      for (int position = 0; position < numTriangles; position++) {
+        int i = this->getTriangleToPaint(position);
+        if ((this->visibleTriangles != nullptr) &&
+            !this->visibleTriangles[i]) {
+          continue;
+        }
+        if (projectTriangle(this->mesh,
+                            i,
+                            this->screenVertices,
+                            this->normalTransform,
+                            viewport,
+                            this->cullBackFaces,
+                            projected)) {
+          fillTriangleRows(image, projected, 0, image.getHeight());
+        }
+      }
+      return;
+    }
+
+    int numBands = this->binTriangles(viewport);
+
+    // Each thread takes the next band to rasterize.
+    std::atomic<int> nextBand(0);
+    runThreads(this->numThreads, [&](int) {
+      for (int band = nextBand++; band < numBands; band = nextBand++) {
+        int rowBegin = band * BAND_ROWS;
+        int rowEnd = std::min(rowBegin + BAND_ROWS, image.getHeight());
+        this->fillBand(image, band, rowBegin, rowEnd);
+      }
+    });
+  }
+
+  // Paints a band at a time, as with threads, but keeps the fragments of the
+  // band in a buffer in each thread. Once the band is painted, the fragments
+  // of each pixel are blended in depth order into the image, so the triangles
+  // need not be sorted.
+  template <typename ImageType>
+  void paintOrderIndependent(ImageType &image) const {
+    int width = image.getWidth();
+    int height = image.getHeight();
+    int numBands = this->binTriangles(glm::ivec4(0, 0, width, height));
+
+    int numThreads = std::max(std::min(this->numThreads, numBands), 1);
+    std::atomic<int> nextBand(0);
+    runThreads(numThreads, [&](int) {
+      FragmentBuffer fragments(width);
+      for (int band = nextBand++; band < numBands; band = nextBand++) {
+        int rowBegin = band * BAND_ROWS;
+        int rowEnd = std::min(rowBegin + BAND_ROWS, height);
+        fragments.startBand(rowBegin);
+        this->fillBand(fragments, band, rowBegin, rowEnd);
+        fragments.resolve(image, rowEnd);
+      }
+    });
+  }
+
+  // Paints a band at a time, as with threads, but into a small image of
+  // band rows in each thread. Each band is compressed as soon as it is
+  // painted. Bands are appended to the compressed image in order, so a
+  // thread that finishes a band early waits for the bands below it.
+  template <typename ImageType, typename Features>
+  std::unique_ptr<ImageSparse> paintCompressed(
+      const ImageType &image,
+      typename ImageSparseColorDepth<Features>::RowBuilder &builder) const {
+    int width = image.getWidth();
+    int height = image.getHeight();
+    int numBands = this->binTriangles(glm::ivec4(0, 0, width, height));
+
+    int numThreads = std::max(std::min(this->numThreads, numBands), 1);
+    std::vector<std::unique_ptr<ImageType>> bandRows;
+    for (int threadIndex = 0; threadIndex < numThreads; ++threadIndex) {
+      std::unique_ptr<Image> rows =
+          image.createNew(width,
+                          BAND_ROWS,
+                          0,
+                          width * BAND_ROWS,
+                          Viewport(0, 0, width - 1, BAND_ROWS - 1));
+      bandRows.emplace_back(dynamic_cast<ImageType *>(rows.release()));
+    }
+
+    // The valid viewport covers the painted spans.
+    Viewport validViewport(width, height, -1, -1);
+
+    std::atomic<int> nextBand(0);
+    std::mutex appendMutex;
+    std::condition_variable bandAppended;
+    int numBandsAppended = 0;
+    runThreads(numThreads, [&](int threadIndex) {
+      BandImage<ImageType> bandImage(*bandRows[threadIndex]);
+      for (int band = nextBand++; band < numBands; band = nextBand++) {
+        int rowBegin = band * BAND_ROWS;
+        int rowEnd = std::min(rowBegin + BAND_ROWS, height);
+        bandImage.startBand(rowBegin);
+        this->fillBand(bandImage, band, rowBegin, rowEnd);
+
+        std::unique_lock<std::mutex> appendLock(appendMutex);
+        bandAppended.wait(appendLock,
+                          [&]() { return numBandsAppended == band; });
+        for (int y = rowBegin; y < rowEnd; ++y) {
+          int rowIndex = y - rowBegin;
+          int spanBegin = bandImage.getSpanBegin(rowIndex);
+          int spanEnd = bandImage.getSpanEnd(rowIndex);
+          if (spanBegin < spanEnd) {
+            builder.appendRow(
+                bandImage.getRows(), rowIndex * width, spanBegin, spanEnd);
+            validViewport = validViewport.unionWith(
+                Viewport(spanBegin, y, spanEnd - 1, y));
+          } else {
+            builder.appendBackgroundRows(1);
+          }
+        }
+        ++numBandsAppended;
+        appendLock.unlock();
+        bandAppended.notify_all();
+      }
+    });
+
+    return builder.finish(validViewport);
+  }
+};
+
+// Calls PaintTriangles::paintCompressed for the images it supports.
+struct PaintCompressed {
+  const PaintTriangles &paintTriangles;
+  std::unique_ptr<ImageSparse> &compressedImage;
+
+  template <typename ImageType>
+  void operator()(const ImageType &image) const {
+    this->paint(image, image);
+  }
+
+  template <typename ImageType, typename Features>
+  void paint(const ImageType &image,
+             const ImageColorDepth<Features> &storage) const {
+    typename ImageSparseColorDepth<Features>::RowBuilder builder(
+        storage, image.getWidth(), image.getHeight());
+    this->compressedImage =
+        this->paintTriangles.paintCompressed<ImageType, Features>(
+            image, builder);
+  }
+
+  // Images without depth blend in visibility order and are not supported.
+  template <typename ImageType>
+  void paint(const ImageType &, const ImageFull &) const {}
+};
+
+struct IsPaintCompressedSupported {
+  bool &supported;
+
+  template <typename ImageType>
+  void operator()(const ImageType &) const {
+    this->supported = std::is_base_of<ImageColorDepthBase, ImageType>::value;
+  }
+};
+
+}  // anonymous namespace
+
+PainterSimple::PainterSimple(int _numThreads) : numThreads(_numThreads) {}
+
+// Transforms the vertices and marks the triangles in view for painting.
+const char *PainterSimple::prepareMesh(const Mesh &mesh,
+                                       const glm::mat4 &modelview,
+                                       const glm::mat4 &projection,
+                                       int width,
+                                       int height) {
+  // Transform each vertex once. The triangles look up their vertices by
+  // index.
+  this->screenVertices.transform(mesh,
+                                 modelview,
+                                 projection,
+                                 glm::ivec4(0, 0, width, height),
+                                 this->numThreads);
+
+  const BoundingVolumeHierarchy *boundingVolumeHierarchy =
+      mesh.getBoundingVolumeHierarchy();
+  if (boundingVolumeHierarchy == nullptr) {
+    return nullptr;
+  }
+  boundingVolumeHierarchy->markTrianglesInFrustum(
+      modelview, projection, this->visibleTriangles);
+  return this->visibleTriangles.data();
+}
+
+void PainterSimple::paintMesh(const Mesh &mesh,
+                              const std::vector<int> *triangleOrder,
+                              ImageFull &image,
+                              const glm::mat4 &modelview,
+                              const glm::mat4 &projection) {
   image.clear();
 
   // It turns out, the normals should be transformed by the inverse transpose
   // of the rotation/scale matrix.
   glm::mat3 normalTransform = glm::inverseTranspose(glm::mat3(modelview));
 
-  for (int i = 0; i < mesh.getNumberOfTriangles(); i++) {
-    this->fillTriangle(
-        image, mesh.getTriangle(i), modelview, projection, normalTransform);
+  const char *visibleTriangles = this->prepareMesh(
+      mesh, modelview, projection, image.getWidth(), image.getHeight());
+
+  PaintTriangles paintTriangles{mesh,
+                                this->screenVertices,
+                                normalTransform,
+                                this->getCullBackFaces(),
+                                this->getOrderIndependentTransparency(),
+                                visibleTriangles,
+                                triangleOrder,
+                                this->numThreads,
+                                this->projectedTriangles,
+                                this->bandBins};
+  bool painted = dispatchImageType(image, paintTriangles);
+  if (!painted) {
+    std::cerr << "Image format not supported by PainterSimple" << std::endl;
   }
 }
+
+void PainterSimple::paint(const Mesh &mesh,
+                          ImageFull &image,
+                          const glm::mat4 &modelview,
+                          const glm::mat4 &projection) {
+  this->paintMesh(mesh, nullptr, image, modelview, projection);
+}
+
+void PainterSimple::paintInOrder(const Mesh &mesh,
+                                 const std::vector<int> &triangleOrder,
+                                 ImageFull &image,
+                                 const glm::mat4 &modelview,
+                                 const glm::mat4 &projection) {
+  this->paintMesh(mesh, &triangleOrder, image, modelview, projection);
+}
+
+bool PainterSimple::canPaintCompressed(const ImageFull &image) const {
+  bool supported = false;
+  dispatchImageType(image, IsPaintCompressedSupported{supported});
+  return supported;
+}
+
+std::unique_ptr<ImageSparse> PainterSimple::paintCompressed(
+    const Mesh &mesh,
+    const ImageFull &image,
+    const glm::mat4 &modelview,
+    const glm::mat4 &projection) {
+  glm::mat3 normalTransform = glm::inverseTranspose(glm::mat3(modelview));
+
+  const char *visibleTriangles = this->prepareMesh(
+      mesh, modelview, projection, image.getWidth(), image.getHeight());
+
+  std::unique_ptr<ImageSparse> compressedImage;
+  PaintTriangles paintTriangles{mesh,
+                                this->screenVertices,
+                                normalTransform,
+                                this->getCullBackFaces(),
+                                this->getOrderIndependentTransparency(),
+                                visibleTriangles,
+                                nullptr,
+                                this->numThreads,
+                                this->projectedTriangles,
+                                this->bandBins};
+  dispatchImageType(image, PaintCompressed{paintTriangles, compressedImage});
+  return compressedImage;
+}
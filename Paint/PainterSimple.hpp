@@ -12,29 +12,101 @@
 #include <iostream>
 
 #include "Painter.hpp"
+#include "ScreenVertices.hpp"
 
 #include <glm/vec3.hpp>
 
+#include <vector>
+
+/// \brief Paints triangles with a simple scanline rasterizer.
+///
+/// The vertices of the mesh are transformed to the image once, and each
+/// triangle looks up its vertices by index.
+///
+/// The painter can use several threads. The rows of the image are split into
+/// bands. The triangles are first projected and sorted into the bands they
+/// cover (in parallel), and then each band is rasterized by one thread with
+/// the triangles in mesh order. Each thread writes only the rows of its own
+/// band, so no locking is needed and the image is the same for any number of
+/// threads.
+///
+/// Images with depth can also be painted compressed. Each band is then
+/// painted into a small image of its own, which is compressed as soon as the
+/// band is done, so the full image is never cleared or held uncompressed.
+///
+/// With order-independent transparency on, images without depth are also
+/// painted a band at a time. Each thread keeps the nearest few fragments of
+/// each pixel of its band sorted by depth (merging the farthest ones when
+/// there are too many) and blends them once the band is done, so the mesh
+/// does not need to be sorted.
+///
+/// When the mesh has a bounding volume hierarchy, triangles in parts of the
+/// hierarchy outside of the view are skipped without being projected.
+///
 class PainterSimple : public Painter {
+ public:
+  /// A triangle projected to the image, with its vertices sorted by y.
+  struct ProjectedTriangle {
+    glm::vec3 vMin;
+    glm::vec3 vMid;
+    glm::vec3 vMax;
+    Color color;
+    int yMin;
+    int yMid;
+    int yMax;
+  };
+
  private:
-  void fillLine(ImageFull& image,
-                int y,
-                const glm::vec3& edgeDir1,
-                const glm::vec3& edgeBase1,
-                const glm::vec3& edgeDir2,
-                const glm::vec3& edgeBase2,
-                const Color& color);
-  void fillTriangle(ImageFull& image,
-                    const Triangle& triangle,
-                    const glm::mat4& modelview,
-                    const glm::mat4& projection,
-                    const glm::mat3& normalTransform);
+  int numThreads;
+
+  // Kept between calls to paint so the memory is reused.
+  ScreenVertices screenVertices;
+  std::vector<ProjectedTriangle> projectedTriangles;
+  // Indices of the triangles covering each band, binned separately by each
+  // thread (indexed by thread and then band).
+  std::vector<std::vector<std::vector<int>>> bandBins;
+  // Triangles that may be in view, when the mesh has a bounding volume
+  // hierarchy.
+  std::vector<char> visibleTriangles;
+
+  const char* prepareMesh(const Mesh& mesh,
+                          const glm::mat4& modelview,
+                          const glm::mat4& projection,
+                          int width,
+                          int height);
+
+  // Paints the triangles in the given order, or in mesh order if null.
+  void paintMesh(const Mesh& mesh,
+                 const std::vector<int>* triangleOrder,
+                 ImageFull& image,
+                 const glm::mat4& modelview,
+                 const glm::mat4& projection);
 
  public:
+  explicit PainterSimple(int _numThreads = 1);
+
+  int getNumberOfThreads() const { return this->numThreads; }
+
   void paint(const Mesh& mesh,
              ImageFull& image,
              const glm::mat4& modelview,
              const glm::mat4& projection) final;
+
+  void paintInOrder(const Mesh& mesh,
+                    const std::vector<int>& triangleOrder,
+                    ImageFull& image,
+                    const glm::mat4& modelview,
+                    const glm::mat4& projection) final;
+
+  bool supportsOrderIndependentTransparency() const final { return true; }
+
+  bool canPaintCompressed(const ImageFull& image) const final;
+
+  std::unique_ptr<ImageSparse> paintCompressed(
+      const Mesh& mesh,
+      const ImageFull& image,
+      const glm::mat4& modelview,
+      const glm::mat4& projection) final;
 };
 
 #endif  // PAINTER_SIMPLE_H
@@ -0,0 +1,122 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include "ScreenVertices.hpp"
+
+#include <Common/RunThreads.hpp>
+
+#include <algorithm>
+
+// Meshes with fewer vertices than this per thread are transformed in fewer
+// threads, since starting a thread costs more than transforming them.
+constexpr int MIN_VERTICES_PER_THREAD = 16384;
+
+namespace {
+
+// The combined transform from model to window coordinates, unpacked so that
+// the loop below works on plain floats.
+struct VertexTransform {
+  float m[4][4];
+  float scaleX;
+  float scaleY;
+  float offsetX;
+  float offsetY;
+
+  VertexTransform(const glm::mat4 &modelview,
+                  const glm::mat4 &projection,
+                  const glm::ivec4 &viewport) {
+    glm::mat4 transform = projection * modelview;
+    for (int column = 0; column < 4; ++column) {
+      for (int row = 0; row < 4; ++row) {
+        this->m[column][row] = transform[column][row];
+      }
+    }
+    this->scaleX = static_cast<float>(viewport[2]);
+    this->scaleY = static_cast<float>(viewport[3]);
+    this->offsetX = static_cast<float>(viewport[0]);
+    this->offsetY = static_cast<float>(viewport[1]);
+  }
+
+  // Transforms vertices [begin, end). There are no branches or calls in the
+  // loop, so the compiler can vectorize it.
+  void apply(const float *points,
+             float *outX,
+             float *outY,
+             float *outZ,
+             int begin,
+             int end) const {
+    const float m00 = this->m[0][0], m01 = this->m[0][1];
+    const float m02 = this->m[0][2], m03 = this->m[0][3];
+    const float m10 = this->m[1][0], m11 = this->m[1][1];
+    const float m12 = this->m[1][2], m13 = this->m[1][3];
+    const float m20 = this->m[2][0], m21 = this->m[2][1];
+    const float m22 = this->m[2][2], m23 = this->m[2][3];
+    const float m30 = this->m[3][0], m31 = this->m[3][1];
+    const float m32 = this->m[3][2], m33 = this->m[3][3];
+    const float scaleX = this->scaleX;
+    const float scaleY = this->scaleY;
+    const float offsetX = this->offsetX;
+    const float offsetY = this->offsetY;
+
+    for (int vertexIndex = begin; vertexIndex < end; ++vertexIndex) {
+      float px = points[3 * vertexIndex + 0];
+      float py = points[3 * vertexIndex + 1];
+      float pz = points[3 * vertexIndex + 2];
+
+      float clipX = m00 * px + m10 * py + m20 * pz + m30;
+      float clipY = m01 * px + m11 * py + m21 * pz + m31;
+      float clipZ = m02 * px + m12 * py + m22 * pz + m32;
+      float clipW = m03 * px + m13 * py + m23 * pz + m33;
+
+      float ndcX = clipX / clipW;
+      float ndcY = clipY / clipW;
+      float ndcZ = clipZ / clipW;
+
+      outX[vertexIndex] = (ndcX * 0.5f + 0.5f) * scaleX + offsetX;
+      outY[vertexIndex] = (ndcY * 0.5f + 0.5f) * scaleY + offsetY;
+      outZ[vertexIndex] = ndcZ * 0.5f + 0.5f;
+    }
+  }
+};
+
+}  // anonymous namespace
+
+void ScreenVertices::transform(const Mesh &mesh,
+                               const glm::mat4 &modelview,
+                               const glm::mat4 &projection,
+                               const glm::ivec4 &viewport,
+                               int numThreads) {
+  int numVertices = mesh.getNumberOfVertices();
+  this->x.resize(numVertices);
+  this->y.resize(numVertices);
+  this->z.resize(numVertices);
+  if (numVertices < 1) {
+    return;
+  }
+
+  VertexTransform vertexTransform(modelview, projection, viewport);
+  const float *points = mesh.getPointCoordinatesBuffer();
+
+  numThreads = std::min(numThreads, numVertices / MIN_VERTICES_PER_THREAD);
+  if (numThreads <= 1) {
+    vertexTransform.apply(points,
+                          this->x.data(),
+                          this->y.data(),
+                          this->z.data(),
+                          0,
+                          numVertices);
+    return;
+  }
+
+  runThreads(numThreads, [&](int threadIndex) {
+    int begin, end;
+    getThreadRange(numVertices, threadIndex, numThreads, begin, end);
+    vertexTransform.apply(
+        points, this->x.data(), this->y.data(), this->z.data(), begin, end);
+  });
+}
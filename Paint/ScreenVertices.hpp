@@ -0,0 +1,57 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#ifndef SCREENVERTICES_HPP
+#define SCREENVERTICES_HPP
+
+#include <miniGraphicsConfig.h>
+
+#include <Common/Mesh.hpp>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+#include <vector>
+
+/// \brief The vertices of a mesh projected to window coordinates.
+///
+/// Painters transform all the vertices of a mesh once per frame with this
+/// and then look up the vertices of each triangle through the mesh's triangle
+/// connections. This way a vertex shared by several triangles is transformed
+/// only once.
+///
+/// The window coordinates are the same as those of glm::project (x and y in
+/// pixels and z from 0 at the near plane to 1 at the far plane) except for
+/// rounding. They are stored as separate x, y, and z arrays so that the
+/// transform loop can be vectorized by the compiler.
+///
+class ScreenVertices {
+  std::vector<float> x;
+  std::vector<float> y;
+  std::vector<float> z;
+
+ public:
+  /// \brief Transforms the vertices of the mesh, replacing any held before.
+  ///
+  /// Large meshes are split among \a numThreads threads.
+  void transform(const Mesh& mesh,
+                 const glm::mat4& modelview,
+                 const glm::mat4& projection,
+                 const glm::ivec4& viewport,
+                 int numThreads = 1);
+
+  int getNumberOfVertices() const { return static_cast<int>(this->x.size()); }
+
+  glm::vec3 getVertex(int vertexIndex) const {
+    return glm::vec3(
+        this->x[vertexIndex], this->y[vertexIndex], this->z[vertexIndex]);
+  }
+};
+
+#endif  // SCREENVERTICES_HPP
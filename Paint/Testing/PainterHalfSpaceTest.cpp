@@ -0,0 +1,166 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include <Paint/PainterHalfSpace.hpp>
+#include <Paint/PainterSimple.hpp>
+
+#include <Common/ImageRGBAFloatColorOnly.hpp>
+#include <Common/ImageRGBFloatColorDepth.hpp>
+#include <Common/Mesh.hpp>
+
+#include <glm/vec2.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+#define TEST_ASSERT(condition) \
+  CheckAssert(condition, #condition, __FILE__, __LINE__);
+
+static void CheckAssert(bool condition,
+                        const std::string& conditionStr,
+                        const std::string& filename,
+                        int line) {
+  if (condition) {
+    std::cout << "    OK (" << conditionStr << ")" << std::endl;
+  } else {
+    std::cerr << "    *** FAILED! *** (" << conditionStr << "), " << filename
+              << ":" << line << std::endl;
+    exit(1);
+  }
+}
+
+// Big enough for several blocks, including some hanging off the image.
+constexpr int IMAGE_WIDTH = 20;
+constexpr int IMAGE_HEIGHT = 19;
+
+constexpr float COLOR_THRESHOLD = 0.001f;
+
+static const Color NEAR_COLOR(0.5f, 0.0f, 0.0f, 0.5f);
+static const Color FAR_COLOR(0.0f, 0.5f, 0.0f, 0.5f);
+
+// Two transparent triangles that each cover the whole image, the near one
+// painted first.
+static Mesh createOverlappingMesh() {
+  Mesh mesh;
+  const float depths[2] = {-0.5f, 0.5f};
+  const Color colors[2] = {NEAR_COLOR, FAR_COLOR};
+  for (int triangleIndex = 0; triangleIndex < 2; ++triangleIndex) {
+    int vertexIndex = mesh.getNumberOfVertices();
+    mesh.addVertex(glm::vec3(-1.0f, -1.0f, depths[triangleIndex]));
+    mesh.addVertex(glm::vec3(3.0f, -1.0f, depths[triangleIndex]));
+    mesh.addVertex(glm::vec3(-1.0f, 3.0f, depths[triangleIndex]));
+    int connections[3] = {vertexIndex, vertexIndex + 1, vertexIndex + 2};
+    mesh.addTriangle(
+        connections, glm::vec3(0.0f, 0.0f, 1.0f), colors[triangleIndex]);
+  }
+  return mesh;
+}
+
+static bool allPixelsAre(const ImageFull& image,
+                         const Color& expected,
+                         int numComponents) {
+  for (int pixel = 0; pixel < image.getNumberOfPixels(); ++pixel) {
+    Color color = image.getColor(pixel);
+    for (int component = 0; component < numComponents; ++component) {
+      if (std::abs(color.Components[component] -
+                   expected.Components[component]) > COLOR_THRESHOLD) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// A fan of transparent triangles around a point off the pixel grid, covering
+// the image. Every pixel is on the inside or on the edges of the triangles.
+static Mesh createFanMesh() {
+  const glm::vec2 rim[8] = {glm::vec2(-1.5f, -1.5f),
+                            glm::vec2(0.0f, -1.5f),
+                            glm::vec2(1.5f, -1.5f),
+                            glm::vec2(1.5f, 0.0f),
+                            glm::vec2(1.5f, 1.5f),
+                            glm::vec2(0.0f, 1.5f),
+                            glm::vec2(-1.5f, 1.5f),
+                            glm::vec2(-1.5f, 0.0f)};
+  Mesh mesh;
+  mesh.addVertex(glm::vec3(0.1f, 0.05f, 0.0f));
+  for (int rimIndex = 0; rimIndex < 8; ++rimIndex) {
+    mesh.addVertex(glm::vec3(rim[rimIndex], 0.0f));
+  }
+  for (int rimIndex = 0; rimIndex < 8; ++rimIndex) {
+    int connections[3] = {0, rimIndex + 1, (rimIndex + 1) % 8 + 1};
+    mesh.addTriangle(connections, glm::vec3(0.0f, 0.0f, 1.0f), NEAR_COLOR);
+  }
+  return mesh;
+}
+
+// A triangle covering the image whose depth changes across each row.
+static Mesh createSlopedMesh() {
+  Mesh mesh;
+  mesh.addVertex(glm::vec3(-1.0f, -1.0f, -0.5f));
+  mesh.addVertex(glm::vec3(3.0f, -1.0f, 0.5f));
+  mesh.addVertex(glm::vec3(-1.0f, 3.0f, -0.5f));
+  int connections[3] = {0, 1, 2};
+  mesh.addTriangle(connections, glm::vec3(0.0f, 0.0f, 1.0f));
+  return mesh;
+}
+
+int PainterHalfSpaceTest(int, char* []) {
+  PainterHalfSpace painter;
+
+  // Pixels on the edges shared by the triangles are painted only once, so
+  // the transparent color is nowhere blended over itself.
+  std::cout << "  Shared edges" << std::endl;
+  ImageRGBAFloatColorOnly fanImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  painter.paint(createFanMesh(), fanImage, glm::mat4(1.0f), glm::mat4(1.0f));
+  TEST_ASSERT(allPixelsAre(fanImage, NEAR_COLOR, 4));
+
+  // Depth comes from the plane of the triangle. The simple painter samples
+  // at the pixel corner rather than the center, so they can differ by one
+  // pixel's step in depth.
+  std::cout << "  Depth plane" << std::endl;
+  Mesh slopedMesh = createSlopedMesh();
+  ImageRGBFloatColorDepth planeImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  painter.paint(slopedMesh, planeImage, glm::mat4(1.0f), glm::mat4(1.0f));
+  PainterSimple simplePainter;
+  ImageRGBFloatColorDepth simpleImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  simplePainter.paint(
+      slopedMesh, simpleImage, glm::mat4(1.0f), glm::mat4(1.0f));
+  float depthStep = 0.25f / IMAGE_WIDTH;
+  float maxDepthDifference = 0.0f;
+  for (int pixel = 0; pixel < planeImage.getNumberOfPixels(); ++pixel) {
+    maxDepthDifference =
+        std::max(maxDepthDifference,
+                 std::abs(planeImage.getDepth(pixel) -
+                          simpleImage.getDepth(pixel)));
+  }
+  TEST_ASSERT(maxDepthDifference <= 1.01f * depthStep);
+
+  Mesh mesh = createOverlappingMesh();
+
+  // Without depth, triangles blend in the order they are painted, so the
+  // farther triangle must not be rejected behind the nearer one.
+  std::cout << "  Color only image" << std::endl;
+  ImageRGBAFloatColorOnly colorOnlyImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  painter.paint(mesh, colorOnlyImage, glm::mat4(1.0f), glm::mat4(1.0f));
+  TEST_ASSERT(allPixelsAre(colorOnlyImage, FAR_COLOR.BlendOver(NEAR_COLOR), 4));
+
+  // Twice, so the hidden-block state left from the last paint is reused.
+  painter.paint(mesh, colorOnlyImage, glm::mat4(1.0f), glm::mat4(1.0f));
+  TEST_ASSERT(allPixelsAre(colorOnlyImage, FAR_COLOR.BlendOver(NEAR_COLOR), 4));
+
+  // With depth, the farther triangle is hidden.
+  std::cout << "  Color depth image" << std::endl;
+  ImageRGBFloatColorDepth colorDepthImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  painter.paint(mesh, colorDepthImage, glm::mat4(1.0f), glm::mat4(1.0f));
+  TEST_ASSERT(allPixelsAre(colorDepthImage, NEAR_COLOR, 3));
+
+  return 0;
+}
@@ -0,0 +1,167 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include <Paint/PainterRayCast.hpp>
+#include <Paint/PainterSimple.hpp>
+
+#include <Common/ImageRGBAFloatColorOnly.hpp>
+#include <Common/ImageRGBFloatColorDepth.hpp>
+#include <Common/Mesh.hpp>
+#include <Common/MeshHelper.hpp>
+#include <Common/Testing/RandomMesh.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define TEST_ASSERT(condition) \
+  CheckAssert(condition, #condition, __FILE__, __LINE__);
+
+static void CheckAssert(bool condition,
+                        const std::string& conditionStr,
+                        const std::string& filename,
+                        int line) {
+  if (condition) {
+    std::cout << "    OK (" << conditionStr << ")" << std::endl;
+  } else {
+    std::cerr << "    *** FAILED! *** (" << conditionStr << "), " << filename
+              << ":" << line << std::endl;
+    exit(1);
+  }
+}
+
+// Not a multiple of the tile or packet size.
+constexpr int IMAGE_WIDTH = 161;
+constexpr int IMAGE_HEIGHT = 119;
+
+constexpr int NUM_OPAQUE_TRIANGLES = 40;
+// Few enough that the simple painter keeps every fragment of each pixel, so
+// its order-independent blending is exact.
+constexpr int NUM_TRANSPARENT_TRIANGLES = 12;
+
+constexpr float COLOR_THRESHOLD = 0.01f;
+
+// The ray caster samples pixel centers and the simple painter does not, so
+// pixels along the edges of triangles can differ. No more than this fraction
+// of the pixels may.
+constexpr float MAX_DIFFERENT_FRACTION = 0.1f;
+
+// Random triangles in the [-1, 1] cube, all with the given alpha, ready to
+// be ray cast.
+static Mesh createRayCastMesh(int numTriangles, float alpha) {
+  Mesh mesh = createRandomMesh(2468, numTriangles, alpha);
+  mesh.buildBoundingVolumeHierarchy();
+  return mesh;
+}
+
+static bool colorsMatch(const Color& color1, const Color& color2) {
+  for (int component = 0; component < 4; ++component) {
+    if (std::abs(color1.Components[component] - color2.Components[component]) >
+        COLOR_THRESHOLD) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static float fractionDifferent(const ImageFull& image1,
+                               const ImageFull& image2) {
+  int numDifferent = 0;
+  for (int pixel = 0; pixel < image1.getNumberOfPixels(); ++pixel) {
+    if (!colorsMatch(image1.getColor(pixel), image2.getColor(pixel))) {
+      ++numDifferent;
+    }
+  }
+  return static_cast<float>(numDifferent) / image1.getNumberOfPixels();
+}
+
+static bool imagesEqual(const ImageFull& image1, const ImageFull& image2) {
+  return image1.pixelsEqual(0, image2, 0, image1.getNumberOfPixels());
+}
+
+template <typename ImageType>
+static void TestAgainstSimple(const Mesh& mesh,
+                              const glm::mat4& modelview,
+                              const glm::mat4& projection) {
+  PainterRayCast rayCastPainter;
+  ImageType rayCastImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  rayCastPainter.paint(mesh, rayCastImage, modelview, projection);
+  TEST_ASSERT(rayCastImage.countActivePixels() > 0);
+
+  // With order-independent transparency, images without depth are blended
+  // in depth order by both painters.
+  PainterSimple simplePainter;
+  simplePainter.setOrderIndependentTransparency(true);
+  ImageType simpleImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  simplePainter.paint(mesh, simpleImage, modelview, projection);
+  TEST_ASSERT(fractionDifferent(rayCastImage, simpleImage) <
+              MAX_DIFFERENT_FRACTION);
+
+  // Each pixel is written by one thread, so threads give the same image.
+  PainterRayCast threadedPainter(3);
+  ImageType threadedImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  threadedPainter.paint(mesh, threadedImage, modelview, projection);
+  TEST_ASSERT(imagesEqual(threadedImage, rayCastImage));
+}
+
+// The order of the triangles does not matter, but the triangles left out of
+// the order are not painted.
+static void TestPaintInOrder(const Mesh& mesh,
+                             const glm::mat4& modelview,
+                             const glm::mat4& projection) {
+  PainterRayCast painter;
+  TEST_ASSERT(!painter.paintInOrderUsesOrder());
+  ImageRGBAFloatColorOnly image(IMAGE_WIDTH, IMAGE_HEIGHT);
+  painter.paint(mesh, image, modelview, projection);
+
+  std::vector<int> reversedOrder;
+  for (int triangleIndex = mesh.getNumberOfTriangles() - 1; triangleIndex >= 0;
+       --triangleIndex) {
+    reversedOrder.push_back(triangleIndex);
+  }
+  ImageRGBAFloatColorOnly reversedImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  painter.paintInOrder(
+      mesh, reversedOrder, reversedImage, modelview, projection);
+  TEST_ASSERT(imagesEqual(reversedImage, image));
+
+  std::vector<int> halfOrder(reversedOrder.begin(),
+                             reversedOrder.begin() + reversedOrder.size() / 2);
+  ImageRGBAFloatColorOnly halfImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  painter.paintInOrder(mesh, halfOrder, halfImage, modelview, projection);
+  ImageRGBAFloatColorOnly expectedHalfImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  painter.paint(meshReorderTriangles(mesh, halfOrder),
+                expectedHalfImage,
+                modelview,
+                projection);
+  TEST_ASSERT(imagesEqual(halfImage, expectedHalfImage));
+  TEST_ASSERT(!imagesEqual(halfImage, image));
+}
+
+int PainterRayCastTest(int, char* []) {
+  glm::mat4 modelview =
+      glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -4.0f)) *
+      glm::rotate(glm::mat4(1.0f), 0.5f, glm::vec3(1.0f, 1.0f, 0.0f));
+  glm::mat4 projection = glm::perspective(0.6f, 1.0f, 1.0f, 8.0f);
+
+  std::cout << "  Opaque triangles with depth" << std::endl;
+  TestAgainstSimple<ImageRGBFloatColorDepth>(
+      createRayCastMesh(NUM_OPAQUE_TRIANGLES, 1.0f), modelview, projection);
+
+  std::cout << "  Transparent triangles without depth" << std::endl;
+  Mesh transparentMesh = createRayCastMesh(NUM_TRANSPARENT_TRIANGLES, 0.5f);
+  TestAgainstSimple<ImageRGBAFloatColorOnly>(
+      transparentMesh, modelview, projection);
+
+  std::cout << "  Paint in order" << std::endl;
+  TestPaintInOrder(transparentMesh, modelview, projection);
+
+  return 0;
+}
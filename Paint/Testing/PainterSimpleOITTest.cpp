@@ -0,0 +1,183 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include <Paint/PainterSimple.hpp>
+
+#include <Common/ImageRGBAFloatColorOnly.hpp>
+#include <Common/Mesh.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define TEST_ASSERT(condition) \
+  CheckAssert(condition, #condition, __FILE__, __LINE__);
+
+static void CheckAssert(bool condition,
+                        const std::string& conditionStr,
+                        const std::string& filename,
+                        int line) {
+  if (condition) {
+    std::cout << "    OK (" << conditionStr << ")" << std::endl;
+  } else {
+    std::cerr << "    *** FAILED! *** (" << conditionStr << "), " << filename
+              << ":" << line << std::endl;
+    exit(1);
+  }
+}
+
+// Tall enough for more than one band of rows.
+constexpr int IMAGE_WIDTH = 20;
+constexpr int IMAGE_HEIGHT = 37;
+
+// More layers than the fragment buffer keeps for each pixel (8).
+constexpr int NUM_LAYERS = 12;
+
+constexpr float COLOR_THRESHOLD = 0.0001f;
+
+struct Layer {
+  float z;
+  Color color;
+};
+
+// Triangles that each cover the whole image, painted in the given order.
+static Mesh createLayerMesh(const std::vector<Layer>& layers) {
+  Mesh mesh;
+  for (const Layer& layer : layers) {
+    int vertexIndex = mesh.getNumberOfVertices();
+    mesh.addVertex(glm::vec3(-1.0f, -1.0f, layer.z));
+    mesh.addVertex(glm::vec3(3.0f, -1.0f, layer.z));
+    mesh.addVertex(glm::vec3(-1.0f, 3.0f, layer.z));
+    int connections[3] = {vertexIndex, vertexIndex + 1, vertexIndex + 2};
+    mesh.addTriangle(connections, glm::vec3(0.0f, 0.0f, 1.0f), layer.color);
+  }
+  return mesh;
+}
+
+// Transparent layers from front to back, each a different color.
+static std::vector<Layer> createLayers(int numLayers) {
+  std::vector<Layer> layers;
+  for (int layerIndex = 0; layerIndex < numLayers; ++layerIndex) {
+    float fraction = static_cast<float>(layerIndex) / numLayers;
+    layers.push_back(
+        Layer{-0.9f + 1.8f * fraction,
+              Color(0.3f * fraction, 0.3f * (1.0f - fraction), 0.1f, 0.3f)});
+  }
+  return layers;
+}
+
+// Blends the layers sorted front to back.
+static Color blendSorted(std::vector<Layer> layers) {
+  std::stable_sort(
+      layers.begin(), layers.end(), [](const Layer& a, const Layer& b) {
+        return a.z < b.z;
+      });
+  Color color(0.0f, 0.0f, 0.0f, 0.0f);
+  for (auto layer = layers.rbegin(); layer != layers.rend(); ++layer) {
+    color = layer->color.BlendOver(color);
+  }
+  return color;
+}
+
+// A fixed shuffle of the layers.
+static std::vector<Layer> shuffleLayers(const std::vector<Layer>& layers) {
+  std::vector<Layer> shuffled;
+  for (int index = 0; index < static_cast<int>(layers.size()); ++index) {
+    shuffled.push_back(layers[(index * 7 + 3) % layers.size()]);
+  }
+  return shuffled;
+}
+
+static bool allPixelsAre(const ImageFull& image, const Color& expected) {
+  for (int pixel = 0; pixel < image.getNumberOfPixels(); ++pixel) {
+    Color color = image.getColor(pixel);
+    for (int component = 0; component < 4; ++component) {
+      if (std::abs(color.Components[component] -
+                   expected.Components[component]) > COLOR_THRESHOLD) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static Color paintLayers(const std::vector<Layer>& layers, int numThreads) {
+  PainterSimple painter(numThreads);
+  painter.setOrderIndependentTransparency(true);
+  ImageRGBAFloatColorOnly image(IMAGE_WIDTH, IMAGE_HEIGHT);
+  painter.paint(
+      createLayerMesh(layers), image, glm::mat4(1.0f), glm::mat4(1.0f));
+  TEST_ASSERT(allPixelsAre(image, image.getColor(0)));
+  return image.getColor(0);
+}
+
+static bool colorsMatch(const Color& color1, const Color& color2) {
+  for (int component = 0; component < 4; ++component) {
+    if (std::abs(color1.Components[component] - color2.Components[component]) >
+        COLOR_THRESHOLD) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int PainterSimpleOITTest(int, char* []) {
+  // With room for every fragment, any paint order blends in depth order.
+  std::cout << "  Few layers, shuffled" << std::endl;
+  std::vector<Layer> fewLayers = createLayers(5);
+  TEST_ASSERT(colorsMatch(paintLayers(shuffleLayers(fewLayers), 1),
+                          blendSorted(fewLayers)));
+
+  // Merging the farthest fragments is exact when they come in depth order.
+  std::cout << "  Many layers, front to back" << std::endl;
+  std::vector<Layer> manyLayers = createLayers(NUM_LAYERS);
+  TEST_ASSERT(colorsMatch(paintLayers(manyLayers, 1), blendSorted(manyLayers)));
+
+  std::cout << "  Many layers, back to front" << std::endl;
+  std::vector<Layer> reversedLayers(manyLayers.rbegin(), manyLayers.rend());
+  TEST_ASSERT(
+      colorsMatch(paintLayers(reversedLayers, 1), blendSorted(manyLayers)));
+
+  // Layers of one color blend the same however the fragments are merged.
+  std::cout << "  Many layers of one color, shuffled" << std::endl;
+  std::vector<Layer> sameColorLayers = createLayers(NUM_LAYERS);
+  for (Layer& layer : sameColorLayers) {
+    layer.color = Color(0.1f, 0.2f, 0.05f, 0.25f);
+  }
+  TEST_ASSERT(colorsMatch(paintLayers(shuffleLayers(sameColorLayers), 1),
+                          blendSorted(sameColorLayers)));
+
+  // An opaque layer hides the layers behind it, whether they come before or
+  // after it.
+  std::cout << "  Opaque layer" << std::endl;
+  std::vector<Layer> opaqueLayers = createLayers(NUM_LAYERS);
+  opaqueLayers[3].color = Color(0.0f, 0.0f, 1.0f, 1.0f);
+  std::vector<Layer> frontLayers(opaqueLayers.begin(),
+                                 opaqueLayers.begin() + 4);
+  TEST_ASSERT(colorsMatch(paintLayers(shuffleLayers(opaqueLayers), 1),
+                          blendSorted(frontLayers)));
+
+  // At equal depth, a triangle painted later is blended over the earlier
+  // one, just as when painting in order without order-independence.
+  std::cout << "  Equal depth" << std::endl;
+  std::vector<Layer> equalLayers = {
+      Layer{0.0f, Color(0.3f, 0.0f, 0.0f, 0.3f)},
+      Layer{0.0f, Color(0.0f, 0.3f, 0.0f, 0.3f)}};
+  TEST_ASSERT(colorsMatch(
+      paintLayers(equalLayers, 1),
+      equalLayers[1].color.BlendOver(equalLayers[0].color)));
+
+  // Each band keeps its own fragments, so threads do not change the result.
+  std::cout << "  Threads" << std::endl;
+  TEST_ASSERT(colorsMatch(paintLayers(shuffleLayers(manyLayers), 3),
+                          paintLayers(shuffleLayers(manyLayers), 1)));
+
+  return 0;
+}
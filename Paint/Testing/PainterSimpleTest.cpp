@@ -0,0 +1,173 @@
+// miniGraphics is distributed under the OSI-approved BSD 3-clause License.
+// See LICENSE.txt for details.
+//
+// Copyright (c) 2017
+// National Technology & Engineering Solutions of Sandia, LLC (NTESS). Under
+// the terms of Contract DE-NA0003525 with NTESS, the U.S. Government retains
+// certain rights in this software.
+
+#include <Paint/PainterSimple.hpp>
+
+#include <Common/ImageRGBAFloatColorOnly.hpp>
+#include <Common/ImageRGBAUByteColorFloatDepth.hpp>
+#include <Common/ImageRGBFloatColorDepth.hpp>
+#include <Common/Mesh.hpp>
+#include <Common/Testing/RandomMesh.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <iostream>
+#include <string>
+
+#define TEST_ASSERT(condition) \
+  CheckAssert(condition, #condition, __FILE__, __LINE__);
+
+static void CheckAssert(bool condition,
+                        const std::string& conditionStr,
+                        const std::string& filename,
+                        int line) {
+  if (condition) {
+    std::cout << "    OK (" << conditionStr << ")" << std::endl;
+  } else {
+    std::cerr << "    *** FAILED! *** (" << conditionStr << "), " << filename
+              << ":" << line << std::endl;
+    exit(1);
+  }
+}
+
+// Several bands of rows, the last one partial.
+constexpr int IMAGE_WIDTH = 67;
+constexpr int IMAGE_HEIGHT = 53;
+
+constexpr int NUM_TRIANGLES = 500;
+
+// Random triangles in the [-1, 1] cube. Every third is opaque and the others
+// are transparent.
+static Mesh createMixedMesh() {
+  constexpr float TRANSPARENT_ALPHA = 0.5f;
+  Mesh mesh = createRandomMesh(4321, NUM_TRIANGLES, TRANSPARENT_ALPHA);
+  for (int triangleIndex = 0; triangleIndex < NUM_TRIANGLES;
+       triangleIndex += 3) {
+    // Colors are premultiplied by alpha, so scale them all to make alpha 1.
+    float* color = mesh.getTriangleColorsBuffer(triangleIndex);
+    for (int component = 0; component < 4; ++component) {
+      color[component] /= TRANSPARENT_ALPHA;
+    }
+  }
+  return mesh;
+}
+
+static bool imagesEqual(const ImageFull& image1, const ImageFull& image2) {
+  return image1.pixelsEqual(0, image2, 0, image1.getNumberOfPixels());
+}
+
+// Paints the mesh with 1 thread and with several, which should give the same
+// image bit for bit.
+template <typename ImageType>
+static void TestThreads(const Mesh& mesh,
+                        const glm::mat4& modelview,
+                        const glm::mat4& projection) {
+  PainterSimple singlePainter(1);
+  ImageType singleImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  singlePainter.paint(mesh, singleImage, modelview, projection);
+  TEST_ASSERT(singleImage.countActivePixels() > 0);
+
+  for (int numThreads : {2, 3, 8}) {
+    std::cout << "    " << numThreads << " threads" << std::endl;
+    PainterSimple threadedPainter(numThreads);
+    ImageType threadedImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+    threadedPainter.paint(mesh, threadedImage, modelview, projection);
+    TEST_ASSERT(imagesEqual(threadedImage, singleImage));
+  }
+}
+
+// Painting straight into a compressed image should give the same image as
+// painting a full image and compressing it.
+template <typename ImageType>
+static void TestPaintCompressed(const Mesh& mesh,
+                                const glm::mat4& modelview,
+                                const glm::mat4& projection) {
+  for (int numThreads : {1, 3}) {
+    std::cout << "    " << numThreads << " threads" << std::endl;
+    PainterSimple painter(numThreads);
+    ImageType fullImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+    TEST_ASSERT(painter.canPaintCompressed(fullImage));
+    std::unique_ptr<ImageSparse> paintedCompressed =
+        painter.paintCompressed(mesh, fullImage, modelview, projection);
+    TEST_ASSERT(paintedCompressed != nullptr);
+
+    painter.paint(mesh, fullImage, modelview, projection);
+    std::unique_ptr<ImageSparse> compressed = fullImage.compress();
+    TEST_ASSERT(paintedCompressed->getDataSize() == compressed->getDataSize());
+    TEST_ASSERT(imagesEqual(*paintedCompressed->uncompress(), fullImage));
+  }
+}
+
+// A triangle covering the image whose depth changes across each row.
+static void addSlopedTriangle(Mesh& mesh) {
+  int vertexIndex = mesh.getNumberOfVertices();
+  mesh.addVertex(glm::vec3(-1.0f, -1.0f, -0.5f));
+  mesh.addVertex(glm::vec3(3.0f, -1.0f, 0.5f));
+  mesh.addVertex(glm::vec3(-1.0f, 3.0f, -0.5f));
+  int connections[3] = {vertexIndex, vertexIndex + 1, vertexIndex + 2};
+  mesh.addTriangle(connections, glm::vec3(0.0f, 0.0f, 1.0f));
+}
+
+// Depth is stepped across every pixel of a line, including those that fail
+// the depth test. Painting the sloped triangle behind a nearer one must leave
+// the depth of the pixels it does paint unchanged.
+static void TestDepthStep() {
+  Mesh slopedMesh;
+  addSlopedTriangle(slopedMesh);
+
+  Mesh occludedMesh;
+  int connections[3] = {0, 1, 2};
+  occludedMesh.addVertex(glm::vec3(-1.0f, -1.0f, -0.9f));
+  occludedMesh.addVertex(glm::vec3(0.0f, -1.0f, -0.9f));
+  occludedMesh.addVertex(glm::vec3(-1.0f, 1.0f, -0.9f));
+  occludedMesh.addTriangle(connections, glm::vec3(0.0f, 0.0f, 1.0f));
+  addSlopedTriangle(occludedMesh);
+
+  PainterSimple painter;
+  ImageRGBFloatColorDepth slopedImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  painter.paint(slopedMesh, slopedImage, glm::mat4(1.0f), glm::mat4(1.0f));
+  ImageRGBFloatColorDepth occludedImage(IMAGE_WIDTH, IMAGE_HEIGHT);
+  painter.paint(occludedMesh, occludedImage, glm::mat4(1.0f), glm::mat4(1.0f));
+
+  // The nearer triangle is at depth 0.05 and the sloped one at least 0.25.
+  int numOccluded = 0;
+  int numDepthMismatches = 0;
+  for (int pixel = 0; pixel < slopedImage.getNumberOfPixels(); ++pixel) {
+    if (occludedImage.getDepth(pixel) < 0.1f) {
+      ++numOccluded;
+    } else if (occludedImage.getDepth(pixel) != slopedImage.getDepth(pixel)) {
+      ++numDepthMismatches;
+    }
+  }
+  TEST_ASSERT(numOccluded > 0);
+  TEST_ASSERT(numDepthMismatches == 0);
+}
+
+int PainterSimpleTest(int, char* []) {
+  Mesh mesh = createMixedMesh();
+  glm::mat4 modelview =
+      glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -4.0f)) *
+      glm::rotate(glm::mat4(1.0f), 0.5f, glm::vec3(1.0f, 1.0f, 0.0f));
+  glm::mat4 projection = glm::perspective(0.6f, 1.0f, 1.0f, 8.0f);
+
+  std::cout << "  Threads with depth" << std::endl;
+  TestThreads<ImageRGBAUByteColorFloatDepth>(mesh, modelview, projection);
+
+  std::cout << "  Threads without depth" << std::endl;
+  TestThreads<ImageRGBAFloatColorOnly>(mesh, modelview, projection);
+
+  std::cout << "  Paint compressed" << std::endl;
+  TestPaintCompressed<ImageRGBAUByteColorFloatDepth>(
+      mesh, modelview, projection);
+  TestPaintCompressed<ImageRGBFloatColorDepth>(mesh, modelview, projection);
+
+  std::cout << "  Depth step behind a nearer triangle" << std::endl;
+  TestDepthStep();
+
+  return 0;
+}
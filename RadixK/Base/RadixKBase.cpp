@@ -8,15 +8,27 @@
 
 #include "RadixKBase.hpp"
 
+#include <Common/ImageFull.hpp>
+#include <Common/ImageSparse.hpp>
 #include <Common/MainLoop.hpp>
 
 #include "../../DirectSend/Overlap/DirectSendOverlap.hpp"
 
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <limits>
 #include <sstream>
 
 constexpr int DEFAULT_TARGET_K = 8;
 
+// Parameters for measuring the network when selecting k with a cost model.
+constexpr int PING_PONG_TAG = 40211;
+constexpr int NUM_PING_PONGS = 10;
+constexpr int LARGE_TRANSFER_BYTES = 4 * 1024 * 1024;
+constexpr int NUM_LARGE_TRANSFERS = 3;
+constexpr int K_MODEL_GROUP_TAG = 40212;
+
 static std::string kToString(const std::vector<int>& kVector) {
   if (kVector.empty()) {
     return "";
@@ -29,17 +41,334 @@ static std::string kToString(const std::vector<int>& kVector) {
   return s.substr(0, s.length() - 1);
 }
 
+using Clock = std::chrono::high_resolution_clock;
+
+static double secondsSince(const Clock::time_point& startTime) {
+  std::chrono::duration<double> secondsElapsed = Clock::now() - startTime;
+  return secondsElapsed.count();
+}
+
+// Bounces a message of the given size between this process and its partner
+// and returns the average one-way time.
+static double pingPong(int partner,
+                       bool initiator,
+                       int numBytes,
+                       int numTrials,
+                       MPI_Comm communicator) {
+  std::vector<char> buffer(numBytes);
+  Clock::time_point startTime = Clock::now();
+  for (int trial = 0; trial < numTrials; ++trial) {
+    if (initiator) {
+      MPI_Send(buffer.data(),
+               numBytes,
+               MPI_BYTE,
+               partner,
+               PING_PONG_TAG,
+               communicator);
+      MPI_Recv(buffer.data(),
+               numBytes,
+               MPI_BYTE,
+               partner,
+               PING_PONG_TAG,
+               communicator,
+               MPI_STATUS_IGNORE);
+    } else {
+      MPI_Recv(buffer.data(),
+               numBytes,
+               MPI_BYTE,
+               partner,
+               PING_PONG_TAG,
+               communicator,
+               MPI_STATUS_IGNORE);
+      MPI_Send(buffer.data(),
+               numBytes,
+               MPI_BYTE,
+               partner,
+               PING_PONG_TAG,
+               communicator);
+    }
+  }
+  return secondsSince(startTime) / (2 * numTrials);
+}
+
+// Returns the number of bytes an uncompressed pixel of the given image's type
+// takes.
+static std::size_t getFullBytesPerPixel(const Image* image) {
+  std::unique_ptr<Image> onePixelImage = image->createNew(0, 1);
+  onePixelImage->clear();
+  const ImageSparse* sparseImage =
+      dynamic_cast<const ImageSparse*>(onePixelImage.get());
+  if (sparseImage != nullptr) {
+    return sparseImage->uncompress()->getDataSize();
+  } else {
+    return onePixelImage->getDataSize();
+  }
+}
+
+// Returns the time per byte to blend pieces of the given image. The pieces are
+// the sizes of those blended in radix-k rounds (1/2, 1/4, and so on of the
+// image down to 1/numProc) so that the cost of small pieces that fit in cache
+// is weighed along with that of large ones. Each piece is blended with a copy
+// of itself rather than the same memory.
+static double measureBlendSecondsPerByte(const Image* image, int numProc) {
+  int numPixels = image->getNumberOfPixels();
+  double totalSeconds = 0;
+  double totalBytes = 0;
+  int maxPieces = std::min(std::max(numProc, 2), numPixels);
+  for (int numPieces = 2; numPieces <= maxPieces; numPieces *= 2) {
+    int pieceSize = numPixels / numPieces;
+    // Take the piece from the middle of the image, where the foreground is.
+    int pieceBegin = (numPixels - pieceSize) / 2;
+    int pieceEnd = pieceBegin + pieceSize;
+    std::unique_ptr<const Image> piece = image->window(pieceBegin, pieceEnd);
+    std::unique_ptr<Image> otherPiece =
+        image->copySubrange(pieceBegin, pieceEnd);
+
+    Clock::time_point startTime = Clock::now();
+    piece->blend(*otherPiece);
+    totalSeconds += secondsSince(startTime);
+    totalBytes += piece->getDataSize();
+  }
+  return totalSeconds / std::max(totalBytes, 1.0);
+}
+
+// A LogGP-style model of the time it takes to do one round of radix-k. Each of
+// the k-1 messages sent and received pays a latency plus a per-byte cost for
+// transfer and blending. The piece of data sent is 1/k of the data currently
+// held.
+struct KCostModel {
+  double latency;
+  double transferPerByte;
+  double blendPerByte;
+  double fullBytesPerPixel;
+
+  double roundSeconds(int k, double dataSize) const {
+    return (k - 1) * (this->latency + (dataSize / k) * (this->transferPerByte +
+                                                        this->blendPerByte));
+  }
+
+  // After a round, the data held is the composite of k pieces, each 1/k of
+  // the data held before, over 1/k of the region. Assume the worst case that
+  // the compressed pieces do not overlap, so the composite is as big as the
+  // data held before the round, unless that is bigger than the uncompressed
+  // region.
+  double nextDataSize(int k, double dataSize, double regionPixels) const {
+    return std::min(dataSize, (regionPixels / k) * this->fullBytesPerPixel);
+  }
+};
+
+// Recursively tries all ordered factorizations of remainingProduct, keeping
+// the one with the lowest predicted time.
+static void searchFactorizations(const KCostModel& model,
+                                 int remainingProduct,
+                                 double dataSize,
+                                 double regionPixels,
+                                 double currentSeconds,
+                                 std::vector<int>& currentK,
+                                 std::vector<int>& bestK,
+                                 double& bestSeconds) {
+  if (currentSeconds >= bestSeconds) {
+    // Already worse than something found. No need to go further.
+    return;
+  }
+  if (remainingProduct == 1) {
+    bestK = currentK;
+    bestSeconds = currentSeconds;
+    return;
+  }
+  for (int k = 2; k <= remainingProduct; ++k) {
+    if ((remainingProduct % k) != 0) {
+      continue;
+    }
+    currentK.push_back(k);
+    searchFactorizations(model,
+                         remainingProduct / k,
+                         model.nextDataSize(k, dataSize, regionPixels),
+                         regionPixels / k,
+                         currentSeconds + model.roundSeconds(k, dataSize),
+                         currentK,
+                         bestK,
+                         bestSeconds);
+    currentK.pop_back();
+  }
+}
+
+RadixKBase::RadixKBase()
+    : maxInFlightReceives(DirectSendOverlap::DEFAULT_MAX_INFLIGHT_RECEIVES),
+      useModel(false),
+      latencySeconds(0),
+      transferSecondsPerByte(0),
+      blendSecondsPerByte(-1) {}
+
+RadixKBase::~RadixKBase() {
+  int mpiFinalized;
+  MPI_Finalized(&mpiFinalized);
+  if (!mpiFinalized) {
+    for (auto&& groupCommunicator : this->modelCommunicators) {
+      MPI_Group_free(&groupCommunicator.first);
+      MPI_Comm_free(&groupCommunicator.second);
+    }
+  }
+}
+
+void RadixKBase::measureNetwork(MPI_Comm communicator) {
+  int rank;
+  MPI_Comm_rank(communicator, &rank);
+
+  int numProc;
+  MPI_Comm_size(communicator, &numProc);
+
+  std::array<double, 2> measurements = {0, 0};
+  int partner = rank ^ 1;
+  if (partner < numProc) {
+    bool initiator = ((rank & 1) == 0);
+    // Warm up the connection.
+    pingPong(partner, initiator, 1, 1, communicator);
+
+    double smallTime =
+        pingPong(partner, initiator, 1, NUM_PING_PONGS, communicator);
+    double largeTime = pingPong(partner,
+                                initiator,
+                                LARGE_TRANSFER_BYTES,
+                                NUM_LARGE_TRANSFERS,
+                                communicator);
+    measurements[0] = smallTime;
+    measurements[1] =
+        std::max(largeTime - smallTime, 0.0) / LARGE_TRANSFER_BYTES;
+  }
+
+  // Use the slowest pair as representative.
+  MPI_Allreduce(MPI_IN_PLACE,
+                measurements.data(),
+                measurements.size(),
+                MPI_DOUBLE,
+                MPI_MAX,
+                communicator);
+
+  this->latencySeconds = measurements[0];
+  this->transferSecondsPerByte = measurements[1];
+}
+
+MPI_Comm RadixKBase::getModelCommunicator(MPI_Group group,
+                                          MPI_Comm communicator) {
+  // Every process of a group takes part in every composite of that group, so
+  // all of them find it here or all of them create the communicator. The
+  // Allreduce on it does not depend on the order of the processes, so groups
+  // with the same members (such as those ordered by depth for each view)
+  // share a communicator.
+  for (auto&& groupCommunicator : this->modelCommunicators) {
+    int comparison;
+    MPI_Group_compare(group, groupCommunicator.first, &comparison);
+    if ((comparison == MPI_IDENT) || (comparison == MPI_SIMILAR)) {
+      return groupCommunicator.second;
+    }
+  }
+
+  MPI_Comm groupCommunicator;
+  MPI_Comm_create_group(
+      communicator, group, K_MODEL_GROUP_TAG, &groupCommunicator);
+  MPI_Group groupCopy;
+  MPI_Comm_group(groupCommunicator, &groupCopy);
+  this->modelCommunicators.push_back(
+      std::make_pair(groupCopy, groupCommunicator));
+  return groupCommunicator;
+}
+
+void RadixKBase::selectModelK(const Image* localImage,
+                              MPI_Group group,
+                              MPI_Comm communicator,
+                              YamlWriter& yaml) {
+  int groupSize;
+  MPI_Group_size(group, &groupSize);
+
+  if (this->blendSecondsPerByte < 0) {
+    // Measure blending the first time we see an image.
+    this->blendSecondsPerByte =
+        measureBlendSecondsPerByte(localImage, groupSize);
+  }
+
+  // All processes have to agree on k, so use the largest (compressed) image
+  // size and blend cost.
+  std::array<double, 2> imageMeasurements = {
+      static_cast<double>(localImage->getDataSize()),
+      this->blendSecondsPerByte};
+  MPI_Allreduce(MPI_IN_PLACE,
+                imageMeasurements.data(),
+                imageMeasurements.size(),
+                MPI_DOUBLE,
+                MPI_MAX,
+                this->getModelCommunicator(group, communicator));
+
+  KCostModel model;
+  model.latency = this->latencySeconds;
+  model.transferPerByte = this->transferSecondsPerByte;
+  model.blendPerByte = imageMeasurements[1];
+  model.fullBytesPerPixel = getFullBytesPerPixel(localImage);
+
+  double dataSize = imageMeasurements[0];
+  double regionPixels = localImage->getNumberOfPixels();
+
+  std::vector<int> currentK;
+  std::vector<int> bestK;
+  double bestSeconds = std::numeric_limits<double>::max();
+  searchFactorizations(model,
+                       groupSize,
+                       dataSize,
+                       regionPixels,
+                       0,
+                       currentK,
+                       bestK,
+                       bestSeconds);
+
+  this->kVector = bestK;
+  this->predictedRoundSeconds.resize(0);
+  for (auto&& k : this->kVector) {
+    this->predictedRoundSeconds.push_back(model.roundSeconds(k, dataSize));
+    dataSize = model.nextDataSize(k, dataSize, regionPixels);
+    regionPixels /= k;
+  }
+
+  yaml.AddDictionaryEntry("k", kToString(this->kVector));
+  yaml.AddDictionaryEntry("k-model-predicted-seconds", bestSeconds);
+}
+
 std::unique_ptr<Image> RadixKBase::compose(Image* localImage,
                                            MPI_Group group,
                                            MPI_Comm communicator,
                                            YamlWriter& yaml) {
+  std::vector<Image*> localImages(1, localImage);
+  return std::move(
+      this->composeMany(localImages, group, communicator, yaml).front());
+}
+
+std::vector<std::unique_ptr<Image>> RadixKBase::composeMany(
+    const std::vector<Image*>& localImages,
+    MPI_Group group,
+    MPI_Comm communicator,
+    YamlWriter& yaml) {
+  if (this->useModel) {
+    // All images share one schedule, so just model it with the first.
+    this->selectModelK(localImages.front(), group, communicator, yaml);
+  }
+
+  std::vector<double> measuredRoundSeconds;
+  std::size_t peakReceiveBytes = 0;
+
   MPI_Group workingGroup;
   int dummy;
   MPI_Group_excl(group, 0, &dummy, &workingGroup);
 
-  std::unique_ptr<Image> workingImage = localImage->shallowCopy();
+  std::vector<Image*> workingImagePointers(localImages);
+  std::vector<std::unique_ptr<Image>> workingImages;
+
+  float autoCompressThreshold = this->getAutoCompressThreshold();
+  if (autoCompressThreshold >= 0) {
+    yaml.StartBlock("auto-compress-rounds");
+  }
 
   for (auto&& k : this->kVector) {
+    Clock::time_point roundStartTime = Clock::now();
+
     int groupSize;
     MPI_Group_size(workingGroup, &groupSize);
     assert((groupSize % k) == 0);
@@ -55,12 +384,21 @@ std::unique_ptr<Image> RadixKBase::compose(Image* localImage,
         k * mySubgroupPartition, k * (mySubgroupPartition + 1) - 1, 1};
     MPI_Group_range_incl(workingGroup, 1, procRange.data(), &directSendGroup);
 
-    workingImage = DirectSendOverlap::compose(workingImage.get(),
-                                              directSendGroup,
-                                              directSendGroup,
-                                              communicator,
-                                              yaml);
+    std::size_t roundPeakReceiveBytes;
+    workingImages = DirectSendOverlap::composeMany(workingImagePointers,
+                                                   directSendGroup,
+                                                   directSendGroup,
+                                                   communicator,
+                                                   this->maxInFlightReceives,
+                                                   autoCompressThreshold,
+                                                   yaml,
+                                                   roundPeakReceiveBytes);
+    peakReceiveBytes = std::max(peakReceiveBytes, roundPeakReceiveBytes);
     MPI_Group_free(&directSendGroup);
+    for (std::size_t imageIndex = 0; imageIndex < workingImages.size();
+         ++imageIndex) {
+      workingImagePointers[imageIndex] = workingImages[imageIndex].get();
+    }
 
     // Collect all processes that have the same image piece into a single group
     // and decend into it
@@ -69,11 +407,45 @@ std::unique_ptr<Image> RadixKBase::compose(Image* localImage,
     MPI_Group_range_incl(workingGroup, 1, procRange.data(), &subgroup);
     MPI_Group_free(&workingGroup);
     workingGroup = subgroup;
+
+    measuredRoundSeconds.push_back(secondsSince(roundStartTime));
+  }
+
+  if (autoCompressThreshold >= 0) {
+    yaml.EndBlock();
   }
+  // The rounds run one after the other, so the peak is the largest of any
+  // round.
+  yaml.AddDictionaryEntry("peak-receive-bytes", peakReceiveBytes);
 
   MPI_Group_free(&workingGroup);
 
-  return workingImage;
+  if (this->useModel) {
+    yaml.StartBlock("k-model-rounds");
+    for (std::size_t round = 0; round < this->kVector.size(); ++round) {
+      yaml.StartListItem();
+      yaml.AddDictionaryEntry("k", this->kVector[round]);
+      yaml.AddDictionaryEntry("predicted-seconds",
+                              this->predictedRoundSeconds[round]);
+      yaml.AddDictionaryEntry("measured-seconds", measuredRoundSeconds[round]);
+    }
+    yaml.EndBlock();
+  }
+
+  if (workingImages.empty()) {
+    // No rounds (a single process). Return the local images.
+    for (auto&& localImage : localImages) {
+      workingImages.push_back(localImage->shallowCopy());
+    }
+  }
+
+  return workingImages;
+}
+
+void RadixKBase::useKModel(MPI_Comm communicator) {
+  // k values are chosen for each image in compose
+  this->useModel = true;
+  this->measureNetwork(communicator);
 }
 
 void RadixKBase::generateK(int targetK, int numProc) {
@@ -118,7 +490,7 @@ void RadixKBase::generateK(int targetK, int numProc) {
 #endif
 }
 
-enum optionIndex { K_VALUES, TARGET_K };
+enum optionIndex { K_VALUES, TARGET_K, K_MODEL, MAX_INFLIGHT_RECEIVES };
 
 std::vector<option::Descriptor> RadixKBase::getOptionVector() {
   std::vector<option::Descriptor> usage;
@@ -133,7 +505,23 @@ std::vector<option::Descriptor> RadixKBase::getOptionVector() {
      "  --target-k=<num>       When k values are generated, it attempts to find\n"
      "                         values as near to this target k as possible. If\n"
      "                         the k values are given (with the --k option),\n"
-     "                         then this argument is ignored. (Default 8).\n"});
+     "                         then this argument is ignored. (Default 8)."});
+  usage.push_back(
+    {K_MODEL, 0, "", "k-model", option::Arg::None,
+     "  --k-model              Select the k values with a cost model. The\n"
+     "                         network latency and bandwidth are measured at\n"
+     "                         startup, and before each composite the k values\n"
+     "                         that minimize the predicted time for the current\n"
+     "                         image size are chosen. If the k values are given\n"
+     "                         (with the --k option), then this argument is\n"
+     "                         ignored."});
+  usage.push_back(
+    {MAX_INFLIGHT_RECEIVES, 0, "", "max-inflight-receives", PositiveIntArg,
+     "  --max-inflight-receives=<num> Set the maximum number of image pieces\n"
+     "                         that are received at once in each round.\n"
+     "                         Setting this parameter limits the memory\n"
+     "                         used for receiving at the expense of less\n"
+     "                         overlap.\n"});
   // clang-format on
 
   return usage;
@@ -148,6 +536,11 @@ bool RadixKBase::setOptions(const std::vector<option::Option>& options,
   int rank;
   MPI_Comm_rank(communicator, &rank);
 
+  if (options[MAX_INFLIGHT_RECEIVES]) {
+    this->maxInFlightReceives = atoi(options[MAX_INFLIGHT_RECEIVES].arg);
+  }
+  yaml.AddDictionaryEntry("max-inflight-receives", this->maxInFlightReceives);
+
   if (options[K_VALUES]) {
     this->kVector.resize(0);
     std::string kArg(options[K_VALUES].arg);
@@ -173,6 +566,18 @@ bool RadixKBase::setOptions(const std::vector<option::Option>& options,
       }
       return false;
     }
+  } else if (options[K_MODEL]) {
+    this->useKModel(communicator);
+    yaml.AddDictionaryEntry("k", "model");
+    yaml.AddDictionaryEntry("k-model-latency-seconds", this->latencySeconds);
+    yaml.AddDictionaryEntry("k-model-seconds-per-byte",
+                            this->transferSecondsPerByte);
+    if (rank == 0) {
+      std::cout << "k values: chosen by model (latency "
+                << this->latencySeconds << " s, "
+                << this->transferSecondsPerByte << " s/byte)" << std::endl;
+    }
+    return true;
   } else {
     // Must generate our own k values
     int targetK = DEFAULT_TARGET_K;
@@ -11,17 +11,60 @@
 
 #include <Common/Compositor.hpp>
 
+#include <utility>
+
 class RadixKBase : public Compositor {
   std::vector<int> kVector;
+  int maxInFlightReceives;
+
+  // State for selecting k values with a cost model.
+  bool useModel;
+  double latencySeconds;
+  double transferSecondsPerByte;
+  double blendSecondsPerByte;
+  std::vector<double> predictedRoundSeconds;
+
+  // Communicators on which the processes of each group seen agree on k. They
+  // are created the first time a set of processes is composited and kept for
+  // later composites of the same processes in any order.
+  std::vector<std::pair<MPI_Group, MPI_Comm>> modelCommunicators;
+
+  void measureNetwork(MPI_Comm communicator);
+  MPI_Comm getModelCommunicator(MPI_Group group, MPI_Comm communicator);
+  void selectModelK(const Image *localImage,
+                    MPI_Group group,
+                    MPI_Comm communicator,
+                    YamlWriter &yaml);
 
  public:
+  RadixKBase();
+
   std::unique_ptr<Image> compose(Image *localImage,
                                  MPI_Group group,
                                  MPI_Comm communicator,
                                  YamlWriter &yaml) final;
 
+  std::vector<std::unique_ptr<Image>> composeMany(
+      const std::vector<Image *> &localImages,
+      MPI_Group group,
+      MPI_Comm communicator,
+      YamlWriter &yaml) final;
+
+  virtual ~RadixKBase();
+
   void generateK(int targetK, int numProc);
 
+  /// Selects the k values with a cost model before each composite (like the
+  /// --k-model option). The network is measured on \a communicator, so all
+  /// of its processes must call this.
+  void useKModel(MPI_Comm communicator);
+  const std::vector<int> &getKVector() const { return this->kVector; }
+
+  int getMaxInFlightReceives() const { return this->maxInFlightReceives; }
+  void setMaxInFlightReceives(int _maxInFlightReceives) {
+    this->maxInFlightReceives = _maxInFlightReceives;
+  }
+
   bool setOptions(const std::vector<option::Option> &options,
                   MPI_Comm communicator,
                   YamlWriter &yaml) override;